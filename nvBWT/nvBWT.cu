@@ -39,6 +39,7 @@
 #include <nvbio/fmindex/bwt.h>
 #include <nvbio/fasta/fasta.h>
 #include <nvbio/io/fmi.h>
+#include <nvbio/io/fmi_container.h>
 #include <nvbio/sufsort/sufsort.h>
 #include "filelist.h"
 
@@ -101,7 +102,8 @@ struct Counter
 
 struct Writer
 {
-    typedef io::FMIndexData::nonconst_stream_type       stream_type;
+    // texts requiring a 64-bit index are addressed through a 64-bit packed stream
+    typedef PackedStream<uint32*,uint8,2,true,uint64>   stream_type;
 
     Writer(uint32* storage, const uint32 reads, const uint64 max_size) :
         m_max_size(max_size), m_size(0), m_stream( storage )
@@ -192,7 +194,7 @@ struct Writer
     BNTSeq      m_bntseq;
     uint8       m_lasts;
 
-    uint32      m_freq[4];
+    uint64      m_freq[4];
 };
 
 template <typename StreamType>
@@ -210,11 +212,11 @@ bool save_stream(FILE* output_file, const uint64 seq_words, const StreamType* st
 //
 // .wpac file
 //
-void save_wpac(const uint32 seq_length, const uint32* string_storage, const char* pac_name)
+void save_wpac(const uint64 seq_length, const uint32* string_storage, const char* pac_name)
 {
     log_info(stderr, "\nwriting \"%s\"... started\n", pac_name);
 
-    const uint32 seq_words = uint32( (seq_length+15)/16 );
+    const uint64 seq_words = (seq_length+15)/16;
 
     FILE* output_file = fopen( pac_name, "wb" );
     if (output_file == NULL)
@@ -241,9 +243,9 @@ void save_wpac(const uint32 seq_length, const uint32* string_storage, const char
 //
 // .pac file
 //
-void save_bpac(const uint32 seq_length, const uint32* string_storage, const char* pac_name)
+void save_bpac(const uint64 seq_length, const uint32* string_storage, const char* pac_name)
 {
-    typedef io::FMIndexData::stream_type                stream_type;
+    typedef io::FMIndexData::stream64_type              stream_type;
     typedef PackedStream<uint8*,uint8,2,true,int64> pac_stream_type;
 
     log_info(stderr, "\nwriting \"%s\"... started\n", pac_name);
@@ -263,7 +265,7 @@ void save_bpac(const uint32 seq_length, const uint32* string_storage, const char
     pac_stream_type pac_string( nvbio::plain_view( pac_storage ) );
         stream_type     string( string_storage );
 
-    for (uint32 i = 0; i < seq_length; ++i)
+    for (uint64 i = 0; i < seq_length; ++i)
         pac_string[i] = string[i];
 
     // save the uint8 stream
@@ -290,7 +292,7 @@ void save_bpac(const uint32 seq_length, const uint32* string_storage, const char
 //
 // .pac | .wpac file
 //
-void save_pac(const uint32 seq_length, const uint32* string_storage, const char* pac_name, const PacType pac_type)
+void save_pac(const uint64 seq_length, const uint32* string_storage, const char* pac_name, const PacType pac_type)
 {
     if (pac_type == BPAC)
         save_bpac( seq_length, string_storage, pac_name );
@@ -299,9 +301,10 @@ void save_pac(const uint32 seq_length, const uint32* string_storage, const char*
 }
 
 //
-// .bwt file
+// .bwt file, with the header fields stored as index_type: 32-bit, or 64-bit as in BWA 0.6+
 //
-void save_bwt(const uint32 seq_length, const uint32 seq_words, const uint32 primary, const uint32* cumFreq, const uint32* h_bwt_storage, const char* bwt_name)
+template <typename index_type>
+void save_bwt(const uint64 seq_length, const uint64 seq_words, const index_type primary, const index_type* cumFreq, const uint32* h_bwt_storage, const char* bwt_name)
 {
     log_info(stderr, "\nwriting \"%s\"... started\n", bwt_name);
     FILE* output_file = fopen( bwt_name, "wb" );
@@ -310,8 +313,8 @@ void save_bwt(const uint32 seq_length, const uint32 seq_words, const uint32 prim
         log_error(stderr, "  could not open output file \"%s\"!\n", bwt_name );
         exit(1);
     }
-    fwrite( &primary, sizeof(uint32), 1, output_file );
-    fwrite( cumFreq,  sizeof(uint32), 4, output_file );
+    fwrite( &primary, sizeof(index_type), 1, output_file );
+    fwrite( cumFreq,  sizeof(index_type), 4, output_file );
     if (save_stream( output_file, seq_words, h_bwt_storage ) == false)
     {
         log_error(stderr, "  writing failed!\n");
@@ -322,9 +325,10 @@ void save_bwt(const uint32 seq_length, const uint32 seq_words, const uint32 prim
 }
 
 //
-// .sa file
+// .sa file, with all fields stored as index_type
 //
-void save_ssa(const uint32 seq_length, const uint32 sa_intv, const uint32 ssa_len, const uint32 primary, const uint32* cumFreq, const uint32* h_ssa, const char* sa_name)
+template <typename index_type>
+void save_ssa(const uint64 seq_length, const uint32 sa_intv, const uint64 ssa_len, const index_type primary, const index_type* cumFreq, const index_type* h_ssa, const char* sa_name)
 {
     log_info(stderr, "\nwriting \"%s\"... started\n", sa_name);
     FILE* output_file = fopen( sa_name, "wb" );
@@ -334,15 +338,90 @@ void save_ssa(const uint32 seq_length, const uint32 sa_intv, const uint32 ssa_le
         exit(1);
     }
 
-    fwrite( &primary,       sizeof(uint32),     1u,         output_file );
-    fwrite( &cumFreq,       sizeof(uint32),     4u,         output_file );
-    fwrite( &sa_intv,       sizeof(uint32),     1u,         output_file );
-    fwrite( &seq_length,    sizeof(uint32),     1u,         output_file );
-    fwrite( &h_ssa[1],      sizeof(uint32),     ssa_len-1,  output_file );
+    const index_type intv = index_type( sa_intv );
+    const index_type len  = index_type( seq_length );
+
+    fwrite( &primary,       sizeof(index_type), 1u,         output_file );
+    fwrite( cumFreq,        sizeof(index_type), 4u,         output_file );
+    fwrite( &intv,          sizeof(index_type), 1u,         output_file );
+    fwrite( &len,           sizeof(index_type), 1u,         output_file );
+    fwrite( &h_ssa[1],      sizeof(index_type), ssa_len-1,  output_file );
     fclose( output_file );
     log_info(stderr, "writing \"%s\"... done\n", sa_name);
 }
 
+//
+// build the forward and reverse BWTs and SSAs of a text requiring a 64-bit index: the GPU
+// suffix sorter is limited to 32-bit suffixes, so these are sorted on the host with SA-IS
+// over 64-bit indices, and the .bwt and .sa files are written with 64-bit fields
+//
+void build_bwt64(
+    const uint64                    seq_length,
+    const uint64                    seq_words,
+    const uint64*                   cumFreq,
+    thrust::host_vector<uint32>&    h_string_storage,
+    thrust::host_vector<uint32>&    h_bwt_storage,
+    const char*                     pac_name,
+    const char*                     rpac_name,
+    const char*                     bwt_name,
+    const char*                     rbwt_name,
+    const char*                     sa_name,
+    const char*                     rsa_name,
+    const PacType                   pac_type)
+{
+    typedef PackedStream<uint32*,uint8,2,true,uint64> stream_type;
+
+    const uint32 sa_intv = nvbio::io::FMIndexData::SA_INT;
+    const uint64 ssa_len = (seq_length + sa_intv) / sa_intv;
+
+    log_info(stderr, "\n  the sequence requires a 64-bit index: sorting its suffixes on the host\n");
+    log_info(stderr, "  suffix array    : %.1f MB\n",
+        float((seq_length+1)*sizeof(int64))/float(1024*1024));
+
+    std::vector<int64>  sa( seq_length+1 );
+    std::vector<uint64> h_ssa( ssa_len );
+
+    Timer timer;
+
+    for (uint32 reverse = 0; reverse < 2; ++reverse)
+    {
+        stream_type h_string( nvbio::plain_view( h_string_storage ) );
+        stream_type h_bwt(    nvbio::plain_view( h_bwt_storage ) );
+
+        log_info(stderr, "\nbuilding %s BWT... started\n", reverse ? "reverse" : "forward");
+        timer.start();
+
+        // sa[0] holds the implicit empty suffix, followed by the sorted suffixes
+        gen_sa( seq_length, h_string.begin(), &sa[0] );
+
+        // sample the suffix array at the same slots as StringSSAHandler
+        h_ssa[0] = uint64(-1);
+        for (uint64 i = 1; i < ssa_len; ++i)
+            h_ssa[i] = uint64( sa[ i * sa_intv ] );
+
+        // and derive the BWT, removing the dollar symbol
+        const uint64 primary = gen_bwt_from_sa( seq_length, h_string.begin(), &sa[0], h_bwt.begin() );
+
+        timer.stop();
+        log_info(stderr, "building %s BWT... done: %um:%us\n", reverse ? "reverse" : "forward", uint32(timer.seconds()/60), uint32(timer.seconds())%60);
+        log_info(stderr, "  primary: %llu\n", primary);
+
+        save_pac( seq_length, nvbio::plain_view( h_string_storage ),                         reverse ? rpac_name : pac_name, pac_type );
+        save_bwt( seq_length, seq_words, primary, cumFreq, nvbio::plain_view( h_bwt_storage ), reverse ? rbwt_name : bwt_name );
+        save_ssa( seq_length, sa_intv, ssa_len, primary, cumFreq, &h_ssa[0],                  reverse ? rsa_name  : sa_name );
+
+        if (reverse == 0)
+        {
+            // reverse the string, reusing the bwt storage
+            for (uint64 i = 0; i < seq_length; ++i)
+                h_bwt[i] = h_string[ seq_length - i - 1u ];
+
+            // and now swap the vectors
+            h_bwt_storage.swap( h_string_storage );
+        }
+    }
+}
+
 int build(
     const char*  input_name,
     const char*  output_name,
@@ -392,19 +471,18 @@ int build(
         2*seq_words*sizeof(uint32)/1.0e6f );
 
     const uint32 sa_intv = nvbio::io::FMIndexData::SA_INT;
-    const uint32 ssa_len = (seq_length + sa_intv) / sa_intv;
+    const uint64 ssa_len = (seq_length + sa_intv) / sa_intv;
 
     // allocate the actual storage
     thrust::host_vector<uint32> h_string_storage( seq_words+1 );
     thrust::host_vector<uint32> h_bwt_storage( seq_words+1 );
-    thrust::host_vector<uint32> h_ssa( ssa_len );
 
     typedef io::FMIndexData::stream_type                const_stream_type;
     typedef io::FMIndexData::nonconst_stream_type             stream_type;
 
     stream_type h_string( nvbio::plain_view( h_string_storage ) );
 
-    uint32 cumFreq[4] = { 0, 0, 0, 0 };
+    uint64 cumFreq[4] = { 0, 0, 0, 0 };
 
     log_info(stderr, "\nbuffering bps... started\n");
     // read all files
@@ -436,12 +514,44 @@ int build(
         if (cumFreq[3] != seq_length)
         {
             log_error(stderr, "  mismatching symbol frequencies!\n");
-            log_error(stderr, "    (%u, %u, %u, %u)\n", cumFreq[0], cumFreq[1], cumFreq[2], cumFreq[3]);
+            log_error(stderr, "    (%llu, %llu, %llu, %llu)\n", cumFreq[0], cumFreq[1], cumFreq[2], cumFreq[3]);
             exit(1);
         }
     }
     log_info(stderr, "buffering bps... done\n");
 
+    if (io::FMIndexData::required_index_bits( seq_length ) > 32)
+    {
+        if (compute_crc)
+            log_warning(stderr, "  crcs are not computed for sequences requiring a 64-bit index\n");
+
+        try
+        {
+            build_bwt64(
+                seq_length,
+                seq_words,
+                cumFreq,
+                h_string_storage,
+                h_bwt_storage,
+                pac_name, rpac_name,
+                bwt_name, rbwt_name,
+                sa_name,  rsa_name,
+                pac_type );
+        }
+        catch (std::bad_alloc e)
+        {
+            log_error(stderr, "caught a std::bad_alloc exception:\n");
+            log_error(stderr, "  %s\n", e.what());
+            exit(1);
+        }
+        return 0;
+    }
+
+    // from here on the sequence fits 32-bit coordinates
+    const uint32 cumFreq32[4] = { uint32(cumFreq[0]), uint32(cumFreq[1]), uint32(cumFreq[2]), uint32(cumFreq[3]) };
+
+    thrust::host_vector<uint32> h_ssa( ssa_len );
+
     if (compute_crc)
     {
         const uint32 crc = crcCalc( h_string.begin(), uint32(seq_length) );
@@ -501,8 +611,8 @@ int build(
             }
 
             save_pac( seq_length, nvbio::plain_view( h_string_storage ),                           pac_name, pac_type );
-            save_bwt( seq_length, seq_words, primary, cumFreq, nvbio::plain_view( h_bwt_storage ), bwt_name );
-            save_ssa( seq_length, sa_intv, ssa_len, primary, cumFreq, nvbio::plain_view( h_ssa ),  sa_name );
+            save_bwt( seq_length, seq_words, primary, cumFreq32, nvbio::plain_view( h_bwt_storage ), bwt_name );
+            save_ssa( seq_length, sa_intv, ssa_len, primary, cumFreq32, nvbio::plain_view( h_ssa ),  sa_name );
         }
 
         // reverse the string in h_string_storage
@@ -563,8 +673,8 @@ int build(
             }
 
             save_pac( seq_length, nvbio::plain_view( h_string_storage ),                           rpac_name, pac_type );
-            save_bwt( seq_length, seq_words, primary, cumFreq, nvbio::plain_view( h_bwt_storage ), rbwt_name );
-            save_ssa( seq_length, sa_intv, ssa_len, primary, cumFreq, nvbio::plain_view( h_ssa ),  rsa_name );
+            save_bwt( seq_length, seq_words, primary, cumFreq32, nvbio::plain_view( h_bwt_storage ), rbwt_name );
+            save_ssa( seq_length, sa_intv, ssa_len, primary, cumFreq32, nvbio::plain_view( h_ssa ),  rsa_name );
         }
     }
     catch (nvbio::cuda_error e)
@@ -625,6 +735,7 @@ int main(int argc, char* argv[])
         log_info(stderr, "    -w | --word-packing   output word packed .wpac\n");
         log_info(stderr, "    -c | --crc            compute crcs\n");
         log_info(stderr, "    -d | --device         cuda device\n");
+        log_info(stderr, "    -f | --fmi            also save a single-file FM-index container (.fmi)\n");
         exit(0);
     }
 
@@ -632,6 +743,7 @@ int main(int argc, char* argv[])
     uint64  max_length  = uint64(-1);
     PacType pac_type    = BPAC;
     bool    crc         = false;
+    bool    fmi         = false;
     int     cuda_device = -1;
 
     uint32 n_files = 0;
@@ -670,6 +782,11 @@ int main(int argc, char* argv[])
         {
             cuda_device = max_length = atoi( argv[++i] );
         }
+        else if ((strcmp( arg, "-f" )               == 0) ||
+                 (strcmp( arg, "--fmi" )            == 0))
+        {
+            fmi = true;
+        }
         else
             file_names[ n_files++ ] = argv[i];
     }
@@ -738,6 +855,16 @@ int main(int argc, char* argv[])
     cudaMemGetInfo(&free, &total);
     NVBIO_CUDA_DEBUG_STATEMENT( log_info(stderr,"device mem : total: %.1f GB, free: %.1f GB\n", float(total)/float(1024*1024*1024), float(free)/float(1024*1024*1024)) );
 
-    return build( input_name, output_name, pac_name, rpac_name, bwt_name, rbwt_name, sa_name, rsa_name, max_length, pac_type, crc );
+    const int ret = build( input_name, output_name, pac_name, rpac_name, bwt_name, rbwt_name, sa_name, rsa_name, max_length, pac_type, crc );
+    if (ret || fmi == false)
+        return ret;
+
+    // reload the index just written, building its occurrence tables, and save it as a single container
+    io::FMIndexDataRAM fmi_data;
+    if (!fmi_data.load( output_name ))
+        return 1;
+
+    std::string fmi_string = std::string( output_name ) + ".fmi";
+    return io::save_fmi_container( fmi_data, fmi_string.c_str() ) ? 0 : 1;
 }
 
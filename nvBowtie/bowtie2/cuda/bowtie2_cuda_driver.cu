@@ -83,6 +83,26 @@ std::map<std::string,std::string> load_options(const char* name)
     return options;
 }
 
+// collect the output options out of the parameters
+io::OutputFileOptions output_file_options(const Params& params)
+{
+    io::OutputFileOptions options;
+    options.compression_level   = params.compression_level;
+    options.compression_threads = params.compression_threads;
+    options.output_queue_depth  = params.output_queue_depth;
+    options.sort                = params.sort_output;
+    options.sort_memory         = uint64(params.sort_memory) * 1024u * 1024u;
+    options.quality_mode        = params.quality_mode == BinQualities  ? io::QUALITY_BIN  :
+                                  params.quality_mode == DropQualities ? io::QUALITY_DROP :
+                                                                         io::QUALITY_KEEP;
+    options.format              = params.output_format == SamOutputFormat   ? io::OUTPUT_FORMAT_SAM    :
+                                  params.output_format == SamGzOutputFormat ? io::OUTPUT_FORMAT_SAM_GZ :
+                                  params.output_format == BamOutputFormat   ? io::OUTPUT_FORMAT_BAM    :
+                                  params.output_format == AlnOutputFormat   ? io::OUTPUT_FORMAT_ALN    :
+                                                                              io::OUTPUT_FORMAT_AUTO;
+    return options;
+}
+
 void parse_options(Params& params, const std::map<std::string,std::string>& options, bool init)
 {
     params.mode             = mapping_mode( string_option(options, "mode", init ? "best"  : mapping_mode( params.mode )).c_str() ); // mapping mode
@@ -104,6 +124,14 @@ void parse_options(Params& params, const std::map<std::string,std::string>& opti
     params.randomized       = uint_option(options, "rand",             init ? 0u      : params.randomized);           // use randomized selection
     params.top_seed         = uint_option(options, "top",              init ? 0u      : params.top_seed);             // explore top seed entirely
     params.min_read_len     = uint_option(options, "min-read-len",     init ? 12u     : params.min_read_len);         // minimum read length
+    params.input_queue_depth = uint_option(options, "input-queue-depth", init ? 4u    : params.input_queue_depth);    // number of read batches loaded ahead
+    params.compression_level   = int_option(options,  "compression-level",   init ? -1   : params.compression_level);   // BAM output compression level
+    params.compression_threads = uint_option(options, "compression-threads", init ? 4u   : params.compression_threads); // BAM output compression threads
+    params.output_queue_depth  = uint_option(options, "output-queue-depth",  init ? 1u   : params.output_queue_depth);  // number of batches written out in the background
+    params.sort_output         = (bool)uint_option(options, "sort",          init ? 0u   : params.sort_output);         // coordinate-sorted, indexed BAM output
+    params.sort_memory         = uint_option(options, "sort-memory",         init ? 768u : params.sort_memory);         // sorting memory budget, in MB
+    params.quality_mode        = quality_mode( string_option(options, "qualities", init ? "keep" : quality_mode( params.quality_mode )).c_str() ); // base quality output mode
+    params.output_format       = output_format( string_option(options, "output-format", init ? "auto" : output_format( params.output_format )).c_str() ); // output format, overriding the file extension
 
     const bool local = params.alignment_type == LocalAlignment;
 
@@ -252,7 +280,6 @@ int driver(
     cudaMemGetInfo(&free, &total);
     log_stats(stderr, "  ready to start processing: device has %ld MB free\n", free/1024/1024);
 
-    float polling_time = 0.0f;
     Timer global_timer;
     global_timer.start();
 
@@ -270,16 +297,19 @@ int driver(
 
     aligner.output_file = io::OutputFile::open(output_name,
                                                io::SINGLE_END,
-                                               io::BNT(driver_data_host));
+                                               io::BNT(driver_data_host),
+                                               output_file_options( params ));
+
+    // let the output file recycle each batch of reads once it's been written out
+    aligner.output_file->set_read_streams( &read_data_stream );
 
     nvbio::bowtie2::cuda::BowtieMapq< BowtieMapq2< SmithWatermanScoringScheme<> > > new_mapq_eval(scoring_scheme.sw);
     aligner.output_file->configure_mapq_evaluator(&new_mapq_eval, params.mapq_filter);
 
     // setup the input thread
-    InputThread input_thread( &read_data_stream, stats, BATCH_SIZE );
+    InputThread input_thread( &read_data_stream, stats, BATCH_SIZE, params.input_queue_depth );
     input_thread.create();
 
-    uint32 input_set  = 0;
     uint32 n_reads    = 0;
 
     // loop through the batches of reads
@@ -300,17 +330,9 @@ int driver(
         stats.read_io_time += timer.seconds();
         stats.max_read_io_speed = std::max( stats.max_read_io_speed, float(read_data_host->size()) / timer.seconds() );
         */
-        Timer polling_timer;
-        polling_timer.start();
-
-        // poll until the current input set is loaded...
-        while (input_thread.read_data[ input_set ] == NULL) {}
-
-        polling_timer.stop();
-        polling_time += polling_timer.seconds();
-
-        io::ReadData* read_data_host = input_thread.read_data[ input_set ];
-        if (read_data_host == (io::ReadData*)InputThread::INVALID)
+        // wait for the next batch to be loaded...
+        io::ReadData* read_data_host = input_thread.next();
+        if (read_data_host == NULL)
             break;
 
         if (read_data_host->max_read_len() > Aligner::MAX_READ_LEN)
@@ -318,6 +340,7 @@ int driver(
             log_error(stderr, "unsupported read length %u (maximum is %u)\n",
                 read_data_host->max_read_len(),
                 Aligner::MAX_READ_LEN );
+            read_data_stream.release( read_data_host );
             break;
         }
 
@@ -332,12 +355,6 @@ int driver(
         timer.stop();
         stats.read_HtoD.add( read_data.size(), timer.seconds() );
 
-        // mark this set as ready to be reused
-        input_thread.read_data[ input_set ] = NULL;
-
-        // advance input set pointer
-        input_set = (input_set + 1) % InputThread::BUFFERS;
-
         const uint32 count = read_data_host->size();
         log_info(stderr, "aligning reads [%u, %u]\n", read_begin, read_begin + count - 1u);
         log_verbose(stderr, "  %u reads\n", read_data_host->m_n_reads);
@@ -388,18 +405,24 @@ int driver(
         stats.global_time += global_timer.seconds();
         global_timer.start();
 
+        // write the batch out, possibly in the background; the output file takes care
+        // of handing the reads back to the stream once done
         aligner.output_file->end_batch();
 
         // increase the total reads counter
         n_reads += count;
 
-        delete read_data_host;
-
         log_verbose(stderr, "  %.1f K reads/s\n", 1.0e-3f * float(n_reads) / stats.global_time);
     }
 
+    input_thread.stop();
     input_thread.join();
 
+    // the input thread stops at the first error, e.g. a truncated file or mates out of sync
+    const bool input_error = read_data_stream.has_error();
+    if (input_error)
+        log_error(stderr, "failed reading the input reads, the output only holds the reads loaded so far\n");
+
     io::IOStats iostats;
 
     aligner.output_file->close();
@@ -408,6 +431,12 @@ int driver(
     iostats = aligner.output_file->get_aggregate_statistics();
 
     stats.alignments_DtoH.add(iostats.alignments_DtoH_count, iostats.alignments_DtoH_time);
+    stats.output_queue_depth = params.output_queue_depth;
+    stats.output_stall       = iostats.output_blocked_time;
+    stats.output_raw_bytes   = iostats.output_raw_bytes;
+    stats.output_qual_bytes  = iostats.output_qual_bytes;
+    stats.output_bytes       = iostats.output_bytes;
+    stats.output_compression_time = iostats.output_compression_time;
     stats.io = iostats.output_process_timings;
     stats.n_mapped          = iostats.mate1.n_mapped;
     stats.n_ambiguous       = iostats.mate1.n_ambiguous;
@@ -438,8 +467,15 @@ int driver(
     log_stats(stderr, "  results DtoH : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.alignments_DtoH.time, 1.0e-6f * stats.alignments_DtoH.avg_speed(), 1.0e-6f * stats.alignments_DtoH.max_speed);
     log_stats(stderr, "  reads HtoD   : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.read_HtoD.time, 1.0e-6f * stats.read_HtoD.avg_speed(), 1.0e-6f * stats.read_HtoD.max_speed);
     log_stats(stderr, "  reads I/O    : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.read_io.time, 1.0e-6f * stats.read_io.avg_speed(), 1.0e-6f * stats.read_io.max_speed);
-    log_stats(stderr, "    exposed    : %.2f sec (avg: %.3fK reads/s).\n", polling_time, 1.0e-3f * float(n_reads)/polling_time);
+    log_stats(stderr, "    exposed    : %.2f sec (avg: %.3fK reads/s).\n", stats.input_consumer_stall, 1.0e-3f * float(n_reads)/stats.input_consumer_stall);
+    log_stats(stderr, "  input queue  : %.2f / %u batches on avg, producer stalled %llu times (%.2f sec), consumer stalled %llu times (%.2f sec)\n",
+        stats.input_queue_occupancy, stats.input_queue_depth,
+        (unsigned long long)stats.input_producer_waits, stats.input_producer_stall,
+        (unsigned long long)stats.input_consumer_waits, stats.input_consumer_stall );
     log_stats(stderr, "  output I/O   : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.io.time, 1.0e-6f * stats.io.avg_speed(), 1.0e-6f * stats.io.max_speed);
+    log_stats(stderr, "    exposed    : %.2f sec blocked on output (%u batches queued at most).\n", stats.output_stall, stats.output_queue_depth);
+    log_stats(stderr, "  output size  : %.1f MB written, %.1f MB formatted (%.1f MB of qualities), %.2f sec compressing.\n",
+        float(stats.output_bytes) * 1.0e-6f, float(stats.output_raw_bytes) * 1.0e-6f, float(stats.output_qual_bytes) * 1.0e-6f, stats.output_compression_time);
 
     std::vector<uint32>& mapped         = stats.mapped;
     uint32&              n_mapped       = stats.n_mapped;
@@ -462,7 +498,7 @@ int driver(
     }
 
     log_visible(stderr, "Bowtie2 cuda driver... done\n");
-    return 0;
+    return input_error ? 1 : 0;
 }
 
 //
@@ -472,8 +508,7 @@ int driver(
     const char*                              output_name, 
     const io::FMIndexData&                   driver_data_host,
     const io::PairedEndPolicy                pe_policy,
-          io::ReadDataStream&                read_data_stream1,
-          io::ReadDataStream&                read_data_stream2,
+          io::PairedReadDataStream&          read_data_stream,
     const std::map<std::string,std::string>& options)
 {
     log_visible(stderr, "Bowtie2 cuda driver... started\n");
@@ -586,7 +621,6 @@ int driver(
     cudaDeviceGetLimit( &stack_size_limit, cudaLimitStackSize );
     log_debug(stderr, "    max cuda stack size: %u\n", stack_size_limit);
 
-    float polling_time = 0.0f;
     Timer timer;
     Timer global_timer;
     global_timer.start();
@@ -605,35 +639,28 @@ int driver(
 
     aligner.output_file = io::OutputFile::open(output_name,
                                                io::PAIRED_END,
-                                               io::BNT(driver_data_host));
+                                               io::BNT(driver_data_host),
+                                               output_file_options( params ));
+
+    // let the output file recycle each batch of reads once it's been written out
+    aligner.output_file->set_read_streams( &read_data_stream );
 
     nvbio::bowtie2::cuda::BowtieMapq< BowtieMapq2< SmithWatermanScoringScheme<> > > new_mapq_eval(scoring_scheme.sw);
     aligner.output_file->configure_mapq_evaluator(&new_mapq_eval, params.mapq_filter);
 
     // setup the input thread
-    InputThreadPaired input_thread( &read_data_stream1, &read_data_stream2, stats, BATCH_SIZE );
+    InputThreadPaired input_thread( &read_data_stream, stats, BATCH_SIZE, params.input_queue_depth );
     input_thread.create();
 
-    uint32 input_set  = 0;
     uint32 n_reads    = 0;
 
     // loop through the batches of reads
     for (uint32 read_begin = 0; true; read_begin += BATCH_SIZE)
     {
-        Timer polling_timer;
-        polling_timer.start();
-
-        // poll until the current input set is loaded...
-        while (input_thread.read_data1[ input_set ] == NULL ||
-               input_thread.read_data2[ input_set ] == NULL) {}
-
-        polling_timer.stop();
-        polling_time += polling_timer.seconds();
-
-        io::ReadData* read_data_host1 = input_thread.read_data1[ input_set ];
-        io::ReadData* read_data_host2 = input_thread.read_data2[ input_set ];
-        if (read_data_host1 == (io::ReadData*)InputThread::INVALID ||
-            read_data_host2 == (io::ReadData*)InputThread::INVALID)
+        // wait for the next pair of batches to be loaded...
+        io::ReadData* read_data_host1;
+        io::ReadData* read_data_host2;
+        if (input_thread.next( &read_data_host1, &read_data_host2 ) == false)
             break;
 
         if ((read_data_host1->max_read_len() > Aligner::MAX_READ_LEN) ||
@@ -642,6 +669,8 @@ int driver(
             log_error(stderr, "unsupported read length %u (maximum is %u)\n",
                 nvbio::max(read_data_host1->max_read_len(), read_data_host2->max_read_len()),
                 Aligner::MAX_READ_LEN );
+            read_data_stream.release( read_data_host1 );
+            read_data_stream.release( read_data_host2 );
             break;
         }
 
@@ -656,13 +685,6 @@ int driver(
         timer.stop();
         stats.read_HtoD.add( read_data1.size(), timer.seconds() );
 
-        // mark this set as ready to be reused
-        input_thread.read_data1[ input_set ] = NULL;
-        input_thread.read_data2[ input_set ] = NULL;
-
-        // advance input set pointer
-        input_set = (input_set + 1) % InputThread::BUFFERS;
-
         const uint32 count = read_data_host1->size();
         log_info(stderr, "aligning reads [%u, %u]\n", read_begin, read_begin + count - 1u);
         log_verbose(stderr, "  %u reads\n", read_data_host1->m_n_reads);
@@ -721,19 +743,24 @@ int driver(
         stats.global_time += global_timer.seconds();
         global_timer.start();
 
+        // write the batch out, possibly in the background; the output file takes care
+        // of handing the reads back to their streams once done
         aligner.output_file->end_batch();
 
         // increase the total reads counter
         n_reads += count;
 
-        delete read_data_host1;
-        delete read_data_host2;
-
         log_verbose(stderr, "  %.1f K reads/s\n", 1.0e-3f * float(n_reads) / stats.global_time);
     }
 
+    input_thread.stop();
     input_thread.join();
 
+    // the input thread stops at the first error, e.g. a truncated file or mates out of sync
+    const bool input_error = read_data_stream.has_error();
+    if (input_error)
+        log_error(stderr, "failed reading the input reads, the output only holds the reads loaded so far\n");
+
     io::IOStats iostats;
 
     aligner.output_file->close();
@@ -742,6 +769,12 @@ int driver(
     iostats = aligner.output_file->get_aggregate_statistics();
 
     stats.alignments_DtoH.add(iostats.alignments_DtoH_count, iostats.alignments_DtoH_time);
+    stats.output_queue_depth = params.output_queue_depth;
+    stats.output_stall       = iostats.output_blocked_time;
+    stats.output_raw_bytes   = iostats.output_raw_bytes;
+    stats.output_qual_bytes  = iostats.output_qual_bytes;
+    stats.output_bytes       = iostats.output_bytes;
+    stats.output_compression_time = iostats.output_compression_time;
     stats.io                = iostats.output_process_timings;
     stats.n_reads           = iostats.n_reads;
     stats.n_mapped          = iostats.paired.n_mapped;
@@ -776,8 +809,15 @@ int driver(
     log_stats(stderr, "  results DtoH   : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.alignments_DtoH.time, 1.0e-6f * stats.alignments_DtoH.avg_speed(), 1.0e-6f * stats.alignments_DtoH.max_speed);
     log_stats(stderr, "  reads HtoD     : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.read_HtoD.time, 1.0e-6f * stats.read_HtoD.avg_speed(), 1.0e-6f * stats.read_HtoD.max_speed);
     log_stats(stderr, "  reads I/O      : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.read_io.time, 1.0e-6f * stats.read_io.avg_speed(), 1.0e-6f * stats.read_io.max_speed);
-    log_stats(stderr, "    exposed      : %.2f sec (avg: %.3fK reads/s).\n", polling_time, 1.0e-3f * float(n_reads)/polling_time);
+    log_stats(stderr, "    exposed      : %.2f sec (avg: %.3fK reads/s).\n", stats.input_consumer_stall, 1.0e-3f * float(n_reads)/stats.input_consumer_stall);
+    log_stats(stderr, "  input queue    : %.2f / %u batches on avg, producer stalled %llu times (%.2f sec), consumer stalled %llu times (%.2f sec)\n",
+        stats.input_queue_occupancy, stats.input_queue_depth,
+        (unsigned long long)stats.input_producer_waits, stats.input_producer_stall,
+        (unsigned long long)stats.input_consumer_waits, stats.input_consumer_stall );
     log_stats(stderr, "  output I/O     : %.2f sec (avg: %.3fM reads/s, max: %.3fM reads/s).\n", stats.io.time, 1.0e-6f * stats.io.avg_speed(), 1.0e-6f * stats.io.max_speed);
+    log_stats(stderr, "    exposed      : %.2f sec blocked on output (%u batches queued at most).\n", stats.output_stall, stats.output_queue_depth);
+    log_stats(stderr, "  output size    : %.1f MB written, %.1f MB formatted (%.1f MB of qualities), %.2f sec compressing.\n",
+        float(stats.output_bytes) * 1.0e-6f, float(stats.output_raw_bytes) * 1.0e-6f, float(stats.output_qual_bytes) * 1.0e-6f, stats.output_compression_time);
 
     std::vector<uint32>& mapped         = stats.mapped;
     uint32&              n_mapped       = stats.n_mapped;
@@ -818,7 +858,7 @@ int driver(
     }
 
     log_visible(stderr, "Bowtie2 cuda driver... done\n");
-    return 0;
+    return input_error ? 1 : 0;
 }
 
 } // namespace cuda
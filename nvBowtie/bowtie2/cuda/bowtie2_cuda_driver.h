@@ -35,8 +35,7 @@ int driver(const char*                              output_name,
 int driver(const char*                              output_name,
            const io::FMIndexData&                   driver_data,
            const io::PairedEndPolicy                pe_policy,
-                 io::ReadDataStream&                read_data_stream1,
-                 io::ReadDataStream&                read_data_stream2,
+                 io::PairedReadDataStream&          read_data_stream,
            const std::map<std::string,std::string>& options);
 
 } // namespace cuda
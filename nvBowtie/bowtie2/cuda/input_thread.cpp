@@ -29,18 +29,20 @@ namespace nvbio {
 namespace bowtie2 {
 namespace cuda {
 
+InputThread::~InputThread()
+{
+    // release any batch left over by an early exit
+    io::ReadData* data;
+    while (m_queue.pop( &data ))
+        m_read_data_stream->release( data );
+}
+
 void InputThread::run()
 {
     log_verbose( stderr, "starting background input thread\n" );
 
     while (1u)
     {
-        // poll until the set is done reading & ready to be reused
-        while (read_data[m_set] != NULL) {}
-
-        //// lock the set to flush
-        //ScopedLock lock( &m_lock[m_set] );
-
         Timer timer;
         timer.start();
 
@@ -48,22 +50,63 @@ void InputThread::run()
 
         timer.stop();
 
-        if (data)
-        {
-            m_stats.read_io.add( data->size(), timer.seconds() );
+        if (data == NULL)
+            break;
 
-            // mark the set as done
-            read_data[ m_set ] = data;
-        }
-        else
+        m_stats.read_io.add( data->size(), timer.seconds() );
+
+        // hand the batch over, waiting for a free slot
+        timer.start();
+
+        const bool queued = m_queue.push( data );
+
+        timer.stop();
+        m_stats.input_producer_stall += timer.seconds();
+
+        if (queued == false)
         {
-            // mark this as an invalid entry
-            read_data[ m_set ] = (io::ReadData*)INVALID;
+            // the consumer has quit
+            m_read_data_stream->release( data );
             break;
         }
+    }
+
+    // signal the end of the input
+    m_queue.close();
+}
+
+io::ReadData* InputThread::next()
+{
+    Timer timer;
+    timer.start();
+
+    io::ReadData* data = NULL;
+    if (m_queue.pop( &data ) == false)
+        data = NULL;
+
+    timer.stop();
+    m_stats.input_consumer_stall += timer.seconds();
+    return data;
+}
+
+void InputThread::stop()
+{
+    m_queue.close();
+
+    m_stats.input_queue_depth     = m_queue.capacity();
+    m_stats.input_queue_occupancy = m_queue.avg_occupancy();
+    m_stats.input_producer_waits  = m_queue.push_waits();
+    m_stats.input_consumer_waits  = m_queue.pop_waits();
+}
 
-        // switch to the next set
-        m_set = (m_set + 1) % BUFFERS;
+InputThreadPaired::~InputThreadPaired()
+{
+    // release any batch left over by an early exit
+    ReadDataPair data;
+    while (m_queue.pop( &data ))
+    {
+        m_read_data_stream->release( data.first );
+        m_read_data_stream->release( data.second );
     }
 }
 
@@ -73,43 +116,66 @@ void InputThreadPaired::run()
 
     while (1u)
     {
-        // poll until the set is done reading & ready to be reused
-        while (read_data1[m_set] != NULL || read_data2[m_set] != NULL) {}
-
-        //// lock the set to flush
-        //ScopedLock lock( &m_lock[m_set] );
-
         Timer timer;
         timer.start();
 
-        io::ReadData* data1 = m_read_data_stream1->next( m_batch_size );
-        io::ReadData* data2 = m_read_data_stream2->next( m_batch_size );
+        // the stream returns both mates of each read, or nothing at all
+        io::ReadData* data1;
+        io::ReadData* data2;
+        const bool loaded = m_read_data_stream->next( m_batch_size, &data1, &data2 );
 
         timer.stop();
 
-        if (data1 && data2)
-        {
-            m_stats.read_io.add( data1->size(), timer.seconds() );
+        if (loaded == false)
+            break;
 
-            // mark the set as done
-            read_data1[ m_set ] = data1;
-            read_data2[ m_set ] = data2;
-        }
-        else
-        {
-            // mark this as an invalid entry
-            read_data1[ m_set ] = (io::ReadData*)INVALID;
-            read_data2[ m_set ] = (io::ReadData*)INVALID;
+        m_stats.read_io.add( data1->size(), timer.seconds() );
+
+        // hand the batches over, waiting for a free slot
+        timer.start();
+
+        const bool queued = m_queue.push( std::make_pair( data1, data2 ) );
+
+        timer.stop();
+        m_stats.input_producer_stall += timer.seconds();
 
-            // delete unpaired segments
-            if (data1) delete data1;
-            if (data2) delete data2;
+        if (queued == false)
+        {
+            // the consumer has quit
+            m_read_data_stream->release( data1 );
+            m_read_data_stream->release( data2 );
             break;
         }
-
-        // switch to the next set
-        m_set = (m_set + 1) % BUFFERS;
     }
+
+    // signal the end of the input
+    m_queue.close();
+}
+
+bool InputThreadPaired::next(io::ReadData** data1, io::ReadData** data2)
+{
+    Timer timer;
+    timer.start();
+
+    ReadDataPair data( (io::ReadData*)NULL, (io::ReadData*)NULL );
+    const bool ret = m_queue.pop( &data );
+
+    timer.stop();
+    m_stats.input_consumer_stall += timer.seconds();
+
+    *data1 = data.first;
+    *data2 = data.second;
+    return ret;
+}
+
+void InputThreadPaired::stop()
+{
+    m_queue.close();
+
+    m_stats.input_queue_depth     = m_queue.capacity();
+    m_stats.input_queue_occupancy = m_queue.avg_occupancy();
+    m_stats.input_producer_waits  = m_queue.push_waits();
+    m_stats.input_consumer_waits  = m_queue.pop_waits();
 }
 
 } // namespace cuda
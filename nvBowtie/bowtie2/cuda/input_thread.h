@@ -23,6 +23,7 @@
 #include <nvBowtie/bowtie2/cuda/stats.h>
 #include <nvbio/basic/threads.h>
 #include <nvbio/basic/timer.h>
+#include <utility>
 
 namespace nvbio {
 namespace bowtie2 {
@@ -32,58 +33,70 @@ namespace cuda {
 // A class implementing a background input thread, providing
 // a set of input read-streams which are read in parallel to the
 // operations performed by the main thread.
+// Batches are handed over through a bounded blocking queue, so that
+// the input thread sleeps when it is too far ahead of the aligner,
+// and the aligner sleeps while waiting for input.
 //
 
 struct InputThread : public Thread<InputThread>
 {
     static const uint32 BUFFERS = 4;
-    static const uint32 INVALID = 1u;
 
-    InputThread(io::ReadDataStream* read_data_stream, Stats& _stats, const uint32 batch_size) :
-        m_read_data_stream( read_data_stream ), m_stats( _stats ), m_batch_size( batch_size ), m_set(0)
-    {
-        for (uint32 i = 0; i < BUFFERS; ++i)
-            read_data[i] = NULL;
-    }
+    InputThread(io::ReadDataStream* read_data_stream, Stats& _stats, const uint32 batch_size, const uint32 queue_depth = BUFFERS) :
+        m_read_data_stream( read_data_stream ), m_stats( _stats ), m_batch_size( batch_size ), m_queue( queue_depth ) {}
+
+    ~InputThread();
 
     void run();
 
-    io::ReadDataStream* m_read_data_stream;
-    Stats&              m_stats;
-    uint32              m_batch_size;
-    volatile uint32     m_set;
+    // fetch the next batch, waiting for it to be loaded;
+    // returns NULL at the end of the input
+    io::ReadData* next();
+
+    // close the queue, letting the input thread quit early if it
+    // still has data to load, and record the queue stats
+    void stop();
 
-    io::ReadData* volatile read_data[BUFFERS];
+    io::ReadDataStream*             m_read_data_stream;
+    Stats&                          m_stats;
+    uint32                          m_batch_size;
+    BlockingQueue<io::ReadData*>    m_queue;
 };
 
 //
 // A class implementing a background input thread, providing
 // a set of input read-streams which are read in parallel to the
 // operations performed by the main thread.
+// Batches are handed over through a bounded blocking queue, so that
+// the input thread sleeps when it is too far ahead of the aligner,
+// and the aligner sleeps while waiting for input.
 //
 
 struct InputThreadPaired : public Thread<InputThreadPaired>
 {
     static const uint32 BUFFERS = 4;
-    static const uint32 INVALID = 1u;
 
-    InputThreadPaired(io::ReadDataStream* read_data_stream1, io::ReadDataStream* read_data_stream2, Stats& _stats, const uint32 batch_size) :
-        m_read_data_stream1( read_data_stream1 ), m_read_data_stream2( read_data_stream2 ), m_stats( _stats ), m_batch_size( batch_size ), m_set(0)
-    {
-        for (uint32 i = 0; i < BUFFERS; ++i)
-            read_data1[i] = read_data2[i] = NULL;
-    }
+    typedef std::pair<io::ReadData*,io::ReadData*> ReadDataPair;
+
+    InputThreadPaired(io::PairedReadDataStream* read_data_stream, Stats& _stats, const uint32 batch_size, const uint32 queue_depth = BUFFERS) :
+        m_read_data_stream( read_data_stream ), m_stats( _stats ), m_batch_size( batch_size ), m_queue( queue_depth ) {}
+
+    ~InputThreadPaired();
 
     void run();
 
-    io::ReadDataStream* m_read_data_stream1;
-    io::ReadDataStream* m_read_data_stream2;
-    Stats&              m_stats;
-    uint32              m_batch_size;
-    volatile uint32     m_set;
+    // fetch the next pair of batches, waiting for them to be loaded;
+    // returns false at the end of the input
+    bool next(io::ReadData** data1, io::ReadData** data2);
+
+    // close the queue, letting the input thread quit early if it
+    // still has data to load, and record the queue stats
+    void stop();
 
-    io::ReadData* volatile read_data1[BUFFERS];
-    io::ReadData* volatile read_data2[BUFFERS];
+    io::PairedReadDataStream*       m_read_data_stream;
+    Stats&                          m_stats;
+    uint32                          m_batch_size;
+    BlockingQueue<ReadDataPair>     m_queue;
 };
 
 } // namespace cuda
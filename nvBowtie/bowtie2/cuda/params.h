@@ -84,6 +84,66 @@ inline uint32 scoring_mode(const char* str)
         return EditDistanceMode;
 }
 
+enum QualityOutputMode {
+    KeepQualities = 0,
+    BinQualities  = 1,
+    DropQualities = 2,
+};
+
+static const char* s_quality_mode[] = {
+    "keep",
+    "bin",
+    "drop"
+};
+inline const char* quality_mode(const uint32 mode)
+{
+    return s_quality_mode[ mode ];
+}
+
+inline uint32 quality_mode(const char* str)
+{
+    if (strcmp( str, "bin" ) == 0)
+        return BinQualities;
+    else if (strcmp( str, "drop" ) == 0)
+        return DropQualities;
+    else
+        return KeepQualities;
+}
+
+enum OutputFormatOption {
+    AutoOutputFormat  = 0,
+    SamOutputFormat   = 1,
+    SamGzOutputFormat = 2,
+    BamOutputFormat   = 3,
+    AlnOutputFormat   = 4,
+};
+
+static const char* s_output_format[] = {
+    "auto",
+    "sam",
+    "sam.gz",
+    "bam",
+    "aln"
+};
+inline const char* output_format(const uint32 format)
+{
+    return s_output_format[ format ];
+}
+
+inline uint32 output_format(const char* str)
+{
+    if (strcmp( str, "sam" ) == 0)
+        return SamOutputFormat;
+    else if (strcmp( str, "sam.gz" ) == 0)
+        return SamGzOutputFormat;
+    else if (strcmp( str, "bam" ) == 0)
+        return BamOutputFormat;
+    else if (strcmp( str, "aln" ) == 0)
+        return AlnOutputFormat;
+    else
+        return AutoOutputFormat;
+}
+
 struct SimpleFunc
 {
     enum Type { LinearFunc = 0, LogFunc = 1, SqrtFunc = 2 };
@@ -142,6 +202,14 @@ struct ParamsPOD
     uint32        subseed_len;
     uint32        mapq_filter;
     uint32        min_read_len;
+    uint32        input_queue_depth;
+    int32         compression_level;
+    uint32        compression_threads;
+    uint32        output_queue_depth;
+    bool          sort_output;
+    uint32        sort_memory;
+    uint32        quality_mode;
+    uint32        output_format;
 
     // paired-end options
     uint32        pe_policy;
@@ -48,6 +48,20 @@ Stats::Stats(const Params& params_) :
 {
     global_time = 0.0f;
 
+    input_queue_depth     = 0u;
+    input_queue_occupancy = 0.0f;
+    input_producer_stall  = 0.0f;
+    input_consumer_stall  = 0.0f;
+    input_producer_waits  = 0u;
+    input_consumer_waits  = 0u;
+
+    output_queue_depth    = 0u;
+    output_stall          = 0.0f;
+    output_raw_bytes      = 0u;
+    output_qual_bytes     = 0u;
+    output_bytes          = 0u;
+    output_compression_time = 0.0f;
+
     hits_total        = 0u;
     hits_ranges       = 0u;
     hits_max          = 0u;
@@ -55,6 +55,22 @@ struct Stats
     KernelStats io;
     KernelStats scoring_pipe;
 
+    // input queue stats
+    uint32      input_queue_depth;
+    float       input_queue_occupancy;
+    float       input_producer_stall;
+    float       input_consumer_stall;
+    uint64      input_producer_waits;
+    uint64      input_consumer_waits;
+
+    // output stats
+    uint32      output_queue_depth;
+    float       output_stall;
+    uint64      output_raw_bytes;
+    uint64      output_qual_bytes;
+    uint64      output_bytes;
+    float       output_compression_time;
+
     // mapping stats
     uint32              n_reads;
     uint32              n_mapped;
@@ -51,6 +51,9 @@ bool is_number(const char* str)
     if (str[0] == '-')
         ++str;
 
+    if (*str == '\0')
+        return false;
+
     for (;*str != '\0'; ++str)
     {
         if (*str < '0' ||
@@ -71,6 +74,8 @@ int main(int argc, char* argv[])
         (argc == 2 && strcmp( argv[1], "-h" ) == 0))
     {
         log_info(stderr,"nvBowtie [options] reference-genome read-file output\n");
+        log_info(stderr,"  (read-file and output can be - to stream from stdin and to stdout)\n");
+        log_info(stderr,"  (reference-genome can be the path of a .fmi container, which is then mapped from file)\n");
         log_info(stderr,"options:\n");
         log_info(stderr,"  General:\n");
         log_info(stderr,"    --max-reads        int [-1]      maximum number of reads to process\n");
@@ -80,12 +85,24 @@ int main(int argc, char* argv[])
         log_info(stderr,"    --phred33                        qualities are ASCII characters equal to Phred quality + 33\n");
         log_info(stderr,"    --phred64                        qualities are ASCII characters equal to Phred quality + 64\n");
         log_info(stderr,"    --solexa-quals                   qualities are in the Solexa format\n");
-        log_info(stderr,"    --pe                             paired ends input\n");
+        log_info(stderr,"    --pe                             paired ends input, from two read files holding the first and second mates\n");
+        log_info(stderr,"    --interleaved                    paired ends input, from a single read file holding the two mates one after the other\n");
+        log_info(stderr,"                                     (FASTQ or TXT), or holding both mates flagged as READ1/READ2 (BAM)\n");
         log_info(stderr,"    --ff                             paired mates are forward-forward\n");
         log_info(stderr,"    --fr                             paired mates are forward-reverse\n");
         log_info(stderr,"    --rf                             paired mates are reverse-forward\n");
         log_info(stderr,"    --rr                             paired mates are reverse-reverse\n");
         log_info(stderr,"    --verbosity                      verbosity level\n");
+        log_info(stderr,"    --input-queue-depth int [4]      number of read batches loaded ahead of the aligner\n");
+        log_info(stderr,"    --shard            i/n [0/1]     only align the i-th of n contiguous portions of the read file\n");
+        log_info(stderr,"    --input-format     str [auto]    read file format: fastq, txt, sam or bam (auto = from the extension, fastq for stdin)\n");
+        log_info(stderr,"    --output-format    str [auto]    output format: sam, sam.gz, bam or aln (auto = from the extension, sam for stdout)\n");
+        log_info(stderr,"    --compression-level int [-1]     BAM and SAM.gz compression level (0-9, -1 = zlib's default)\n");
+        log_info(stderr,"    --compression-threads int [4]    number of BAM and SAM.gz compression threads (0 = compress synchronously)\n");
+        log_info(stderr,"    --output-queue-depth int [1]     number of batches written out while aligning the next (0 = write synchronously)\n");
+        log_info(stderr,"    --sort                           write BAM output sorted by coordinate, along with its .bai index\n");
+        log_info(stderr,"    --sort-memory      int [768]     memory used for sorting, in MB (the rest is spilled to temporary files)\n");
+        log_info(stderr,"    --qualities        str [keep]    write SAM/BAM base qualities as they are (keep), binned to 8 levels (bin), or not at all (drop)\n");
         log_info(stderr,"  Seeding:\n");
         log_info(stderr,"    --seed-len         int [22]      seed lengths\n");
         log_info(stderr,"    --seed-freq        int [15]      interval between seeds\n");
@@ -118,12 +135,16 @@ int main(int argc, char* argv[])
 
     uint32 max_reads    = uint32(-1);
     uint32 max_read_len = uint32(-1);
+    uint32 shard        = 0u;
+    uint32 n_shards     = 1u;
     //bool   debug        = false;
     int    cuda_device  = -1;
     bool   from_file    = false;
     bool   paired_end   = false;
+    bool   interleaved  = false;
     io::PairedEndPolicy pe_policy = io::PE_POLICY_FF;
     io::QualityEncoding qencoding = io::Phred33;
+    io::ReadFileFormat  read_format = io::READ_FORMAT_AUTO;
 
     std::map<std::string,std::string> string_options;
 
@@ -133,6 +154,11 @@ int main(int argc, char* argv[])
             strcmp( argv[i], "-paired-ends" ) == 0 ||
             strcmp( argv[i], "--paired-ends" ) == 0)
             paired_end = true;
+        else if (strcmp( argv[i], "--interleaved" ) == 0)
+        {
+            paired_end  = true;
+            interleaved = true;
+        }
         else if (strcmp( argv[i], "--ff" ) == 0)
             pe_policy = io::PE_POLICY_FF;
         else if (strcmp( argv[i], "--fr" ) == 0)
@@ -147,6 +173,33 @@ int main(int argc, char* argv[])
         else if (strcmp( argv[i], "-max-read-len" ) == 0 ||
                  strcmp( argv[i], "--max-read-len" ) == 0)
             max_read_len = atoi( argv[++i] );
+        else if (strcmp( argv[i], "-shard" ) == 0 ||
+                 strcmp( argv[i], "--shard" ) == 0)
+        {
+            if (sscanf( argv[++i], "%u/%u", &shard, &n_shards ) != 2 || shard >= n_shards)
+            {
+                log_error(stderr, "invalid shard \"%s\", expected i/n with i < n\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp( argv[i], "-input-format" ) == 0 ||
+                 strcmp( argv[i], "--input-format" ) == 0)
+        {
+            ++i;
+            if (strcmp( argv[i], "fastq" ) == 0)
+                read_format = io::READ_FORMAT_FASTQ;
+            else if (strcmp( argv[i], "txt" ) == 0)
+                read_format = io::READ_FORMAT_TXT;
+            else if (strcmp( argv[i], "sam" ) == 0)
+                read_format = io::READ_FORMAT_SAM;
+            else if (strcmp( argv[i], "bam" ) == 0)
+                read_format = io::READ_FORMAT_BAM;
+            else if (strcmp( argv[i], "auto" ) != 0)
+            {
+                log_error(stderr, "unknown input format \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }
         else if (strcmp( argv[i], "-file-ref" ) == 0 ||
                  strcmp( argv[i], "--file-ref" ) == 0)
             from_file = true;
@@ -183,7 +236,7 @@ int main(int argc, char* argv[])
         else if (strcmp( argv[i], "-verbosity" ) == 0 ||
                  strcmp( argv[i], "--verbosity" ) == 0)
             set_verbosity( Verbosity( atoi( argv[++i] ) ) );
-        else if (argv[i][0] == '-')
+        else if (argv[i][0] == '-' && argv[i][1] != '\0') // a lone "-" is the standard input or output
         {
             // add unknown option to the string options
             const std::string key = std::string( argv[i][1] == '-' ? argv[i] + 2 : argv[i] + 1 );
@@ -199,9 +252,31 @@ int main(int argc, char* argv[])
         }
     }
 
+    // reject invalid compression levels up front, rather than when the output is first compressed
+    {
+        std::map<std::string,std::string>::const_iterator level = string_options.find( "compression-level" );
+        if (level != string_options.end())
+        {
+            char* end;
+            const long value = strtol( level->second.c_str(), &end, 10 );
+            if (level->second.empty() || *end != '\0' || value < -1 || value > 9)
+            {
+                log_error(stderr, "invalid compression level \"%s\", expected -1 to 9\n", level->second.c_str());
+                return 1;
+            }
+        }
+    }
+
     log_info(stderr, "nvBowtie... started\n");
     log_debug(stderr, "  %-16s : %d\n", "max-reads",  max_reads);
     log_debug(stderr, "  %-16s : %d\n", "max-length", max_read_len);
+    if (n_shards > 1u)
+        log_debug(stderr, "  %-16s : %u/%u\n", "shard", shard, n_shards);
+    if (read_format != io::READ_FORMAT_AUTO)
+        log_debug(stderr, "  %-16s : %s\n", "input-format", read_format == io::READ_FORMAT_FASTQ ? "fastq" :
+                                                            read_format == io::READ_FORMAT_TXT   ? "txt"   :
+                                                            read_format == io::READ_FORMAT_SAM   ? "sam"   :
+                                                                                                   "bam");
     log_debug(stderr, "  %-16s : %s\n", "quals", qencoding == io::Phred33 ? "phred33" :
                                                  qencoding == io::Phred64 ? "phred64" :
                                                                             "solexa");
@@ -261,12 +336,29 @@ int main(int argc, char* argv[])
         cudaSetDevice( cuda_device );
     }
 
-    uint32 arg_offset = paired_end ? argc-4 : argc-3;
+    uint32 arg_offset = (paired_end && !interleaved) ? argc-4 : argc-3;
 
     try
     {
         nvbio::io::FMIndexData* driver_data;
-        if (from_file)
+
+        // a single-file container is only mapped when its path is given as the reference,
+        // so that the separate index files of a prefix are never shadowed by a stale container
+        const char*  reference_name = argv[arg_offset];
+        const size_t reference_len  = strlen( reference_name );
+        const bool   is_container   =
+            reference_len > 4u &&
+            strcmp( reference_name + reference_len - 4u, ".fmi" ) == 0;
+
+        if (is_container)
+        {
+            nvbio::io::FMIndexDataMMAP* loader = new nvbio::io::FMIndexDataMMAP;
+            if (!loader->load_file( reference_name ))
+                return 1;
+
+            driver_data = loader;
+        }
+        else if (from_file)
         {
             nvbio::io::FMIndexDataRAM* loader = new nvbio::io::FMIndexDataRAM;
             if (!loader->load( argv[arg_offset] ))
@@ -283,39 +375,53 @@ int main(int argc, char* argv[])
             driver_data = loader;
         }
 
+        int ret = 0;
+
         if (paired_end)
         {
-            log_visible(stderr, "opening read file [1] \"%s\"\n", argv[arg_offset+1]);
-            SharedPointer<nvbio::io::ReadDataStream> read_data_file1(
-                nvbio::io::open_read_file(argv[arg_offset+1],
-                                          qencoding,
-                                          max_reads,
-                                          max_read_len,
-                                          io::REVERSE)
-            );
+            // the mates of a read are not guaranteed to fall in the same shard of their respective files
+            if (n_shards > 1u)
+            {
+                log_error(stderr, "sharding is not supported with paired ends\n");
+                return 1;
+            }
 
-            if (read_data_file1 == NULL || read_data_file1->is_ok() == false)
+            const char* read_file_name1 = argv[arg_offset+1];
+            const char* read_file_name2 = interleaved ? NULL : argv[arg_offset+2];
+
+            // only an interleaved input can hold both mates on a single stream
+            if (read_file_name2 &&
+                strcmp( read_file_name1, "-" ) == 0 &&
+                strcmp( read_file_name2, "-" ) == 0)
             {
-                log_error(stderr, "unable to open read file \"%s\"\n", argv[arg_offset+1]);
+                log_error(stderr, "only one of the paired read files can be read from the standard input\n");
                 return 1;
             }
 
-            log_visible(stderr, "opening read file [2] \"%s\"\n", argv[arg_offset+2]);
-            SharedPointer<nvbio::io::ReadDataStream> read_data_file2(
-                nvbio::io::open_read_file(argv[arg_offset+2],
-                                          qencoding,
-                                          max_reads,
-                                          max_read_len,
-                                          io::REVERSE)
+            if (read_file_name2)
+                log_visible(stderr, "opening read files \"%s\" and \"%s\"\n", read_file_name1, read_file_name2);
+            else
+                log_visible(stderr, "opening interleaved read file \"%s\"\n", read_file_name1);
+
+            SharedPointer<nvbio::io::PairedReadDataStream> read_data_file(
+                nvbio::io::open_paired_read_file(read_file_name1,
+                                                 read_file_name2,
+                                                 qencoding,
+                                                 max_reads,
+                                                 max_read_len,
+                                                 io::REVERSE,
+                                                 1u,
+                                                 io::LOAD_ALL,
+                                                 read_format)
             );
 
-            if (read_data_file2 == NULL || read_data_file2->is_ok() == false)
+            if (read_data_file == NULL || read_data_file->is_ok() == false)
             {
-                log_error(stderr, "unable to open read file \"%s\"\n", argv[arg_offset+2]);
+                log_error(stderr, "unable to open paired read input\n");
                 return 1;
             }
 
-            nvbio::bowtie2::cuda::driver( argv[argc-1], *driver_data, pe_policy, *read_data_file1, *read_data_file2, string_options );
+            ret = nvbio::bowtie2::cuda::driver( argv[argc-1], *driver_data, pe_policy, *read_data_file, string_options );
         }
         else
         {
@@ -325,7 +431,12 @@ int main(int argc, char* argv[])
                                           qencoding,
                                           max_reads,
                                           max_read_len,
-                                          io::REVERSE)
+                                          io::REVERSE,
+                                          1u,
+                                          io::LOAD_ALL,
+                                          shard,
+                                          n_shards,
+                                          read_format)
             );
 
             if (read_data_file == NULL || read_data_file->is_ok() == false)
@@ -334,10 +445,14 @@ int main(int argc, char* argv[])
                 return 1;
             }
 
-            nvbio::bowtie2::cuda::driver( argv[argc-1], *driver_data, *read_data_file, string_options );
+            ret = nvbio::bowtie2::cuda::driver( argv[argc-1], *driver_data, *read_data_file, string_options );
         }
         delete driver_data;
 
+        // the driver fails on input errors, after writing out the reads it could load
+        if (ret)
+            return ret;
+
         log_info( stderr, "nvBowtie... done\n" );
     }
     catch (nvbio::cuda_error e)
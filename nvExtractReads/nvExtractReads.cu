@@ -21,7 +21,9 @@
 
 #include <nvbio/basic/timer.h>
 #include <nvbio/basic/shared_pointer.h>
+#include <nvbio/basic/threads.h>
 #include <nvbio/io/reads/reads.h>
+#include <nvbio/io/reads/reads_archive.h>
 #include <nvbio/basic/dna.h>
 #include <thrust/host_vector.h>
 #include <thrust/device_vector.h>
@@ -32,7 +34,7 @@
 
 using namespace nvbio;
 
-bool read(const char* reads_name, FILE* output_file, const io::QualityEncoding qencoding, const io::ReadEncoding flags)
+bool read(const char* reads_name, FILE* output_file, io::ReadDataArchiveWriter* archive, const io::QualityEncoding qencoding, const io::ReadEncoding flags, const uint32 n_threads)
 {
     log_visible(stderr, "opening read file \"%s\"\n", reads_name);
     SharedPointer<nvbio::io::ReadDataStream> read_data_file(
@@ -40,7 +42,8 @@ bool read(const char* reads_name, FILE* output_file, const io::QualityEncoding q
         qencoding,
         uint32(-1),
         uint32(-1),
-        flags )
+        flags,
+        n_threads )
     );
 
     if (read_data_file == NULL || read_data_file->is_ok() == false)
@@ -59,24 +62,40 @@ bool read(const char* reads_name, FILE* output_file, const io::QualityEncoding q
     while (1)
     {
         // load a new batch of reads
-        SharedPointer<io::ReadData> h_read_data( read_data_file->next( batch_size ) );
+        io::ReadData* h_read_data = read_data_file->next( batch_size );
         if (h_read_data == NULL)
             break;
 
-        // loop through all reads
-        for (uint32 i = 0; i < h_read_data->size(); ++i)
+        if (archive)
         {
-            const io::ReadData::read_string read = h_read_data->get_read(i);
+            // store the encoded batch as is
+            if (archive->write( *h_read_data ) == false)
+            {
+                log_error(stderr, "    failed writing the read archive\n");
+                read_data_file->release( h_read_data );
+                return false;
+            }
+        }
+        else
+        {
+            // loop through all reads
+            for (uint32 i = 0; i < h_read_data->size(); ++i)
+            {
+                const io::ReadData::read_string read = h_read_data->get_read(i);
 
-            dna_to_string( read, read.length(), &char_read[0] );
+                dna_to_string( read, read.length(), &char_read[0] );
 
-            char_read[ read.length() ] = '\n';
+                char_read[ read.length() ] = '\n';
 
-            fwrite( &char_read[0], sizeof(char), read.length()+1, output_file );
+                fwrite( &char_read[0], sizeof(char), read.length()+1, output_file );
+            }
         }
 
         n_reads += h_read_data->size();
 
+        // hand the batch back to the stream for recycling
+        read_data_file->release( h_read_data );
+
         log_verbose(stderr,"\r    %u reads    ", n_reads);
     }
     log_verbose_cont(stderr,"\n");
@@ -88,11 +107,13 @@ int main(int argc, char* argv[])
     if (argc < 2)
     {
         log_info(stderr, "nvExtractReads [options] input output\n");
-        log_info(stderr, "  extract a set of reads to a plain ASCII file with one read per line (.txt)\n\n");
+        log_info(stderr, "  extract a set of reads to a plain ASCII file with one read per line (.txt),\n");
+        log_info(stderr, "  or to a pre-encoded binary read archive (.nvr)\n\n");
         log_info(stderr, "options:\n");
         log_info(stderr, "  --verbosity\n");
-        log_info(stderr, "  -F | --skip-forward          skip forward strand\n");
-        log_info(stderr, "  -R | --skip-reverse          skip forward strand\n");
+        log_info(stderr, "  -F | --skip-forward          skip forward strand (.txt only)\n");
+        log_info(stderr, "  -R | --skip-reverse          skip reverse strand (.txt only)\n");
+        log_info(stderr, "  -t | --threads     int       number of input parsing threads [all cores]\n");
         exit(0);
     }
 
@@ -100,6 +121,7 @@ int main(int argc, char* argv[])
     const char* out_name    = argv[argc-1];
     bool  forward           = true;
     bool  reverse           = true;
+    uint32 n_threads        = num_logical_cores();
     io::QualityEncoding qencoding = io::Phred33;
 
     for (int i = 0; i < argc - 2; ++i)
@@ -119,10 +141,35 @@ int main(int argc, char* argv[])
         {
             reverse = false;
         }
+        else if (strcmp( argv[i], "-t" )        == 0 ||
+                 strcmp( argv[i], "--threads" ) == 0)  // number of input parsing threads
+        {
+            n_threads = uint32( atoi( argv[++i] ) );
+        }
     }
 
-    FILE* output_file = fopen( out_name, "w" );
-    if (output_file == NULL)
+    uint32       encoding_flags  = 0u;
+    if (forward) encoding_flags |= io::FORWARD;
+    if (reverse) encoding_flags |= io::REVERSE_COMPLEMENT;
+
+    const uint32 out_len    = uint32( strlen( out_name ) );
+    const bool   to_archive = out_len >= 4u && strcmp( out_name + out_len - 4u, ".nvr" ) == 0;
+
+    // archives store the forward strands only, deriving the ones requested by their readers
+    if (to_archive)
+    {
+        if (encoding_flags != (io::FORWARD | io::REVERSE_COMPLEMENT))
+            log_warning(stderr, "  read archives store the forward strands only, ignoring -F and -R\n");
+
+        encoding_flags = io::FORWARD;
+    }
+
+    FILE*                   output_file = NULL;
+    io::ReadDataArchiveWriter archive;
+
+    if (to_archive ?
+        archive.open( out_name ) == false :
+        (output_file = fopen( out_name, "w" )) == NULL)
     {
         log_error(stderr, "    failed opening file \"%s\"\n", out_name);
         return 1;
@@ -130,14 +177,19 @@ int main(int argc, char* argv[])
 
     log_visible(stderr,"nvExtractReads... started\n");
 
-    uint32       encoding_flags  = 0u;
-    if (forward) encoding_flags |= io::FORWARD;
-    if (reverse) encoding_flags |= io::REVERSE_COMPLEMENT;
-
-    if (read( reads_name, output_file, qencoding, io::ReadEncoding(encoding_flags) ) == false)
+    if (read( reads_name, output_file, to_archive ? &archive : NULL, qencoding, io::ReadEncoding(encoding_flags), n_threads ) == false)
         return 1;
 
-    fclose( output_file );
+    if (to_archive)
+    {
+        if (archive.close() == false)
+        {
+            log_error(stderr, "    failed writing file \"%s\"\n", out_name);
+            return 1;
+        }
+    }
+    else
+        fclose( output_file );
 
     log_visible(stderr,"nvExtractReads... done\n");
     return 0;
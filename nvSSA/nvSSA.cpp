@@ -25,30 +25,77 @@
 #include <string>
 #include <nvbio/basic/console.h>
 #include <nvbio/io/fmi.h>
+#include <nvbio/io/fmi_container.h>
 
 void crcInit();
 
 using namespace nvbio;
 
+// save a sampled suffix array in a format compatible with BWA's: 32-bit indices use
+// 32-bit fields, while 64-bit ones use the 64-bit fields introduced by BWA 0.6
+//
+template <typename index_type, typename L2_type>
+void save_ssa(
+    const char*         file_name,
+    const uint64        seq_length,
+    const uint64        primary,
+    const L2_type*      L2,
+    const uint32        sa_intv,
+    const index_type*   ssa)
+{
+    const uint64 ssa_len = (seq_length + sa_intv) / sa_intv;
+
+    const index_type primary_field    = index_type( primary );
+    const index_type sa_intv_field    = index_type( sa_intv );
+    const index_type seq_length_field = index_type( seq_length );
+
+    index_type L2_fields[4];
+    for (uint32 c = 0; c < 4; ++c)
+        L2_fields[c] = index_type( L2[c+1] );
+
+    FILE* file = fopen( file_name, "wb" );
+    if (file == NULL)
+    {
+        log_error(stderr, "unable to open \"%s\" for writing\n", file_name);
+        exit(1);
+    }
+
+    fwrite( &primary_field,     sizeof(index_type), 1u, file );
+    fwrite( L2_fields,          sizeof(index_type), 4u, file );
+    fwrite( &sa_intv_field,     sizeof(index_type), 1u, file );
+    fwrite( &seq_length_field,  sizeof(index_type), 1u, file );
+    fwrite( &ssa[1],            sizeof(index_type), ssa_len-1, file );
+    fclose( file );
+}
+
 int main(int argc, char* argv[])
 {
     cudaSetDeviceFlags( cudaDeviceMapHost );
 
     crcInit();
 
-    if (argc == 1)
+    bool gpu = false;
+    bool fmi = false;
+
+    int base_arg = 1;
+    for (; base_arg < argc && argv[base_arg][0] == '-'; ++base_arg)
+    {
+        if (strcmp( argv[base_arg], "-gpu" ) == 0)
+            gpu = true;
+        else if (strcmp( argv[base_arg], "-fmi" ) == 0)
+            fmi = true;
+    }
+
+    if (base_arg >= argc)
     {
-        log_info(stderr,"nvSSA [-gpu] input-prefix [output-prefix]\n");
+        log_info(stderr,"nvSSA [-gpu] [-fmi] input-prefix [output-prefix]\n");
+        log_info(stderr,"  -gpu    build the SSA on the GPU\n");
+        log_info(stderr,"  -fmi    also save a single-file FM-index container (output-prefix.fmi)\n");
         exit(0);
     }
 
-    int base_arg = 0;
     const char* input;
     const char* output;
-    if (strcmp( argv[1], "-gpu" ) == 0)
-        base_arg = 2;
-    else
-        base_arg = 1;
 
     input = argv[base_arg];
     if (argc == base_arg+2)
@@ -63,9 +110,41 @@ int main(int argc, char* argv[])
     if (!driver_data.load( input ))
         return 1;
 
+    const uint32 sa_intv = nvbio::io::FMIndexData::SA_INT;
+
+    std::string sa_name  = std::string( output ) + std::string(".sa");
+    std::string rsa_name = std::string( output ) + std::string(".rsa");
+
+    if (driver_data.index_bits() == 64)
+    {
+        // the device FM-index only supports 32-bit indices
+        if (gpu)
+            log_warning(stderr, "64-bit indices are not supported on the GPU, building the SSA on the host\n");
+
+        nvbio::io::FMIndexData::SSA64_type ssa, rssa;
+
+        init_ssa( driver_data, ssa, rssa );
+
+        log_info(stderr, "saving SSA... started\n");
+        save_ssa(  sa_name.c_str(), driver_data.seq_length, driver_data.primary,  driver_data.L2_64,  sa_intv, &ssa.m_ssa[0] );
+        save_ssa( rsa_name.c_str(), driver_data.seq_length, driver_data.rprimary, driver_data.rL2_64, sa_intv, &rssa.m_ssa[0] );
+        log_info(stderr, "saving SSA... done\n");
+
+        if (fmi)
+        {
+            driver_data.ssa64.m_ssa  = &ssa.m_ssa[0];
+            driver_data.rssa64.m_ssa = &rssa.m_ssa[0];
+            driver_data.sa_words     = ssa.m_ssa.size();
+
+            if (!nvbio::io::save_fmi_container( driver_data, (std::string( output ) + ".fmi").c_str() ))
+                return 1;
+        }
+        return 0;
+    }
+
     nvbio::io::FMIndexData::SSA_type ssa, rssa;
 
-    if (strcmp( argv[1], "-gpu" ) == 0)
+    if (gpu)
     {
         nvbio::io::FMIndexDataDevice driver_data_cuda(
             driver_data,
@@ -81,33 +160,19 @@ int main(int argc, char* argv[])
     else
         init_ssa( driver_data, ssa, rssa );
 
-    const uint32 sa_intv = nvbio::io::FMIndexData::SA_INT;
-    const uint32 ssa_len = (driver_data.seq_length + sa_intv) / sa_intv;
-
     log_info(stderr, "saving SSA... started\n");
+    save_ssa(  sa_name.c_str(), driver_data.seq_length, driver_data.primary,  driver_data.L2,  sa_intv, &ssa.m_ssa[0] );
+    save_ssa( rsa_name.c_str(), driver_data.seq_length, driver_data.rprimary, driver_data.rL2, sa_intv, &rssa.m_ssa[0] );
+    log_info(stderr, "saving SSA... done\n");
+
+    if (fmi)
     {
-        std::string file_name = std::string( output ) + std::string(".sa");
-        FILE* file = fopen( file_name.c_str(), "wb" );
-
-        fwrite( &driver_data.primary,       sizeof(uint32), 1u, file );
-        fwrite( &driver_data.L2+1,          sizeof(uint32), 4u, file );
-        fwrite( &sa_intv,                   sizeof(uint32), 1u, file );
-        fwrite( &driver_data.seq_length,    sizeof(uint32), 1u, file );
-        fwrite( &ssa.m_ssa[1],              sizeof(uint32), ssa_len-1, file );
-        fclose( file );
-    }
-    {
-        std::string file_name = std::string( output ) + std::string(".rsa");
-        FILE* file = fopen( file_name.c_str(), "wb" );
-
-        fwrite( &driver_data.rprimary,      sizeof(uint32), 1u, file );
-        fwrite( &driver_data.rL2+1,         sizeof(uint32), 4u, file );
-        fwrite( &sa_intv,                   sizeof(uint32), 1u, file );
-        fwrite( &driver_data.seq_length,    sizeof(uint32), 1u, file );
-        fwrite( &rssa.m_ssa[1],             sizeof(uint32), ssa_len-1, file );
-        fclose( file );
+        driver_data.ssa.m_ssa  = &ssa.m_ssa[0];
+        driver_data.rssa.m_ssa = &rssa.m_ssa[0];
+        driver_data.sa_words   = ssa.m_ssa.size();
+
+        if (!nvbio::io::save_fmi_container( driver_data, (std::string( output ) + ".fmi").c_str() ))
+            return 1;
     }
-    log_info(stderr, "saving SSA... done\n");
     return 0;
 }
-
@@ -32,6 +32,7 @@
 #include <nvbio/basic/timer.h>
 #include <nvbio/strings/string_set.h>
 #include <nvbio/basic/shared_pointer.h>
+#include <nvbio/basic/threads.h>
 #include <nvbio/io/reads/reads.h>
 #include <nvbio/basic/dna.h>
 #include <thrust/host_vector.h>
@@ -73,12 +74,15 @@ bool read(const char* reads_name, const io::QualityEncoding qencoding, const io:
     const uint32 SYMBOLS_PER_WORD = Reads::SYMBOLS_PER_WORD;
 
     log_visible(stderr, "opening read file \"%s\"\n", reads_name);
+    // only the base pairs are needed, so skip parsing names and qualities altogether
     SharedPointer<nvbio::io::ReadDataStream> read_data_file(
         nvbio::io::open_read_file(reads_name,
         qencoding,
         uint32(-1),
         uint32(-1),
-        flags )
+        flags,
+        num_logical_cores(),
+        0u )
     );
 
     if (read_data_file == NULL || read_data_file->is_ok() == false)
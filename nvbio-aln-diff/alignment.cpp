@@ -25,6 +25,7 @@ namespace alndiff {
 
 AlignmentStream* open_dbg_file(const char* file_name);
 AlignmentStream* open_bam_file(const char* file_name);
+AlignmentStream* open_columnar_file(const char* file_name);
 
 AlignmentStream* open_alignment_file(const char* file_name)
 {
@@ -32,6 +33,8 @@ AlignmentStream* open_alignment_file(const char* file_name)
         return open_dbg_file( file_name );
     if (strcmp( file_name + strlen(file_name) - 4u, ".bam" ) == 0)
         return open_bam_file( file_name );
+    if (strcmp( file_name + strlen(file_name) - 4u, ".aln" ) == 0)
+        return open_columnar_file( file_name );
 
     return NULL;
 }
@@ -0,0 +1,179 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio-aln-diff/alignment.h>
+#include <nvbio/io/columnar_format.h>
+#include <nvbio/basic/console.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace nvbio {
+namespace alndiff {
+
+struct ColumnarAlignmentStream : public AlignmentStream
+{
+    ColumnarAlignmentStream(const char* file_name) : m_n_rows(0), m_row(0)
+    {
+        m_file = fopen( file_name, "rb" );
+        if (m_file == NULL)
+            return;
+
+        io::ColumnarFileHeader header;
+        if (fread( &header, sizeof(header), 1u, m_file ) != 1u ||
+            memcmp( header.magic, "NVAC", 4u ) != 0 ||
+            header.version != io::COLUMNAR_VERSION)
+        {
+            log_error(stderr, "\"%s\" is not a columnar alignment file\n", file_name);
+            fclose( m_file );
+            m_file = NULL;
+        }
+    }
+
+    ~ColumnarAlignmentStream()
+    {
+        if (m_file)
+            fclose( m_file );
+    }
+
+    // return if the stream is ok
+    //
+    bool is_ok() { return m_file != NULL; }
+
+    // get the next batch
+    //
+    uint32 next_batch(
+        const uint32    count,
+        Alignment*      batch)
+    {
+        uint32 n_read = 0;
+
+        while (n_read < count)
+        {
+            if (m_row == m_n_rows && read_columns() == false)
+                break;
+
+            // copy out as many rows as we can from the current batch
+            const uint32 n = nvbio::min( count - n_read, m_n_rows - m_row );
+
+            const uint32* read_id    = &m_columns[ io::COLUMNAR_READ_ID ][ m_row ];
+            const uint32* read_len   = &m_columns[ io::COLUMNAR_READ_LEN ][ m_row ];
+            const uint32* mate       = &m_columns[ io::COLUMNAR_MATE ][ m_row ];
+            const uint32* pos        = &m_columns[ io::COLUMNAR_POS ][ m_row ];
+            const uint32* ref_id     = &m_columns[ io::COLUMNAR_REF_ID ][ m_row ];
+            const uint32* flag       = &m_columns[ io::COLUMNAR_FLAG ][ m_row ];
+            const uint32* score      = &m_columns[ io::COLUMNAR_SCORE ][ m_row ];
+            const uint32* mapQ       = &m_columns[ io::COLUMNAR_MAPQ ][ m_row ];
+            const uint32* ed         = &m_columns[ io::COLUMNAR_ED ][ m_row ];
+            const uint32* subs       = &m_columns[ io::COLUMNAR_SUBS ][ m_row ];
+            const uint32* ins        = &m_columns[ io::COLUMNAR_INS ][ m_row ];
+            const uint32* dels       = &m_columns[ io::COLUMNAR_DELS ][ m_row ];
+            const uint32* mms        = &m_columns[ io::COLUMNAR_MMS ][ m_row ];
+            const uint32* gapo       = &m_columns[ io::COLUMNAR_GAPO ][ m_row ];
+            const uint32* gape       = &m_columns[ io::COLUMNAR_GAPE ][ m_row ];
+            const uint32* has_second = &m_columns[ io::COLUMNAR_HAS_SECOND ][ m_row ];
+            const uint32* sec_score  = &m_columns[ io::COLUMNAR_SEC_SCORE ][ m_row ];
+
+            Alignment* out = batch + n_read;
+            for (uint32 i = 0; i < n; ++i)
+            {
+                out[i].read_id    = read_id[i];
+                out[i].read_len   = read_len[i];
+                out[i].mate       = mate[i];
+                out[i].pos        = pos[i];
+                out[i].ref_id     = ref_id[i];
+                out[i].flag       = flag[i];
+                out[i].score      = int32( score[i] );
+                out[i].mapQ       = uint8( mapQ[i] );
+                out[i].ed         = uint8( ed[i] );
+                out[i].subs       = uint16( subs[i] );
+                out[i].ins        = uint16( ins[i] );
+                out[i].dels       = uint16( dels[i] );
+                out[i].n_mm       = uint8( mms[i] );
+                out[i].n_gapo     = uint8( gapo[i] );
+                out[i].n_gape     = uint8( gape[i] );
+                out[i].has_second = uint8( has_second[i] );
+                out[i].sec_score  = int32( sec_score[i] );
+            }
+
+            m_row  += n;
+            n_read += n;
+        }
+        return n_read;
+    }
+
+    // read and unpack the next batch of columns
+    //
+    bool read_columns()
+    {
+        io::ColumnarBatchHeader header;
+        if (fread( &header, sizeof(header), 1u, m_file ) != 1u)
+            return false;
+
+        // read the whole batch with a single bulk read
+        m_data.resize( header.size );
+        if (header.size && fread( &m_data[0], header.size, 1u, m_file ) != 1u)
+        {
+            log_error(stderr, "truncated columnar alignment file\n");
+            return false;
+        }
+
+        // columns missing from the file get the same defaults as Alignment()
+        const Alignment defaults;
+        const uint32 default_values[ io::COLUMNAR_N_COLUMNS ] = {
+            defaults.read_id,   defaults.read_len,  defaults.mate,  defaults.pos,   defaults.ref_id,
+            defaults.flag,      uint32( defaults.score ), defaults.mapQ, defaults.ed, defaults.subs,
+            defaults.ins,       defaults.dels,      defaults.n_mm,  defaults.n_gapo, defaults.n_gape,
+            defaults.has_second, uint32( defaults.sec_score ), uint32(-1), 0u };
+
+        for (uint32 c = 0; c < io::COLUMNAR_N_COLUMNS; ++c)
+            m_columns[c].assign( header.n_rows, default_values[c] );
+
+        const uint8* in = m_data.size() ? &m_data[0] : NULL;
+        for (uint32 c = 0; c < header.n_columns; ++c)
+        {
+            io::ColumnarColumnHeader column;
+            memcpy( &column, in, sizeof(column) );
+            in += sizeof(column);
+
+            // skip the columns we don't know about
+            if (column.id < io::COLUMNAR_N_COLUMNS)
+                io::columnar_unpack( column, in, header.n_rows, &m_columns[ column.id ][0] );
+
+            in += uint64( header.n_rows ) * column.width;
+        }
+
+        m_n_rows = header.n_rows;
+        m_row    = 0;
+        return true;
+    }
+
+    FILE*               m_file;
+    std::vector<uint8>  m_data;
+    std::vector<uint32> m_columns[ io::COLUMNAR_N_COLUMNS ];
+    uint32              m_n_rows;
+    uint32              m_row;
+};
+
+AlignmentStream* open_columnar_file(const char* file_name)
+{
+    return new ColumnarAlignmentStream( file_name );
+}
+
+} // alndiff namespace
+} // nvbio namespace
@@ -0,0 +1,133 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// blocking_queue_test.cpp
+//
+
+#include <nvbio/basic/threads.h>
+#include <nvbio/basic/console.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace nvbio {
+namespace { // anonymous namespace
+
+// a producer pushing a sequence of integers through a blocking queue
+//
+struct Producer : public Thread<Producer>
+{
+    Producer(BlockingQueue<uint32>* queue, const uint32 n_items) : m_queue( queue ), m_n_items( n_items ), m_pushed( 0u ) {}
+
+    void run()
+    {
+        for (uint32 i = 0; i < m_n_items; ++i)
+        {
+            if (m_queue->push( i ) == false)
+                break;
+
+            m_pushed++;
+        }
+        m_queue->close();
+    }
+
+    BlockingQueue<uint32>*  m_queue;
+    uint32                  m_n_items;
+    uint32                  m_pushed;
+};
+
+} // anonymous namespace
+
+int blocking_queue_test()
+{
+    log_info(stderr, "blocking queue test... started\n");
+
+    // check that all items are received in order
+    {
+        const uint32 n_items = 100000;
+
+        BlockingQueue<uint32> queue( 2u );
+
+        Producer producer( &queue, n_items );
+        producer.create();
+
+        uint32 n_popped = 0;
+        uint32 item;
+        while (queue.pop( &item ))
+        {
+            if (item != n_popped)
+            {
+                log_error(stderr, "  wrong item: %u != %u\n", item, n_popped);
+                exit(1);
+            }
+            n_popped++;
+        }
+        producer.join();
+
+        if (n_popped != n_items)
+        {
+            log_error(stderr, "  wrong number of items: %u != %u\n", n_popped, n_items);
+            exit(1);
+        }
+        if (queue.avg_occupancy() > float(queue.capacity()))
+        {
+            log_error(stderr, "  occupancy exceeds capacity: %.2f > %u\n", queue.avg_occupancy(), queue.capacity());
+            exit(1);
+        }
+        log_verbose(stderr, "  avg occupancy: %.2f, producer waits: %llu, consumer waits: %llu\n",
+            queue.avg_occupancy(),
+            (unsigned long long)queue.push_waits(),
+            (unsigned long long)queue.pop_waits());
+    }
+    // check that closing the queue early releases a blocked producer
+    {
+        BlockingQueue<uint32> queue( 4u );
+
+        Producer producer( &queue, 1000u );
+        producer.create();
+
+        uint32 item;
+        for (uint32 i = 0; i < 10; ++i)
+            queue.pop( &item );
+
+        queue.close();
+        producer.join();
+
+        // the producer can only have gone as far as filling the queue after the last pop
+        if (producer.m_pushed > 10u + queue.capacity())
+        {
+            log_error(stderr, "  producer ran ahead of the queue: %u items pushed\n", producer.m_pushed);
+            exit(1);
+        }
+
+        // the queued items must still be drained
+        uint32 n_drained = 0;
+        while (queue.pop( &item ))
+            n_drained++;
+
+        if (n_drained != producer.m_pushed - 10u)
+        {
+            log_error(stderr, "  wrong number of drained items: %u != %u\n", n_drained, producer.m_pushed - 10u);
+            exit(1);
+        }
+    }
+
+    log_info(stderr, "blocking queue test... done\n");
+    return 0;
+}
+
+} // namespace nvbio
@@ -0,0 +1,302 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// fmi_container_test.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/numbers.h>
+#include <nvbio/fmindex/bwt.h>
+#include <nvbio/io/fmi.h>
+#include <nvbio/io/fmi_container.h>
+
+namespace nvbio {
+namespace { // anonymous namespace
+
+// fill an in-RAM FM-index with a synthetic text: the streams are random rather than actual
+// BWTs, which is all it takes to check that the container stores them faithfully
+//
+void build_synthetic_index(io::FMIndexDataRAM& fmi, const uint32 LEN)
+{
+    typedef io::FMIndexData::nonconst_stream_type stream_type;
+
+    const uint32 OCC_INT = io::FMIndexData::OCC_INT;
+    const uint32 SA_INT  = io::FMIndexData::SA_INT;
+
+    fmi.m_flags      = io::FMIndexData::GENOME | io::FMIndexData::FORWARD | io::FMIndexData::REVERSE | io::FMIndexData::SA;
+    fmi.seq_length   = LEN;
+    fmi.seq_words    = align<4>( (LEN+15)/16 );
+    fmi.occ_words    = ((LEN+OCC_INT-1)/OCC_INT) * 4;
+    fmi.sa_words     = (LEN+SA_INT)/SA_INT;
+    fmi.primary      = rand() % LEN;
+    fmi.rprimary     = rand() % LEN;
+
+    fmi.m_genome_stream_vec.resize( fmi.seq_words, 0u );
+    fmi.m_bwt_stream_vec.resize( fmi.seq_words, 0u );
+    fmi.m_rbwt_stream_vec.resize( fmi.seq_words, 0u );
+    fmi.m_occ_vec.resize( fmi.occ_words, 0u );
+    fmi.m_rocc_vec.resize( fmi.occ_words, 0u );
+    fmi.m_ssa_vec.resize( fmi.sa_words );
+    fmi.m_rssa_vec.resize( fmi.sa_words );
+
+    fmi.m_genome_stream = &fmi.m_genome_stream_vec[0];
+    fmi.m_bwt_stream    = &fmi.m_bwt_stream_vec[0];
+    fmi.m_rbwt_stream   = &fmi.m_rbwt_stream_vec[0];
+    fmi.m_occ           = &fmi.m_occ_vec[0];
+    fmi.m_rocc          = &fmi.m_rocc_vec[0];
+    fmi.ssa.m_ssa       = &fmi.m_ssa_vec[0];
+    fmi.rssa.m_ssa      = &fmi.m_rssa_vec[0];
+    fmi.L2              = &fmi.m_L2[0];
+    fmi.rL2             = &fmi.m_rL2[0];
+    fmi.count_table     = &fmi.m_count_table[0];
+
+    stream_type genome( fmi.m_genome_stream );
+    stream_type bwt( fmi.m_bwt_stream );
+    stream_type rbwt( fmi.m_rbwt_stream );
+
+    for (uint32 i = 0; i < LEN; ++i)
+    {
+        genome[i] = rand() % 4;
+        bwt[i]    = rand() % 4;
+        rbwt[i]   = rand() % 4;
+    }
+
+    uint32 cnt[4], rcnt[4];
+    build_occurrence_table<OCC_INT>( bwt.begin(),  bwt.begin()  + LEN, fmi.m_occ,  cnt );
+    build_occurrence_table<OCC_INT>( rbwt.begin(), rbwt.begin() + LEN, fmi.m_rocc, rcnt );
+
+    fmi.L2[0] = fmi.rL2[0] = 0;
+    for (uint32 c = 0; c < 4; ++c)
+    {
+        fmi.L2[c+1]  = fmi.L2[c]  + cnt[c];
+        fmi.rL2[c+1] = fmi.rL2[c] + rcnt[c];
+    }
+
+    for (uint32 i = 0; i < fmi.sa_words; ++i)
+    {
+        fmi.m_ssa_vec[i]  = rand() % LEN;
+        fmi.m_rssa_vec[i] = rand() % LEN;
+    }
+
+    gen_bwt_count_table( fmi.count_table );
+
+    // a couple of sequences and a hole
+    const char names[] = "chr1\0chr2";
+    const char annos[] = "first\0second";
+    fmi.m_bnt_vec.names.assign( names, names + sizeof(names) );
+    fmi.m_bnt_vec.annos.assign( annos, annos + sizeof(annos) );
+    fmi.m_bnt_vec.anns.resize( 2 );
+    fmi.m_bnt_vec.ambs.resize( 1 );
+    memset( &fmi.m_bnt_vec.anns[0], 0, sizeof(io::BNTAnn) * 2 );
+    memset( &fmi.m_bnt_vec.ambs[0], 0, sizeof(io::BNTAmb) );
+    fmi.m_bnt_vec.anns[1].name_offset = 5;
+    fmi.m_bnt_vec.anns[1].anno_offset = 6;
+    fmi.m_bnt_vec.anns[1].offset      = LEN/2;
+    fmi.m_bnt_vec.anns[0].len         = LEN/2;
+    fmi.m_bnt_vec.anns[1].len         = LEN - LEN/2;
+    fmi.m_bnt_vec.ambs[0].offset      = LEN/3;
+    fmi.m_bnt_vec.ambs[0].len         = 10;
+    fmi.m_bnt_vec.ambs[0].amb         = 'N';
+
+    fmi.m_bnt_info.n_seqs    = 2;
+    fmi.m_bnt_info.seed      = 11;
+    fmi.m_bnt_info.n_holes   = 1;
+    fmi.m_bnt_info.names_len = uint32( fmi.m_bnt_vec.names.size() );
+    fmi.m_bnt_info.annos_len = uint32( fmi.m_bnt_vec.annos.size() );
+
+    fmi.m_bnt_data.names = &fmi.m_bnt_vec.names[0];
+    fmi.m_bnt_data.annos = &fmi.m_bnt_vec.annos[0];
+    fmi.m_bnt_data.anns  = &fmi.m_bnt_vec.anns[0];
+    fmi.m_bnt_data.ambs  = &fmi.m_bnt_vec.ambs[0];
+}
+
+// compare two FM-indices, table by table
+//
+bool compare(const io::FMIndexData& fmi1, const io::FMIndexData& fmi2)
+{
+    if (fmi1.index_bits() != fmi2.index_bits() ||
+        fmi1.seq_length   != fmi2.seq_length   ||
+        fmi1.seq_words    != fmi2.seq_words    ||
+        fmi1.occ_words    != fmi2.occ_words    ||
+        fmi1.sa_words     != fmi2.sa_words     ||
+        fmi1.primary      != fmi2.primary      ||
+        fmi1.rprimary     != fmi2.rprimary)
+        return false;
+
+    for (uint32 i = 0; i < 5; ++i)
+    {
+        if (fmi1.L2[i] != fmi2.L2[i] || fmi1.rL2[i] != fmi2.rL2[i])
+            return false;
+    }
+
+    if (memcmp( fmi1.m_genome_stream, fmi2.m_genome_stream, sizeof(uint32) * fmi1.seq_words ) != 0 ||
+        memcmp( fmi1.m_bwt_stream,    fmi2.m_bwt_stream,    sizeof(uint32) * fmi1.seq_words ) != 0 ||
+        memcmp( fmi1.m_rbwt_stream,   fmi2.m_rbwt_stream,   sizeof(uint32) * fmi1.seq_words ) != 0 ||
+        memcmp( fmi1.m_occ,           fmi2.m_occ,           sizeof(uint32) * fmi1.occ_words ) != 0 ||
+        memcmp( fmi1.m_rocc,          fmi2.m_rocc,          sizeof(uint32) * fmi1.occ_words ) != 0 ||
+        memcmp( fmi1.ssa.m_ssa,       fmi2.ssa.m_ssa,       sizeof(uint32) * fmi1.sa_words )  != 0 ||
+        memcmp( fmi1.rssa.m_ssa,      fmi2.rssa.m_ssa,      sizeof(uint32) * fmi1.sa_words )  != 0)
+        return false;
+
+    const io::BNTInfo& bnt1 = fmi1.m_bnt_info;
+    const io::BNTInfo& bnt2 = fmi2.m_bnt_info;
+    if (memcmp( &bnt1, &bnt2, sizeof(io::BNTInfo) ) != 0 ||
+        memcmp( fmi1.m_bnt_data.names, fmi2.m_bnt_data.names, bnt1.names_len )                   != 0 ||
+        memcmp( fmi1.m_bnt_data.annos, fmi2.m_bnt_data.annos, bnt1.annos_len )                   != 0 ||
+        memcmp( fmi1.m_bnt_data.anns,  fmi2.m_bnt_data.anns,  sizeof(io::BNTAnn) * bnt1.n_seqs )  != 0 ||
+        memcmp( fmi1.m_bnt_data.ambs,  fmi2.m_bnt_data.ambs,  sizeof(io::BNTAmb) * bnt1.n_holes ) != 0)
+        return false;
+
+    // and check the rank dictionaries agree
+    const io::FMIndexData::rank_dict_type dict1 = fmi1.rank_dict();
+    const io::FMIndexData::rank_dict_type dict2 = fmi2.rank_dict();
+    for (uint32 i = 0; i < 1000; ++i)
+    {
+        const uint32 pos = rand() % uint32( fmi1.seq_length );
+        const uint8  c   = rand() % 4;
+        if (rank( dict1, pos, c ) != rank( dict2, pos, c ))
+            return false;
+    }
+    return true;
+}
+
+// flip the bits of a byte of a file selected by mask, so that the byte is guaranteed to change
+//
+bool patch_file(const char* file_name, const uint64 offset, const uint8 mask)
+{
+    FILE* file = fopen( file_name, "r+b" );
+    if (file == NULL)
+        return false;
+
+    uint8 value = 0;
+    bool ret =
+        fseek( file, long(offset), SEEK_SET ) == 0 &&
+        fread( &value, 1u, 1u, file ) == 1u;
+
+    if (ret)
+    {
+        value ^= mask;
+        ret = fseek( file, long(offset), SEEK_SET ) == 0 &&
+              fwrite( &value, 1u, 1u, file ) == 1u;
+    }
+
+    fclose( file );
+    return ret;
+}
+
+} // anonymous namespace
+
+int fmi_container_test()
+{
+    fprintf(stderr, "FM-index container test... started\n");
+
+    const char* file_name = "fmi_container_test.fmi";
+
+    const uint32 LEN = 1000000;
+
+    io::FMIndexDataRAM fmi;
+    build_synthetic_index( fmi, LEN );
+
+    if (io::save_fmi_container( fmi, file_name ) == false)
+    {
+        log_error(stderr, "  unable to write \"%s\"\n", file_name);
+        exit(1);
+    }
+
+    // map the container back and check it matches the original index
+    {
+        io::FMIndexDataMMAP mapped_fmi;
+        if (mapped_fmi.load_file( file_name, true ) == 0)
+        {
+            log_error(stderr, "  unable to map \"%s\"\n", file_name);
+            exit(1);
+        }
+        if (compare( fmi, mapped_fmi ) == false)
+        {
+            log_error(stderr, "  mismatching mapped index\n");
+            exit(1);
+        }
+    }
+
+    // check that corrupting an occurrence table is detected by the checksums
+    {
+        io::FMIndexContainerHeader header;
+
+        FILE* file = fopen( file_name, "rb" );
+        if (file == NULL || fread( &header, sizeof(header), 1u, file ) != 1u)
+        {
+            log_error(stderr, "  unable to read \"%s\"\n", file_name);
+            exit(1);
+        }
+        fclose( file );
+
+        const io::FMIndexContainerSection& occ_section = header.sections[ io::FMIndexContainerHeader::OCC_SECTION ];
+        if (occ_section.offset % io::FMIndexContainerHeader::ALIGNMENT != 0)
+        {
+            log_error(stderr, "  misaligned occurrence table section\n");
+            exit(1);
+        }
+
+        if (patch_file( file_name, occ_section.offset + 100u, 0xFFu ) == false)
+        {
+            log_error(stderr, "  unable to patch \"%s\"\n", file_name);
+            exit(1);
+        }
+
+        io::FMIndexDataMMAP verified_fmi;
+        if (verified_fmi.load_file( file_name, true ) != 0)
+        {
+            log_error(stderr, "  corrupted section not detected\n");
+            exit(1);
+        }
+
+        // without verification the container is mapped as is
+        io::FMIndexDataMMAP unverified_fmi;
+        if (unverified_fmi.load_file( file_name, false ) == 0)
+        {
+            log_error(stderr, "  unable to map \"%s\"\n", file_name);
+            exit(1);
+        }
+
+        // while a corrupted header is always detected
+        if (patch_file( file_name, offsetof( io::FMIndexContainerHeader, primary ), 0xFFu ) == false)
+        {
+            log_error(stderr, "  unable to patch \"%s\"\n", file_name);
+            exit(1);
+        }
+
+        io::FMIndexDataMMAP corrupted_fmi;
+        if (corrupted_fmi.load_file( file_name, false ) != 0)
+        {
+            log_error(stderr, "  corrupted header not detected\n");
+            exit(1);
+        }
+    }
+
+    remove( file_name );
+
+    fprintf(stderr, "FM-index container test... done\n");
+    return 0;
+}
+
+} // namespace nvbio
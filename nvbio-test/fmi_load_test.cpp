@@ -0,0 +1,274 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// fmi_load_test.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/bnt.h>
+#include <nvbio/basic/packedstream.h>
+#include <nvbio/fmindex/bwt.h>
+#include <nvbio/io/fmi.h>
+
+namespace nvbio {
+namespace { // anonymous namespace
+
+// the BWT and sampled suffix array of a text, as the loader is expected to return them
+//
+struct ReferenceBWT
+{
+    uint64              primary;
+    std::vector<uint32> bwt;        // packed BWT words
+    std::vector<uint64> ssa;        // sampled suffix array, including the implicit empty suffix
+};
+
+// write the .bwt and .sa files of a text with index_type wide fields, sorting its suffixes with
+// sa_type (int32 or int64) entries the same way nvBWT does, and return what they hold
+//
+template <typename index_type, typename sa_type>
+ReferenceBWT write_bwt(
+    const uint32                LEN,
+    const std::vector<uint32>&  text_words,
+    const char*                 bwt_name,
+    const char*                 sa_name)
+{
+    typedef PackedStream<uint32*,uint8,2,true,index_type> stream_type;
+
+    const uint32 SA_INT    = io::FMIndexData::SA_INT;
+    const uint32 sa_size   = (LEN + SA_INT) / SA_INT;
+    const uint32 seq_words = (LEN + 15) / 16;
+
+    std::vector<uint32> text( text_words );
+    stream_type text_stream( &text[0] );
+
+    ReferenceBWT ref;
+    ref.bwt.resize( seq_words+1, 0u );
+    stream_type bwt_stream( &ref.bwt[0] );
+
+    std::vector<sa_type> sa( LEN+1 );
+    gen_sa( index_type(LEN), text_stream.begin(), &sa[0] );
+
+    ref.ssa.resize( sa_size );
+    ref.ssa[0] = uint64(-1);
+    for (uint32 i = 1; i < sa_size; ++i)
+        ref.ssa[i] = uint64( sa[ i * SA_INT ] );
+
+    ref.primary = gen_bwt_from_sa( index_type(LEN), text_stream.begin(), &sa[0], bwt_stream.begin() );
+    ref.bwt.resize( seq_words );
+
+    index_type cumFreq[4] = { 0, 0, 0, 0 };
+    for (uint32 i = 0; i < LEN; ++i)
+        ++cumFreq[ uint8( text_stream[i] ) ];
+    for (uint32 c = 1; c < 4; ++c)
+        cumFreq[c] += cumFreq[c-1];
+
+    const index_type primary = index_type( ref.primary );
+    const index_type sa_intv = index_type( SA_INT );
+    const index_type len     = index_type( LEN );
+
+    FILE* bwt_file = fopen( bwt_name, "wb" );
+    FILE* sa_file  = fopen( sa_name, "wb" );
+    if (bwt_file == NULL || sa_file == NULL)
+    {
+        log_error(stderr, "  unable to write \"%s\"\n", bwt_file == NULL ? bwt_name : sa_name);
+        exit(1);
+    }
+
+    fwrite( &primary,    sizeof(index_type), 1u,        bwt_file );
+    fwrite( cumFreq,     sizeof(index_type), 4u,        bwt_file );
+    fwrite( &ref.bwt[0], sizeof(uint32),     seq_words, bwt_file );
+
+    fwrite( &primary,    sizeof(index_type), 1u,        sa_file );
+    fwrite( cumFreq,     sizeof(index_type), 4u,        sa_file );
+    fwrite( &sa_intv,    sizeof(index_type), 1u,        sa_file );
+    fwrite( &len,        sizeof(index_type), 1u,        sa_file );
+    for (uint32 i = 1; i < sa_size; ++i)
+    {
+        const index_type entry = index_type( ref.ssa[i] );
+        fwrite( &entry, sizeof(index_type), 1u, sa_file );
+    }
+
+    fclose( bwt_file );
+    fclose( sa_file );
+    return ref;
+}
+
+// write a full index for the given text and its reverse with index_type wide .bwt/.sa fields
+//
+template <typename index_type, typename sa_type>
+void write_index(
+    const char*                 prefix,
+    const uint32                LEN,
+    const std::vector<uint32>&  text_words,
+    const std::vector<uint32>&  rtext_words,
+    ReferenceBWT&               ref,
+    ReferenceBWT&               rref)
+{
+    const std::string wpac_name = std::string( prefix ) + ".wpac";
+    const std::string bwt_name  = std::string( prefix ) + ".bwt";
+    const std::string rbwt_name = std::string( prefix ) + ".rbwt";
+    const std::string sa_name   = std::string( prefix ) + ".sa";
+    const std::string rsa_name  = std::string( prefix ) + ".rsa";
+
+    FILE* wpac_file = fopen( wpac_name.c_str(), "wb" );
+    if (wpac_file == NULL)
+    {
+        log_error(stderr, "  unable to write \"%s\"\n", wpac_name.c_str());
+        exit(1);
+    }
+    const uint64 len = LEN;
+    fwrite( &len,           sizeof(uint64), 1u,                 wpac_file );
+    fwrite( &text_words[0], sizeof(uint32), (LEN + 15) / 16,    wpac_file );
+    fclose( wpac_file );
+
+    ref  = write_bwt<index_type,sa_type>( LEN, text_words,  bwt_name.c_str(),  sa_name.c_str() );
+    rref = write_bwt<index_type,sa_type>( LEN, rtext_words, rbwt_name.c_str(), rsa_name.c_str() );
+
+    BNTSeq bnt;
+    bnt.l_pac  = LEN;
+    bnt.n_seqs = 1;
+    bnt.anns_data.resize( 1 );
+    bnt.anns_info.resize( 1 );
+    bnt.anns_data[0].len  = LEN;
+    bnt.anns_info[0].name = "chr1";
+    bnt.anns_info[0].anno = "null";
+    save_bns( bnt, prefix );
+}
+
+// check a loaded BWT and SSA against the expected ones
+//
+bool compare(const ReferenceBWT& ref, const uint64 primary, const uint32* bwt, const uint32* ssa)
+{
+    if (primary != ref.primary)
+        return false;
+
+    if (memcmp( bwt, &ref.bwt[0], sizeof(uint32) * ref.bwt.size() ) != 0)
+        return false;
+
+    for (uint32 i = 0; i < ref.ssa.size(); ++i)
+    {
+        if (ssa[i] != uint32( ref.ssa[i] ))
+            return false;
+    }
+    return true;
+}
+
+// check two reference BWTs are the same
+//
+bool operator==(const ReferenceBWT& ref1, const ReferenceBWT& ref2)
+{
+    return ref1.primary == ref2.primary &&
+           ref1.bwt     == ref2.bwt     &&
+           ref1.ssa     == ref2.ssa;
+}
+
+// remove all the files of an index
+//
+void remove_index(const char* prefix)
+{
+    const char* extensions[] = { ".wpac", ".bwt", ".rbwt", ".sa", ".rsa", ".ann", ".amb" };
+    for (uint32 i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i)
+        remove( (std::string( prefix ) + extensions[i]).c_str() );
+}
+
+} // anonymous namespace
+
+int fmi_load_test()
+{
+    fprintf(stderr, "FM-index load test... started\n");
+
+    const uint32 LEN = 100000;
+
+    // build a random text and its reverse
+    std::vector<uint32> text_words( (LEN + 15) / 16, 0u );
+    std::vector<uint32> rtext_words( (LEN + 15) / 16, 0u );
+    {
+        io::FMIndexData::nonconst_stream_type text( &text_words[0] );
+        io::FMIndexData::nonconst_stream_type rtext( &rtext_words[0] );
+
+        for (uint32 i = 0; i < LEN; ++i)
+            text[i] = rand() % 4;
+        for (uint32 i = 0; i < LEN; ++i)
+            rtext[i] = text[ LEN - i - 1u ];
+    }
+
+    const uint32 flags = io::FMIndexData::GENOME | io::FMIndexData::FORWARD | io::FMIndexData::REVERSE | io::FMIndexData::SA;
+
+    // write the same index with 32-bit fields, sorting 32-bit suffixes, and with the 64-bit
+    // fields written by BWA 0.6+ and by nvBWT's host path, sorting 64-bit suffixes: both must
+    // load as the same 32-bit index
+    ReferenceBWT ref32, rref32;
+
+    for (uint32 field_bits = 32; field_bits <= 64; field_bits += 32)
+    {
+        const char* prefix = field_bits == 32 ? "fmi_load_test32" : "fmi_load_test64";
+
+        ReferenceBWT ref, rref;
+        if (field_bits == 32)
+        {
+            write_index<uint32,int32>( prefix, LEN, text_words, rtext_words, ref, rref );
+            ref32  = ref;
+            rref32 = rref;
+        }
+        else
+        {
+            write_index<uint64,int64>( prefix, LEN, text_words, rtext_words, ref, rref );
+
+            // the 64-bit suffix sorting must produce the very same BWTs and SSAs
+            if (!(ref == ref32) || !(rref == rref32))
+            {
+                log_error(stderr, "  mismatching BWTs built with 64-bit suffixes\n");
+                exit(1);
+            }
+        }
+
+        io::FMIndexDataRAM fmi;
+        if (fmi.load( prefix, flags ) == 0)
+        {
+            log_error(stderr, "  unable to load the index with %u-bit fields\n", field_bits);
+            exit(1);
+        }
+        if (fmi.index_bits() != 32 || fmi.seq_length != LEN)
+        {
+            log_error(stderr, "  unexpected index with %u-bit fields\n", field_bits);
+            exit(1);
+        }
+        if (compare( ref, fmi.primary, fmi.m_bwt_stream, fmi.ssa.m_ssa ) == false)
+        {
+            log_error(stderr, "  mismatching forward index with %u-bit fields\n", field_bits);
+            exit(1);
+        }
+        if (compare( rref, fmi.rprimary, fmi.m_rbwt_stream, fmi.rssa.m_ssa ) == false)
+        {
+            log_error(stderr, "  mismatching reverse index with %u-bit fields\n", field_bits);
+            exit(1);
+        }
+
+        remove_index( prefix );
+    }
+
+    fprintf(stderr, "FM-index load test... done\n");
+    return 0;
+}
+
+} // namespace nvbio
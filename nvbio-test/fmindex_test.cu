@@ -45,6 +45,8 @@
 #include <nvbio/fmindex/ssa.h>
 #include <nvbio/fmindex/fmindex.h>
 #include <nvbio/fmindex/backtrack.h>
+#include <nvbio/fmindex/filter.h>
+#include <nvbio/strings/string_set.h>
 #include <nvbio/io/fmi.h>
 #include <nvbio/io/reads/reads.h>
 
@@ -382,6 +384,8 @@ void synthetic_test_host(
 
     typedef typename FMIndexType::range_type range_type;
 
+    thrust::host_vector<range_type> ranges( REQS );
+
     Timer timer;
     timer.start();
     for (uint32 i = 0; i < REQS; ++i)
@@ -393,6 +397,8 @@ void synthetic_test_host(
             text.begin() + data.input[i],
             PLEN );
 
+        ranges[i] = range;
+
         if (range.y < range.x)
         {
             fprintf(stderr, "  \nerror: unable to match pattern %u\n", data.input[i]);
@@ -403,6 +409,36 @@ void synthetic_test_host(
     timer.stop();
 
     fprintf(stderr, "\n    cpu alignment... done: %.1fms, A/s: %.2f M\n", timer.seconds()*1000.0f, REQS/(timer.seconds()*1.0e6f) );
+
+    // rank the same patterns with the host filter, which searches them in interleaved groups
+    fprintf(stderr, "    cpu filter... started\n" );
+
+    thrust::host_vector<uint2> pattern_ranges( REQS );
+    for (uint32 i = 0; i < REQS; ++i)
+        pattern_ranges[i] = make_uint2( data.input[i], data.input[i] + PLEN );
+
+    typedef SparseStringSet<typename TextType::iterator, const uint2*> pattern_set_type;
+    const pattern_set_type patterns( REQS, text.begin(), thrust::raw_pointer_cast( &pattern_ranges.front() ) );
+
+    FMIndexFilterHost<FMIndexType> filter;
+
+    timer.start();
+    filter.rank( fmi, patterns );
+    timer.stop();
+
+    for (uint32 i = 0; i < REQS; ++i)
+    {
+        if (filter.ranges()[i].x != ranges[i].x ||
+            filter.ranges()[i].y != ranges[i].y)
+        {
+            fprintf(stderr, "  \nerror : filter mismatch for pattern %u: expected (%u,%u), got (%u,%u)\n", i,
+                uint32( ranges[i].x ), uint32( ranges[i].y ),
+                uint32( filter.ranges()[i].x ), uint32( filter.ranges()[i].y ));
+            exit(1);
+        }
+    }
+
+    fprintf(stderr, "    cpu filter... done: %.1fms, Q/s: %.2f M\n", timer.seconds()*1000.0f, REQS/(timer.seconds()*1.0e6f) );
 }
 
 } // anonymous namespace
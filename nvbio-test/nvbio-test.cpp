@@ -44,6 +44,11 @@ int work_queue_test(int argc, char* argv[]);
 int string_set_test(int argc, char* argv[]);
 int sum_tree_test();
 int qgram_test(int argc, char* argv[]);
+int reads_test(int argc, char* argv[]);
+int blocking_queue_test();
+int fmi_container_test();
+int fmi_load_test();
+int output_test();
 
 namespace cuda { void scan_test(); }
 namespace aln { void test(int argc, char* argv[]); }
@@ -69,6 +74,11 @@ enum Tests {
     kAlignment      = 16384u,
     kRank           = 32768u,
     kQGram          = 65536u,
+    kReads          = 131072u,
+    kBlockingQueue  = 262144u,
+    kFMIContainer   = 524288u,
+    kOutput         = 1048576u,
+    kFMILoad        = 2097152u,
     kALL            = 0xFFFFFFFFu
 };
 
@@ -116,6 +126,8 @@ int main(int argc, char* argv[])
                 tests = kFMIndex;
             else if (strcmp( argv[arg], "-qgram" ) == 0)
                 tests = kQGram;
+            else if (strcmp( argv[arg], "-reads" ) == 0)
+                tests = kReads;
             else if (strcmp( argv[arg], "-alloc" ) == 0)
                 tests = kAlloc;
             else if (strcmp( argv[arg], "-syncblocks" ) == 0)
@@ -124,6 +136,14 @@ int main(int argc, char* argv[])
                 tests = kCondition;
             else if (strcmp( argv[arg], "-work-queue" ) == 0)
                 tests = kWorkQueue;
+            else if (strcmp( argv[arg], "-blocking-queue" ) == 0)
+                tests = kBlockingQueue;
+            else if (strcmp( argv[arg], "-fmi-container" ) == 0)
+                tests = kFMIContainer;
+            else if (strcmp( argv[arg], "-output" ) == 0)
+                tests = kOutput;
+            else if (strcmp( argv[arg], "-fmi-load" ) == 0)
+                tests = kFMILoad;
 
             ++arg;
         }
@@ -175,6 +195,7 @@ int main(int argc, char* argv[])
     if (tests & kSyncblocks)    syncblocks_test();
     if (tests & kCondition)     condition_test();
     if (tests & kWorkQueue)     work_queue_test( argc, argv+arg );
+    if (tests & kBlockingQueue) blocking_queue_test();
     if (tests & kStringSet)     string_set_test( argc, argv+arg );
     if (tests & kScan)          cuda::scan_test();
     if (tests & kAlignment)     aln::test( argc, argv+arg );
@@ -186,6 +207,10 @@ int main(int argc, char* argv[])
     if (tests & kRank)          rank_test( argc, argv+arg );
     if (tests & kFMIndex)       fmindex_test( argc, argv+arg );
     if (tests & kQGram)         qgram_test( argc, argv+arg );
+    if (tests & kReads)         reads_test( argc, argv+arg );
+    if (tests & kFMIContainer)  fmi_container_test();
+    if (tests & kFMILoad)       fmi_load_test();
+    if (tests & kOutput)        output_test();
 
     cudaDeviceReset();
 	return 0;
@@ -0,0 +1,1551 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// output_test.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <zlib/zlib.h>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/numbers.h>
+#include <nvbio/io/output/output_gzip.h>
+#include <nvbio/io/output/output_sam.h>
+#include <nvbio/io/output/output_bam_sort.h>
+#include <nvbio/io/output/output_bam_index.h>
+#include <nvbio/io/output/output_batch.h>
+#include <nvbio/io/output/output_bam.h>
+#include <nvbio/io/output/output_columnar.h>
+#include <nvbio/io/bam_format.h>
+#include <nvbio/io/columnar_format.h>
+#include <nvbio-aln-diff/alignment.h>
+#include <crc/crc.h>
+
+namespace nvbio {
+
+namespace alndiff {
+AlignmentStream* open_columnar_file(const char* file_name);
+} // namespace alndiff
+
+namespace { // anonymous namespace
+
+// read a whole file into a string
+//
+bool read_file(const char* file_name, std::string& data)
+{
+    FILE* file = fopen( file_name, "rb" );
+    if (file == NULL)
+        return false;
+
+    data.clear();
+
+    char buffer[64*1024];
+    size_t n;
+    while ((n = fread( buffer, 1u, sizeof(buffer), file )) > 0)
+        data.append( buffer, n );
+
+    fclose( file );
+    return true;
+}
+
+// compress a payload with a BGZFWriter using a given number of threads, cutting it in
+// blocks of the given sizes, and return the compressed file along with the block addresses
+//
+void write_bgzf(
+    const char*                 file_name,
+    const std::string&          payload,
+    const std::vector<uint32>&  block_sizes,
+    const uint32                n_threads,
+    std::string&                data,
+    std::vector<uint64>&        addresses)
+{
+    FILE* file = fopen( file_name, "wb" );
+    if (file == NULL)
+    {
+        log_error(stderr, "  unable to write \"%s\"\n", file_name);
+        exit(1);
+    }
+
+    io::BGZFWriter writer;
+    io::DataBuffer block;
+
+    writer.open( file, Z_DEFAULT_COMPRESSION, n_threads, true );
+
+    uint64 offset = 0;
+    for (uint32 i = 0; i < block_sizes.size(); ++i)
+    {
+        block.append_data( payload.c_str() + offset, int( block_sizes[i] ) );
+        writer.write_block( block );
+
+        offset += block_sizes[i];
+
+        // wait for the blocks in flight every now and then
+        if (i % 50u == 49u)
+            writer.flush();
+    }
+    writer.close();
+    writer.write_eof_marker();
+
+    addresses.resize( block_sizes.size() + 1u );
+    for (uint32 i = 0; i <= block_sizes.size(); ++i)
+        addresses[i] = writer.block_address( i );
+
+    fclose( file );
+
+    if (read_file( file_name, data ) == false)
+    {
+        log_error(stderr, "  unable to read \"%s\"\n", file_name);
+        exit(1);
+    }
+}
+
+// check that the BGZFWriter output doesn't depend on the number of compression threads,
+// and that it decompresses back to the original payload
+//
+void bgzf_test()
+{
+    const char* file_name = "output_test.gz";
+
+    // a compressible payload cut in blocks of random sizes, up to the largest a BGZF block can hold
+    std::vector<uint32> block_sizes( 400 );
+    std::string         payload;
+
+    const char words[][8] = { "ACGT", "TTAGGG", "N", "GATTACA", "\t", "\n", "CIGAR", "255" };
+    for (uint32 i = 0; i < block_sizes.size(); ++i)
+    {
+        block_sizes[i] = 1u + rand() % io::DataBuffer::BUFFER_SIZE;
+
+        const uint64 end = payload.size() + block_sizes[i];
+        while (payload.size() < end)
+            payload.append( rand() % 4 ? words[ rand() % 8 ] : "x" );
+
+        payload.resize( end );
+    }
+
+    std::string         reference;
+    std::vector<uint64> reference_addresses;
+    write_bgzf( file_name, payload, block_sizes, 0u, reference, reference_addresses );
+
+    const uint32 n_threads[] = { 1u, 4u };
+    for (uint32 t = 0; t < 2; ++t)
+    {
+        std::string         data;
+        std::vector<uint64> addresses;
+        write_bgzf( file_name, payload, block_sizes, n_threads[t], data, addresses );
+
+        if (data != reference)
+        {
+            log_error(stderr, "  BGZF output with %u threads differs from the synchronous one\n", n_threads[t]);
+            exit(1);
+        }
+        if (addresses != reference_addresses)
+        {
+            log_error(stderr, "  BGZF block addresses with %u threads differ from the synchronous ones\n", n_threads[t]);
+            exit(1);
+        }
+    }
+
+    // the concatenated gzip members decompress to the original payload
+    {
+        gzFile file = gzopen( file_name, "rb" );
+        if (file == NULL)
+        {
+            log_error(stderr, "  unable to open \"%s\"\n", file_name);
+            exit(1);
+        }
+
+        std::string output( payload.size() + 1u, '\0' );
+        const int n = gzread( file, &output[0], unsigned( output.size() ) );
+        gzclose( file );
+
+        if (n != int( payload.size() ) || memcmp( &output[0], payload.c_str(), payload.size() ) != 0)
+        {
+            log_error(stderr, "  BGZF output doesn't decompress to the original payload\n");
+            exit(1);
+        }
+    }
+    remove( file_name );
+}
+
+// fill a SAM record with the given fields, leaving the tags to the caller
+//
+void set_sam_alignment(
+    io::SamOutput::SamAlignment&    aln,
+    const char*                     qname,
+    const uint32                    flags,
+    const char*                     rname,
+    const uint32                    pos,
+    const uint32                    mapq,
+    const char*                     cigar,
+    const char*                     rnext,
+    const uint32                    pnext,
+    const int32                     tlen,
+    const char*                     seq,
+    const char*                     qual,
+    const char*                     md)
+{
+    aln.qname       = qname;
+    aln.flags       = flags;
+    aln.rname       = rname;
+    aln.rname_len   = uint32( strlen( rname ) );
+    aln.pos         = pos;
+    aln.mapq        = uint8( mapq );
+    aln.rnext       = rnext;
+    aln.rnext_len   = rnext ? uint32( strlen( rnext ) ) : 0u;
+    aln.pnext       = pnext;
+    aln.tlen        = tlen;
+    aln.qual_len    = uint32( strlen( qual ) );
+    aln.cigar_len   = uint32( strlen( cigar ) );
+    aln.md_len      = uint32( strlen( md ) );
+    strcpy( aln.cigar,     cigar );
+    strcpy( aln.seq,       seq );
+    strcpy( aln.qual,      qual );
+    strcpy( aln.md_string, md );
+
+    aln.ed = aln.score = aln.second_score = aln.mm = aln.gapo = aln.gape = 0;
+    aln.second_score_valid = false;
+}
+
+// render a fixed batch of alignments with the SAM record formatter and check the text
+// against the expected records
+//
+void sam_format_test()
+{
+    std::vector<io::SamOutput::SamAlignment> batch( 4 );
+    std::vector<const char*>                 expected( 4 );
+
+    // a mapped single-end read with a second best score and a mismatch
+    set_sam_alignment( batch[0], "read0", 0u, "chr1", 100u, 42u, "8M", NULL, 0u, 0, "ACGTACGT", "IIIIHHHH", "3A4" );
+    batch[0].ed                 = 1;
+    batch[0].score              = -6;
+    batch[0].second_score       = -12;
+    batch[0].second_score_valid = true;
+    batch[0].mm                 = 1;
+    expected[0] = "read0\t0\tchr1\t100\t42\t8M\t*\t0\t0\tACGTACGT\tIIIIHHHH\tNM:i:1\tAS:i:-6\tXS:i:-12\tXM:i:1\tXO:i:0\tXG:i:0\tMD:Z:3A4\n";
+
+    // the reverse-complemented first mate of a pair, with a gap and omitted qualities
+    set_sam_alignment( batch[1], "pair0/1", 0x1u | 0x2u | 0x10u | 0x40u, "chr2", 4294967295u, 255u, "3M1D2M", "=", 1000u, -1234567, "GATTAC", "*", "3^T2" );
+    batch[1].ed                 = 1;
+    batch[1].score              = -2147483647 - 1;
+    batch[1].gapo               = 1;
+    batch[1].gape               = 1;
+    expected[1] = "pair0/1\t83\tchr2\t4294967295\t255\t3M1D2M\t=\t1000\t-1234567\tGATTAC\t*\tNM:i:1\tAS:i:-2147483648\tXM:i:0\tXO:i:1\tXG:i:1\tMD:Z:3^T2\n";
+
+    // a mapped read without an MD string
+    set_sam_alignment( batch[2], "read1", 0x100u, "scaffold_7", 1u, 0u, "1M", NULL, 0u, 0, "N", "!", "" );
+    expected[2] = "read1\t256\tscaffold_7\t1\t0\t1M\t*\t0\t0\tN\t!\tNM:i:0\tAS:i:0\tXM:i:0\tXO:i:0\tXG:i:0\tMD:Z:*\n";
+
+    // an unmapped read: everything but the name, flags, sequence and qualities is blank
+    set_sam_alignment( batch[3], "read2", 0x4u, "", 0u, 0u, "", NULL, 0u, 0, "ACGTN", "#####", "" );
+    batch[3].ed = 3;
+    expected[3] = "read2\t4\t*\t0\t0\t*\t*\t0\t0\tACGTN\t#####\n";
+
+    std::string text;
+    std::string expected_text;
+    for (uint32 i = 0; i < batch.size(); ++i)
+    {
+        const uint32 read_len = uint32( strlen( batch[i].seq ) );
+        const uint32 max_size = io::SamOutput::max_alignment_size( batch[i], read_len );
+
+        std::vector<char> buffer( max_size );
+        char* end = io::SamOutput::format_alignment( &buffer[0], batch[i], read_len );
+
+        if (end < &buffer[0] || end > &buffer[0] + max_size)
+        {
+            log_error(stderr, "  SAM record %u overflows its %u bytes size bound\n", i, max_size);
+            exit(1);
+        }
+        text.append( &buffer[0], end - &buffer[0] );
+        expected_text.append( expected[i] );
+    }
+
+    if (text != expected_text)
+    {
+        log_error(stderr, "  SAM records differ from the expected text:\n%s\nexpected:\n%s\n", text.c_str(), expected_text.c_str());
+        exit(1);
+    }
+
+    // Illumina's 8-level quality binning, on both sides of each bin boundary
+    const uint8 qualities[] = { 0, 1, 2, 9, 10, 19, 20, 24, 25, 29, 30, 34, 35, 39, 40, 41, 93 };
+    const uint8 bins[]      = { 0, 1, 6, 6, 15, 15, 22, 22, 27, 27, 33, 33, 37, 37, 40, 40, 40 };
+    for (uint32 i = 0; i < sizeof(qualities); ++i)
+    {
+        if (io::bin_quality( qualities[i] ) != bins[i])
+        {
+            log_error(stderr, "  quality %u binned to %u, expected %u\n", qualities[i], io::bin_quality( qualities[i] ), bins[i]);
+            exit(1);
+        }
+    }
+}
+
+// a BAM record of the sort test, along with the reference span of its alignment
+//
+struct SortRecord
+{
+    int32               ref_id;
+    int32               pos;
+    int32               pos_end;
+    uint32              id;         // the order in which the record was added to the sorter
+    std::vector<char>   data;
+};
+
+// build a BAM record named after its id, with a CIGAR made of a match, an optional
+// deletion of the given length and another match
+//
+void make_sort_record(SortRecord& r, const uint32 id, const int32 ref_id, const int32 pos, const uint32 read_len, const uint32 del_len)
+{
+    char name[16];
+    sprintf( name, "r%u", id );
+    const uint32 l_read_name = uint32( strlen( name ) ) + 1u;
+
+    std::vector<uint32> cigar;
+    if (del_len)
+    {
+        cigar.push_back( ((read_len/2) << 4) | 0u );
+        cigar.push_back( (del_len << 4) | 2u );
+        cigar.push_back( ((read_len - read_len/2) << 4) | 0u );
+    }
+    else
+        cigar.push_back( (read_len << 4) | 0u );
+
+    r.ref_id  = ref_id;
+    r.pos     = pos;
+    r.pos_end = ref_id < 0 ? pos : pos + int32( read_len + del_len );
+    r.id      = id;
+
+    const uint32 flag   = ref_id < 0 ? 4u : 0u;
+    const uint32 bin    = ref_id < 0 ? 4680u : io::bam_reg2bin( r.pos, r.pos_end );
+    const int32 fields[8] = {
+        0,                                                  // block_size, patched below
+        ref_id,
+        pos,
+        int32( (bin << 16) | (60u << 8) | l_read_name ),
+        int32( (flag << 16) | uint32( cigar.size() ) ),
+        int32( read_len ),
+        -1,
+        -1 };
+
+    r.data.assign( (const char*)fields, (const char*)fields + sizeof(fields) );
+
+    const int32 tlen = 0;
+    r.data.insert( r.data.end(), (const char*)&tlen, (const char*)&tlen + sizeof(int32) );
+    r.data.insert( r.data.end(), name, name + l_read_name );
+    r.data.insert( r.data.end(), (const char*)&cigar[0], (const char*)&cigar[0] + cigar.size() * sizeof(uint32) );
+    r.data.insert( r.data.end(), (read_len + 1u)/2u, char(0x12) );  // ACAC...
+    r.data.insert( r.data.end(), read_len, char(30) );
+
+    const int32 block_size = int32( r.data.size() - sizeof(int32) );
+    memcpy( &r.data[0], &block_size, sizeof(int32) );
+}
+
+// the BAI contents of a reference
+//
+struct BaiReference
+{
+    std::map< uint32, std::vector<uint64> >     bins;       // pairs of chunk begin / end virtual offsets
+    std::vector<uint64>                         intervals;
+};
+
+// fetch a value from a BAI file, failing if it's truncated
+//
+template <typename T>
+T read_bai_value(const std::string& bai, uint64& offset)
+{
+    if (offset + sizeof(T) > bai.size())
+    {
+        log_error(stderr, "  truncated BAI file\n");
+        exit(1);
+    }
+    T value;
+    memcpy( &value, &bai[offset], sizeof(T) );
+    offset += sizeof(T);
+    return value;
+}
+
+// sort a shuffled set of records across several spills, write them out as BAM blocks along with
+// their BAI index, and check the record order, the bins and the linear index
+//
+void bam_sort_test()
+{
+    const char* bam_name = "output_test.bam";
+    const char* bai_name = "output_test.bam.bai";
+
+    const uint32 n_refs      = 3;
+    const int32  ref_lens[3] = { 1000000, 200000, 60000 };
+    const uint32 n_records   = 20000;
+
+    // records come in random order; a few share their coordinates, a few span several
+    // windows of the linear index, and a few are unplaced
+    std::vector<SortRecord> records( n_records );
+    for (uint32 i = 0; i < n_records; ++i)
+    {
+        const uint32 read_len = 50u + rand() % 101u;
+
+        if (rand() % 20 == 0)
+            make_sort_record( records[i], i, -1, -1, read_len, 0u );
+        else
+        {
+            const int32  ref_id  = rand() % n_refs;
+            const int32  pos     = rand() % 10 == 0 ? rand() % 100 : rand() % (ref_lens[ref_id] - 50000);
+            const uint32 del_len = rand() % 50 == 0 ? rand() % 40000 : 0u;
+            make_sort_record( records[i], i, ref_id, pos, read_len, del_len );
+        }
+    }
+
+    // a small memory budget forces several spills
+    io::BamRecordSorter sorter( "output_test.sort", 256*1024 );
+    {
+        io::DataBuffer block;
+        for (uint32 i = 0; i < n_records; ++i)
+        {
+            if (block.get_pos() + int( records[i].data.size() ) > io::DataBuffer::BUFFER_SIZE)
+            {
+                sorter.add( block );
+                block.rewind();
+            }
+            block.append_data( &records[i].data[0], int( records[i].data.size() ) );
+        }
+        sorter.add( block );
+    }
+    sorter.finish();
+
+    if (sorter.spilled_runs() < 4)
+    {
+        log_error(stderr, "  expected the sort to spill several runs, got %u\n", sorter.spilled_runs());
+        exit(1);
+    }
+
+    FILE* file = fopen( bam_name, "wb" );
+    if (file == NULL)
+    {
+        log_error(stderr, "  unable to write \"%s\"\n", bam_name);
+        exit(1);
+    }
+
+    // write out the sorted records the way BamOutput does, keeping track of their offsets
+    io::BGZFWriter          writer;
+    io::DataBuffer          block;
+    io::BamIndexBuilder     index( n_refs );
+    std::vector<uint32>     sorted_ids;
+    std::vector<uint64>     begins;
+    std::vector<uint64>     ends;
+    std::vector<uint64>     data_offsets;
+    std::string             sorted_data;
+
+    writer.open( file, Z_DEFAULT_COMPRESSION, 2u, true );
+
+    const char* record;
+    uint32      record_size;
+    while (sorter.next( &record, &record_size ))
+    {
+        if (block.get_pos() + record_size > io::DataBuffer::BUFFER_SIZE)
+            writer.write_block( block );
+
+        const uint64 begin = (writer.block_count() << 16) | block.get_pos();
+        block.append_data( record, record_size );
+        const uint64 end   = (writer.block_count() << 16) | block.get_pos();
+
+        index.add( record, begin, end );
+
+        // recover the record id from its name
+        sorted_ids.push_back( uint32( atoi( record + 36 + 1 ) ) );
+        begins.push_back( begin );
+        ends.push_back( end );
+        data_offsets.push_back( sorted_data.size() );
+        sorted_data.append( record, record_size );
+    }
+    if (block.get_pos())
+        writer.write_block( block );
+
+    writer.close();
+    writer.write_eof_marker();
+    fclose( file );
+
+    if (index.write( bai_name, writer ) == false)
+        exit(1);
+
+    // all the records come back, sorted by coordinate, unplaced ones last, and ties in insertion order
+    if (sorted_ids.size() != n_records)
+    {
+        log_error(stderr, "  sorted %u records, expected %u\n", uint32( sorted_ids.size() ), n_records);
+        exit(1);
+    }
+    {
+        std::vector<bool> seen( n_records, false );
+        for (uint32 i = 0; i < n_records; ++i)
+        {
+            const uint32 id = sorted_ids[i];
+            if (id >= n_records || seen[id] ||
+                sorted_data.compare( data_offsets[i], records[id].data.size(), &records[id].data[0], records[id].data.size() ) != 0)
+            {
+                log_error(stderr, "  sorted record %u is lost, duplicated or corrupted\n", i);
+                exit(1);
+            }
+            seen[id] = true;
+
+            if (i == 0)
+                continue;
+
+            const SortRecord& p = records[ sorted_ids[i-1] ];
+            const SortRecord& r = records[ id ];
+            const uint64 p_key = (uint64( uint32( p.ref_id ) ) << 32) | uint32( p.pos );
+            const uint64 r_key = (uint64( uint32( r.ref_id ) ) << 32) | uint32( r.pos );
+            if (p_key > r_key || (p_key == r_key && p.id > r.id))
+            {
+                log_error(stderr, "  sorted records %u and %u are out of order\n", i-1, i);
+                exit(1);
+            }
+        }
+    }
+
+    // the BGZF file decompresses to the sorted records
+    {
+        gzFile gz = gzopen( bam_name, "rb" );
+        std::string output( sorted_data.size() + 1u, '\0' );
+        const int n = gz ? gzread( gz, &output[0], unsigned( output.size() ) ) : -1;
+        if (gz)
+            gzclose( gz );
+
+        if (n != int( sorted_data.size() ) || memcmp( &output[0], sorted_data.c_str(), sorted_data.size() ) != 0)
+        {
+            log_error(stderr, "  sorted BAM blocks don't decompress to the sorted records\n");
+            exit(1);
+        }
+    }
+
+    // parse the index
+    std::string bai;
+    if (read_file( bai_name, bai ) == false || bai.size() < 8 || memcmp( bai.c_str(), "BAI\1", 4 ) != 0)
+    {
+        log_error(stderr, "  \"%s\" is not a BAI file\n", bai_name);
+        exit(1);
+    }
+
+    std::vector<BaiReference> bai_refs( n_refs );
+    std::vector<uint64>       n_mapped( n_refs, 0u );
+    uint64 offset = 4;
+    if (read_bai_value<int32>( bai, offset ) != int32( n_refs ))
+    {
+        log_error(stderr, "  wrong number of references in the BAI file\n");
+        exit(1);
+    }
+    for (uint32 r = 0; r < n_refs; ++r)
+    {
+        const int32 n_bin = read_bai_value<int32>( bai, offset );
+        for (int32 b = 0; b < n_bin; ++b)
+        {
+            const uint32 bin     = read_bai_value<uint32>( bai, offset );
+            const int32  n_chunk = read_bai_value<int32>( bai, offset );
+            for (int32 c = 0; c < 2*n_chunk; ++c)
+                bai_refs[r].bins[bin].push_back( read_bai_value<uint64>( bai, offset ) );
+        }
+        const int32 n_intv = read_bai_value<int32>( bai, offset );
+        for (int32 w = 0; w < n_intv; ++w)
+            bai_refs[r].intervals.push_back( read_bai_value<uint64>( bai, offset ) );
+
+        // the pseudo-bin holds the reference span and its number of mapped and unmapped reads
+        if (bai_refs[r].bins[37450].size() == 4)
+            n_mapped[r] = bai_refs[r].bins[37450][2];
+        bai_refs[r].bins.erase( 37450 );
+    }
+    const uint64 n_no_coor = read_bai_value<uint64>( bai, offset );
+
+    // check each placed record is covered by a chunk of its bin, and by the linear index of the windows it overlaps
+    uint64 n_unplaced = 0;
+    std::vector<uint64> ref_counts( n_refs, 0u );
+    std::vector< std::vector<uint64> > first_offsets( n_refs );
+    for (uint32 i = 0; i < n_records; ++i)
+    {
+        const SortRecord& r = records[ sorted_ids[i] ];
+        if (r.ref_id < 0)
+        {
+            n_unplaced++;
+            continue;
+        }
+        ref_counts[ r.ref_id ]++;
+
+        const uint64 vbegin = (writer.block_address( begins[i] >> 16 ) << 16) | (begins[i] & 0xffff);
+        const uint64 vend   = (writer.block_address( ends[i]   >> 16 ) << 16) | (ends[i]   & 0xffff);
+
+        const std::vector<uint64>& chunks = bai_refs[ r.ref_id ].bins[ io::bam_reg2bin( r.pos, r.pos_end ) ];
+
+        bool covered = false;
+        for (uint32 c = 0; c < chunks.size(); c += 2)
+            covered |= chunks[c] <= vbegin && vend <= chunks[c+1];
+
+        if (covered == false)
+        {
+            log_error(stderr, "  record %u at %d:%d isn't covered by the chunks of its bin\n", sorted_ids[i], r.ref_id, r.pos);
+            exit(1);
+        }
+
+        std::vector<uint64>& first = first_offsets[ r.ref_id ];
+        const uint32 last_window = uint32( r.pos_end - 1 ) >> 14;
+        if (first.size() <= last_window)
+            first.resize( last_window + 1u, uint64(-1) );
+
+        for (uint32 w = uint32( r.pos ) >> 14; w <= last_window; ++w)
+            first[w] = std::min( first[w], vbegin );
+    }
+
+    for (uint32 r = 0; r < n_refs; ++r)
+    {
+        // each window points to the first record overlapping it
+        const std::vector<uint64>& intervals = bai_refs[r].intervals;
+        if (intervals.size() != first_offsets[r].size())
+        {
+            log_error(stderr, "  reference %u has %u linear index windows, expected %u\n", r, uint32( intervals.size() ), uint32( first_offsets[r].size() ));
+            exit(1);
+        }
+        for (uint32 w = 0; w < intervals.size(); ++w)
+        {
+            if (first_offsets[r][w] != uint64(-1) && intervals[w] != first_offsets[r][w])
+            {
+                log_error(stderr, "  wrong linear index entry for window %u of reference %u\n", w, r);
+                exit(1);
+            }
+        }
+
+        if (n_mapped[r] != ref_counts[r])
+        {
+            log_error(stderr, "  reference %u has %llu mapped reads in the index, expected %llu\n", r, (unsigned long long)n_mapped[r], (unsigned long long)ref_counts[r]);
+            exit(1);
+        }
+    }
+    if (n_no_coor != n_unplaced)
+    {
+        log_error(stderr, "  the index counts %llu unplaced reads, expected %llu\n", (unsigned long long)n_no_coor, (unsigned long long)n_unplaced);
+        exit(1);
+    }
+
+    remove( bam_name );
+    remove( bai_name );
+}
+
+// a reference made of a few sequences, standing in for the FM-index the outputs resolve
+// alignment positions against
+//
+struct TestReference
+{
+    static const uint32 N_SEQS = 3;
+
+    TestReference()
+    {
+        const char*  seq_names[N_SEQS] = { "chr1", "chr2", "chrM" };
+        const int32  seq_lens[N_SEQS]  = { 100000, 70000, 16569 };
+
+        anns.resize( N_SEQS );
+
+        int64 offset = 0;
+        for (uint32 i = 0; i < N_SEQS; ++i)
+        {
+            memset( &anns[i], 0, sizeof(io::BNTAnn) );
+            anns[i].name_offset = uint32( names.size() );
+            anns[i].offset      = offset;
+            anns[i].len         = seq_lens[i];
+
+            names.insert( names.end(), seq_names[i], seq_names[i] + strlen( seq_names[i] ) + 1u );
+            offset += seq_lens[i];
+        }
+        annos.push_back( '\0' );
+
+        fmi.m_bnt_info.n_seqs    = N_SEQS;
+        fmi.m_bnt_info.seed      = 0;
+        fmi.m_bnt_info.n_holes   = 0;
+        fmi.m_bnt_info.names_len = uint32( names.size() );
+        fmi.m_bnt_info.annos_len = uint32( annos.size() );
+        fmi.m_bnt_data.names     = &names[0];
+        fmi.m_bnt_data.annos     = &annos[0];
+        fmi.m_bnt_data.anns      = &anns[0];
+        fmi.m_bnt_data.ambs      = NULL;
+    }
+
+    // the index of the sequence holding a global position
+    uint32 locate(const uint32 pos) const
+    {
+        uint32 r = 0;
+        while (r + 1u < N_SEQS && anns[r+1].offset <= pos)
+            ++r;
+        return r;
+    }
+
+    io::FMIndexData         fmi;
+    std::vector<char>       names;
+    std::vector<char>       annos;
+    std::vector<io::BNTAnn> anns;
+};
+
+// a mapping quality depending on the edit distance of the alignment only
+//
+struct TestMapQ : public io::MapQEvaluator
+{
+    int compute_mapq(const io::AlignmentData& alignment, const io::AlignmentData& mate) const
+    {
+        return 3 + 10 * int( alignment.best->ed() );
+    }
+};
+
+// a small deterministic hash, so that the same synthetic reads can be generated over and over
+//
+inline uint32 test_hash(uint32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// a read of the synthetic batches, along with its best and second best alignments
+//
+struct TestRead
+{
+    std::string     name;
+    std::string     seq;
+    std::string     qual;
+    io::Alignment   best;
+    io::Alignment   second_best;
+};
+
+// the deterministic contents of a mate of the i-th read of the k-th synthetic batch: reads
+// of varying lengths, with qualities spanning the whole Phred range, placed at random on the
+// reference with signed scores; the pairs cycle through all the combinations of mapped and
+// unmapped mates
+//
+TestRead make_test_read(const TestReference& ref, const uint32 k, const uint32 i, const uint32 mate)
+{
+    uint32 h = test_hash( ((k * 1000003u) + i) * 2u + mate );
+
+    TestRead read;
+
+    char name[32];
+    sprintf( name, "batch%u.read%u", k, i );
+    read.name = name;
+
+    const uint32 read_len = 20u + h % 61u;
+    for (uint32 j = 0; j < read_len; ++j)
+    {
+        h = test_hash( h );
+        read.seq.push_back( "ACGTACGTACGTACGN"[ h % 16u ] );
+        read.qual.push_back( char( 33u + (h >> 8) % 42u ) );
+    }
+
+    const bool aligned = (i % 4u == 0u) || (i % 4u == 1u && mate == 0u) || (i % 4u == 2u && mate == 1u);
+    if (aligned == false)
+    {
+        read.best        = io::Alignment::invalid();
+        read.second_best = io::Alignment::invalid();
+        return read;
+    }
+
+    h = test_hash( h );
+    const uint32 r   = h % TestReference::N_SEQS;
+    const uint32 pos = uint32( ref.anns[r].offset ) + (h >> 4) % (ref.anns[r].len - read_len);
+
+    h = test_hash( h );
+    const int32 score = int32( h % 600u ) - 500;
+
+    read.best = io::Alignment( pos, h % 4u, score, (h >> 10) & 1u, mate, ((h >> 11) % 3u) != 0u );
+
+    read.second_best = ((h >> 12) & 1u) ?
+        io::Alignment( uint32( ref.anns[0].offset ) + (h >> 13) % 1000u, 5u, score - int32( (h >> 16) % 50u ), 0u, mate, false ) :
+        io::Alignment::invalid();
+
+    return read;
+}
+
+// build the host reads of a mate of the k-th synthetic batch, as nvBowtie loads them
+//
+void make_test_reads(const TestReference& ref, const uint32 k, const uint32 n_reads, const uint32 mate, io::ReadDataRAM& reads)
+{
+    for (uint32 i = 0; i < n_reads; ++i)
+    {
+        const TestRead read = make_test_read( ref, k, i, mate );
+
+        reads.push_back(
+            uint32( read.seq.size() ),
+            read.name.c_str(),
+            (const uint8*)read.seq.c_str(),
+            (const uint8*)read.qual.c_str(),
+            io::Phred33,
+            uint32(-1),
+            io::ReadDataRAM::REVERSE_OP );
+    }
+    reads.end_batch();
+}
+
+// fill a host output batch with the alignments of the k-th synthetic batch on top of the
+// reads of its mates, the way the GPU passes read them back
+//
+void make_test_batch(
+    const TestReference&    ref,
+    const uint32            k,
+    const uint32            n_reads,
+    const io::ReadData*     reads1,
+    const io::ReadData*     reads2,
+    io::CPUOutputBatch&     batch)
+{
+    const uint32 n_mates = reads2 ? 2u : 1u;
+
+    batch.count = n_reads;
+    batch.read_data[ io::MATE_1 ] = reads1;
+    batch.read_data[ io::MATE_2 ] = reads2;
+
+    batch.best_alignments.resize( n_reads );
+
+    for (uint32 m = 0; m < n_mates; ++m)
+    {
+        io::HostCigarArray& cigar = batch.cigar[m];
+        io::HostMdsArray&   mds   = batch.mds[m];
+
+        cigar.array.m_arena.resize( n_reads );
+        cigar.array.m_index.resize( n_reads );
+        cigar.coords.resize( n_reads );
+        mds.m_arena.resize( n_reads * 4u );
+        mds.m_index.resize( n_reads );
+
+        for (uint32 i = 0; i < n_reads; ++i)
+        {
+            const TestRead read     = make_test_read( ref, k, i, m );
+            const uint32   read_len = uint32( read.seq.size() );
+
+            io::AlignmentResult& result = batch.best_alignments[i];
+            result.best[m]        = read.best;
+            result.second_best[m] = read.second_best;
+            result.is_paired_end  = n_mates == 2u;
+
+            // a CIGAR and an MD string matching the whole read
+            cigar.array.m_arena[i] = io::Cigar( io::Cigar::SUBSTITUTION, uint16( read_len ) );
+            cigar.array.m_index[i] = i;
+            cigar.coords[i]        = make_uint2( 0u, 1u );
+
+            mds.m_arena[ i*4u + 0u ] = 4u;
+            mds.m_arena[ i*4u + 1u ] = 0u;
+            mds.m_arena[ i*4u + 2u ] = io::MDS_MATCH;
+            mds.m_arena[ i*4u + 3u ] = uint8( read_len );
+            mds.m_index[i]           = i*4u;
+        }
+    }
+}
+
+// an output file fed with host batches, standing in for the GPU alignment passes
+//
+template <typename OutputType>
+struct HostOutputFile : public OutputType
+{
+    HostOutputFile(const char* file_name, const io::AlignmentType type, io::BNT bnt)
+        : OutputType( file_name, type, bnt ) {}
+
+    template <typename A1, typename A2, typename A3, typename A4>
+    HostOutputFile(const char* file_name, const io::AlignmentType type, io::BNT bnt, A1 a1, A2 a2, A3 a3, A4 a4)
+        : OutputType( file_name, type, bnt, a1, a2, a3, a4 ) {}
+
+    template <typename A1, typename A2, typename A3, typename A4, typename A5>
+    HostOutputFile(const char* file_name, const io::AlignmentType type, io::BNT bnt, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5)
+        : OutputType( file_name, type, bnt, a1, a2, a3, a4, a5 ) {}
+
+    // write the batches out through the background thread, as OutputFile::open does
+    void set_queue_depth(const uint32 queue_depth) { this->start_output_thread( queue_depth ); }
+
+    // process a whole batch of alignments
+    void push(const io::CPUOutputBatch& batch)
+    {
+        this->start_batch( batch.read_data[ io::MATE_1 ], batch.read_data[ io::MATE_2 ] );
+        *this->cpu_batch = batch;
+        this->end_batch();
+    }
+};
+
+// the columnar row ColumnarOutput is expected to write for a mate of a synthetic pair
+//
+void expected_columnar_row(
+    const TestReference&    ref,
+    const TestRead&         read,
+    const TestRead&         mate_read,
+    const uint32            mate,
+    const uint32            mapq,
+    uint32*                 row)
+{
+    const io::Alignment& aln = read.best;
+
+    row[ io::COLUMNAR_READ_ID ]  = crcCalc( read.name.c_str(), uint32( read.name.size() ) );
+    row[ io::COLUMNAR_READ_LEN ] = uint32( read.seq.size() );
+    row[ io::COLUMNAR_MATE ]     = mate;
+
+    if (mate_read.best.is_aligned())
+    {
+        const uint32 r = ref.locate( mate_read.best.alignment() );
+        row[ io::COLUMNAR_MATE_POS ]    = mate_read.best.alignment() - uint32( ref.anns[r].offset ) + 1u;
+        row[ io::COLUMNAR_MATE_REF_ID ] = r;
+    }
+    else
+    {
+        row[ io::COLUMNAR_MATE_POS ]    = 0u;
+        row[ io::COLUMNAR_MATE_REF_ID ] = uint32(-1);
+    }
+
+    const uint32 read_flag = mate ? 128u : 64u;
+
+    if (aln.is_aligned() == false)
+    {
+        row[ io::COLUMNAR_POS ]        = 0u;
+        row[ io::COLUMNAR_REF_ID ]     = uint32(-1);
+        row[ io::COLUMNAR_FLAG ]       = 4u | read_flag;
+        row[ io::COLUMNAR_SCORE ]      = uint32(-65536);
+        row[ io::COLUMNAR_MAPQ ]       = 0u;
+        row[ io::COLUMNAR_ED ]         = 255u;
+        row[ io::COLUMNAR_SUBS ]       = 0u;
+        row[ io::COLUMNAR_HAS_SECOND ] = 0u;
+        row[ io::COLUMNAR_SEC_SCORE ]  = uint32(-65536);
+    }
+    else
+    {
+        const uint32 r = ref.locate( aln.alignment() );
+        row[ io::COLUMNAR_POS ]        = aln.alignment() - uint32( ref.anns[r].offset ) + 1u;
+        row[ io::COLUMNAR_REF_ID ]     = r;
+        row[ io::COLUMNAR_FLAG ]       = read_flag |
+                                         (aln.is_rc()                          ? 16u : 0u) |
+                                         (aln.is_paired()                      ?  2u : 0u) |
+                                         (mate_read.best.is_aligned() == false ?  8u : 0u);
+        row[ io::COLUMNAR_SCORE ]      = uint32( aln.score() );
+        row[ io::COLUMNAR_MAPQ ]       = mapq;
+        row[ io::COLUMNAR_ED ]         = aln.ed();
+        row[ io::COLUMNAR_SUBS ]       = uint32( read.seq.size() );
+        row[ io::COLUMNAR_HAS_SECOND ] = read.second_best.is_aligned() ? 1u : 0u;
+        row[ io::COLUMNAR_SEC_SCORE ]  = uint32( read.second_best.is_aligned() ? read.second_best.score() : -32768 );
+    }
+
+    // the synthetic alignments have no gaps nor mismatches
+    row[ io::COLUMNAR_INS ]  = 0u;
+    row[ io::COLUMNAR_DELS ] = 0u;
+    row[ io::COLUMNAR_MMS ]  = 0u;
+    row[ io::COLUMNAR_GAPO ] = 0u;
+    row[ io::COLUMNAR_GAPE ] = 0u;
+}
+
+// check the frame-of-reference coding of the columnar format on signed and unsigned columns
+// needing each of the available widths
+//
+void columnar_format_test()
+{
+    const uint32 n = 1000;
+    const uint32 ranges[3] = { 0xFFu, 0xFFFFu, 0xFFFFFFFFu };
+
+    std::vector<uint32> values( n );
+    std::vector<uint32> unpacked( n );
+    std::vector<uint8>  packed( n * 4u );
+
+    for (uint32 w = 0; w < 3; ++w)
+    {
+        for (uint32 is_signed = 0; is_signed < 2; ++is_signed)
+        {
+            const uint32 id = is_signed ? io::COLUMNAR_SCORE : io::COLUMNAR_READ_ID;
+
+            // signed values straddle zero, unsigned ones the top of the range
+            const uint32 base = is_signed ? uint32( -int32( ranges[w] / 2u ) ) : ~ranges[w];
+            for (uint32 i = 0; i < n; ++i)
+                values[i] = base + (w == 2 ? test_hash( i ) : test_hash( i ) % (ranges[w] + 1u));
+
+            // make sure the whole range is used
+            values[0] = base;
+            values[1] = base + ranges[w];
+
+            io::ColumnarColumnHeader header;
+            const uint64 size = io::columnar_setup( id, &values[0], n, &header );
+
+            if (header.id != id || header.width != (1u << w) || size != uint64( n ) * header.width)
+            {
+                log_error(stderr, "  wrong %u-byte %s column header (width %u)\n", 1u << w, is_signed ? "signed" : "unsigned", header.width);
+                exit(1);
+            }
+            if (w < 2 && header.base != base)
+            {
+                log_error(stderr, "  wrong %u-byte %s column base (%d, expected %d)\n", 1u << w, is_signed ? "signed" : "unsigned", int32( header.base ), int32( base ));
+                exit(1);
+            }
+
+            io::columnar_pack( header, &values[0], n, &packed[0] );
+            io::columnar_unpack( header, &packed[0], n, &unpacked[0] );
+
+            if (unpacked != values)
+            {
+                log_error(stderr, "  %u-byte %s column doesn't round trip\n", 1u << w, is_signed ? "signed" : "unsigned");
+                exit(1);
+            }
+        }
+    }
+}
+
+// write a few batches of paired alignments with ColumnarOutput, and check that both the raw
+// columns and the alignments nvbio-aln-diff reads back hold the values they were made of
+//
+void columnar_test()
+{
+    const char*  file_name = "output_test.aln";
+    const uint32 n_batches = 3;
+    const uint32 n_reads   = 1000;
+
+    columnar_format_test();
+
+    TestReference ref;
+    TestMapQ      mapq;
+
+    // the expected rows, column by column
+    std::vector<uint32> expected[ io::COLUMNAR_N_COLUMNS ];
+    {
+        io::ReadDataRAM    reads[2];
+        io::CPUOutputBatch batch;
+
+        HostOutputFile<io::ColumnarOutput> output( file_name, io::PAIRED_END, io::BNT( ref.fmi ) );
+        output.configure_mapq_evaluator( &mapq, 0 );
+
+        for (uint32 k = 0; k < n_batches; ++k)
+        {
+            for (uint32 m = 0; m < 2; ++m)
+            {
+                reads[m].clear();
+                make_test_reads( ref, k, n_reads, m, reads[m] );
+            }
+            make_test_batch( ref, k, n_reads, &reads[0], &reads[1], batch );
+            output.push( batch );
+
+            for (uint32 i = 0; i < n_reads; ++i)
+            {
+                const TestRead mates[2] = { make_test_read( ref, k, i, 0u ), make_test_read( ref, k, i, 1u ) };
+
+                // the mapping quality is computed once for the pair, on the first mate
+                const uint32 pair_mapq = mates[0].best.is_aligned() ? uint32( 3u + 10u * mates[0].best.ed() ) : 0u;
+
+                for (uint32 m = 0; m < 2; ++m)
+                {
+                    uint32 row[ io::COLUMNAR_N_COLUMNS ];
+                    expected_columnar_row( ref, mates[m], mates[1u-m], m, pair_mapq, row );
+
+                    for (uint32 c = 0; c < io::COLUMNAR_N_COLUMNS; ++c)
+                        expected[c].push_back( row[c] );
+                }
+            }
+        }
+        output.close();
+    }
+    const uint32 n_rows = uint32( expected[0].size() );
+
+    // parse the raw file, column by column
+    {
+        std::string data;
+        if (read_file( file_name, data ) == false)
+        {
+            log_error(stderr, "  unable to read \"%s\"\n", file_name);
+            exit(1);
+        }
+
+        io::ColumnarFileHeader file_header;
+        memcpy( &file_header, data.c_str(), sizeof(file_header) );
+        if (memcmp( file_header.magic, "NVAC", 4u ) != 0 || file_header.version != io::COLUMNAR_VERSION || file_header.paired != 1u)
+        {
+            log_error(stderr, "  wrong columnar file header\n");
+            exit(1);
+        }
+
+        uint64 offset      = sizeof(file_header);
+        uint32 row0        = 0;
+        bool   signed_base = false;
+
+        for (uint32 k = 0; k < n_batches; ++k)
+        {
+            io::ColumnarBatchHeader batch_header;
+            memcpy( &batch_header, data.c_str() + offset, sizeof(batch_header) );
+            offset += sizeof(batch_header);
+
+            if (batch_header.n_rows != n_reads * 2u || batch_header.n_columns != io::COLUMNAR_N_COLUMNS ||
+                offset + batch_header.size > data.size())
+            {
+                log_error(stderr, "  wrong header for columnar batch %u\n", k);
+                exit(1);
+            }
+
+            std::vector<uint32> values( batch_header.n_rows );
+            for (uint32 c = 0; c < batch_header.n_columns; ++c)
+            {
+                io::ColumnarColumnHeader header;
+                memcpy( &header, data.c_str() + offset, sizeof(header) );
+                offset += sizeof(header);
+
+                io::columnar_unpack( header, (const uint8*)data.c_str() + offset, batch_header.n_rows, &values[0] );
+                offset += uint64( batch_header.n_rows ) * header.width;
+
+                if (header.id >= io::COLUMNAR_N_COLUMNS ||
+                    std::equal( values.begin(), values.end(), expected[ header.id ].begin() + row0 ) == false)
+                {
+                    log_error(stderr, "  wrong column %u in columnar batch %u\n", header.id, k);
+                    exit(1);
+                }
+
+                // the signed scores must be coded against a negative base
+                if (header.id == io::COLUMNAR_SCORE && int32( header.base ) < 0)
+                    signed_base = true;
+            }
+            row0 += batch_header.n_rows;
+        }
+
+        if (offset != data.size() || signed_base == false)
+        {
+            log_error(stderr, "  wrong columnar file layout\n");
+            exit(1);
+        }
+    }
+
+    // and read it back the way nvbio-aln-diff does
+    {
+        alndiff::AlignmentStream* stream = alndiff::open_columnar_file( file_name );
+        if (stream == NULL || stream->is_ok() == false)
+        {
+            log_error(stderr, "  unable to open \"%s\"\n", file_name);
+            exit(1);
+        }
+
+        // read in odd-sized batches, straddling the stored ones
+        std::vector<alndiff::Alignment> alns( n_rows + 1u );
+
+        uint32 n_read = 0;
+        while (uint32 n = stream->next_batch( 777u, &alns[ n_read ] ))
+            n_read += n;
+
+        delete stream;
+
+        if (n_read != n_rows)
+        {
+            log_error(stderr, "  read back %u columnar rows, expected %u\n", n_read, n_rows);
+            exit(1);
+        }
+
+        for (uint32 i = 0; i < n_rows; ++i)
+        {
+            const alndiff::Alignment& aln = alns[i];
+            if (aln.read_id    != expected[ io::COLUMNAR_READ_ID ][i]                 ||
+                aln.read_len   != expected[ io::COLUMNAR_READ_LEN ][i]                ||
+                aln.mate       != expected[ io::COLUMNAR_MATE ][i]                    ||
+                aln.pos        != expected[ io::COLUMNAR_POS ][i]                     ||
+                aln.ref_id     != expected[ io::COLUMNAR_REF_ID ][i]                  ||
+                aln.flag       != expected[ io::COLUMNAR_FLAG ][i]                    ||
+                aln.score      != int32( expected[ io::COLUMNAR_SCORE ][i] )          ||
+                aln.mapQ       != expected[ io::COLUMNAR_MAPQ ][i]                    ||
+                aln.ed         != expected[ io::COLUMNAR_ED ][i]                      ||
+                aln.subs       != expected[ io::COLUMNAR_SUBS ][i]                    ||
+                aln.has_second != expected[ io::COLUMNAR_HAS_SECOND ][i]              ||
+                aln.sec_score  != int32( expected[ io::COLUMNAR_SEC_SCORE ][i] ))
+            {
+                log_error(stderr, "  wrong columnar alignment %u\n", i);
+                exit(1);
+            }
+
+            // nvbio-aln-diff requires the rows of a pair to refer to different mates
+            if ((i & 1u) && alns[i-1].mate == aln.mate)
+            {
+                log_error(stderr, "  columnar alignments %u and %u refer to the same mate\n", i-1, i);
+                exit(1);
+            }
+        }
+    }
+    remove( file_name );
+}
+
+// a read stream serving the reads of a mate of the synthetic batches, recycling the batches
+// released back to it, so that a batch released before being written gets overwritten
+//
+struct TestReadStream : public io::ReadDataStream
+{
+    TestReadStream(const TestReference& ref, const uint32 mate, const uint32 n_batches, const uint32 n_reads)
+        : m_ref( ref ), m_mate( mate ), m_n_batches( n_batches ), m_n_reads( n_reads ), m_batch( 0 ) {}
+
+    io::ReadData* next(const uint32 batch_size, const uint32 batch_bps = uint32(-1))
+    {
+        if (m_batch == m_n_batches)
+            return NULL;
+
+        io::ReadDataRAM* reads = acquire_batch();
+        m_batches.insert( reads );
+
+        make_test_reads( m_ref, m_batch++, m_n_reads, m_mate, *reads );
+        return reads;
+    }
+
+    bool is_ok()     { return true; }
+    bool has_error() { return false; }
+
+    // check that all the batches handed out have been released exactly once, by drawing
+    // them back from the pool
+    bool all_released()
+    {
+        std::set<io::ReadDataRAM*> pooled;
+        for (uint32 i = 0; i < m_batches.size(); ++i)
+            pooled.insert( acquire_batch() );
+
+        bool success = pooled == m_batches;
+
+        for (std::set<io::ReadDataRAM*>::iterator it = pooled.begin(); it != pooled.end(); ++it)
+            release( *it );
+
+        return success;
+    }
+
+    const TestReference&        m_ref;
+    uint32                      m_mate;
+    uint32                      m_n_batches;
+    uint32                      m_n_reads;
+    uint32                      m_batch;
+    std::set<io::ReadDataRAM*>  m_batches;
+};
+
+// write all the synthetic batches pulled from a pair of read streams, letting the output
+// release the reads back to them, and writing them out through the output thread with the
+// given queue depth, or synchronously if zero
+//
+template <typename OutputType>
+void write_test_batches(
+    HostOutputFile<OutputType>& output,
+    const TestReference&        ref,
+    const uint32                queue_depth,
+    const uint32                n_batches,
+    const uint32                n_reads)
+{
+    TestMapQ       mapq;
+    TestReadStream stream1( ref, 0u, n_batches, n_reads );
+    TestReadStream stream2( ref, 1u, n_batches, n_reads );
+
+    output.configure_mapq_evaluator( &mapq, 0 );
+    output.set_read_streams( &stream1, &stream2 );
+    output.set_queue_depth( queue_depth );
+
+    io::CPUOutputBatch batch;
+    for (uint32 k = 0; k < n_batches; ++k)
+    {
+        const io::ReadData* reads1 = stream1.next( n_reads );
+        const io::ReadData* reads2 = stream2.next( n_reads );
+
+        make_test_batch( ref, k, n_reads, reads1, reads2, batch );
+        output.push( batch );
+    }
+    output.close();
+
+    if (stream1.all_released() == false || stream2.all_released() == false)
+    {
+        log_error(stderr, "  the reads of some batches were not released (queue depth %u)\n", queue_depth);
+        exit(1);
+    }
+}
+
+// write the same batches to SAM, BAM and columnar files both synchronously and through the
+// output thread with several queue depths, and check the files are identical
+//
+void async_output_test()
+{
+    const uint32 n_batches = 24;
+    const uint32 n_reads   = 2000;
+
+    const char* file_names[3] = { "output_test_async.sam", "output_test_async.bam", "output_test_async.aln" };
+    const uint32 queue_depths[3] = { 0u, 1u, 3u };
+
+    TestReference ref;
+
+    for (uint32 f = 0; f < 3; ++f)
+    {
+        std::string reference;
+
+        for (uint32 d = 0; d < 3; ++d)
+        {
+            if (f == 0)
+            {
+                HostOutputFile<io::SamOutput> output( file_names[f], io::PAIRED_END, io::BNT( ref.fmi ), false, Z_DEFAULT_COMPRESSION, 0u, io::QUALITY_KEEP );
+                write_test_batches( output, ref, queue_depths[d], n_batches, n_reads );
+            }
+            else if (f == 1)
+            {
+                HostOutputFile<io::BamOutput> output( file_names[f], io::PAIRED_END, io::BNT( ref.fmi ), Z_DEFAULT_COMPRESSION, 0u, false, uint64( 768u * 1024u * 1024u ), io::QUALITY_KEEP );
+                write_test_batches( output, ref, queue_depths[d], n_batches, n_reads );
+            }
+            else
+            {
+                HostOutputFile<io::ColumnarOutput> output( file_names[f], io::PAIRED_END, io::BNT( ref.fmi ) );
+                write_test_batches( output, ref, queue_depths[d], n_batches, n_reads );
+            }
+
+            std::string data;
+            if (read_file( file_names[f], data ) == false)
+            {
+                log_error(stderr, "  unable to read \"%s\"\n", file_names[f]);
+                exit(1);
+            }
+
+            if (d == 0)
+                reference = data;
+            else if (data != reference)
+            {
+                log_error(stderr, "  \"%s\" written with queue depth %u differs from the synchronous one\n", file_names[f], queue_depths[d]);
+                exit(1);
+            }
+        }
+        remove( file_names[f] );
+    }
+}
+
+// split a SAM file in the fields of its records, skipping the header
+//
+void read_sam_records(const char* file_name, std::vector< std::vector<std::string> >& records)
+{
+    std::string data;
+    if (read_file( file_name, data ) == false)
+    {
+        log_error(stderr, "  unable to read \"%s\"\n", file_name);
+        exit(1);
+    }
+
+    records.clear();
+    for (size_t begin = 0; begin < data.size(); )
+    {
+        size_t end = data.find( '\n', begin );
+        if (end == std::string::npos)
+            end = data.size();
+
+        if (data[begin] != '@')
+        {
+            records.push_back( std::vector<std::string>() );
+            for (size_t field = begin; field <= end; )
+            {
+                size_t next = data.find( '\t', field );
+                if (next == std::string::npos || next > end)
+                    next = end;
+
+                records.back().push_back( data.substr( field, next - field ) );
+                field = next + 1u;
+            }
+        }
+        begin = end + 1u;
+    }
+}
+
+// decompress a BAM file, and locate the qualities of each of its records
+//
+void read_bam_records(const char* file_name, std::string& data, std::vector<uint32>& qual_offsets, std::vector<uint32>& qual_lens)
+{
+    gzFile file = gzopen( file_name, "rb" );
+    if (file == NULL)
+    {
+        log_error(stderr, "  unable to open \"%s\"\n", file_name);
+        exit(1);
+    }
+
+    data.clear();
+
+    char buffer[64*1024];
+    int  n;
+    while ((n = gzread( file, buffer, sizeof(buffer) )) > 0)
+        data.append( buffer, n );
+
+    gzclose( file );
+
+    // skip the header and the reference dictionary
+    int32 l_text, n_ref;
+    memcpy( &l_text, data.c_str() + 4u, sizeof(int32) );
+    memcpy( &n_ref,  data.c_str() + 8u + l_text, sizeof(int32) );
+
+    uint32 offset = 12u + l_text;
+    for (int32 r = 0; r < n_ref; ++r)
+    {
+        int32 l_name;
+        memcpy( &l_name, data.c_str() + offset, sizeof(int32) );
+        offset += 8u + l_name;
+    }
+
+    qual_offsets.clear();
+    qual_lens.clear();
+    while (offset < data.size())
+    {
+        const char* record = data.c_str() + offset;
+
+        int32  block_size, l_seq;
+        uint8  l_read_name;
+        uint16 n_cigar_op;
+        memcpy( &block_size,  record,       sizeof(int32) );
+        memcpy( &l_read_name, record + 12u, sizeof(uint8) );
+        memcpy( &n_cigar_op,  record + 16u, sizeof(uint16) );
+        memcpy( &l_seq,       record + 20u, sizeof(int32) );
+
+        qual_offsets.push_back( offset + 36u + l_read_name + 4u * n_cigar_op + (l_seq + 1u) / 2u );
+        qual_lens.push_back( l_seq );
+
+        offset += 4u + block_size;
+    }
+}
+
+// write the same batches to SAM and BAM files keeping, binning and dropping their qualities,
+// and check the binned and dropped ones against the kept ones, all other fields being equal
+//
+void quality_mode_test()
+{
+    const uint32 n_batches = 4;
+    const uint32 n_reads   = 1000;
+
+    const char*           sam_name = "output_test_qual.sam";
+    const char*           bam_name = "output_test_qual.bam";
+    const io::QualityMode modes[3] = { io::QUALITY_KEEP, io::QUALITY_BIN, io::QUALITY_DROP };
+
+    TestReference ref;
+
+    std::vector< std::vector<std::string> > sam_records[3];
+    std::string                             bam_data[3];
+    std::vector<uint32>                     qual_offsets[3];
+    std::vector<uint32>                     qual_lens[3];
+
+    for (uint32 m = 0; m < 3; ++m)
+    {
+        {
+            HostOutputFile<io::SamOutput> output( sam_name, io::PAIRED_END, io::BNT( ref.fmi ), false, Z_DEFAULT_COMPRESSION, 0u, modes[m] );
+            write_test_batches( output, ref, 0u, n_batches, n_reads );
+        }
+        {
+            HostOutputFile<io::BamOutput> output( bam_name, io::PAIRED_END, io::BNT( ref.fmi ), Z_DEFAULT_COMPRESSION, 0u, false, uint64( 768u * 1024u * 1024u ), modes[m] );
+            write_test_batches( output, ref, 0u, n_batches, n_reads );
+        }
+        read_sam_records( sam_name, sam_records[m] );
+        read_bam_records( bam_name, bam_data[m], qual_offsets[m], qual_lens[m] );
+    }
+    remove( sam_name );
+    remove( bam_name );
+
+    const uint32 n_records = n_batches * n_reads * 2u;
+
+    // SAM: the binned qualities are the bins of the kept ones, and the dropped ones are '*'
+    bool binned = false;
+    for (uint32 m = 0; m < 3; ++m)
+    {
+        if (sam_records[m].size() != n_records)
+        {
+            log_error(stderr, "  wrote %u SAM records with quality mode %u, expected %u\n", uint32( sam_records[m].size() ), m, n_records);
+            exit(1);
+        }
+    }
+    for (uint32 i = 0; i < n_records; ++i)
+    {
+        const std::vector<std::string>& kept    = sam_records[0][i];
+        const std::vector<std::string>& bins    = sam_records[1][i];
+        const std::vector<std::string>& dropped = sam_records[2][i];
+
+        if (kept.size() < 11u || kept.size() != bins.size() || kept.size() != dropped.size())
+        {
+            log_error(stderr, "  wrong number of fields in SAM record %u\n", i);
+            exit(1);
+        }
+        for (uint32 f = 0; f < kept.size(); ++f)
+        {
+            if (f != 10u && (bins[f] != kept[f] || dropped[f] != kept[f]))
+            {
+                log_error(stderr, "  field %u of SAM record %u depends on the quality mode\n", f, i);
+                exit(1);
+            }
+        }
+
+        const std::string& qual = kept[10];
+        if (qual.size() != kept[9].size() || bins[10].size() != qual.size())
+        {
+            log_error(stderr, "  wrong quality length in SAM record %u\n", i);
+            exit(1);
+        }
+        for (uint32 j = 0; j < qual.size(); ++j)
+        {
+            const uint8 q = uint8( qual[j] - 33 );
+            if (uint8( bins[10][j] - 33 ) != io::bin_quality( q ))
+            {
+                log_error(stderr, "  wrong binned quality in SAM record %u\n", i);
+                exit(1);
+            }
+            binned |= io::bin_quality( q ) != q;
+        }
+
+        if (dropped[10] != "*")
+        {
+            log_error(stderr, "  dropped qualities written as \"%s\" in SAM record %u\n", dropped[10].c_str(), i);
+            exit(1);
+        }
+    }
+    if (binned == false)
+    {
+        log_error(stderr, "  no SAM quality was changed by binning\n");
+        exit(1);
+    }
+
+    // BAM: the same, the dropped qualities being filled with 0xFF
+    for (uint32 m = 1; m < 3; ++m)
+    {
+        if (bam_data[m].size() != bam_data[0].size() || qual_offsets[m] != qual_offsets[0] || qual_offsets[0].size() != n_records)
+        {
+            log_error(stderr, "  BAM records with quality mode %u don't match the ones with kept qualities\n", m);
+            exit(1);
+        }
+    }
+
+    std::string expected[3] = { bam_data[0], bam_data[0], bam_data[0] };
+    for (uint32 i = 0; i < n_records; ++i)
+    {
+        for (uint32 j = 0; j < qual_lens[0][i]; ++j)
+        {
+            const uint32 k = qual_offsets[0][i] + j;
+            expected[1][k] = char( io::bin_quality( uint8( bam_data[0][k] ) ) );
+            expected[2][k] = char( 0xFF );
+        }
+    }
+    for (uint32 m = 1; m < 3; ++m)
+    {
+        if (bam_data[m] != expected[m])
+        {
+            log_error(stderr, "  wrong BAM records with %s qualities\n", m == 1 ? "binned" : "dropped");
+            exit(1);
+        }
+    }
+    if (expected[1] == bam_data[0])
+    {
+        log_error(stderr, "  no BAM quality was changed by binning\n");
+        exit(1);
+    }
+}
+
+} // anonymous namespace
+
+int output_test()
+{
+    fprintf(stderr, "output test... started\n");
+
+    bgzf_test();
+    sam_format_test();
+    bam_sort_test();
+    columnar_test();
+    async_output_test();
+    quality_mode_test();
+
+    fprintf(stderr, "output test... done\n");
+    return 0;
+}
+
+} // namespace nvbio
@@ -79,6 +79,100 @@ void do_test(const index_type LEN, const rank_dict_type& dict)
     }
 }
 
+// check that the multi-threaded occurrence table construction matches the serial one,
+// including on lengths which are not a multiple of the word size
+//
+template <uint32 K, typename WordType>
+void do_build_test(const uint32 LEN, const WordType* words)
+{
+    typedef PackedStream<const WordType*,uint8,2,true,uint64> stream_type;
+    stream_type text( words );
+
+    const uint32 lengths[2]   = { LEN, LEN > 5u ? LEN - 5u : LEN };
+    const uint32 n_threads[2] = { 0u, 3u };
+
+    for (uint32 l = 0; l < 2; ++l)
+    {
+        const uint32 n         = lengths[l];
+        const uint32 occ_words = ((n+K-1)/K)*4;
+
+        std::vector<uint64> occ( occ_words );
+        std::vector<uint64> cnt( 4 );
+
+        Timer timer;
+        timer.start();
+
+        build_occurrence_table<K>(
+            text.begin(),
+            text.begin() + uint64(n),
+            &occ[0],
+            &cnt[0] );
+
+        timer.stop();
+        const float serial_time = timer.seconds();
+
+        for (uint32 t = 0; t < 2; ++t)
+        {
+            std::vector<uint64> pocc( occ_words, uint64(-1) );
+            std::vector<uint64> pcnt( 4 );
+
+            timer.start();
+
+            build_packed_occurrence_table<K>(
+                words,
+                uint64(n),
+                &pocc[0],
+                &pcnt[0],
+                n_threads[t] );
+
+            timer.stop();
+
+            if (pocc != occ || pcnt != cnt)
+            {
+                log_error(stderr, "  parallel occurrence table mismatch (length %u, %u threads)\n", n, n_threads[t]);
+                exit(1);
+            }
+            if (l == 0 && t == 0)
+                fprintf(stderr, "    occurrence table : %.2fx speedup\n", serial_time / timer.seconds());
+        }
+    }
+}
+
+// measure the throughput of random range queries, returning the number of queries per second
+//
+template <typename rank_dict_type>
+float do_speed_test(const uint32 LEN, const rank_dict_type& dict, const uint32 n_queries)
+{
+    std::vector<uint2>  ranges( n_queries );
+    std::vector<uint8>  chars( n_queries );
+    for (uint32 i = 0; i < n_queries; ++i)
+    {
+        const uint32 l = uint32( ((uint64(rand()) << 16) ^ rand()) % LEN );
+        const uint32 r = nvbio::min( l + uint32(rand() % 256), LEN-1 );
+
+        ranges[i] = make_uint2( l, r );
+        chars[i]  = uint8( rand() % 4 );
+    }
+
+    Timer timer;
+    timer.start();
+
+    uint32 sink = 0;
+    for (uint32 i = 0; i < n_queries; ++i)
+    {
+        const uint2 r = rank( dict, ranges[i], chars[i] );
+        sink += r.y - r.x;
+    }
+
+    timer.stop();
+
+    // make sure the queries can't be optimized away
+    if (sink == uint32(-1))
+        fprintf(stderr, "  %u\n", sink);
+
+    return float(n_queries) / timer.seconds();
+}
+
 void synthetic_test(const uint32 LEN)
 {
     // 32-bits test
@@ -130,6 +224,9 @@ void synthetic_test(const uint32 LEN)
                 &L2[1] );
         }
 
+        // check the multi-threaded construction
+        do_build_test<OCC_INT>( LEN, &text_storage[0] );
+
         // generate the count table
         gen_bwt_count_table( &count_table[0] );
 
@@ -158,6 +255,41 @@ void synthetic_test(const uint32 LEN)
                 &count_table[0] );
 
             do_test( LEN, dict );
+
+            const float qps = do_speed_test( LEN, dict, 4*1024*1024 );
+            fprintf(stderr, "    separate layout : %.2f M queries/s\n", qps * 1.0e-6f);
+        }
+        // test the fused layout, interleaving each uint4 of text with its uint4 of counters
+        {
+            const uint32 n_blocks = align<4>(WORDS)/4;
+
+            // align the base of the fused table to a cache line
+            thrust::host_vector<uint4> bwt_occ_storage( n_blocks*2 + 4 );
+            const size_t misalignment = size_t( &bwt_occ_storage[0] ) & 63u;
+            uint4* bwt_occ = &bwt_occ_storage[0] + (misalignment ? (64u - misalignment) / sizeof(uint4) : 0u);
+
+            interleave_occurrence_table(
+                n_blocks,
+                (const uint4*)&text_storage[0],
+                (const uint4*)&occ[0],
+                bwt_occ );
+
+            typedef deinterleaved_iterator<2,0,const uint4*> bwt_type;
+            typedef deinterleaved_iterator<2,1,const uint4*> occ_type;
+
+            typedef PackedStream<bwt_type,uint8,2,true> stream_type;
+            stream_type text( (bwt_type( bwt_occ )) );
+
+            typedef rank_dictionary<2u, OCC_INT, stream_type, occ_type, const uint32*> rank_dict_type;
+            rank_dict_type dict(
+                text,
+                occ_type( bwt_occ ),
+                &count_table[0] );
+
+            do_test( LEN, dict );
+
+            const float qps = do_speed_test( LEN, dict, 4*1024*1024 );
+            fprintf(stderr, "    fused layout    : %.2f M queries/s\n", qps * 1.0e-6f);
         }
     }
     // 64-bits test
@@ -209,6 +341,9 @@ void synthetic_test(const uint32 LEN)
                 &L2[1] );
         }
 
+        // check the multi-threaded construction
+        do_build_test<OCC_INT>( LEN, &text_storage[0] );
+
         // generate the count table
         gen_bwt_count_table( &count_table[0] );
 
@@ -217,6 +352,29 @@ void synthetic_test(const uint32 LEN)
             typedef PackedStream<const uint64*,uint8,2,true,uint64> stream_type;
             stream_type text( &text_storage[0] );
 
+            typedef rank_dictionary<2u, OCC_INT, stream_type, const uint64*, const uint32*> rank_dict_type;
+            rank_dict_type dict(
+                text,
+                &occ[0],
+                &count_table[0] );
+
+            do_test( uint64(LEN), dict );
+        }
+        // test 64-bit indexing of a text packed in uint32 words, as used by 64-bit FM-indices
+        {
+            thrust::host_vector<uint32> text32_storage( align<4>(WORDS)*2, 0u );
+
+            typedef PackedStream<const uint64*,uint8,2,true,uint64> stream64_type;
+            typedef PackedStream<uint32*,uint8,2,true,uint64>       stream32_type;
+            stream64_type text64( &text_storage[0] );
+            stream32_type text32( &text32_storage[0] );
+
+            for (uint32 i = 0; i < LEN; ++i)
+                text32[i] = text64[i];
+
+            typedef PackedStream<const uint32*,uint8,2,true,uint64> stream_type;
+            stream_type text( &text32_storage[0] );
+
             typedef rank_dictionary<2u, OCC_INT, stream_type, const uint64*, const uint32*> rank_dict_type;
             rank_dict_type dict(
                 text,
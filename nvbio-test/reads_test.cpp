@@ -0,0 +1,1272 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// reads_test.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <nvbio/basic/timer.h>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/threads.h>
+#include <nvbio/io/reads/reads.h>
+#include <nvbio/io/reads/reads_fastq.h>
+#include <nvbio/io/reads/reads_archive.h>
+#include <nvbio/io/output/output_gzip.h>
+#include <nvbio/io/bam_format.h>
+
+namespace nvbio {
+namespace { // anonymous namespace
+
+// write a synthetic FASTQ file with variable-length reads
+//
+uint64 write_synthetic_fastq(const char* file_name, const uint32 n_reads)
+{
+    FILE* file = fopen( file_name, "w" );
+    if (file == NULL)
+        return 0;
+
+    const char bps[] = "ACGTN";
+
+    char read[512];
+    char qual[512];
+
+    for (uint32 i = 0; i < n_reads; ++i)
+    {
+        const uint32 len = 50u + (rand() % 200u);
+        for (uint32 j = 0; j < len; ++j)
+        {
+            read[j] = bps[ rand() % 5 ];
+            qual[j] = char( 33 + (rand() % 41) );
+        }
+        read[len] = '\0';
+        qual[len] = '\0';
+
+        fprintf( file, "@read.%u length=%u\n%s\n+%s\n%s\n", i, len, read, (i & 1) ? "" : "read", qual );
+    }
+    const uint64 size = ftell( file );
+    fclose( file );
+    return size;
+}
+
+// compress a buffer into a BGZF file, cutting it in blocks of a given size irrespective
+// of the record boundaries
+//
+bool write_bgzf(const char* file_name, const std::string& data, const uint32 block_size)
+{
+    FILE* file = fopen( file_name, "wb" );
+    if (file == NULL)
+        return false;
+
+    io::BGZFWriter writer;
+    io::DataBuffer block;
+
+    writer.open( file, 1, 0u );
+    for (uint64 offset = 0; offset < data.size(); offset += block_size)
+    {
+        block.append_data( data.c_str() + offset, int( nvbio::min( uint64( data.size() ) - offset, uint64( block_size ) ) ) );
+        writer.write_block( block );
+    }
+    writer.close();
+    writer.write_eof_marker();
+
+    return fclose( file ) == 0;
+}
+
+// reverse-complement a read, reversing its qualities, as done for reads aligned to the reverse strand
+//
+void reverse_complement(std::string& read, std::string& qual)
+{
+    std::reverse( read.begin(), read.end() );
+    std::reverse( qual.begin(), qual.end() );
+    for (uint32 j = 0; j < read.length(); ++j)
+    {
+        const char* bp = strchr( "ACGT", read[j] );
+        if (bp)
+            read[j] = "TGCA"[ bp - "ACGT" ];
+    }
+}
+
+// append a BAM record holding an unaligned read to a buffer; an empty quality string
+// is stored as missing
+//
+void append_bam_record(std::string& bam, const char* name, const uint32 flag, const std::string& read, const std::string& qual)
+{
+    static const char bam_bps[] = "=ACMGRSVTWYHKDBN";
+
+    const uint32 name_len = uint32( strlen( name ) ) + 1u;
+    const uint32 len      = uint32( read.length() );
+
+    io::BAM_alignment align;
+    align.block_size = int32( sizeof(io::BAM_alignment) - sizeof(int32) + name_len + (len + 1u)/2u + len );
+    align.refID      = -1;
+    align.pos        = -1;
+    align.bin_mq_nl  = (4680u << 16) | name_len;
+    align.flag_nc    = flag << 16;
+    align.l_seq      = int32( len );
+    align.next_refID = -1;
+    align.next_pos   = -1;
+    align.tlen       = 0;
+
+    bam.append( (const char*)&align, sizeof(io::BAM_alignment) );
+    bam.append( name, name_len );
+
+    // the bases are packed two per byte, high nibble first
+    std::string seq( (len + 1u)/2u, '\0' );
+    for (uint32 i = 0; i < len; ++i)
+        seq[i/2] |= char( uint32( strchr( bam_bps, toupper( read[i] ) ) - bam_bps ) << ((i & 1u) ? 0u : 4u) );
+
+    bam.append( seq );
+
+    for (uint32 i = 0; i < len; ++i)
+        bam.push_back( qual.empty() ? char( 0xFF ) : char( qual[i] - 33 ) );
+}
+
+// write a synthetic BAM file holding unaligned variable-length reads, along with a FASTQ file
+// holding the same reads; some of the reads are stored reverse-complemented as if they were
+// aligned to the reverse strand, and the BAM file also holds secondary records and records
+// without a sequence, neither of which is loaded
+//
+bool write_synthetic_bam(const char* bam_name, const char* fastq_name, const uint32 n_reads)
+{
+    FILE* fastq = fopen( fastq_name, "w" );
+    if (fastq == NULL)
+        return false;
+
+    // all the IUPAC codes, which BAM files store as 4-bit symbols
+    const char bps[] = "ACGTNACGTNRYSWKMBDHV";
+
+    // an empty header with no reference sequences
+    std::string bam( "BAM\1\0\0\0\0\0\0\0\0", 12 );
+
+    for (uint32 i = 0; i < n_reads; ++i)
+    {
+        std::string read;
+        std::string qual;
+
+        const uint32 len = 50u + (rand() % 200u);
+        for (uint32 j = 0; j < len; ++j)
+        {
+            read.push_back( bps[ rand() % (sizeof(bps)-1) ] );
+            qual.push_back( char( 33 + (rand() % 41) ) );
+        }
+
+        char name[32];
+        sprintf( name, "read.%u", i );
+
+        fprintf( fastq, "@%s\n%s\n+\n%s\n", name, read.c_str(), qual.c_str() );
+
+        if (i % 3u == 1u)
+        {
+            // store the read reverse-complemented, along with its reversed qualities
+            reverse_complement( read, qual );
+            append_bam_record( bam, name, 0x10u, read, qual );
+        }
+        else
+            append_bam_record( bam, name, 0u, read, qual );
+
+        if (i % 7u == 3u)
+            append_bam_record( bam, name, 0x100u, std::string( len, 'A' ), std::string() );
+
+        if (i % 11u == 5u)
+        {
+            sprintf( name, "empty.%u", i );
+            append_bam_record( bam, name, 0x4u, std::string(), std::string() );
+        }
+    }
+    fclose( fastq );
+
+    // use small blocks, so as to have records straddling them
+    return write_bgzf( bam_name, bam, 7919u );
+}
+
+// write a synthetic BAM file holding read pairs, with their mates flagged as READ1 and READ2,
+// along with two FASTQ files holding the first and second mates respectively; the two mates of
+// a pair come in either order, some are stored reverse-complemented, and secondary records and
+// single-end reads are interspersed, none of which is loaded. If dangling is set, the BAM file
+// ends with a first mate missing its pair
+//
+bool write_synthetic_paired_bam(const char* bam_name, const char* fastq_name1, const char* fastq_name2, const uint32 n_pairs, const bool dangling)
+{
+    FILE* fastq[2] = { fopen( fastq_name1, "w" ), fopen( fastq_name2, "w" ) };
+    if (fastq[0] == NULL || fastq[1] == NULL)
+    {
+        if (fastq[0]) fclose( fastq[0] );
+        if (fastq[1]) fclose( fastq[1] );
+        return false;
+    }
+
+    const char bps[] = "ACGTN";
+
+    // an empty header with no reference sequences
+    std::string bam( "BAM\1\0\0\0\0\0\0\0\0", 12 );
+
+    for (uint32 i = 0; i < n_pairs + (dangling ? 1u : 0u); ++i)
+    {
+        char name[32];
+        sprintf( name, "pair.%u", i );
+
+        // the last pair of a dangling file only has its first mate
+        const uint32 n_mates = i < n_pairs ? 2u : 1u;
+
+        std::string reads[2];
+        std::string quals[2];
+        for (uint32 m = 0; m < n_mates; ++m)
+        {
+            const uint32 len = 50u + (rand() % 200u);
+            for (uint32 j = 0; j < len; ++j)
+            {
+                reads[m].push_back( bps[ rand() % (sizeof(bps)-1) ] );
+                quals[m].push_back( char( 33 + (rand() % 41) ) );
+            }
+            if (i < n_pairs)
+                fprintf( fastq[m], "@%s\n%s\n+\n%s\n", name, reads[m].c_str(), quals[m].c_str() );
+        }
+
+        // paired (0x1), with the first and second mates flagged as READ1 (0x40) and READ2 (0x80)
+        for (uint32 k = 0; k < n_mates; ++k)
+        {
+            const uint32 m = (i & 1u) ? n_mates - 1u - k : k;
+
+            uint32 flag = m ? 0x81u : 0x41u;
+            if ((i + m) % 3u == 1u)
+            {
+                reverse_complement( reads[m], quals[m] );
+                flag |= 0x10u;
+            }
+            append_bam_record( bam, name, flag, reads[m], quals[m] );
+
+            // secondary records may sit in between the mates
+            if (i % 5u == 2u)
+                append_bam_record( bam, name, flag | 0x100u, std::string( 10u, 'A' ), std::string() );
+        }
+
+        if (i % 7u == 3u)
+        {
+            sprintf( name, "single.%u", i );
+            append_bam_record( bam, name, 0u, std::string( 20u, 'C' ), std::string() );
+        }
+    }
+    fclose( fastq[0] );
+    fclose( fastq[1] );
+
+    return write_bgzf( bam_name, bam, 7919u );
+}
+
+// write a synthetic SAM file holding unaligned variable-length reads, along with a FASTQ file
+// holding the same reads; as in write_synthetic_bam(), some reads are stored reverse-complemented,
+// and secondary records and records without a sequence are interspersed; some reads lack
+// qualities, which are loaded as the highest score, and many are a single base long, so as to
+// check that a lone '*' is always taken for missing qualities, irrespective of the read length
+//
+bool write_synthetic_sam(const char* sam_name, const char* fastq_name, const uint32 n_reads)
+{
+    FILE* sam   = fopen( sam_name, "w" );
+    FILE* fastq = fopen( fastq_name, "w" );
+    if (sam == NULL || fastq == NULL)
+    {
+        if (sam)   fclose( sam );
+        if (fastq) fclose( fastq );
+        return false;
+    }
+
+    const char bps[] = "ACGTNACGTNRYSWKMBDHV";
+
+    fprintf( sam, "@HD\tVN:1.4\tSO:unsorted\n" );
+
+    for (uint32 i = 0; i < n_reads; ++i)
+    {
+        std::string read;
+        std::string qual;
+
+        const uint32 len = (i % 4u == 0u) ? 1u : 1u + (rand() % 150u);
+        for (uint32 j = 0; j < len; ++j)
+        {
+            read.push_back( bps[ rand() % (sizeof(bps)-1) ] );
+            qual.push_back( char( 33 + (rand() % 41) ) );
+        }
+
+        // missing qualities are loaded as the highest score, and a single base read with
+        // a '*' quality can't be told apart from one without qualities
+        const bool missing_qual = (i % 5u == 2u) || qual == "*";
+        if (missing_qual)
+            qual = std::string( len, char( 0xFF ) );
+
+        char name[32];
+        sprintf( name, "read.%u", i );
+
+        fprintf( fastq, "@%s\n%s\n+\n%s\n", name, read.c_str(), qual.c_str() );
+
+        uint32 flag = 0u;
+        if (i % 3u == 1u)
+        {
+            // store the read reverse-complemented, along with its reversed qualities
+            reverse_complement( read, qual );
+            flag = 0x10u;
+        }
+
+        // only some records have optional fields
+        fprintf( sam, "%s\t%u\t*\t0\t0\t*\t*\t0\t0\t%s\t%s%s\n",
+            name, flag, read.c_str(), missing_qual ? "*" : qual.c_str(), (i & 1u) ? "\tNM:i:0" : "" );
+
+        if (i % 7u == 3u)
+            fprintf( sam, "%s\t256\t*\t0\t0\t*\t*\t0\t0\t%s\t*\n", name, std::string( len, 'A' ).c_str() );
+
+        if (i % 11u == 5u)
+            fprintf( sam, "empty.%u\t4\t*\t0\t0\t*\t*\t0\t0\t*\t*\n", i );
+    }
+    fclose( fastq );
+    return fclose( sam ) == 0;
+}
+
+// compare two read batches
+//
+bool compare(const io::ReadData& r1, const io::ReadData& r2)
+{
+    if (r1.size()              != r2.size()           ||
+        r1.bps()               != r2.bps()            ||
+        r1.words()             != r2.words()          ||
+        r1.name_stream_len()   != r2.name_stream_len())
+        return false;
+
+    if (memcmp( r1.read_index(), r2.read_index(), sizeof(uint32) * (r1.size()+1) )         != 0 ||
+        memcmp( r1.read_stream(), r2.read_stream(), sizeof(uint32) * r1.words() )          != 0 ||
+        memcmp( r1.qual_stream(), r2.qual_stream(), r1.bps() )                             != 0 ||
+        memcmp( r1.name_index(), r2.name_index(), sizeof(uint32) * (r1.size()+1) )         != 0 ||
+        memcmp( r1.name_stream(), r2.name_stream(), r1.name_stream_len() )                 != 0)
+        return false;
+
+    return true;
+}
+
+// compare the i-th read of a batch with the j-th read of another one
+//
+bool compare_read(const io::ReadData& r1, const uint32 i, const io::ReadData& r2, const uint32 j)
+{
+    const io::ReadData::read_string read1 = r1.get_read(i);
+    const io::ReadData::read_string read2 = r2.get_read(j);
+
+    if (read1.length() != read2.length())
+        return false;
+
+    for (uint32 k = 0; k < read1.length(); ++k)
+    {
+        if (read1[k] != read2[k])
+            return false;
+    }
+
+    // the qualities are either missing from both batches or equal
+    if ((r1.qual_stream() == NULL) != (r2.qual_stream() == NULL))
+        return false;
+
+    if (r1.qual_stream() &&
+        memcmp( r1.qual_stream() + r1.get_range(i).x, r2.qual_stream() + r2.get_range(j).x, read1.length() ) != 0)
+        return false;
+
+    return strcmp( r1.name_stream() + r1.name_index()[i], r2.name_stream() + r2.name_index()[j] ) == 0;
+}
+
+// check that two streams hold the same reads, irrespective of how they split them in batches,
+// and that both end without errors
+//
+bool compare_streams(const char* test_name, io::ReadDataStream& stream, const uint32 batch_size, io::ReadDataStream& reference, const uint32 ref_batch_size)
+{
+    io::ReadData* batches[2]     = { NULL, NULL };
+    uint32        pos[2]         = { 0, 0 };
+    bool          success        = true;
+
+    io::ReadDataStream* streams[2]     = { &stream, &reference };
+    const uint32        batch_sizes[2] = { batch_size, ref_batch_size };
+
+    while (success)
+    {
+        // move on to the next batch of either stream once the current one is over
+        for (uint32 s = 0; s < 2; ++s)
+        {
+            if (batches[s] == NULL || pos[s] == batches[s]->size())
+            {
+                streams[s]->release( batches[s] );
+                batches[s] = streams[s]->next( batch_sizes[s], uint32(-1) );
+                pos[s]     = 0;
+            }
+        }
+
+        if (batches[0] == NULL || batches[1] == NULL)
+        {
+            if (batches[0] != batches[1])
+            {
+                log_error(stderr, "  %s: read count mismatch\n", test_name);
+                success = false;
+            }
+            break;
+        }
+
+        if (compare_read( *batches[0], pos[0]++, *batches[1], pos[1]++ ) == false)
+        {
+            log_error(stderr, "  %s: read mismatch\n", test_name);
+            success = false;
+        }
+    }
+    for (uint32 s = 0; s < 2; ++s)
+        streams[s]->release( batches[s] );
+
+    if (success && (stream.has_error() || reference.has_error()))
+    {
+        log_error(stderr, "  %s: the streams ended with an error\n", test_name);
+        success = false;
+    }
+    return success;
+}
+
+// check that two paired streams hold the same reads, irrespective of how they split them in batches,
+// and that both end without errors
+//
+bool compare_paired(const char* test_name, io::PairedReadDataStream& paired, io::PairedReadDataStream& reference, const uint32 batch_size)
+{
+    io::ReadData* batches[2][2] = { { NULL, NULL }, { NULL, NULL } };
+    uint32        pos[2]        = { 0, 0 };
+    bool          loaded[2]     = { true, true };
+    bool          success       = true;
+
+    io::PairedReadDataStream* streams[2] = { &paired, &reference };
+
+    while (success)
+    {
+        // move on to the next pair of batches of either stream once the current one is over
+        for (uint32 s = 0; s < 2; ++s)
+        {
+            if (loaded[s] && (batches[s][0] == NULL || pos[s] == batches[s][0]->size()))
+            {
+                streams[s]->release( batches[s][0] );
+                streams[s]->release( batches[s][1] );
+                batches[s][0] = batches[s][1] = NULL;
+                pos[s] = 0;
+
+                loaded[s] = streams[s]->next( batch_size, &batches[s][0], &batches[s][1] );
+            }
+        }
+
+        if (loaded[0] == false && loaded[1] == false)
+            break;
+
+        if (loaded[0] != loaded[1] ||
+            batches[0][0]->size() != batches[0][1]->size() ||
+            compare_read( *batches[0][0], pos[0], *batches[1][0], pos[1] ) == false ||
+            compare_read( *batches[0][1], pos[0], *batches[1][1], pos[1] ) == false)
+        {
+            log_error(stderr, "  %s: mate mismatch\n", test_name);
+            success = false;
+        }
+        pos[0]++;
+        pos[1]++;
+    }
+    for (uint32 s = 0; s < 2; ++s)
+    {
+        streams[s]->release( batches[s][0] );
+        streams[s]->release( batches[s][1] );
+    }
+
+    if (success && (paired.has_error() || reference.has_error()))
+    {
+        log_error(stderr, "  %s: the streams ended with an error\n", test_name);
+        success = false;
+    }
+    return success;
+}
+
+// split a file in shards, and check that together they cover all the reads of a reference
+// stream exactly once, in order
+//
+bool shard_test(
+    const char*             test_name,
+    const char*             file_name,
+    io::ReadDataStream&     reference,
+    const io::ReadEncoding  flags,
+    const uint32            n_threads,
+    const uint32            n_shards,
+    const uint32            batch_size)
+{
+    io::ReadData* ref     = NULL;
+    uint32        ref_pos = 0;
+    bool          success = true;
+
+    for (uint32 shard = 0; shard < n_shards && success; ++shard)
+    {
+        io::ReadDataStream* shard_file = io::open_read_file( file_name, io::Phred33, uint32(-1), uint32(-1), flags, n_threads, io::LOAD_ALL, shard, n_shards );
+        if (shard_file == NULL)
+        {
+            log_error(stderr, "  %s: unable to select shard %u\n", test_name, shard);
+            success = false;
+            break;
+        }
+
+        while (io::ReadData* batch = success ? shard_file->next( batch_size, uint32(-1) ) : NULL)
+        {
+            for (uint32 i = 0; i < batch->size() && success; ++i)
+            {
+                if (ref == NULL || ref_pos == ref->size())
+                {
+                    reference.release( ref );
+                    ref     = reference.next( batch_size, uint32(-1) );
+                    ref_pos = 0;
+                }
+                if (ref == NULL || compare_read( *ref, ref_pos++, *batch, i ) == false)
+                {
+                    log_error(stderr, "  %s: read mismatch in shard %u\n", test_name, shard);
+                    success = false;
+                }
+            }
+            shard_file->release( batch );
+        }
+        delete shard_file;
+    }
+
+    if (success && (ref == NULL || ref_pos != ref->size() || reference.next( batch_size, uint32(-1) ) != NULL))
+    {
+        log_error(stderr, "  %s: read count mismatch\n", test_name);
+        success = false;
+    }
+    reference.release( ref );
+    return success;
+}
+
+// the reference scalar encoding of a base pair, mapping A,C,G,T to 0,1,2,3, '-' to 5 and anything else to N
+//
+uint8 reference_bp(const char c)
+{
+    switch (c)
+    {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    case '-':           return 5;
+    default:            return 4;
+    }
+}
+
+// encode random reads with all strand operators at once, and check them against the reference
+// scalar encoder, which complements any symbol other than A,C,G,T to N
+//
+bool encoding_test()
+{
+    const char bps[] = "ACGTNacgtn-RY.=";
+
+    const io::ReadDataRAM::StrandOp ops[4] = {
+        io::ReadDataRAM::NO_OP,
+        io::ReadDataRAM::REVERSE_OP,
+        io::ReadDataRAM::COMPLEMENT_OP,
+        io::ReadDataRAM::REVERSE_COMPLEMENT_OP };
+
+    const uint32 n_reads = 1000;
+
+    std::vector<std::string> reads( n_reads );
+    std::vector<std::string> quals( n_reads );
+
+    io::ReadDataRAM batch;
+    for (uint32 i = 0; i < n_reads; ++i)
+    {
+        // vary the lengths so as to exercise all the word alignments and the vectorized loops
+        const uint32 len = 1u + (rand() % 100u);
+        for (uint32 j = 0; j < len; ++j)
+        {
+            reads[i].push_back( bps[ rand() % (sizeof(bps)-1) ] );
+            quals[i].push_back( char( 33 + (rand() % 41) ) );
+        }
+
+        batch.push_back(
+            len,
+            "read",
+            (const uint8*)reads[i].c_str(),
+            (const uint8*)quals[i].c_str(),
+            io::Phred33,
+            uint32(-1),
+            4u,
+            ops );
+    }
+    batch.end_batch();
+
+    for (uint32 i = 0; i < n_reads; ++i)
+    {
+        const uint32 len = uint32( reads[i].length() );
+
+        for (uint32 s = 0; s < 4; ++s)
+        {
+            const uint32 r = i*4 + s;
+
+            const io::ReadData::read_string read = batch.get_read( r );
+            const char*                     qual = batch.qual_stream() + batch.get_range( r ).x;
+
+            const bool reverse    = (ops[s] & io::ReadDataRAM::REVERSE_OP)    != 0;
+            const bool complement = (ops[s] & io::ReadDataRAM::COMPLEMENT_OP) != 0;
+
+            if (read.length() != len)
+            {
+                log_error(stderr, "  encoding: length mismatch at read %u, strand %u\n", i, s);
+                return false;
+            }
+            for (uint32 j = 0; j < len; ++j)
+            {
+                uint8 bp = reference_bp( reads[i][ reverse ? len - j - 1u : j ] );
+                if (complement)
+                    bp = bp < 4u ? 3u - bp : 4u;
+
+                // the qualities are laid out in reverse order for the complemented strands only
+                const char q = char( quals[i][ complement ? len - j - 1u : j ] - 33 );
+
+                if (uint8( read[j] ) != bp || qual[j] != q)
+                {
+                    log_error(stderr, "  encoding: mismatch at read %u, strand %u, bp %u\n", i, s, j);
+                    return false;
+                }
+            }
+        }
+    }
+
+    // recycle the batch for a shorter one without qualities: its storage is reused as is,
+    // and none of the previous contents must leak through
+    io::ReadDataRAM short_batch;
+    short_batch.push_back( 3u, "short", (const uint8*)"ACG", NULL, io::Phred33, uint32(-1), io::ReadDataRAM::NO_OP );
+
+    batch.clear();
+    batch.append_reads( short_batch, 0u, 1u );
+    batch.end_batch();
+
+    if (batch.size() != 1u || batch.qual_stream() != NULL ||
+        batch.read_stream()[0] != 0x210u ||
+        strcmp( batch.name_stream(), "short" ) != 0)
+    {
+        log_error(stderr, "  encoding: recycled batch mismatch\n");
+        return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int reads_test(int argc, char* argv[])
+{
+    fprintf(stderr, "reads test... started\n");
+
+    if (encoding_test() == false)
+        exit(1);
+
+    const char* file_name = "reads_test.fastq";
+    uint64      file_size = 0;
+
+    if (argc > 0)
+    {
+        // benchmark a user-provided file
+        file_name = argv[0];
+
+        FILE* file = fopen( file_name, "rb" );
+        if (file == NULL)
+        {
+            log_error(stderr, "  unable to open \"%s\"\n", file_name);
+            exit(1);
+        }
+        fseek( file, 0, SEEK_END );
+        file_size = ftell( file );
+        fclose( file );
+    }
+    else
+    {
+        file_size = write_synthetic_fastq( file_name, 200000u );
+        if (file_size == 0)
+        {
+            log_error(stderr, "  unable to write \"%s\"\n", file_name);
+            exit(1);
+        }
+    }
+
+    const io::ReadEncoding flags = io::ReadEncoding( io::FORWARD | io::REVERSE_COMPLEMENT );
+
+    // use at least two threads, so as to exercise the parallel parser on any machine
+    const uint32 n_threads = nvbio::max( num_logical_cores(), 2u );
+
+    // open the file with each of the available parsers: the byte-at-a-time one, the block-scanning one,
+    // the parallel one, and the parallel one working in place on a memory mapping
+    io::ReadDataFile_FASTQ_gz   scalar_file(   file_name, io::Phred33, uint32(-1), uint32(-1), flags );
+    io::ReadDataFile_FASTQ_gz   block_file(    file_name, io::Phred33, uint32(-1), uint32(-1), flags );
+    io::ReadDataFile_FASTQ_gz   parallel_file( file_name, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+    io::ReadDataFile_FASTQ_mmap mapped_file(   file_name, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+    scalar_file.set_block_scan( false );
+    block_file.set_block_scan( true );
+
+    const uint32 n_parsers = 4;
+
+    io::ReadDataStream* parsers[n_parsers]      = { &scalar_file, &block_file, &parallel_file, &mapped_file };
+    const char*         parser_names[n_parsers] = { "scalar parser  ", "block parser   ", "parallel parser", "mapped parser  " };
+    float               parser_times[n_parsers] = { 0.0f };
+
+    if (mapped_file.is_ok() == false)
+    {
+        log_error(stderr, "  unable to map \"%s\"\n", file_name);
+        exit(1);
+    }
+
+    const uint32 batch_size = 512*1024;
+
+    Timer timer;
+
+    uint32 n_reads = 0;
+    bool   success = true;
+
+    while (success)
+    {
+        io::ReadData* batches[n_parsers];
+        for (uint32 i = 0; i < n_parsers; ++i)
+        {
+            timer.start();
+            batches[i] = parsers[i]->next( batch_size, uint32(-1) );
+            timer.stop();
+            parser_times[i] += timer.seconds();
+        }
+
+        for (uint32 i = 1; i < n_parsers; ++i)
+        {
+            if ((batches[0] == NULL) != (batches[i] == NULL))
+            {
+                log_error(stderr, "  %s: batch count mismatch after %u reads\n", parser_names[i], n_reads);
+                success = false;
+            }
+            else if (batches[0] != NULL && compare( *batches[0], *batches[i] ) == false)
+            {
+                log_error(stderr, "  %s: batch mismatch after %u reads\n", parser_names[i], n_reads);
+                success = false;
+            }
+        }
+
+        if (batches[0] == NULL)
+            break;
+
+        n_reads += batches[0]->size();
+
+        // recycle all batches, so as to check that the following ones are not polluted by stale data
+        for (uint32 i = 0; i < n_parsers; ++i)
+            parsers[i]->release( batches[i] );
+    }
+
+    // write the forward strands of all batches to a read archive, and check that they are streamed
+    // back unchanged, both as whole batches, through random access, and in smaller slices
+    const char* archive_name = "reads_test.nvr";
+    float       archive_time = 0.0f;
+
+    if (success)
+    {
+        io::ReadDataFile_FASTQ_mmap input( file_name, io::Phred33, uint32(-1), uint32(-1), io::FORWARD, n_threads );
+        io::ReadDataArchiveWriter   writer;
+
+        if (writer.open( archive_name ) == false)
+        {
+            log_error(stderr, "  unable to write \"%s\"\n", archive_name);
+            exit(1);
+        }
+        while (io::ReadData* batch = input.next( batch_size, uint32(-1) ))
+        {
+            if (writer.write( *batch ) == false)
+            {
+                log_error(stderr, "  unable to write \"%s\"\n", archive_name);
+                exit(1);
+            }
+            input.release( batch );
+        }
+        writer.close();
+
+        io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), io::FORWARD, n_threads );
+        io::ReadDataFile_Archive    whole(  archive_name, uint32(-1), uint32(-1), io::FORWARD );
+        io::ReadDataFile_Archive    sliced( archive_name, uint32(-1), uint32(-1), io::FORWARD );
+
+        io::ReadData* slice     = NULL;
+        uint32        slice_pos = 0;
+
+        for (uint32 k = 0; success; ++k)
+        {
+            io::ReadData* ref = reference.next( batch_size, uint32(-1) );
+
+            timer.start();
+            io::ReadData* batch = whole.next( batch_size, uint32(-1) );
+            timer.stop();
+            archive_time += timer.seconds();
+
+            if ((ref == NULL) != (batch == NULL))
+            {
+                log_error(stderr, "  archive: batch count mismatch\n");
+                success = false;
+            }
+            if (ref == NULL || batch == NULL)
+                break;
+
+            if (compare( *ref, *batch ) == false)
+            {
+                log_error(stderr, "  archive: batch %u mismatch\n", k);
+                success = false;
+            }
+
+            io::ReadData* random_batch = whole.batch( k );
+            if (random_batch == NULL || compare( *ref, *random_batch ) == false)
+            {
+                log_error(stderr, "  archive: random access to batch %u failed\n", k);
+                success = false;
+            }
+            delete random_batch;
+
+            // match the batch read by read against the stream of slices
+            for (uint32 i = 0; i < batch->size() && success; ++i)
+            {
+                if (slice == NULL || slice_pos == slice->size())
+                {
+                    sliced.release( slice );
+                    slice     = sliced.next( batch_size / 3u, uint32(-1) );
+                    slice_pos = 0;
+                }
+                if (slice == NULL || compare_read( *batch, i, *slice, slice_pos++ ) == false)
+                {
+                    log_error(stderr, "  archive: slice mismatch in batch %u\n", k);
+                    success = false;
+                }
+            }
+
+            reference.release( ref );
+            whole.release( batch );
+        }
+
+        if (success && (slice == NULL || slice_pos != slice->size() || sliced.next( batch_size / 3u, uint32(-1) ) != NULL))
+        {
+            log_error(stderr, "  archive: slice count mismatch\n");
+            success = false;
+        }
+        sliced.release( slice );
+    }
+
+    // open the archive like any other read file, asking for strands other than the stored ones,
+    // and in particular for the reverse ones nvBowtie requests, and check they are derived as
+    // the FASTQ parser derives them
+    if (success)
+    {
+        const io::ReadEncoding encodings[2] = { flags, io::REVERSE };
+
+        for (uint32 e = 0; e < 2 && success; ++e)
+        {
+            io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), encodings[e], n_threads );
+            io::ReadDataStream*         archive = io::open_read_file( archive_name, io::Phred33, uint32(-1), uint32(-1), encodings[e] );
+
+            if (archive == NULL || archive->is_ok() == false)
+            {
+                log_error(stderr, "  archive: unable to open \"%s\" with strands %u\n", archive_name, uint32( encodings[e] ));
+                success = false;
+            }
+            else
+                success = compare_streams( "archive strands", *archive, batch_size / 3u, reference, batch_size );
+
+            delete archive;
+        }
+    }
+
+    // write an archive from batches without qualities, and check they are served without
+    // qualities, both on the forward path and while deriving the other strands
+    if (success)
+    {
+        io::ReadDataFile_FASTQ_mmap input( file_name, io::Phred33, uint32(-1), uint32(-1), io::FORWARD, n_threads );
+        input.m_load_flags = io::LOAD_NAMES;
+
+        io::ReadDataArchiveWriter writer;
+        if (writer.open( archive_name ) == false)
+        {
+            log_error(stderr, "  unable to write \"%s\"\n", archive_name);
+            exit(1);
+        }
+        while (io::ReadData* batch = input.next( batch_size, uint32(-1) ))
+        {
+            if (batch->qual_stream() != NULL || writer.write( *batch ) == false)
+            {
+                log_error(stderr, "  unable to write \"%s\" without qualities\n", archive_name);
+                exit(1);
+            }
+            input.release( batch );
+        }
+        writer.close();
+
+        const io::ReadEncoding encodings[2] = { io::FORWARD, flags };
+
+        for (uint32 e = 0; e < 2 && success; ++e)
+        {
+            io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), encodings[e], n_threads );
+            io::ReadDataFile_Archive    archive( archive_name, uint32(-1), uint32(-1), encodings[e] );
+            reference.m_load_flags = io::LOAD_NAMES;
+
+            if (archive.is_ok() == false)
+            {
+                log_error(stderr, "  archive: unable to open \"%s\" without qualities\n", archive_name);
+                success = false;
+            }
+            else
+                success = compare_streams( "archive without qualities", archive, batch_size / 3u, reference, batch_size );
+        }
+    }
+    remove( archive_name );
+
+    // load the reads skipping the qualities and replacing the names with their ids, both sequentially
+    // and in parallel, and check the base pairs are unaffected
+    if (success)
+    {
+        io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+        io::ReadDataFile_FASTQ_gz   scalar(    file_name, io::Phred33, uint32(-1), uint32(-1), flags );
+        io::ReadDataFile_FASTQ_mmap parallel(  file_name, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+        scalar.set_block_scan( false );
+        scalar.m_load_flags   = io::LOAD_READ_IDS;
+        parallel.m_load_flags = io::LOAD_READ_IDS;
+
+        io::ReadDataStream* stripped[2] = { &scalar, &parallel };
+
+        uint32 read_id = 0;
+        while (success)
+        {
+            io::ReadData* ref = reference.next( batch_size, uint32(-1) );
+            io::ReadData* batches[2];
+            for (uint32 p = 0; p < 2; ++p)
+                batches[p] = stripped[p]->next( batch_size, uint32(-1) );
+
+            for (uint32 p = 0; p < 2 && success; ++p)
+            {
+                io::ReadData* batch = batches[p];
+                if ((ref == NULL) != (batch == NULL))
+                {
+                    log_error(stderr, "  stripped load: batch count mismatch\n");
+                    success = false;
+                }
+                else if (ref != NULL &&
+                         (batch->size()        != ref->size() ||
+                          batch->qual_stream() != NULL        ||
+                          memcmp( batch->read_index(),  ref->read_index(),  sizeof(uint32) * (ref->size()+1) ) != 0 ||
+                          memcmp( batch->read_stream(), ref->read_stream(), sizeof(uint32) * ref->words() )    != 0))
+                {
+                    log_error(stderr, "  stripped load: batch mismatch\n");
+                    success = false;
+                }
+
+                // each read is stored once per strand, all sharing the same id
+                for (uint32 i = 0; ref != NULL && i < ref->size() && success; ++i)
+                {
+                    char id[16];
+                    sprintf( id, "%u", read_id + i/2u );
+                    if (strcmp( batch->name_stream() + batch->name_index()[i], id ) != 0)
+                    {
+                        log_error(stderr, "  stripped load: read id mismatch at read %u\n", read_id + i/2u);
+                        success = false;
+                    }
+                }
+            }
+
+            if (ref == NULL)
+                break;
+
+            read_id += ref->size() / 2u;
+
+            reference.release( ref );
+            for (uint32 p = 0; p < 2; ++p)
+                stripped[p]->release( batches[p] );
+        }
+    }
+
+    // read the file as interleaved pairs, and check that the two mates of each pair are
+    // consecutive reads of the file, both strands included
+    if (success && (n_reads % 4u) == 0)
+    {
+        io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), flags );
+        io::ReadData*               ref     = NULL;
+        uint32                      ref_pos = 0;
+
+        io::PairedReadDataStream* paired = io::open_paired_read_file( file_name, NULL, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+
+        io::ReadData* mates[2];
+        while (success && paired != NULL && paired->next( batch_size / 3u, &mates[0], &mates[1] ))
+        {
+            if (mates[0]->size() != mates[1]->size() || (mates[0]->size() & 1u))
+            {
+                log_error(stderr, "  interleaved: unpaired batch\n");
+                success = false;
+            }
+
+            // each mate is stored once per strand
+            for (uint32 i = 0; i < mates[0]->size() && success; i += 2)
+            {
+                for (uint32 m = 0; m < 4 && success; ++m)
+                {
+                    if (ref == NULL || ref_pos == ref->size())
+                    {
+                        reference.release( ref );
+                        ref     = reference.next( batch_size, uint32(-1) );
+                        ref_pos = 0;
+                    }
+                    if (ref == NULL || compare_read( *ref, ref_pos++, *mates[m/2], i + m%2 ) == false)
+                    {
+                        log_error(stderr, "  interleaved: mate mismatch at read %u\n", i);
+                        success = false;
+                    }
+                }
+            }
+            paired->release( mates[0] );
+            paired->release( mates[1] );
+        }
+
+        if (success && (paired == NULL || ref == NULL || ref_pos != ref->size() || reference.next( batch_size, uint32(-1) ) != NULL))
+        {
+            log_error(stderr, "  interleaved: read count mismatch\n");
+            success = false;
+        }
+        if (success && paired->has_error())
+        {
+            log_error(stderr, "  interleaved: the stream ended with an error\n");
+            success = false;
+        }
+        reference.release( ref );
+        delete paired;
+    }
+
+    // load the same pairs from a BAM file, where they're paired up through their READ1/READ2 flags,
+    // and from two FASTQ files; then check that a BAM file ending with a lone mate fails, and so do
+    // two FASTQ files holding different numbers of reads
+    if (success)
+    {
+        const char* bam_name    = "reads_test.pairs.bam";
+        const char* fastq_name1 = "reads_test.pairs_1.fastq";
+        const char* fastq_name2 = "reads_test.pairs_2.fastq";
+
+        for (uint32 dangling = 0; dangling < 2 && success; ++dangling)
+        {
+            if (write_synthetic_paired_bam( bam_name, fastq_name1, fastq_name2, 5000u, dangling != 0 ) == false)
+            {
+                log_error(stderr, "  unable to write \"%s\"\n", bam_name);
+                success = false;
+                break;
+            }
+
+            io::PairedReadDataStream* paired    = io::open_paired_read_file( bam_name, NULL, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+            io::PairedReadDataStream* reference = io::open_paired_read_file( fastq_name1, fastq_name2, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+
+            if (paired == NULL || reference == NULL)
+            {
+                log_error(stderr, "  unable to open the paired read files\n");
+                success = false;
+            }
+            else if (dangling == 0)
+                success = compare_paired( "BAM pairs", *paired, *reference, batch_size / 7u );
+            else
+            {
+                io::ReadData* mates[2];
+                while (paired->next( batch_size / 7u, &mates[0], &mates[1] ))
+                {
+                    paired->release( mates[0] );
+                    paired->release( mates[1] );
+                }
+                if (paired->has_error() == false || paired->is_ok())
+                {
+                    log_error(stderr, "  BAM pairs: a missing mate went unnoticed\n");
+                    success = false;
+                }
+            }
+            delete paired;
+            delete reference;
+        }
+
+        if (success && (write_synthetic_fastq( fastq_name1, 3000u ) == 0 || write_synthetic_fastq( fastq_name2, 2999u ) == 0))
+        {
+            log_error(stderr, "  unable to write the paired read files\n");
+            success = false;
+        }
+        if (success)
+        {
+            io::PairedReadDataStream* paired = io::open_paired_read_file( fastq_name1, fastq_name2, io::Phred33, uint32(-1), uint32(-1), flags, n_threads );
+
+            io::ReadData* mates[2];
+            while (paired != NULL && paired->next( batch_size / 7u, &mates[0], &mates[1] ))
+            {
+                paired->release( mates[0] );
+                paired->release( mates[1] );
+            }
+            if (paired == NULL || paired->has_error() == false || paired->is_ok())
+            {
+                log_error(stderr, "  paired files: mismatching read counts went unnoticed\n");
+                success = false;
+            }
+            delete paired;
+        }
+        remove( bam_name );
+        remove( fastq_name1 );
+        remove( fastq_name2 );
+    }
+
+    // split the file in shards, and check that together they cover all reads exactly once, in order
+    if (success)
+    {
+        io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), flags );
+
+        success = shard_test( "shards", file_name, reference, flags, n_threads, 7u, batch_size / 5u );
+    }
+
+    // compress the file in BGZF format and split it in shards at block boundaries, locating
+    // the records straddling them in the decompressed data
+    if (success)
+    {
+        const char* bgzf_name = "reads_test.fastq.gz";
+
+        std::string data( file_size, '\0' );
+
+        FILE* file = fopen( file_name, "rb" );
+        if (file == NULL || fread( &data[0], 1u, file_size, file ) != file_size || write_bgzf( bgzf_name, data, 32749u ) == false)
+        {
+            log_error(stderr, "  unable to write \"%s\"\n", bgzf_name);
+            success = false;
+        }
+        if (file)
+            fclose( file );
+
+        if (success)
+        {
+            io::ReadDataFile_FASTQ_mmap reference( file_name, io::Phred33, uint32(-1), uint32(-1), flags );
+
+            success = shard_test( "BGZF shards", bgzf_name, reference, flags, n_threads, 7u, batch_size / 5u );
+        }
+        remove( bgzf_name );
+    }
+
+    // write a BAM file along with a FASTQ file holding the same reads, and check the BAM file
+    // decodes to the same batches with all strands, and that its shards cover all reads exactly once
+    if (success)
+    {
+        const char* bam_name   = "reads_test.bam";
+        const char* fastq_name = "reads_test.bam.fastq";
+
+        if (write_synthetic_bam( bam_name, fastq_name, 20000u ) == false)
+        {
+            log_error(stderr, "  unable to write \"%s\"\n", bam_name);
+            success = false;
+        }
+
+        if (success)
+        {
+            const io::ReadEncoding all_strands = io::ReadEncoding( io::FORWARD | io::REVERSE | io::FORWARD_COMPLEMENT | io::REVERSE_COMPLEMENT );
+
+            io::ReadDataFile_FASTQ_mmap reference( fastq_name, io::Phred33, uint32(-1), uint32(-1), all_strands );
+            io::ReadDataStream*         bam = io::open_read_file( bam_name, io::Phred33, uint32(-1), uint32(-1), all_strands );
+
+            while (success && bam != NULL)
+            {
+                io::ReadData* ref   = reference.next( batch_size / 3u, uint32(-1) );
+                io::ReadData* batch = bam->next( batch_size / 3u, uint32(-1) );
+
+                if ((ref == NULL) != (batch == NULL) ||
+                    (ref != NULL && compare( *ref, *batch ) == false))
+                {
+                    log_error(stderr, "  BAM: batch mismatch\n");
+                    success = false;
+                }
+                if (ref == NULL || batch == NULL)
+                    break;
+
+                reference.release( ref );
+                bam->release( batch );
+            }
+            if (bam == NULL)
+            {
+                log_error(stderr, "  unable to open \"%s\"\n", bam_name);
+                success = false;
+            }
+            delete bam;
+        }
+
+        if (success)
+        {
+            io::ReadDataFile_FASTQ_mmap reference( fastq_name, io::Phred33, uint32(-1), uint32(-1), flags );
+
+            success = shard_test( "BAM shards", bam_name, reference, flags, n_threads, 7u, batch_size / 5u );
+        }
+        remove( bam_name );
+        remove( fastq_name );
+    }
+
+    // write a SAM file along with a FASTQ file holding the same reads, and check the SAM file
+    // decodes to the same batches with all strands
+    if (success)
+    {
+        const char* sam_name   = "reads_test.sam";
+        const char* fastq_name = "reads_test.sam.fastq";
+
+        if (write_synthetic_sam( sam_name, fastq_name, 20000u ) == false)
+        {
+            log_error(stderr, "  unable to write \"%s\"\n", sam_name);
+            success = false;
+        }
+
+        if (success)
+        {
+            const io::ReadEncoding all_strands = io::ReadEncoding( io::FORWARD | io::REVERSE | io::FORWARD_COMPLEMENT | io::REVERSE_COMPLEMENT );
+
+            io::ReadDataFile_FASTQ_mmap reference( fastq_name, io::Phred33, uint32(-1), uint32(-1), all_strands );
+            io::ReadDataStream*         sam = io::open_read_file( sam_name, io::Phred33, uint32(-1), uint32(-1), all_strands );
+
+            while (success && sam != NULL)
+            {
+                io::ReadData* ref   = reference.next( batch_size / 3u, uint32(-1) );
+                io::ReadData* batch = sam->next( batch_size / 3u, uint32(-1) );
+
+                if ((ref == NULL) != (batch == NULL) ||
+                    (ref != NULL && compare( *ref, *batch ) == false))
+                {
+                    log_error(stderr, "  SAM: batch mismatch\n");
+                    success = false;
+                }
+                if (ref == NULL || batch == NULL)
+                    break;
+
+                reference.release( ref );
+                sam->release( batch );
+            }
+            if (sam == NULL)
+            {
+                log_error(stderr, "  unable to open \"%s\"\n", sam_name);
+                success = false;
+            }
+            delete sam;
+        }
+        remove( sam_name );
+        remove( fastq_name );
+    }
+
+    if (argc == 0)
+        remove( file_name );
+
+    if (success == false)
+        exit(1);
+
+    fprintf(stderr, "  reads          : %u\n", n_reads);
+    for (uint32 i = 0; i < n_parsers; ++i)
+        fprintf(stderr, "  %s: %.2f s (%.1f MB/s)\n", parser_names[i], parser_times[i], (float(file_size) / float(1024*1024)) / parser_times[i]);
+    fprintf(stderr, "  read archive   : %.2f s (%.1f MB/s)\n", archive_time, (float(file_size) / float(1024*1024)) / archive_time);
+    fprintf(stderr, "  threads        : %u\n", n_threads);
+    fprintf(stderr, "reads test... done\n");
+    return 0;
+}
+
+} // namespace nvbio
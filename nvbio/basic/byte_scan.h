@@ -0,0 +1,58 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/basic/types.h>
+
+namespace nvbio {
+
+///@addtogroup Basic
+///@{
+
+///@addtogroup BasicUtils Utilities
+///@{
+
+///
+/// \page byte_scan_page Byte Scanning
+///
+/// This module provides a few host-side primitives to scan large byte buffers,
+/// e.g. for locating record boundaries in text files.
+/// The primitives are vectorized with AVX2 or SSE2 when the host compiler targets
+/// those instruction sets (i.e. when <i>__AVX2__</i> or <i>__SSE2__</i> are defined),
+/// and fall back to plain scalar loops otherwise.
+///
+
+/// find the first occurrence of a given byte in the range [begin,end)
+///
+/// \return         a pointer to the first matching byte, or end if none was found
+///
+inline const char* find_byte(const char* begin, const char* end, const char c);
+
+/// find the first byte in the range [begin,end) falling outside of the closed interval [lo,hi]
+///
+/// \return         a pointer to the first such byte, or end if none was found
+///
+inline const char* find_byte_not_in_range(const char* begin, const char* end, const uint8 lo, const uint8 hi);
+
+///@} BasicUtils
+///@} Basic
+
+} // namespace nvbio
+
+#include <nvbio/basic/byte_scan_inl.h>
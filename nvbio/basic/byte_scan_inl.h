@@ -0,0 +1,117 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/basic/popcount.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NVBIO_BYTE_SCAN_SSE2
+#endif
+
+namespace nvbio {
+
+// find the first occurrence of a given byte in the range [begin,end)
+//
+inline const char* find_byte(const char* begin, const char* end, const char c)
+{
+    const char* p = begin;
+
+#if defined(__AVX2__)
+    const __m256i pattern = _mm256_set1_epi8( c );
+    for (; p + 32 <= end; p += 32)
+    {
+        const __m256i block = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+        const uint32  mask  = uint32( _mm256_movemask_epi8( _mm256_cmpeq_epi8( block, pattern ) ) );
+        if (mask)
+            return p + ffs( int32( mask ) ) - 1u;
+    }
+#elif defined(NVBIO_BYTE_SCAN_SSE2)
+    const __m128i pattern = _mm_set1_epi8( c );
+    for (; p + 16 <= end; p += 16)
+    {
+        const __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+        const uint32  mask  = uint32( _mm_movemask_epi8( _mm_cmpeq_epi8( block, pattern ) ) );
+        if (mask)
+            return p + ffs( int32( mask ) ) - 1u;
+    }
+#endif
+
+    // scalar tail
+    for (; p < end; ++p)
+    {
+        if (*p == c)
+            return p;
+    }
+    return end;
+}
+
+// find the first byte in the range [begin,end) falling outside of the closed interval [lo,hi]
+//
+inline const char* find_byte_not_in_range(const char* begin, const char* end, const uint8 lo, const uint8 hi)
+{
+    const char* p = begin;
+
+#if defined(__AVX2__)
+    const __m256i vlo = _mm256_set1_epi8( char(lo) );
+    const __m256i vhi = _mm256_set1_epi8( char(hi) );
+    for (; p + 32 <= end; p += 32)
+    {
+        const __m256i block = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+
+        // x is in [lo,hi] iff max(x,lo) == x && min(x,hi) == x
+        const __m256i in_range = _mm256_and_si256(
+            _mm256_cmpeq_epi8( _mm256_max_epu8( block, vlo ), block ),
+            _mm256_cmpeq_epi8( _mm256_min_epu8( block, vhi ), block ) );
+
+        const uint32 mask = ~uint32( _mm256_movemask_epi8( in_range ) );
+        if (mask)
+            return p + ffs( int32( mask ) ) - 1u;
+    }
+#elif defined(NVBIO_BYTE_SCAN_SSE2)
+    const __m128i vlo = _mm_set1_epi8( char(lo) );
+    const __m128i vhi = _mm_set1_epi8( char(hi) );
+    for (; p + 16 <= end; p += 16)
+    {
+        const __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+
+        // x is in [lo,hi] iff max(x,lo) == x && min(x,hi) == x
+        const __m128i in_range = _mm_and_si128(
+            _mm_cmpeq_epi8( _mm_max_epu8( block, vlo ), block ),
+            _mm_cmpeq_epi8( _mm_min_epu8( block, vhi ), block ) );
+
+        const uint32 mask = ~uint32( _mm_movemask_epi8( in_range ) ) & 0xFFFFu;
+        if (mask)
+            return p + ffs( int32( mask ) ) - 1u;
+    }
+#endif
+
+    // scalar tail
+    for (; p < end; ++p)
+    {
+        const uint8 b = uint8( *p );
+        if (b < lo || b > hi)
+            return p;
+    }
+    return end;
+}
+
+} // namespace nvbio
@@ -29,8 +29,8 @@ namespace nvbio {
 template<uint32 STRIDE, uint32 WHICH, typename BaseIterator>
 struct deinterleaved_iterator
 {
-    typedef typename BaseIterator::value_type   value_type;
-    typedef typename BaseIterator::reference    reference;
+    typedef typename std::iterator_traits<BaseIterator>::value_type   value_type;
+    typedef typename std::iterator_traits<BaseIterator>::reference    reference;
     typedef const value_type*                   pointer;
     typedef int32                               difference_type;
     typedef std::random_access_iterator_tag     iterator_category;
@@ -79,7 +79,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     deinterleaved_iterator& operator++()
     {
-        ++m_it;
+        m_it += STRIDE;
         return *this;
     }
 
@@ -90,7 +90,7 @@ struct deinterleaved_iterator
     deinterleaved_iterator operator++(int i)
     {
         this_type r( m_it );
-        ++m_it;
+        m_it += STRIDE;
         return r;
     }
 
@@ -100,7 +100,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     deinterleaved_iterator& operator--()
     {
-        --m_it;
+        m_it -= STRIDE;
         return *this;
     }
 
@@ -111,7 +111,7 @@ struct deinterleaved_iterator
     deinterleaved_iterator operator--(int i)
     {
         this_type r( m_it );
-        --m_it;
+        m_it -= STRIDE;
         return r;
     }
 
@@ -121,7 +121,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     deinterleaved_iterator operator+(const difference_type i) const
     {
-        return transform_iterator( m_it + i );
+        return this_type( m_it + i*STRIDE );
     }
 
     /// subtraction
@@ -130,7 +130,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     deinterleaved_iterator operator-(const difference_type i) const
     {
-        return this_type( m_it - i );
+        return this_type( m_it - i*STRIDE );
     }
 
     /// addition
@@ -139,7 +139,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     deinterleaved_iterator& operator+=(const difference_type i)
     {
-        m_it += i;
+        m_it += i*STRIDE;
         return *this;
     }
 
@@ -149,7 +149,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     deinterleaved_iterator& operator-=(const difference_type i)
     {
-        m_it -= i;
+        m_it -= i*STRIDE;
         return *this;
     }
 
@@ -159,7 +159,7 @@ struct deinterleaved_iterator
     NVBIO_FORCEINLINE NVBIO_HOST_DEVICE
     difference_type operator-(const deinterleaved_iterator& it) const
     {
-        return m_it - it.m_it;
+        return (m_it - it.m_it) / STRIDE;
     }
 
     /// assignment
@@ -18,6 +18,7 @@
 
 #include <nvbio/basic/mmap.h>
 #include <nvbio/basic/console.h>
+#include <nvbio/basic/numbers.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -133,6 +134,60 @@ ServerMappedFile::~ServerMappedFile()
     delete impl;
 }
 
+struct MappedInputFile::Impl
+{
+    Impl() : h_file( INVALID_HANDLE_VALUE ), h_mapping( NULL ), buffer( NULL ), file_size( 0 ) {}
+
+    HANDLE h_file;
+    HANDLE h_mapping;
+    void*  buffer;
+    uint64 file_size;
+};
+
+MappedInputFile::MappedInputFile() : impl( new Impl() ) {}
+
+const char* MappedInputFile::init(const char* file_name, const bool sequential)
+{
+    impl->h_file = CreateFileA(
+        file_name,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS),
+        NULL );
+
+    if (impl->h_file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx( impl->h_file, &file_size ) == FALSE || file_size.QuadPart == 0)
+        return NULL;
+
+    impl->file_size = uint64( file_size.QuadPart );
+
+    impl->h_mapping = CreateFileMapping( impl->h_file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if (impl->h_mapping == NULL)
+        return NULL;
+
+    impl->buffer = MapViewOfFile( impl->h_mapping, FILE_MAP_READ, 0, 0, 0 );
+    return (const char*)impl->buffer;
+}
+
+uint64 MappedInputFile::size() const { return impl->file_size; }
+
+// no paging hints on Windows: FILE_FLAG_SEQUENTIAL_SCAN already takes care of read-ahead
+void MappedInputFile::read_ahead(const uint64 offset) {}
+
+MappedInputFile::~MappedInputFile()
+{
+    if (impl->buffer != NULL) UnmapViewOfFile( impl->buffer );
+    if (impl->h_mapping != NULL) CloseHandle( impl->h_mapping );
+    if (impl->h_file != INVALID_HANDLE_VALUE) CloseHandle( impl->h_file );
+
+    delete impl;
+}
+
 } // namespace nvbio
 
 #else
@@ -248,6 +303,99 @@ ServerMappedFile::~ServerMappedFile()
     delete impl;
 }
 
+// the amount of input prefetched past the current read offset
+static const uint64 READ_AHEAD_SIZE = 64u*1024u*1024u;
+
+struct MappedInputFile::Impl
+{
+    Impl() : h_file( -1 ), buffer( NULL ), file_size( 0 ), released( 0 ), prefetched( 0 ) {}
+
+    int     h_file;
+    void*   buffer;
+    uint64  file_size;
+    uint64  released;
+    uint64  prefetched;
+};
+
+MappedInputFile::MappedInputFile() : impl( new Impl() ) {}
+
+const char* MappedInputFile::init(const char* file_name, const bool sequential)
+{
+    impl->h_file = open( file_name, O_RDONLY );
+    if (impl->h_file == -1)
+        return NULL;
+
+    struct stat file_stat;
+    if (fstat( impl->h_file, &file_stat ) != 0 ||
+        S_ISREG( file_stat.st_mode ) == false ||
+        file_stat.st_size == 0)
+        return NULL;
+
+    impl->file_size = uint64( file_stat.st_size );
+
+    void* buffer = mmap(
+        NULL,
+        impl->file_size,
+        PROT_READ,
+        MAP_PRIVATE,
+        impl->h_file,
+        0 );
+
+    if (buffer == MAP_FAILED)
+        return NULL;
+
+    impl->buffer = buffer;
+
+    if (sequential)
+    {
+        // the file will be scanned sequentially: ask for aggressive read-ahead
+        madvise( impl->buffer, impl->file_size, MADV_SEQUENTIAL );
+        read_ahead( 0u );
+    }
+    else
+    {
+        // the file will be accessed at random: only page in what gets touched
+        madvise( impl->buffer, impl->file_size, MADV_RANDOM );
+    }
+
+    return (const char*)impl->buffer;
+}
+
+uint64 MappedInputFile::size() const { return impl->file_size; }
+
+void MappedInputFile::read_ahead(const uint64 offset)
+{
+    if (impl->buffer == NULL)
+        return;
+
+    const uint64 page_size = uint64( sysconf( _SC_PAGESIZE ) );
+
+    // release the pages entirely behind the offset
+    const uint64 release_end = (offset / page_size) * page_size;
+    if (release_end > impl->released)
+    {
+        madvise( (char*)impl->buffer + impl->released, release_end - impl->released, MADV_DONTNEED );
+        impl->released = release_end;
+    }
+
+    // and prefetch the ones ahead of it
+    const uint64 prefetch_begin = nvbio::max( impl->prefetched, release_end );
+    const uint64 prefetch_end   = nvbio::min( offset + READ_AHEAD_SIZE, impl->file_size );
+    if (prefetch_end > prefetch_begin)
+    {
+        madvise( (char*)impl->buffer + prefetch_begin, prefetch_end - prefetch_begin, MADV_WILLNEED );
+        impl->prefetched = prefetch_end;
+    }
+}
+
+MappedInputFile::~MappedInputFile()
+{
+    if (impl->buffer != NULL) munmap( impl->buffer, impl->file_size );
+    if (impl->h_file != -1)   close( impl->h_file );
+
+    delete impl;
+}
+
 } // namespace nvbio
 
 #endif
@@ -30,6 +30,7 @@ namespace nvbio {
 ///
 /// - MappedFile
 /// - ServerMappedFile
+/// - MappedInputFile
 ///
 /// \section MMAPExampleSection Example
 ///
@@ -153,6 +154,40 @@ private:
     Impl* impl;
 };
 
+///
+/// A class to map a regular file read-only into the address space of the calling process,
+/// so that it can be parsed in place. The mapping is released when the destructor is called.
+///
+struct MappedInputFile
+{
+    /// constructor
+    ///
+    MappedInputFile();
+
+    /// destructor
+    ///
+    ~MappedInputFile();
+
+    /// map the given file, advising the OS that it will be read sequentially or, if
+    /// sequential is false, accessed at random without any read-ahead;
+    /// returns NULL if the file couldn't be mapped (e.g. because it's empty, or not a regular file)
+    ///
+    const char* init(const char* file_name, const bool sequential = true);
+
+    /// return the mapped file size
+    ///
+    uint64 size() const;
+
+    /// signal that the mapped bytes before the given offset won't be accessed any longer:
+    /// the pages past it are prefetched, while the ones before it may be released
+    ///
+    void read_ahead(const uint64 offset);
+
+private:
+    struct Impl;
+    Impl* impl;
+};
+
 ///@} MemoryMappingModule
 ///@} Basic
 
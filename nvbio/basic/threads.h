@@ -33,7 +33,9 @@ namespace nvbio {
 /// - Thread
 /// - Mutex
 /// - ScopedLock
+/// - Condition
 /// - WorkQueue
+/// - BlockingQueue
 ///
 
 ///@addtogroup Basic
@@ -138,6 +140,8 @@ public:
     void unlock();
 
 private:
+    friend class Condition;
+
     struct Impl;
 
     SharedPointer<Impl, AtomicInt32>  m_impl;
@@ -176,6 +180,50 @@ private:
     Mutex* m_mutex;
 };
 
+/// A condition variable, to be used together with a Mutex to let threads sleep
+/// until some shared state protected by the mutex changes.
+///
+/// \code
+/// // consumer
+/// {
+///     ScopedLock lock( &m_mutex );
+///     while (m_ready == false)
+///         m_condition.wait( &m_mutex );
+///     ... // consume
+/// }
+/// // producer
+/// {
+///     ScopedLock lock( &m_mutex );
+///     m_ready = true;
+///     m_condition.signal();
+/// }
+/// \endcode
+///
+class Condition
+{
+public:
+     Condition();
+    ~Condition();
+
+    /// atomically release the given mutex, which must be locked by the calling thread,
+    /// and sleep until signaled; the mutex is locked again before returning
+    ///
+    void wait(Mutex* mutex);
+
+    /// wake up one of the waiting threads
+    ///
+    void signal();
+
+    /// wake up all the waiting threads
+    ///
+    void broadcast();
+
+private:
+    struct Impl;
+
+    SharedPointer<Impl, AtomicInt32>  m_impl;
+};
+
 /// Work queue class
 template <typename WorkItemT, typename ProgressCallbackT>
 class WorkQueue
@@ -221,6 +269,141 @@ private:
     uint32                m_size;
 };
 
+/// A bounded producer/consumer queue: push() sleeps while the queue is full and pop()
+/// sleeps while it is empty, so that a producer can never run more than a fixed number of
+/// items ahead of its consumers, and neither side burns a core while waiting.
+/// Once the queue has been closed, push() fails and pop() fails as soon as the items
+/// already queued have been drained.
+///
+/// The queue also keeps track of how often either side had to wait and of its average
+/// occupancy, which tell whether the consumer or the producer is the bottleneck.
+///
+/// \tparam T     the item type
+///
+template <typename T>
+class BlockingQueue
+{
+public:
+    typedef T   value_type;
+
+    /// constructor
+    ///
+    /// \param capacity     the maximum number of queued items
+    ///
+    BlockingQueue(const uint32 capacity = 4u) :
+        m_capacity( nvbio::max( capacity, 1u ) ),
+        m_closed( false ),
+        m_push_waits( 0u ),
+        m_pop_waits( 0u ),
+        m_pops( 0u ),
+        m_occupancy( 0u ) {}
+
+    /// push an item at the back of the queue, waiting for a free slot if the queue is full;
+    /// returns false if the queue has been closed
+    ///
+    bool push(const T item)
+    {
+        ScopedLock block( &m_lock );
+
+        if (m_queue.size() >= m_capacity && m_closed == false)
+            m_push_waits++;
+
+        while (m_queue.size() >= m_capacity && m_closed == false)
+            m_not_full.wait( &m_lock );
+
+        if (m_closed)
+            return false;
+
+        m_queue.push( item );
+        m_not_empty.signal();
+        return true;
+    }
+
+    /// pop an item from the front of the queue, waiting for one to be pushed if the queue
+    /// is empty; returns false if the queue has been closed and fully drained
+    ///
+    bool pop(T* item)
+    {
+        ScopedLock block( &m_lock );
+
+        if (m_queue.empty() && m_closed == false)
+            m_pop_waits++;
+
+        while (m_queue.empty() && m_closed == false)
+            m_not_empty.wait( &m_lock );
+
+        if (m_queue.empty())
+            return false;
+
+        // sample the occupancy seen by the consumer
+        m_occupancy += m_queue.size();
+        m_pops++;
+
+        *item = m_queue.front();
+        m_queue.pop();
+        m_not_full.signal();
+        return true;
+    }
+
+    /// close the queue, waking up all waiting threads
+    ///
+    void close()
+    {
+        ScopedLock block( &m_lock );
+        m_closed = true;
+        m_not_full.broadcast();
+        m_not_empty.broadcast();
+    }
+
+    /// return the maximum number of queued items
+    ///
+    uint32 capacity() const { return m_capacity; }
+
+    /// return the current number of queued items
+    ///
+    uint32 size()
+    {
+        ScopedLock block( &m_lock );
+        return uint32( m_queue.size() );
+    }
+
+    /// return the number of times push() had to wait for a free slot
+    ///
+    uint64 push_waits()
+    {
+        ScopedLock block( &m_lock );
+        return m_push_waits;
+    }
+
+    /// return the number of times pop() had to wait for an item
+    ///
+    uint64 pop_waits()
+    {
+        ScopedLock block( &m_lock );
+        return m_pop_waits;
+    }
+
+    /// return the average number of queued items seen by pop()
+    ///
+    float avg_occupancy()
+    {
+        ScopedLock block( &m_lock );
+        return m_pops ? float(m_occupancy) / float(m_pops) : 0.0f;
+    }
+
+private:
+    std::queue<T>   m_queue;
+    Mutex           m_lock;
+    Condition       m_not_full;
+    Condition       m_not_empty;
+    uint32          m_capacity;
+    bool            m_closed;
+    uint64          m_push_waits;
+    uint64          m_pop_waits;
+    uint64          m_pops;
+    uint64          m_occupancy;
+};
+
 /// return a number close to batch_size that achieves best threading balance
 inline uint32 balance_batch_size(uint32 batch_size, uint32 total_count, uint32 thread_count)
 {
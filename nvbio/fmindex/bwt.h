@@ -53,6 +53,37 @@ uint32 gen_bwt_from_sa(const uint32 n, const StreamIterator T, const int32* SA,
     return primary;
 }
 
+/// helper function to generate a suffix array padded by 1, where
+/// the 0-th entry is the SA size, for texts requiring 64-bit indices.
+///
+template <typename StreamIterator>
+int64 gen_sa(const uint64 n, const StreamIterator T, int64 *SA)
+{
+  SA[0] = int64(n);
+  if (n <= 1) {
+      if (n == 1) SA[1] = 0;
+      return 0;
+  }
+  return saisxx( T, SA+1, int64(n), int64(4) );
+}
+
+/// helper function to generate the BWT of a string given its suffix array,
+/// for texts requiring 64-bit indices.
+///
+template <typename StreamIterator>
+uint64 gen_bwt_from_sa(const uint64 n, const StreamIterator T, const int64* SA, StreamIterator bwt)
+{
+    uint64 i, primary = 0;
+
+    for (i = 0; i <= n; ++i)
+    {
+        if (SA[i] == 0) primary = i;
+        else bwt[i] = T[SA[i] - 1];
+    }
+    for (i = primary; i < n; ++i) bwt[i] = bwt[i + 1];
+    return primary;
+}
+
 /// helper function to generate the BWT of a string given a temporary buffer.
 ///
 template <typename StreamIterator>
@@ -76,8 +76,15 @@ struct FMIndexFilter<host_tag, fm_index_type>
     static const uint32                                     hit_dim = coord_dim*2;  ///< hits are either uint2 or uint4
     typedef typename vector_type<coord_type,hit_dim>::type  hit_type;               ///< hits are either uint2 or uint4
 
+    static const uint32                                     GROUP_SIZE = 32;        ///< the number of queries searched in lock-step by each thread
+
     /// enact the filter on an FM-index and a string-set
     ///
+    /// The queries are matched in groups of GROUP_SIZE, advancing their backward searches
+    /// in lock-step and prefetching the rank dictionary blocks of the next step of every
+    /// query before any of them is used, so as to hide the latency of the cache misses;
+    /// the groups are spread across the OpenMP threads.
+    ///
     /// \param index            the FM-index
     /// \param string-set       the query string-set
     ///
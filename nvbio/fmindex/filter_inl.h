@@ -66,6 +66,91 @@ struct rank_functor
     const string_set_type   string_set;
 };
 
+// match a group of consecutive strings of a string-set, advancing all their backward searches
+// in lock-step: at each step the rank dictionary blocks needed by all the active searches are
+// prefetched before any of them is consumed, so that their cache misses overlap instead of
+// being paid one after the other
+//
+// \tparam GROUP_SIZE       the maximum number of strings in the group
+//
+// \param index            the FM-index
+// \param string_set       the string-set
+// \param begin            the first string of the group
+// \param end              the end of the group, at most begin + GROUP_SIZE
+// \param ranges           the output ranges, indexed by string id
+//
+template <uint32 GROUP_SIZE, typename index_type, typename string_set_type>
+void rank_group(
+    const index_type&                       index,
+    const string_set_type&                  string_set,
+    const uint32                            begin,
+    const uint32                            end,
+    typename index_type::range_type*        ranges)
+{
+    typedef typename index_type::index_type         coord_type;
+    typedef typename index_type::range_type         range_type;
+    typedef typename string_set_type::string_type   string_type;
+
+    string_type strings[GROUP_SIZE];
+    range_type  group_ranges[GROUP_SIZE];
+    uint32      suffix_len[GROUP_SIZE];     // the number of symbols left to match
+    uint8       symbols[GROUP_SIZE];
+    uint32      active[GROUP_SIZE];         // the queries still being searched
+    uint32      n_active = 0;
+
+    for (uint32 j = 0; j < end - begin; ++j)
+    {
+        strings[j]      = string_set[ begin + j ];
+        suffix_len[j]   = length( strings[j] );
+        group_ranges[j] = make_vector( coord_type(0), index.length() );
+
+        if (suffix_len[j])
+            active[ n_active++ ] = j;
+    }
+
+    while (n_active)
+    {
+        // fetch the next symbol of each active query, and prefetch what ranking it will touch
+        for (uint32 a = 0; a < n_active; ++a)
+        {
+            const uint32 j = active[a];
+            const uint8  c = strings[j][ suffix_len[j]-1 ];
+            symbols[j] = c;
+
+            if (c <= 3)
+                prefetch_rank( index, make_vector( group_ranges[j].x-1, group_ranges[j].y ) );
+        }
+
+        // extend all the active queries by one symbol, retiring the ones that are done
+        uint32 n_left = 0;
+        for (uint32 a = 0; a < n_active; ++a)
+        {
+            const uint32 j = active[a];
+            const uint8  c = symbols[j];
+            if (c > 3) // there is an N here. no match
+            {
+                group_ranges[j] = make_vector( coord_type(1), coord_type(0) );
+                continue;
+            }
+
+            const range_type c_rank = rank(
+                index,
+                make_vector( group_ranges[j].x-1, group_ranges[j].y ),
+                c );
+
+            group_ranges[j].x = index.L2(c) + c_rank.x + 1;
+            group_ranges[j].y = index.L2(c) + c_rank.y;
+
+            if (--suffix_len[j] && group_ranges[j].x <= group_ranges[j].y)
+                active[ n_left++ ] = j;
+        }
+        n_active = n_left;
+    }
+
+    for (uint32 j = 0; j < end - begin; ++j)
+        ranges[ begin + j ] = group_ranges[j];
+}
+
 template <typename range_type>
 struct filter_results
 {
@@ -202,12 +287,20 @@ uint64 FMIndexFilter<host_tag, fm_index_type>::rank(
     m_ranges.resize( m_n_queries );
     m_slots.resize( m_n_queries );
 
-    // search the strings in the index, obtaining a set of ranges
-    thrust::transform(
-        thrust::make_counting_iterator<uint32>(0u),
-        thrust::make_counting_iterator<uint32>(0u) + m_n_queries,
-        m_ranges.begin(),
-        fmindex::rank_functor<fm_index_type,string_set_type>( m_index, string_set ) );
+    // search the strings in the index, obtaining a set of ranges: the strings are searched
+    // in groups of interleaved queries, and the groups are spread across the host threads
+    range_type* ranges = nvbio::plain_view( m_ranges );
+
+    const int32 n_groups = int32( util::divide_ri( m_n_queries, GROUP_SIZE ) );
+
+    #pragma omp parallel for schedule(dynamic,16)
+    for (int32 g = 0; g < n_groups; ++g)
+    {
+        const uint32 begin = uint32(g) * GROUP_SIZE;
+        const uint32 end   = nvbio::min( begin + GROUP_SIZE, m_n_queries );
+
+        fmindex::rank_group<GROUP_SIZE>( m_index, string_set, begin, end, ranges );
+    }
 
     // scan their size to determine the slots
     thrust::inclusive_scan(
@@ -377,6 +377,20 @@ typename fm_index<TRankDictionary,TSuffixArray>::range_type rank(
     typename fm_index<TRankDictionary,TSuffixArray>::range_type     range,
     uint8                                                           c);
 
+/// \relates fm_index
+/// prefetch the parts of the rank dictionary which a rank() query on the ranges [0,l] and [0,r]
+/// would touch, so that several queries can overlap their cache misses (a no-op on the device).
+///
+/// \param fmi      FM-index
+/// \param range    range query [l,r]
+///
+template <
+    typename TRankDictionary,
+    typename TSuffixArray>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch_rank(
+    const fm_index<TRankDictionary,TSuffixArray>&                   fmi,
+    typename fm_index<TRankDictionary,TSuffixArray>::range_type     range);
+
 /// \relates fm_index
 /// return the number of occurrences of all characters in the range [0,k] of the
 /// given FM-index.
@@ -87,6 +87,31 @@ typename fm_index<TRankDictionary,TSuffixArray>::range_type rank(
     return rank( fmi.rank_dict(), range, c );
 }
 
+// prefetch the parts of the rank dictionary which a rank() query on the ranges [0,l] and [0,r]
+// would touch.
+//
+// \param fmi      FM-index
+// \param range    range query [l,r]
+//
+template <
+    typename TRankDictionary,
+    typename TSuffixArray>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch_rank(
+    const fm_index<TRankDictionary,TSuffixArray>&                   fmi,
+    typename fm_index<TRankDictionary,TSuffixArray>::range_type     range)
+{
+    typedef typename fm_index<TRankDictionary,TSuffixArray>::index_type index_type;
+
+    // the ends of the BWT are ranked without looking at the dictionary
+    if (range.x == fmi.length()) range.x = index_type(-1);
+    if (range.y == fmi.length()) range.y = index_type(-1);
+
+    if (range.x != index_type(-1) && range.x >= fmi.primary()) --range.x; // because $ is not in bwt
+    if (range.y != index_type(-1) && range.y >= fmi.primary()) --range.y; // because $ is not in bwt
+
+    prefetch_rank( fmi.rank_dict(), range );
+}
+
 // return the number of occurrences of all characters in the range [0,k] of the
 // given FM-index.
 //
@@ -23,8 +23,11 @@
 #include <nvbio/basic/popcount.h>
 #include <nvbio/basic/packedstream.h>
 #include <nvbio/basic/iterator.h>
+#include <nvbio/basic/deinterleaved_iterator.h>
+#include <nvbio/basic/threads.h>
 #include <vector_types.h>
 #include <vector_functions.h>
+#include <vector>
 
 namespace nvbio {
 
@@ -109,6 +112,48 @@ void build_occurrence_table(
     IndexType*     occ,
     IndexType*     cnt = NULL);
 
+///
+/// Build the occurrence table for a 2-bit big-endian packed string using multiple host
+/// threads: each thread pop-counts a contiguous range of K-symbol blocks a word at a time,
+/// the per-thread counters are exclusive-scanned, and each thread then fills its own
+/// slice of the table.
+/// The output is identical to the one produced by build_occurrence_table(), and K must be
+/// a multiple of the number of symbols per word.
+///
+/// \param words        packed symbol words
+/// \param n            number of symbols
+/// \param occ          output occurrence map
+/// \param cnt          optional table of the global counters
+/// \param n_threads    number of threads to use (0 = all logical cores)
+///
+template <uint32 K, typename WordType, typename IndexType>
+void build_packed_occurrence_table(
+    const WordType*  words,
+    const IndexType  n,
+    IndexType*       occ,
+    IndexType*       cnt       = NULL,
+    uint32           n_threads = 0u);
+
+///
+/// Interleave a 2-bit packed text and its occurrence table sampled every 64 symbols
+/// into a single stream of alternating (text[k], occ[k]) uint4 blocks, so that each
+/// group of 64 symbols sits right next to its base counters in the same 32-byte segment
+/// and a rank query on a cache-line aligned stream touches a single cache line.
+/// The two halves can be read back through deinterleaved_iterator<2,0> and
+/// deinterleaved_iterator<2,1> respectively.
+/// The output stream must contain 2*n_blocks entries.
+///
+/// \param n_blocks     number of 64-symbol blocks
+/// \param text         packed text blocks
+/// \param occ          occurrence table blocks
+/// \param bwt_occ      output interleaved stream
+///
+inline void interleave_occurrence_table(
+    const uint32    n_blocks,
+    const uint4*    text,
+    const uint4*    occ,
+    uint4*          bwt_occ);
+
 /// \relates rank_dictionary
 /// fetch the text character at position i in the rank dictionary
 ///
@@ -177,6 +222,20 @@ template <uint32 K, typename TextString, typename OccIterator, typename CountTab
 NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void rank4(
     const rank_dictionary<2,K,TextString,OccIterator,CountTable>& dict, const uint64_2 range, uint64_4* outl, uint64_4* outh);
 
+/// \relates rank_dictionary
+/// prefetch the occurrence counters and text blocks a rank query on the substrings [0,l] and [0,r]
+/// will touch, so that the query can later be answered without stalling on memory.
+/// This is a no-op on the device, and for dictionaries whose storage is not accessed through
+/// plain pointers.
+///
+/// \param dict         the rank dictionary
+/// \param range        the ends of the query ranges [0,range.x] and [0,range.y]; either
+///                     can be -1 to skip it
+///
+template <uint32 SYMBOL_SIZE_T, uint32 K, typename TextString, typename OccIterator, typename CountTable, typename RangeType>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch_rank(
+    const rank_dictionary<SYMBOL_SIZE_T,K,TextString,OccIterator,CountTable>& dict, const RangeType range);
+
 ///@} RankDictionaryModule
 ///@} FMIndex
 
@@ -48,7 +48,7 @@ void build_occurrence_table(
         if (i_mod_K == 0)
         {
             // save the counters
-            const uint32 k = i / K;
+            const IndexType k = i / K;
             for (uint32 c = 0; c < 4; ++c)
                 occ[ k*4 + c ] = counters[c];
         }
@@ -65,6 +65,189 @@ void build_occurrence_table(
     }
 }
 
+namespace priv {
+
+// count the occurrences of each symbol in the packed 2-bit big-endian string
+// words[begin/SYMBOLS_PER_WORD, ...) of length end - begin, where begin is word-aligned
+//
+template <typename WordType, typename IndexType>
+void count_packed_symbols(
+    const WordType*  words,
+    const IndexType  begin,
+    const IndexType  end,
+    IndexType*       counters)
+{
+    const uint32 SYMBOLS_PER_WORD = sizeof(WordType)*4u;
+
+    const IndexType n_words = (end - begin) / SYMBOLS_PER_WORD;
+    const uint32    n_tail  = uint32( (end - begin) & (SYMBOLS_PER_WORD-1u) );
+
+    const WordType* w = words + begin / SYMBOLS_PER_WORD;
+
+    // accumulate the counts of the first three symbols; the last one is given by
+    // the difference to the total
+    IndexType c1 = 0u, c2 = 0u, c3 = 0u;
+    for (IndexType i = 0; i < n_words; ++i)
+    {
+        const WordType word = w[i];
+        c1 += popc_2bit( word, 1 );
+        c2 += popc_2bit( word, 2 );
+        c3 += popc_2bit( word, 3 );
+    }
+    if (n_tail)
+    {
+        // the first symbols sit in the high bits: mask out the trailing padding
+        const WordType word = w[ n_words ];
+        const uint32   pad  = SYMBOLS_PER_WORD - n_tail;
+        c1 += popc_2bit( word, 1, pad );
+        c2 += popc_2bit( word, 2, pad );
+        c3 += popc_2bit( word, 3, pad );
+    }
+    counters[0] += (end - begin) - c1 - c2 - c3;
+    counters[1] += c1;
+    counters[2] += c2;
+    counters[3] += c3;
+}
+
+// a worker building the slice of the occurrence table covering the K-symbol
+// blocks [block_begin, block_end)
+//
+template <uint32 K, typename WordType, typename IndexType>
+struct PackedOccurrenceTableThread : public Thread< PackedOccurrenceTableThread<K,WordType,IndexType> >
+{
+    void run()
+    {
+        const IndexType begin = block_begin * K;
+        const IndexType end   = nvbio::min( block_end * K, n );
+
+        if (fill == false)
+        {
+            // first pass: count the symbols in this slice
+            for (uint32 c = 0; c < 4; ++c)
+                counters[c] = 0u;
+
+            count_packed_symbols( words, begin, end, counters );
+        }
+        else
+        {
+            // second pass: write out the counters at the beginning of each block,
+            // starting from the scanned base of this slice
+            for (IndexType k = block_begin; k < block_end; ++k)
+            {
+                for (uint32 c = 0; c < 4; ++c)
+                    occ[ k*4 + c ] = counters[c];
+
+                count_packed_symbols( words, k*K, nvbio::min( (k+1)*K, n ), counters );
+            }
+        }
+    }
+
+    const WordType* words;
+    IndexType       n;
+    IndexType*      occ;
+    IndexType       block_begin;
+    IndexType       block_end;
+    IndexType       counters[4];
+    bool            fill;
+};
+
+} // namespace priv
+
+//
+// Build the occurrence table for a 2-bit big-endian packed string using multiple host
+// threads.
+//
+// \param words        packed symbol words
+// \param n            number of symbols
+// \param occ          output occurrence map
+// \param cnt          optional table of the global counters
+// \param n_threads    number of threads to use (0 = all logical cores)
+//
+template <uint32 K, typename WordType, typename IndexType>
+void build_packed_occurrence_table(
+    const WordType*  words,
+    const IndexType  n,
+    IndexType*       occ,
+    IndexType*       cnt,
+    uint32           n_threads)
+{
+    typedef priv::PackedOccurrenceTableThread<K,WordType,IndexType> thread_type;
+
+    const IndexType n_blocks = (n + K-1) / K;
+
+    if (n_threads == 0)
+        n_threads = num_logical_cores();
+
+    // make sure each thread gets at least one block
+    n_threads = uint32( nvbio::max( nvbio::min( IndexType( n_threads ), n_blocks ), IndexType(1u) ) );
+
+    const IndexType blocks_per_thread = (n_blocks + n_threads-1) / n_threads;
+
+    // allocate each thread separately, as copies of a thread object would share its handle
+    std::vector<thread_type*> threads( n_threads );
+    for (uint32 t = 0; t < n_threads; ++t)
+    {
+        threads[t] = new thread_type;
+        threads[t]->words       = words;
+        threads[t]->n           = n;
+        threads[t]->occ         = occ;
+        threads[t]->block_begin = nvbio::min( IndexType( t ) * blocks_per_thread, n_blocks );
+        threads[t]->block_end   = nvbio::min( IndexType( t+1 ) * blocks_per_thread, n_blocks );
+        threads[t]->fill        = false;
+    }
+
+    // first pass: count the symbols in each slice
+    for (uint32 t = 0; t < n_threads; ++t)
+        threads[t]->create();
+    for (uint32 t = 0; t < n_threads; ++t)
+        threads[t]->join();
+
+    // exclusive scan of the per-thread counters
+    IndexType counters[4] = { 0u, 0u, 0u, 0u };
+    for (uint32 t = 0; t < n_threads; ++t)
+    {
+        for (uint32 c = 0; c < 4; ++c)
+        {
+            const IndexType slice_count = threads[t]->counters[c];
+            threads[t]->counters[c] = counters[c];
+            counters[c] += slice_count;
+        }
+        threads[t]->fill = true;
+    }
+
+    // second pass: fill the occurrence table
+    for (uint32 t = 0; t < n_threads; ++t)
+        threads[t]->create();
+    for (uint32 t = 0; t < n_threads; ++t)
+        threads[t]->join();
+
+    for (uint32 t = 0; t < n_threads; ++t)
+        delete threads[t];
+
+    if (cnt)
+    {
+        // build a cumulative table of the final counters
+        for (uint32 i = 0; i < 4; ++i)
+            cnt[i] = counters[i];
+    }
+}
+
+// Interleave a 2-bit packed text and its occurrence table sampled every 64 symbols
+// into a single stream of alternating (text[k], occ[k]) uint4 blocks
+//
+inline void interleave_occurrence_table(
+    const uint32    n_blocks,
+    const uint4*    text,
+    const uint4*    occ,
+    uint4*          bwt_occ)
+{
+    for (uint32 k = 0; k < n_blocks; ++k)
+    {
+        bwt_occ[ k*2+0 ] = text[k];
+        bwt_occ[ k*2+1 ] = occ[k];
+    }
+}
+
 //
 // TODO: CUDA build_occurrence_table
 //
@@ -115,15 +298,15 @@ template <>           NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint32 popc_2bit(const
 // pop-count all the occurrences of c in each of the 32-bit masks in text[begin, end],
 // where the last mask is truncated to i.
 //
-template <typename TextString, typename T>
+template <typename TextString, typename T, typename IndexType>
 NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint32 popc_2bit(
     const TextString    text,
     const T             c,
-    const uint32        begin,
-    const uint32        end)
+    const IndexType     begin,
+    const IndexType     end)
 {
     uint32 x = 0;
-    for (uint32 j = begin; j < end; ++j)
+    for (IndexType j = begin; j < end; ++j)
         x += occ::popc_2bit( text[j], c );
 
     return x;
@@ -131,16 +314,16 @@ NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint32 popc_2bit(
 // pop-count all the occurrences of c in each of the 32-bit masks in text[begin, end],
 // where the last mask is truncated to i.
 //
-template <typename TextString, typename T>
+template <typename TextString, typename T, typename IndexType>
 NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint32 popc_2bit(
     const TextString    text,
     const T             c,
-    const uint32        begin,
-    const uint32        end,
+    const IndexType     begin,
+    const IndexType     end,
     const uint32        i)
 {
     uint32 x = 0;
-    for (uint32 j = begin; j < end; ++j)
+    for (IndexType j = begin; j < end; ++j)
         x += occ::popc_2bit( text[j], c );
 
     return x + occ::popc_2bit( text[ end ], c, i );
@@ -166,6 +349,36 @@ NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint32 popc_2bit(
     return x + occ::popc_2bit( last_mask, c, i );
 }
 
+// prefetch the cache line holding the given element into all cache levels:
+// only plain host pointers can be prefetched, other iterators are left alone
+//
+template <typename Iterator>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(const Iterator it) {}
+
+template <typename T>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(T* ptr)
+{
+#if !defined(__CUDA_ARCH__) && defined(__GNUC__)
+    __builtin_prefetch( ptr );
+#endif
+}
+
+template <typename T>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(const T* ptr)
+{
+#if !defined(__CUDA_ARCH__) && defined(__GNUC__)
+    __builtin_prefetch( ptr );
+#endif
+}
+
+// prefetch an element of an interleaved stream: forwards to the underlying iterator
+//
+template <uint32 STRIDE, uint32 WHICH, typename BaseIterator>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(const deinterleaved_iterator<STRIDE,WHICH,BaseIterator> it)
+{
+    prefetch( it.m_it + WHICH );
+}
+
 } // namespace occ
 
 // fetch the text character at position i in the rank dictionary
@@ -223,17 +436,17 @@ struct dispatch_rank<2,K,PackedStream<TextStorage,uint8,2u,true,index_type>,OccI
     static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint2 popc2(
         const TextStorage   text,
         const range_type    range,
-        const uint32        kl,
-        const uint32        kh,
+        const index_type    kl,
+        const index_type    kh,
         const T             c)
     {
-        const uint32 ml = (range.x - kl*K) >> LOG_SYMS_PER_WORD;
-        const uint32 mh = (range.y - kh*K) >> LOG_SYMS_PER_WORD;
+        const uint32 ml = uint32( (range.x - kl*K) >> LOG_SYMS_PER_WORD );
+        const uint32 mh = uint32( (range.y - kh*K) >> LOG_SYMS_PER_WORD );
 
         const word_type l_mod = ~word_type(range.x) & (SYMS_PER_WORD-1);
         const word_type h_mod = ~word_type(range.y) & (SYMS_PER_WORD-1);
 
-        const uint32 offl = kl*(K >> LOG_SYMS_PER_WORD);
+        const index_type offl = kl*(K >> LOG_SYMS_PER_WORD);
 
         // sum up all the pop-counts of the relevant masks, up to ml-1
         uint32 xl = occ::popc_2bit( text, c, offl, offl + ml );
@@ -252,7 +465,7 @@ struct dispatch_rank<2,K,PackedStream<TextStorage,uint8,2u,true,index_type>,OccI
         // finish computing the end of the range
         if (kl != kh || mh > ml)
         {
-            const uint32 offh = kh*(K >> LOG_SYMS_PER_WORD);
+            const index_type offh = kh*(K >> LOG_SYMS_PER_WORD);
             xh += occ::popc_2bit( text, c, offh + startm, offh + mh, h_mod );
         }
         return make_uint2( xl, xh );
@@ -264,14 +477,14 @@ struct dispatch_rank<2,K,PackedStream<TextStorage,uint8,2u,true,index_type>,OccI
         if (i == index_type(-1))
             return 0u;
 
-        const uint32 k = i / K;
-        const uint32 m = (i - k*K) >> LOG_SYMS_PER_WORD;
+        const index_type k = i / K;
+        const uint32     m = uint32( (i - k*K) >> LOG_SYMS_PER_WORD );
         const word_type i_mod = ~word_type(i) & (SYMS_PER_WORD-1);
 
         // fetch base occurrence counter
-        const word_type out = dict.occ[ k*4 + c ];
+        const index_type out = dict.occ[ k*4 + c ];
 
-        const uint32 off = k*(K >> LOG_SYMS_PER_WORD);
+        const index_type off = k*(K >> LOG_SYMS_PER_WORD);
 
         // sum up all the pop-counts of the relevant masks
         return out + occ::popc_2bit( dict.text.stream(), c, off, off + m, i_mod );
@@ -290,8 +503,8 @@ struct dispatch_rank<2,K,PackedStream<TextStorage,uint8,2u,true,index_type>,OccI
             return make_vector( r, r );
         }
 
-        const uint32 kl = range.x / K;
-        const uint32 kh = range.y / K;
+        const index_type kl = range.x / K;
+        const index_type kh = range.y / K;
 
         // fetch base occurrence counters for the respective blocks
         const index_type outl = dict.occ[ kl*4 + c ];
@@ -301,16 +514,41 @@ struct dispatch_rank<2,K,PackedStream<TextStorage,uint8,2u,true,index_type>,OccI
 
         return make_vector( outl + r.x, outh + r.y );
     }
+    // prefetch the occurrence counters and text words needed to rank the substring [0,i]
+    static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(const dictionary_type& dict, const index_type i)
+    {
+        if (i == index_type(-1))
+            return;
+
+        const index_type k   = i / K;
+        const uint32     m   = uint32( (i - k*K) >> LOG_SYMS_PER_WORD );
+        const index_type off = k*(K >> LOG_SYMS_PER_WORD);
+
+        occ::prefetch( dict.occ + k*4 );
+
+        // the masks from the start of the block up to the one holding i may span two cache lines
+        occ::prefetch( dict.text.stream() + off );
+        occ::prefetch( dict.text.stream() + off + m );
+    }
+    // prefetch the occurrence counters and text words needed to rank the substrings [0,l] and [0,r]
+    static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(const dictionary_type& dict, const range_type range)
+    {
+        prefetch( dict, range.x );
+        if (range.y / K != range.x / K || range.x == index_type(-1))
+            prefetch( dict, range.y );
+        else
+            occ::prefetch( dict.text.stream() + (range.y >> LOG_SYMS_PER_WORD) );
+    }
     // fetch the number of occurrences of character c in the substring [0,i]
     static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE vec4_type run4(const dictionary_type& dict, const index_type i)
     {
-        const uint32 k = i / K;
-        const uint32 m = (i - k*K) >> LOG_SYMS_PER_WORD;
+        const index_type k = i / K;
+        const uint32     m = uint32( (i - k*K) >> LOG_SYMS_PER_WORD );
 
         // fetch base occurrence counters for all symbols in the respective block
         vec4_type r = make_vector( dict.occ[k*4+0], dict.occ[k*4+1], dict.occ[k*4+2], dict.occ[k*4+3] );
 
-        const uint32 off = k*(K >> LOG_SYMS_PER_WORD);
+        const index_type off = k*(K >> LOG_SYMS_PER_WORD);
         const uint32 x = occ::popc_2bit( dict.text.stream(), dict.count_table, off, off + m, ~word_type(i) & (SYMS_PER_WORD-1) );
 
         // add the packed counters to the output result
@@ -320,8 +558,8 @@ struct dispatch_rank<2,K,PackedStream<TextStorage,uint8,2u,true,index_type>,OccI
     // fetch the number of occurrences of character c in the substring [0,i]
     static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void run4(const dictionary_type& dict, const range_type range, vec4_type* outl, vec4_type* outh)
     {
-        const uint32 kl = range.x / K;
-        const uint32 kh = range.y / K;
+        const index_type kl = range.x / K;
+        const index_type kh = range.y / K;
 
         // fetch base occurrence counters for for all symbols in the respective blocks
         *outl =                      make_vector( dict.occ[kl*4+0], dict.occ[kl*4+1], dict.occ[kl*4+2], dict.occ[kl*4+3] );
@@ -446,6 +684,20 @@ struct dispatch_rank<2,64,PackedStream<TextStorage,uint8,2u,true>,OccIterator,Co
 
         return make_uint2( outl + r.x, outh + r.y );
     }
+    // prefetch the occurrence counters and text block needed to rank the substrings [0,l] and [0,r]
+    static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch(const dictionary_type& dict, const uint2 range)
+    {
+        if (range.x != uint32(-1))
+        {
+            occ::prefetch( dict.occ + (range.x >> LOG_K) );
+            occ::prefetch( dict.text.stream() + (range.x >> LOG_K) );
+        }
+        if (range.y != uint32(-1) && (range.y >> LOG_K) != (range.x >> LOG_K))
+        {
+            occ::prefetch( dict.occ + (range.y >> LOG_K) );
+            occ::prefetch( dict.text.stream() + (range.y >> LOG_K) );
+        }
+    }
     // fetch the number of occurrences of character c in the substring [0,i]
     static NVBIO_FORCEINLINE NVBIO_HOST_DEVICE uint4 run4(const dictionary_type& dict, const uint32 i)
     {
@@ -538,4 +790,16 @@ NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void rank4(
         dict, range, outl, outh );
 }
 
+// prefetch the occurrence counters and text blocks needed to rank the substrings [0,l] and [0,r]
+template <uint32 SYMBOL_SIZE_T, uint32 K, typename TextString, typename OccIterator, typename CountTable, typename RangeType>
+NVBIO_FORCEINLINE NVBIO_HOST_DEVICE void prefetch_rank(
+    const rank_dictionary<SYMBOL_SIZE_T,K,TextString,OccIterator,CountTable>& dict, const RangeType range)
+{
+    typedef typename TextString::storage_type                      word_type;
+    typedef typename std::iterator_traits<OccIterator>::value_type occ_type;
+
+    dispatch_rank<SYMBOL_SIZE_T,K,TextString,OccIterator,CountTable,word_type,occ_type>::prefetch(
+        dict, range );
+}
+
 } // namespace nvbio
@@ -256,13 +256,13 @@ inline SSA_index_multiple<K,index_type>::SSA_index_multiple(
     const index_type  n,
     const index_type* sa)
 {
-    const uint32 n_items = (n+1+K-1) / K;
+    const index_type n_items = (n+1+K-1) / K;
 
     m_n = n;
     m_ssa.resize( n_items );
 
     // store all the needed values
-    for (uint32 i = 0; i < n_items; ++i)
+    for (index_type i = 0; i < n_items; ++i)
         m_ssa[i] = sa[i*K];
 }
 
@@ -275,8 +275,8 @@ template <typename FMIndexType>
 SSA_index_multiple<K,index_type>::SSA_index_multiple(
     const FMIndexType& fmi)
 {
-    const uint32 n = fmi.length();
-    const uint32 n_items = (n+1+K-1) / K;
+    const index_type n = fmi.length();
+    const index_type n_items = (n+1+K-1) / K;
 
     m_n = n;
     m_ssa.resize( n_items );
@@ -84,5 +84,18 @@ struct BAM_alignment_data_block
     bool                second_score_valid; // do we have a second score?
 };
 
+// compute the smallest bin containing the 0-based, half-open interval [beg, end),
+// as defined by the BAM spec
+inline uint32 bam_reg2bin(const int32 beg, int32 end)
+{
+    --end;
+    if (beg >> 14 == end >> 14) return ((1u << 15) - 1) / 7 + (beg >> 14);
+    if (beg >> 17 == end >> 17) return ((1u << 12) - 1) / 7 + (beg >> 17);
+    if (beg >> 20 == end >> 20) return ((1u <<  9) - 1) / 7 + (beg >> 20);
+    if (beg >> 23 == end >> 23) return ((1u <<  6) - 1) / 7 + (beg >> 23);
+    if (beg >> 26 == end >> 26) return ((1u <<  3) - 1) / 7 + (beg >> 26);
+    return 0;
+}
+
 } // namespace io
 } // namespace nvbio
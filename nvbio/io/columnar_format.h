@@ -0,0 +1,190 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/basic/types.h>
+#include <string.h>
+
+namespace nvbio {
+namespace io {
+
+// Columnar alignment format (*.aln files)
+//
+// The file starts with a ColumnarFileHeader, followed by a sequence of batches. Each batch starts
+// with a ColumnarBatchHeader and holds n_columns columns of n_rows values each, every column being
+// made of a ColumnarColumnHeader followed by its packed values. Paired-end alignments are stored
+// as consecutive rows, the first mate coming first.
+//
+// Columns are compressed with frame-of-reference coding: each value is stored as its difference
+// to the base of the column, using the smallest width (1, 2 or 4 bytes) that fits all of them.
+// Readers should skip the columns they don't know about.
+
+// the columns of the format; values are 32-bit, unsigned unless noted
+enum ColumnarColumnId
+{
+    COLUMNAR_READ_ID     = 0,    // CRC of the read name
+    COLUMNAR_READ_LEN    = 1,
+    COLUMNAR_MATE        = 2,    // 0 for the first mate, 1 for the second
+    COLUMNAR_POS         = 3,    // 1-based position on the reference, 0 if unmapped
+    COLUMNAR_REF_ID      = 4,    // index of the reference sequence, -1 if unmapped
+    COLUMNAR_FLAG        = 5,    // SAM flags
+    COLUMNAR_SCORE       = 6,    // signed
+    COLUMNAR_MAPQ        = 7,
+    COLUMNAR_ED          = 8,
+    COLUMNAR_SUBS        = 9,    // number of CIGAR matches/mismatches
+    COLUMNAR_INS         = 10,   // number of CIGAR insertions
+    COLUMNAR_DELS        = 11,   // number of CIGAR deletions
+    COLUMNAR_MMS         = 12,   // number of mismatches
+    COLUMNAR_GAPO        = 13,   // number of gap opens
+    COLUMNAR_GAPE        = 14,   // number of gap extensions
+    COLUMNAR_HAS_SECOND  = 15,   // whether there's a second best alignment
+    COLUMNAR_SEC_SCORE   = 16,   // signed
+    COLUMNAR_MATE_REF_ID = 17,   // reference index of the opposite mate, -1 if unmapped
+    COLUMNAR_MATE_POS    = 18,   // 1-based position of the opposite mate, 0 if unmapped
+    COLUMNAR_N_COLUMNS   = 19
+};
+
+struct ColumnarFileHeader
+{
+    char   magic[4];    // "NVAC"
+    uint32 version;     // COLUMNAR_VERSION
+    uint32 paired;      // whether rows come in pairs of mates
+    uint32 pad;
+};
+
+struct ColumnarBatchHeader
+{
+    uint32 n_rows;
+    uint32 n_columns;
+    uint64 size;        // size of the column data following this header, in bytes
+};
+
+struct ColumnarColumnHeader
+{
+    uint32 id;          // a ColumnarColumnId
+    uint32 width;       // width of each value, in bytes
+    uint32 base;        // value added to each stored value
+    uint32 pad;
+};
+
+static const uint32 COLUMNAR_VERSION = 1;
+
+// whether a column holds signed values
+inline bool columnar_is_signed(const uint32 id)
+{
+    return id == COLUMNAR_SCORE || id == COLUMNAR_SEC_SCORE;
+}
+
+// compute the header of a column holding the given values, and the size of its packed data
+inline uint64 columnar_setup(const uint32 id, const uint32 *values, const uint32 n, ColumnarColumnHeader *header)
+{
+    uint32 range = 0;
+    uint32 base  = n ? values[0] : 0;
+
+    // find the smallest value and the range of the column, comparing signed columns as such
+    if (columnar_is_signed(id))
+    {
+        int32 min = n ? int32(values[0]) : 0;
+        int32 max = min;
+        for(uint32 i = 1; i < n; i++)
+        {
+            min = int32(values[i]) < min ? int32(values[i]) : min;
+            max = int32(values[i]) > max ? int32(values[i]) : max;
+        }
+        base  = uint32(min);
+        range = uint32(max) - uint32(min);
+    }
+    else
+    {
+        uint32 min = base;
+        uint32 max = base;
+        for(uint32 i = 1; i < n; i++)
+        {
+            min = values[i] < min ? values[i] : min;
+            max = values[i] > max ? values[i] : max;
+        }
+        base  = min;
+        range = max - min;
+    }
+
+    header->id    = id;
+    header->width = range < 0x100u ? 1u : range < 0x10000u ? 2u : 4u;
+    header->base  = base;
+    header->pad   = 0;
+    return uint64(n) * header->width;
+}
+
+// pack the values of a column set up by columnar_setup
+inline void columnar_pack(const ColumnarColumnHeader& header, const uint32 *values, const uint32 n, uint8 *out)
+{
+    const uint32 base = header.base;
+    if (header.width == 1)
+    {
+        for(uint32 i = 0; i < n; i++)
+            out[i] = uint8(values[i] - base);
+    }
+    else if (header.width == 2)
+    {
+        for(uint32 i = 0; i < n; i++)
+        {
+            const uint16 v = uint16(values[i] - base);
+            memcpy(out + i * 2, &v, sizeof(uint16));
+        }
+    }
+    else
+    {
+        for(uint32 i = 0; i < n; i++)
+        {
+            const uint32 v = values[i] - base;
+            memcpy(out + i * 4, &v, sizeof(uint32));
+        }
+    }
+}
+
+// unpack the values of a column
+inline void columnar_unpack(const ColumnarColumnHeader& header, const uint8 *in, const uint32 n, uint32 *values)
+{
+    const uint32 base = header.base;
+    if (header.width == 1)
+    {
+        for(uint32 i = 0; i < n; i++)
+            values[i] = base + in[i];
+    }
+    else if (header.width == 2)
+    {
+        for(uint32 i = 0; i < n; i++)
+        {
+            uint16 v;
+            memcpy(&v, in + i * 2, sizeof(uint16));
+            values[i] = base + v;
+        }
+    }
+    else
+    {
+        for(uint32 i = 0; i < n; i++)
+        {
+            uint32 v;
+            memcpy(&v, in + i * 4, sizeof(uint32));
+            values[i] = base + v;
+        }
+    }
+}
+
+} // namespace io
+} // namespace nvbio
@@ -17,6 +17,7 @@
  */
 
 #include <nvbio/io/fmi.h>
+#include <nvbio/io/fmi_container.h>
 #include <nvbio/basic/timer.h>
 #include <nvbio/basic/console.h>
 #include <nvbio/basic/bnt.h>
@@ -115,29 +116,62 @@ void cuda_alloc(T*& dst, const uint32 words, uint64& allocated)
 
 struct file_mismatch {};
 
+// return the size of an open file, leaving the file pointer at its beginning
+//
+uint64 file_size(FILE* file)
+{
+#if defined(WIN32)
+    _fseeki64( file, 0, SEEK_END );
+    const uint64 size = uint64( _ftelli64( file ) );
+#else
+    fseeko( file, 0, SEEK_END );
+    const uint64 size = uint64( ftello( file ) );
+#endif
+    fseek( file, 0, SEEK_SET );
+    return size;
+}
+
+// read a header field stored as either a 32-bit or a 64-bit integer
+//
+bool read_field(FILE* file, const uint32 field_size, uint64& field)
+{
+    if (field_size == sizeof(uint32))
+    {
+        uint32 field32;
+        if (!fread( &field32, sizeof(uint32), 1, file ))
+            return false;
+
+        field = field32;
+        return true;
+    }
+    return fread( &field, sizeof(uint64), 1, file ) == 1;
+}
+
+template <typename T>
 struct VectorAllocator
 {
-    VectorAllocator(std::vector<uint32>& vec) : m_vec( vec ) {}
+    VectorAllocator(std::vector<T>& vec) : m_vec( vec ) {}
 
-    uint32* alloc(const uint32 words)
+    T* alloc(const uint64 words)
     {
         m_vec.resize( words );
         return &m_vec[0];
     }
 
-    std::vector<uint32>& m_vec;
+    std::vector<T>& m_vec;
 };
+template <typename T>
 struct MMapAllocator
 {
     MMapAllocator(
         const char*       name,
         ServerMappedFile& mmap) : m_name( name ), m_mmap( mmap ) {}
 
-    uint32* alloc(const uint32 words)
+    T* alloc(const uint64 words)
     {
-        return (uint32*)m_mmap.init(
+        return (T*)m_mmap.init(
             m_name,
-            words * sizeof(uint32),
+            words * sizeof(T),
             NULL );
     }
 
@@ -149,16 +183,14 @@ template <typename Allocator>
 uint32* load_genome(
     const char*     genome_prefix,
     Allocator&      allocator,
-    uint32&         seq_length,
-    uint32&         seq_words)
+    uint64&         seq_length,
+    uint64&         seq_words)
 {
     std::string genome_wpac_string = std::string( genome_prefix ) + ".wpac";
     std::string genome_pac_string  = std::string( genome_prefix ) + ".pac";
     const char* wpac_file_name = genome_wpac_string.c_str();
     const char* pac_file_name  = genome_pac_string.c_str();
 
-    typedef FMIndexData::nonconst_stream_type nonconst_stream_type;
-
     bool pac = false;
 
     FILE* genome_file = fopen( wpac_file_name, "rb" );
@@ -187,18 +219,18 @@ uint32* load_genome(
             log_error(stderr, "error: failed reading genome\n");
             return 0;
         }
-        seq_length = uint32(field);
-        const uint32 unaligned_seq_words  = uint32( (seq_length+15)/16 );
+        seq_length = field;
+        const uint64 unaligned_seq_words  = (seq_length+15)/16;
         // make sure the genome length is a multiple of 4
         // this is required due to the interleaving of bwt and occ data in FMIndexDataDevice
         seq_words  = align<FMI_ALIGNMENT>( unaligned_seq_words );
 
         genome_stream = allocator.alloc( seq_words );
         // initialize the alignment slack
-        for (uint32 i = unaligned_seq_words; i < seq_words; ++i)
+        for (uint64 i = unaligned_seq_words; i < seq_words; ++i)
             genome_stream[i] = 0u;
 
-        const uint32 n_words = (uint32)block_fread( genome_stream, unaligned_seq_words, genome_file );
+        const uint64 n_words = block_fread( genome_stream, unaligned_seq_words, genome_file );
         if (n_words != unaligned_seq_words)
         {
             log_error(stderr, "error: failed reading genome\n");
@@ -208,8 +240,8 @@ uint32* load_genome(
     else
     {
         // read a .pac file
+        const uint64 packed_file_len = file_size( genome_file ) - 1u;
         fseek( genome_file, -1, SEEK_END );
-        const uint32 packed_file_len = ftell( genome_file );
         uint8 last_byte_len;
         if (!fread( &last_byte_len, sizeof(unsigned char), 1, genome_file ))
         {
@@ -220,7 +252,7 @@ uint32* load_genome(
 
         fseek( genome_file, 0, SEEK_SET );
 
-        const uint32 seq_bytes = uint32( (seq_length + 3u)/4u );
+        const uint64 seq_bytes = (seq_length + 3u)/4u;
 
         std::vector<uint8> pac_vec( seq_bytes );
         uint8* pac_stream = &pac_vec[0];
@@ -233,28 +265,29 @@ uint32* load_genome(
         }
 
         // alloc the word-packed genome
-        const uint32 unaligned_seq_words = uint32( (seq_length+15)/16 );
+        const uint64 unaligned_seq_words = (seq_length+15)/16;
         // make sure the genome length is a multiple of 4
         // this is required due to the interleaving of bwt and occ data in FMIndexDataDevice
         seq_words = align<FMI_ALIGNMENT>( unaligned_seq_words );
 
         genome_stream = allocator.alloc( seq_words );
         // initialize the alignment slack
-        for (uint32 i = unaligned_seq_words; i < seq_words; ++i)
+        for (uint64 i = unaligned_seq_words; i < seq_words; ++i)
             genome_stream[i] = 0u;
 
         // copy the pac stream into the genome
-        typedef PackedStream<uint8*,uint8,2,true> pac_stream_type;
+        typedef PackedStream<uint8*,uint8,2,true,uint64>        pac_stream_type;
+        typedef PackedStream<uint32*,uint8,2,true,uint64>   genome_stream_type;
         pac_stream_type pac( pac_stream );
 
-        nonconst_stream_type genome( genome_stream );
-        for (uint32 i = 0; i < seq_length; ++i)
+        genome_stream_type genome( genome_stream );
+        for (uint64 i = 0; i < seq_length; ++i)
             genome[i] = pac[i];
     }
     fclose( genome_file );
 
     log_info(stderr, "reading (%s) genome... done\n", pac ? "pac" : "wpac");
-    log_visible(stderr, "  genome length : %u bps (words: %u)\n", seq_length, seq_words);
+    log_visible(stderr, "  genome length : %llu bps (words: %llu)\n", seq_length, seq_words);
 
     return genome_stream;
 }
@@ -263,8 +296,9 @@ template <typename Allocator>
 uint32* load_bwt(
     const char*     bwt_file_name,
     Allocator&      allocator,
-    const uint32    seq_words,
-    uint32&         primary)
+    const uint64    seq_length,
+    const uint64    seq_words,
+    uint64&         primary)
 {
     FILE* bwt_file = fopen( bwt_file_name, "rb" );
     if (bwt_file == NULL)
@@ -272,18 +306,32 @@ uint32* load_bwt(
         log_warning(stderr, "unable to open bwt \"%s\"\n", bwt_file_name);
         return 0;
     }
-    uint32 field;
-    if (!fread( &field, sizeof(field), 1, bwt_file ))
+
+    // the header holds the primary and the four symbol frequencies, stored as either 32-bit
+    // or, as in the files written by BWA 0.6+, 64-bit integers: tell them apart by the file size
+    const uint64 unaligned_seq_words = (seq_length+15)/16;
+    const uint64 header_size = file_size( bwt_file ) - unaligned_seq_words * sizeof(uint32);
+    if (header_size != 5u*sizeof(uint32) &&
+        header_size != 5u*sizeof(uint64))
+    {
+        log_error(stderr, "error: unexpected size for bwt \"%s\"\n", bwt_file_name);
+        fclose( bwt_file );
+        return 0;
+    }
+    const uint32 field_size = uint32( header_size / 5u );
+
+    uint64 field;
+    if (!read_field( bwt_file, field_size, field ))
     {
         log_error(stderr, "error: failed reading bwt \"%s\"\n", bwt_file_name);
         return 0;
     }
-    primary = uint32(field);
+    primary = field;
 
     // discard frequencies
     for (uint32 i = 0; i < 4; ++i)
     {
-        if (!fread( &field, sizeof(field), 1, bwt_file ))
+        if (!read_field( bwt_file, field_size, field ))
         {
             log_error(stderr, "error: failed reading bwt \"%s\"\n", bwt_file_name);
             return 0;
@@ -292,29 +340,32 @@ uint32* load_bwt(
 
     uint32* bwt_stream = allocator.alloc( seq_words );
 
-    const uint32 n_words = (uint32)block_fread( bwt_stream, seq_words, bwt_file );
+    const uint64 n_words = block_fread( bwt_stream, seq_words, bwt_file );
     if (align<FMI_ALIGNMENT>(n_words) != seq_words)
     {
         log_error(stderr, "error: failed reading bwt \"%s\"\n", bwt_file_name);
         return 0;
     }
     // initialize the alignment slack
-    for (uint32 i = n_words; i < seq_words; ++i)
+    for (uint64 i = n_words; i < seq_words; ++i)
         bwt_stream[i] = 0u;
 
     fclose( bwt_file );
     return bwt_stream;
 }
 
-template <typename Allocator>
-uint32* load_sa(
+// load a sampled suffix array, stored with either 32-bit or 64-bit entries, into an
+// SSA of the requested width
+//
+template <typename index_type, typename Allocator>
+index_type* load_sa(
     const char*     sa_file_name,
     Allocator&      allocator,
-    const uint32    seq_length,
-    const uint32    primary,
+    const uint64    seq_length,
+    const uint64    primary,
     const uint32    SA_INT)
 {
-    uint32* ssa = NULL;
+    index_type* ssa = NULL;
 
     FILE* sa_file = fopen( sa_file_name, "rb" );
     if (sa_file != NULL)
@@ -323,9 +374,25 @@ uint32* load_sa(
 
         try
         {
-            uint32 field;
+            // the file holds 7 header fields followed by all entries but the first, all of
+            // the same width: tell 32-bit and 64-bit files apart by their size
+            const uint64 sa_size = (seq_length + SA_INT) / SA_INT;
+            const uint64 sa_file_size = file_size( sa_file );
+
+            uint32 field_size;
+            if (sa_file_size == (sa_size + 6u) * sizeof(uint32))
+                field_size = sizeof(uint32);
+            else if (sa_file_size == (sa_size + 6u) * sizeof(uint64))
+                field_size = sizeof(uint64);
+            else
+            {
+                log_error(stderr, "SA file mismatch \"%s\"\n", sa_file_name);
+                throw file_mismatch();
+            }
+
+            uint64 field;
 
-            if (!fread( &field, sizeof(field), 1, sa_file ))
+            if (!read_field( sa_file, field_size, field ))
             {
                 log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
                 return 0;
@@ -338,25 +405,25 @@ uint32* load_sa(
 
             for (uint32 i = 0; i < 4; ++i)
             {
-                if (!fread( &field, sizeof(field), 1, sa_file ))
+                if (!read_field( sa_file, field_size, field ))
                 {
                     log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
                     return 0;
                 }
             }
 
-            if (!fread( &field, sizeof(field), 1, sa_file ))
+            if (!read_field( sa_file, field_size, field ))
             {
                 log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
                 return 0;
             }
             if (field != SA_INT)
             {
-                log_error(stderr, "unsupported SA interval (found %u, expected %u)\n", field, SA_INT);
+                log_error(stderr, "unsupported SA interval (found %llu, expected %u)\n", field, SA_INT);
                 throw file_mismatch();
             }
 
-            if(!fread( &field, sizeof(field), 1, sa_file ))
+            if (!read_field( sa_file, field_size, field ))
             {
                 log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
                 return 0;
@@ -367,14 +434,42 @@ uint32* load_sa(
                 throw file_mismatch();
             }
 
-            const uint32 sa_size = (seq_length + SA_INT) / SA_INT;
-
             ssa = allocator.alloc( sa_size );
-            ssa[0] = uint32(-1);
-            if (!fread( &ssa[1], sizeof(uint32), sa_size-1, sa_file ))
+            ssa[0] = index_type(-1);
+
+            if (field_size == sizeof(index_type))
             {
-                log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
-                return 0;
+                if (block_fread( &ssa[1], sa_size-1, sa_file ) != sa_size-1)
+                {
+                    log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
+                    return 0;
+                }
+            }
+            else
+            {
+                // convert the entries to the requested width, one batch at a time
+                const uint64 BATCH_SIZE = 1024*1024;
+
+                std::vector<uint32> batch32( field_size == sizeof(uint32) ? BATCH_SIZE : 0u );
+                std::vector<uint64> batch64( field_size == sizeof(uint64) ? BATCH_SIZE : 0u );
+
+                for (uint64 batch_begin = 1; batch_begin < sa_size; batch_begin += BATCH_SIZE)
+                {
+                    const uint64 batch_size = nvbio::min( BATCH_SIZE, sa_size - batch_begin );
+
+                    const uint64 n_read = field_size == sizeof(uint32) ?
+                        block_fread( &batch32[0], batch_size, sa_file ) :
+                        block_fread( &batch64[0], batch_size, sa_file );
+
+                    if (n_read != batch_size)
+                    {
+                        log_error(stderr, "error: failed reading SSA \"%s\"\n", sa_file_name);
+                        return 0;
+                    }
+
+                    for (uint64 i = 0; i < batch_size; ++i)
+                        ssa[ batch_begin + i ] = field_size == sizeof(uint32) ? index_type( batch32[i] ) : index_type( batch64[i] );
+                }
             }
         }
         catch (...)
@@ -442,6 +537,44 @@ struct BNTLoader : public nvbio::BNTSeqLoader
     AmbVector*      m_amb_vec;
 };
 
+// build the fused BWT+occurrence table out of the separate ones, aligning its base to
+// a 64-byte cache line so that no 32-byte (BWT,occ) block ever straddles two lines
+//
+uint4* build_fused_table(
+    const uint32        seq_words,
+    const uint32        occ_words,
+    const uint32*       bwt,
+    const uint32*       occ,
+    std::vector<uint4>& fused_vec)
+{
+    if (occ_words < seq_words)  throw runtime_error("FMIndexData: occurrence table has %u words, BWT has %u!", occ_words, seq_words);
+    if (seq_words % 4 != 0)     throw runtime_error("FMIndexData: BWT has %u words, not a multiple of 4!", seq_words);
+
+    const uint32 n_blocks = seq_words / 4;
+
+    // over-allocate by one cache line worth of uint4's to leave room for the alignment
+    fused_vec.resize( n_blocks*2 + 4 );
+
+    const size_t misalignment = size_t( &fused_vec[0] ) & 63u;
+    uint4* fused = &fused_vec[0] + (misalignment ? (64u - misalignment) / sizeof(uint4) : 0u);
+
+    interleave_occurrence_table(
+        n_blocks,
+        (const uint4*)bwt,
+        (const uint4*)occ,
+        fused );
+
+    return fused;
+}
+
+// return a pointer to a section of a mapped FM-index container, or NULL if the section is missing
+//
+template <typename T>
+T* container_section(const char* data, const FMIndexContainerHeader& header, const uint32 section)
+{
+    return header.sections[ section ].size ? (T*)(data + header.sections[ section ].offset) : (T*)NULL;
+}
+
 ///@} // FMIndexIODetails
 
 } // anonymous namespace
@@ -450,6 +583,7 @@ struct BNTLoader : public nvbio::BNTSeqLoader
 //
 FMIndexData::FMIndexData() :
     m_flags         ( 0 ),
+    m_index_bits    ( 32 ),
     seq_length      ( 0 ),
     seq_words       ( 0 ),
     occ_words       ( 0 ),
@@ -461,10 +595,20 @@ FMIndexData::FMIndexData() :
     m_rbwt_stream   ( NULL ),
     m_occ           ( NULL ),
     m_rocc          ( NULL ),
+    m_fused         ( NULL ),
+    m_rfused        ( NULL ),
+    m_occ64         ( NULL ),
+    m_rocc64        ( NULL ),
     L2              ( NULL ),
     rL2             ( NULL ),
+    L2_64           ( NULL ),
+    rL2_64          ( NULL ),
     count_table     ( NULL )
 {
+    ssa.m_ssa    = NULL;
+    rssa.m_ssa   = NULL;
+    ssa64.m_ssa  = NULL;
+    rssa64.m_ssa = NULL;
 }
 
 int FMIndexDataRAM::load(
@@ -478,6 +622,8 @@ int FMIndexDataRAM::load(
     m_flags     = flags;
      L2         = &m_L2[0];
     rL2         = &m_rL2[0];
+     L2_64      = &m_L2_64[0];
+    rL2_64      = &m_rL2_64[0];
     count_table = &m_count_table[0];
 
     seq_length = seq_words = 0;
@@ -498,13 +644,16 @@ int FMIndexDataRAM::load(
     // read genome
     //if (flags & GENOME) // currently needed to get the total length
     {
-        VectorAllocator allocator( m_genome_stream_vec );
+        VectorAllocator<uint32> allocator( m_genome_stream_vec );
         m_genome_stream = load_genome(
             genome_prefix,
             allocator,
             seq_length,
             seq_words );
 
+        if (m_genome_stream == NULL)
+            return 0;
+
         if (0)
         {
             stream_type genome( m_genome_stream );
@@ -518,10 +667,11 @@ int FMIndexDataRAM::load(
         // read bwt
         log_info(stderr, "reading bwt... started\n");
         {
-            VectorAllocator allocator( m_bwt_stream_vec );
+            VectorAllocator<uint32> allocator( m_bwt_stream_vec );
             m_bwt_stream = load_bwt(
                 bwt_file_name,
                 allocator,
+                seq_length,
                 seq_words,
                 primary );
 
@@ -535,10 +685,11 @@ int FMIndexDataRAM::load(
     {
         log_info(stderr, "reading rbwt... started\n");
         {
-            VectorAllocator allocator( m_rbwt_stream_vec );
+            VectorAllocator<uint32> allocator( m_rbwt_stream_vec );
             m_rbwt_stream = load_bwt(
                 rbwt_file_name,
                 allocator,
+                seq_length,
                 seq_words,
                 rprimary );
 
@@ -548,101 +699,184 @@ int FMIndexDataRAM::load(
         log_info(stderr, "reading rbwt... done\n");
     }
 
-    if (flags & FORWARD) log_visible(stderr, "   primary : %u\n", uint32(primary));
-    if (flags & REVERSE) log_visible(stderr, "  rprimary : %u\n", uint32(rprimary));
+    if (flags & FORWARD) log_visible(stderr, "   primary : %llu\n", primary);
+    if (flags & REVERSE) log_visible(stderr, "  rprimary : %llu\n", rprimary);
+
+    // select the index width
+    m_index_bits = required_index_bits( seq_length );
+    if (m_index_bits == 64)
+        log_visible(stderr, "  index    : 64-bit\n");
 
-    const uint32 OCC_INT = FMIndexData::OCC_INT;
-    const uint32 SA_INT  = FMIndexData::SA_INT;
+    const uint32 OCC_INT    = m_index_bits == 64 ? FMIndexData::OCC_INT64 : FMIndexData::OCC_INT;
+    const uint32 SA_INT     = FMIndexData::SA_INT;
+    const uint32 index_size = m_index_bits / 8u;
 
     const uint32 has_genome = (flags & GENOME)  ? 1u : 0;
     const uint32 has_fw     = (flags & FORWARD) ? 1u : 0;
     const uint32 has_rev    = (flags & REVERSE) ? 1u : 0;
     const uint32 has_sa     = (flags & SA)      ? 1u : 0;
+    const uint32 has_fused  = (flags & FUSED) && m_index_bits == 32 ? 1u : 0;
+
+    if ((flags & FUSED) && has_fused == 0)
+        log_warning(stderr, "  the fused BWT+occurrence layout is not available for 64-bit indices\n");
 
     const uint64 memory_footprint =
         (has_genome + has_fw + has_rev) * sizeof(uint32)*seq_words +
-        (has_fw + has_rev)              * sizeof(uint32)*4*uint64(seq_length+OCC_INT-1)/OCC_INT +
-        has_sa * (has_fw + has_rev)     * sizeof(uint32)*uint64(seq_length+SA_INT)/SA_INT;
+        (has_fw + has_rev)              * index_size*4*((seq_length+OCC_INT-1)/OCC_INT) +
+        has_fused * (has_fw + has_rev)  * sizeof(uint32)*2*seq_words +
+        has_sa * (has_fw + has_rev)     * index_size*((seq_length+SA_INT)/SA_INT);
 
     log_visible(stderr, "  memory   : %.1f MB\n", float(memory_footprint)/float(1024*1024));
 
-    stream_type bwt( m_bwt_stream );
-    stream_type rbwt( m_rbwt_stream );
-
     occ_words = ((seq_length+OCC_INT-1) / OCC_INT) * 4;
 
+    // zero out the L2 tables
+    for (uint32 c = 0; c < 5; ++c)
+        L2[c] = rL2[c] = 0;
+    for (uint32 c = 0; c < 5; ++c)
+        L2_64[c] = rL2_64[c] = 0;
+
     if ((flags & FORWARD) ||
         (flags & REVERSE))
     {
         log_info(stderr, "building occurrence tables... started\n");
 
-        uint32 cnt[ 4 ];
-        uint32 rcnt[ 4 ];
-
-        if (flags & FORWARD)
+        if (m_index_bits == 32)
         {
-            m_occ_vec.resize( occ_words, 0u );
-            m_occ = &m_occ_vec[0];
+            uint32 cnt[ 4 ]  = { 0u, 0u, 0u, 0u };
+            uint32 rcnt[ 4 ] = { 0u, 0u, 0u, 0u };
 
-            build_occurrence_table<OCC_INT>(
-                bwt.begin(),
-                bwt.begin() + seq_length,
-                m_occ,
-                cnt );
+            if (flags & FORWARD)
+            {
+                m_occ_vec.resize( occ_words, 0u );
+                m_occ = &m_occ_vec[0];
+
+                build_packed_occurrence_table<FMIndexData::OCC_INT>(
+                    m_bwt_stream,
+                    uint32(seq_length),
+                    m_occ,
+                    cnt );
+            }
+            if (flags & REVERSE)
+            {
+                m_rocc_vec.resize( occ_words, 0u );
+                m_rocc = &m_rocc_vec[0];
+
+                build_packed_occurrence_table<FMIndexData::OCC_INT>(
+                    m_rbwt_stream,
+                    uint32(seq_length),
+                    m_rocc,
+                    rcnt );
+            }
+
+            // compute the L2 tables
+            for (uint32 c = 0; c < 4; ++c)
+                L2[c+1] = L2[c] + cnt[c];
+
+            for (uint32 c = 0; c < 4; ++c)
+                rL2[c+1] = rL2[c] + rcnt[c];
         }
-        if (flags & REVERSE)
+        else
         {
-            m_rocc_vec.resize( occ_words, 0u );
-            m_rocc = &m_rocc_vec[0];
+            uint64 cnt[ 4 ]  = { 0u, 0u, 0u, 0u };
+            uint64 rcnt[ 4 ] = { 0u, 0u, 0u, 0u };
 
-            build_occurrence_table<OCC_INT>(
-                rbwt.begin(),
-                rbwt.begin() + seq_length,
-                m_rocc,
-                rcnt );
-        }
+            if (flags & FORWARD)
+            {
+                m_occ64_vec.resize( occ_words, 0u );
+                m_occ64 = &m_occ64_vec[0];
+
+                build_packed_occurrence_table<FMIndexData::OCC_INT64>(
+                    m_bwt_stream,
+                    seq_length,
+                    m_occ64,
+                    cnt );
+            }
+            if (flags & REVERSE)
+            {
+                m_rocc64_vec.resize( occ_words, 0u );
+                m_rocc64 = &m_rocc64_vec[0];
+
+                build_packed_occurrence_table<FMIndexData::OCC_INT64>(
+                    m_rbwt_stream,
+                    seq_length,
+                    m_rocc64,
+                    rcnt );
+            }
 
-        // compute the L2 tables
-        L2[0] = 0;
-        for (uint32 c = 0; c < 4; ++c)
-            L2[c+1] = L2[c] + cnt[c];
+            // compute the L2 tables
+            for (uint32 c = 0; c < 4; ++c)
+                L2_64[c+1] = L2_64[c] + cnt[c];
 
-        rL2[0] = 0;
-        for (uint32 c = 0; c < 4; ++c)
-            rL2[c+1] = rL2[c] + rcnt[c];
+            for (uint32 c = 0; c < 4; ++c)
+                rL2_64[c+1] = rL2_64[c] + rcnt[c];
+        }
 
         log_info(stderr, "building occurrence tables... done\n");
-    }
-    else
-    {
-        // zero out the L2 tables
-        for (uint32 c = 0; c < 5; ++c)
-            L2[c] = rL2[c] = 0;
+
+        if (has_fused)
+        {
+            log_info(stderr, "building fused BWT+occurrence tables... started\n");
+
+            if (flags & FORWARD)
+                m_fused  = build_fused_table( seq_words, occ_words, m_bwt_stream,  m_occ,  m_fused_vec );
+            if (flags & REVERSE)
+                m_rfused = build_fused_table( seq_words, occ_words, m_rbwt_stream, m_rocc, m_rfused_vec );
+
+            log_info(stderr, "building fused BWT+occurrence tables... done\n");
+        }
     }
 
     // read ssa
     if (flags & SA)
     {
-        if (flags & FORWARD)
+        if (m_index_bits == 32)
         {
-            VectorAllocator allocator( m_ssa_vec );
-            ssa.m_ssa = load_sa(
-                sa_file_name,
-                allocator,
-                seq_length,
-                primary,
-                SA_INT );
+            if (flags & FORWARD)
+            {
+                VectorAllocator<uint32> allocator( m_ssa_vec );
+                ssa.m_ssa = load_sa<uint32>(
+                    sa_file_name,
+                    allocator,
+                    seq_length,
+                    primary,
+                    SA_INT );
+            }
+            // read rssa
+            if (flags & REVERSE)
+            {
+                VectorAllocator<uint32> allocator( m_rssa_vec );
+                rssa.m_ssa = load_sa<uint32>(
+                    rsa_file_name,
+                    allocator,
+                    seq_length,
+                    rprimary,
+                    SA_INT );
+            }
         }
-        // read rssa
-        if (flags & REVERSE)
+        else
         {
-            VectorAllocator allocator( m_rssa_vec );
-            rssa.m_ssa = load_sa(
-                rsa_file_name,
-                allocator,
-                seq_length,
-                rprimary,
-                SA_INT );
+            if (flags & FORWARD)
+            {
+                VectorAllocator<uint64> allocator( m_ssa64_vec );
+                ssa64.m_ssa = load_sa<uint64>(
+                    sa_file_name,
+                    allocator,
+                    seq_length,
+                    primary,
+                    SA_INT );
+            }
+            // read rssa
+            if (flags & REVERSE)
+            {
+                VectorAllocator<uint64> allocator( m_rssa64_vec );
+                rssa64.m_ssa = load_sa<uint64>(
+                    rsa_file_name,
+                    allocator,
+                    seq_length,
+                    rprimary,
+                    SA_INT );
+            }
         }
         sa_words = (seq_length + SA_INT) / SA_INT;
     }
@@ -714,7 +948,7 @@ int FMIndexDataMMAPServer::load(const char* genome_prefix, const char* mapped_na
     {
         // read genome
         {
-            MMapAllocator allocator( pacName.c_str(), m_pac_file );
+            MMapAllocator<uint32> allocator( pacName.c_str(), m_pac_file );
             m_genome_stream = load_genome(
                 genome_prefix,
                 allocator,
@@ -727,15 +961,19 @@ int FMIndexDataMMAPServer::load(const char* genome_prefix, const char* mapped_na
                 const uint32 crc = crcCalc( genome.begin(), uint32(seq_length) );
                 log_info(stderr, "  crc           : %u\n", crc);
             }
+
+            if (m_genome_stream == NULL)
+                return 0;
         }
 
         // read bwt
         log_info(stderr, "reading bwt... started\n");
         {
-            MMapAllocator allocator( bwtName.c_str(), m_bwt_file );
+            MMapAllocator<uint32> allocator( bwtName.c_str(), m_bwt_file );
             m_bwt_stream = load_bwt(
                 bwt_file_name,
                 allocator,
+                seq_length,
                 seq_words,
                 primary );
 
@@ -746,10 +984,11 @@ int FMIndexDataMMAPServer::load(const char* genome_prefix, const char* mapped_na
 
         log_info(stderr, "reading rbwt... started\n");
         {
-            MMapAllocator allocator( rbwtName.c_str(), m_rbwt_file );
+            MMapAllocator<uint32> allocator( rbwtName.c_str(), m_rbwt_file );
             m_rbwt_stream = load_bwt(
                 rbwt_file_name,
                 allocator,
+                seq_length,
                 seq_words,
                 rprimary );
 
@@ -758,79 +997,131 @@ int FMIndexDataMMAPServer::load(const char* genome_prefix, const char* mapped_na
         }
         log_info(stderr, "reading rbwt... done\n");
 
-        log_visible(stderr, "   primary : %u\n", uint32(primary));
-        log_visible(stderr, "  rprimary : %u\n", uint32(rprimary));
+        log_visible(stderr, "   primary : %llu\n", primary);
+        log_visible(stderr, "  rprimary : %llu\n", rprimary);
 
-        const uint32 OCC_INT = FMIndexData::OCC_INT;
-        const uint32 SA_INT  = FMIndexData::SA_INT;
+        // select the index width
+        m_index_bits = required_index_bits( seq_length );
+        if (m_index_bits == 64)
+            log_visible(stderr, "  index    : 64-bit\n");
+
+        const uint32 OCC_INT    = m_index_bits == 64 ? FMIndexData::OCC_INT64 : FMIndexData::OCC_INT;
+        const uint32 SA_INT     = FMIndexData::SA_INT;
+        const uint32 index_size = m_index_bits / 8u;
 
         const uint64 memory_footprint =
             (wpac_file_name ? 3 : 2)*sizeof(uint32)*seq_words +
-            2*sizeof(uint32)*4*uint64(seq_length+OCC_INT-1)/OCC_INT +
-            2*sizeof(uint32)*uint64(seq_length+SA_INT)/SA_INT;
+            2*index_size*4*((seq_length+OCC_INT-1)/OCC_INT) +
+            2*index_size*((seq_length+SA_INT)/SA_INT);
 
         log_visible(stderr, "  memory   : %.1f MB\n", float(memory_footprint)/float(1024*1024));
 
-        stream_type bwt( m_bwt_stream );
-        stream_type rbwt( m_rbwt_stream );
-
         occ_words = ((seq_length+OCC_INT-1) / OCC_INT) * 4;
-        m_occ = (uint32*)m_occ_file.init(
-            occName.c_str(),
-            occ_words * sizeof(uint32),
-            NULL );
-        m_rocc = (uint32*)m_rocc_file.init(
-            roccName.c_str(),
-            occ_words * sizeof(uint32),
-            NULL );
 
-        uint32  cnt[ 4 ];
-        uint32  rcnt[ 4 ];
+        uint64 L2[5]  = { 0u };
+        uint64 rL2[5] = { 0u };
 
         log_info(stderr, "building occurrence tables... started\n");
-        build_occurrence_table<OCC_INT>(
-            bwt.begin(),
-            bwt.begin() + seq_length,
-            m_occ,
-            cnt );
-
-        build_occurrence_table<OCC_INT>(
-            rbwt.begin(),
-            rbwt.begin() + seq_length,
-            m_rocc,
-            rcnt );
-        log_info(stderr, "building occurrence tables... done\n");
-
-        // read ssa
+        if (m_index_bits == 32)
         {
-            MMapAllocator allocator( saName.c_str(), m_sa_file );
-            ssa.m_ssa = load_sa(
-                sa_file_name,
-                allocator,
-                seq_length,
-                primary,
-                SA_INT );
+            m_occ = MMapAllocator<uint32>( occName.c_str(), m_occ_file ).alloc( occ_words );
+            m_rocc = MMapAllocator<uint32>( roccName.c_str(), m_rocc_file ).alloc( occ_words );
+
+            uint32  cnt[ 4 ];
+            uint32  rcnt[ 4 ];
+
+            build_packed_occurrence_table<FMIndexData::OCC_INT>(
+                m_bwt_stream,
+                uint32(seq_length),
+                m_occ,
+                cnt );
+
+            build_packed_occurrence_table<FMIndexData::OCC_INT>(
+                m_rbwt_stream,
+                uint32(seq_length),
+                m_rocc,
+                rcnt );
+
+            for (uint32 c = 0; c < 4; ++c)
+            {
+                 L2[c+1] =  L2[c] +  cnt[c];
+                rL2[c+1] = rL2[c] + rcnt[c];
+            }
         }
-        // read rssa
+        else
         {
-            MMapAllocator allocator( rsaName.c_str(), m_rsa_file );
-            rssa.m_ssa = load_sa(
-                rsa_file_name,
-                allocator,
+            m_occ64 = MMapAllocator<uint64>( occName.c_str(), m_occ_file ).alloc( occ_words );
+            m_rocc64 = MMapAllocator<uint64>( roccName.c_str(), m_rocc_file ).alloc( occ_words );
+
+            uint64  cnt[ 4 ];
+            uint64  rcnt[ 4 ];
+
+            build_packed_occurrence_table<FMIndexData::OCC_INT64>(
+                m_bwt_stream,
                 seq_length,
-                rprimary,
-                SA_INT );
-        }
+                m_occ64,
+                cnt );
+
+            build_packed_occurrence_table<FMIndexData::OCC_INT64>(
+                m_rbwt_stream,
+                seq_length,
+                m_rocc64,
+                rcnt );
 
-        uint32 L2[5];
-        L2[0] = 0;
-        for (uint32 c = 0; c < 4; ++c)
-            L2[c+1] = L2[c] + cnt[c];
+            for (uint32 c = 0; c < 4; ++c)
+            {
+                 L2[c+1] =  L2[c] +  cnt[c];
+                rL2[c+1] = rL2[c] + rcnt[c];
+            }
+        }
+        log_info(stderr, "building occurrence tables... done\n");
 
-        uint32 rL2[5];
-        rL2[0] = 0;
-        for (uint32 c = 0; c < 4; ++c)
-            rL2[c+1] = rL2[c] + rcnt[c];
+        if (m_index_bits == 32)
+        {
+            // read ssa
+            {
+                MMapAllocator<uint32> allocator( saName.c_str(), m_sa_file );
+                ssa.m_ssa = load_sa<uint32>(
+                    sa_file_name,
+                    allocator,
+                    seq_length,
+                    primary,
+                    SA_INT );
+            }
+            // read rssa
+            {
+                MMapAllocator<uint32> allocator( rsaName.c_str(), m_rsa_file );
+                rssa.m_ssa = load_sa<uint32>(
+                    rsa_file_name,
+                    allocator,
+                    seq_length,
+                    rprimary,
+                    SA_INT );
+            }
+        }
+        else
+        {
+            // read ssa
+            {
+                MMapAllocator<uint64> allocator( saName.c_str(), m_sa_file );
+                ssa64.m_ssa = load_sa<uint64>(
+                    sa_file_name,
+                    allocator,
+                    seq_length,
+                    primary,
+                    SA_INT );
+            }
+            // read rssa
+            {
+                MMapAllocator<uint64> allocator( rsaName.c_str(), m_rsa_file );
+                rssa64.m_ssa = load_sa<uint64>(
+                    rsa_file_name,
+                    allocator,
+                    seq_length,
+                    rprimary,
+                    SA_INT );
+            }
+        }
 
         sa_words = has_ssa() ? (seq_length + SA_INT) / SA_INT : 0u;
 
@@ -883,6 +1174,7 @@ int FMIndexDataMMAPServer::load(const char* genome_prefix, const char* mapped_na
         }
         log_info(stderr, "reading BNT... done\n");
 
+        m_info.index_bits      = m_index_bits;
         m_info.sequence_length = seq_length;
         m_info.sequence_words  = seq_words;
         m_info.occ_words       = occ_words;
@@ -958,6 +1250,46 @@ void init_ssa(
     log_info(stderr, "building reverse SSA... done\n");
 }
 
+void init_ssa(
+    const FMIndexData&       driver_data,
+    FMIndexData::SSA64_type& ssa,
+    FMIndexData::SSA64_type& rssa)
+{
+    typedef FMIndexData::rank_dict64_type rank_dict_type;
+    typedef FMIndexData::fm_index64_type  fm_index_type;
+    typedef FMIndexData::stream64_type    stream_type;
+    typedef FMIndexData::SSA64_type       SSA_type;
+    typedef FMIndexData::SSA64_context    SSA_context;
+
+    fm_index_type temp_fmi(
+        driver_data.seq_length,
+        driver_data.primary,
+        driver_data.L2_64,
+        rank_dict_type(
+            stream_type( driver_data.m_bwt_stream ),
+            driver_data.m_occ64,
+            driver_data.count_table ),
+        SSA_context() );
+
+    fm_index_type temp_rfmi(
+        driver_data.seq_length,
+        driver_data.rprimary,
+        driver_data.rL2_64,
+        rank_dict_type(
+            stream_type( driver_data.m_rbwt_stream ),
+            driver_data.m_rocc64,
+            driver_data.count_table ),
+        SSA_context() );
+
+    log_info(stderr, "building SSA... started\n");
+    ssa = SSA_type( temp_fmi /*, SA_INT*/ );
+    log_info(stderr, "building SSA... done\n");
+
+    log_info(stderr, "building reverse SSA... started\n");
+    rssa = SSA_type( temp_rfmi /*, SA_INT*/ );
+    log_info(stderr, "building reverse SSA... done\n");
+}
+
 
 int FMIndexDataMMAP::load(
     const char* file_name)
@@ -978,32 +1310,51 @@ int FMIndexDataMMAP::load(
     // bind pointers to static vectors
      L2         = &m_L2[0];
     rL2         = &m_rL2[0];
+     L2_64      = &m_L2_64[0];
+    rL2_64      = &m_rL2_64[0];
     count_table = &m_count_table[0];
 
     try {
         const Info* info = (const Info*)m_info_file.init( infoName.c_str(), sizeof(Info) );
 
+        m_index_bits = info->index_bits;
+
+        // the occurrence table and SSA entries are as wide as the index
+        const uint32 index_size = m_index_bits / 8u;
+
         const uint64 file_size     = info->sequence_words * sizeof(uint32);
-        const uint64 occ_file_size = info->occ_words * sizeof(uint32);
-        const uint64 sa_file_size  = info->sa_words * sizeof(uint32);
+        const uint64 occ_file_size = info->occ_words * index_size;
+        const uint64 sa_file_size  = info->sa_words * index_size;
 
         m_genome_stream = (uint32*)m_genome_file.init( pacName.c_str(), file_size );
         m_bwt_stream    = (uint32*)m_bwt_file.init( bwtName.c_str(), file_size );
         m_rbwt_stream   = (uint32*)m_rbwt_file.init( rbwtName.c_str(), file_size );
-        m_occ           = (uint32*)m_occ_file.init( occName.c_str(), occ_file_size );
-        m_rocc          = (uint32*)m_rocc_file.init( roccName.c_str(), occ_file_size );
+        if (m_index_bits == 32)
+        {
+            m_occ  = (uint32*)m_occ_file.init( occName.c_str(), occ_file_size );
+            m_rocc = (uint32*)m_rocc_file.init( roccName.c_str(), occ_file_size );
+        }
+        else
+        {
+            m_occ64  = (uint64*)m_occ_file.init( occName.c_str(), occ_file_size );
+            m_rocc64 = (uint64*)m_rocc_file.init( roccName.c_str(), occ_file_size );
+        }
         if (info->sa_words)
         {
-            ssa.m_ssa  = (uint32*)m_sa_file.init( saName.c_str(), sa_file_size );
-            rssa.m_ssa = (uint32*)m_rsa_file.init( rsaName.c_str(), sa_file_size );
+            if (m_index_bits == 32)
+            {
+                ssa.m_ssa  = (uint32*)m_sa_file.init( saName.c_str(), sa_file_size );
+                rssa.m_ssa = (uint32*)m_rsa_file.init( rsaName.c_str(), sa_file_size );
+            }
+            else
+            {
+                ssa64.m_ssa  = (uint64*)m_sa_file.init( saName.c_str(), sa_file_size );
+                rssa64.m_ssa = (uint64*)m_rsa_file.init( rsaName.c_str(), sa_file_size );
+            }
             sa_words   = (info->sequence_length + SA_INT) / SA_INT;
         }
         else
-        {
-            ssa.m_ssa  = NULL;
-            rssa.m_ssa = NULL;
             sa_words   = 0u;
-        }
 
         seq_length = info->sequence_length;
         seq_words  = info->sequence_words;
@@ -1012,8 +1363,10 @@ int FMIndexDataMMAP::load(
         rprimary   = info->rprimary;
         for (uint32 i = 0; i < 5; ++i)
         {
-            L2[i]  = info->L2[i];
-            rL2[i] = info->rL2[i];
+            L2_64[i]  = info->L2[i];
+            rL2_64[i] = info->rL2[i];
+            L2[i]     = m_index_bits == 32 ? uint32( info->L2[i] )  : 0u;
+            rL2[i]    = m_index_bits == 32 ? uint32( info->rL2[i] ) : 0u;
         }
 
         m_bnt_info = info->bnt;
@@ -1055,9 +1408,144 @@ int FMIndexDataMMAP::load(
     return 1;
 }
 
+int FMIndexDataMMAP::load_file(
+    const char* file_name,
+    const bool  verify)
+{
+    typedef FMIndexContainerHeader Header;
+
+    log_visible(stderr, "FMIndexData (file) : loading... started\n");
+    log_visible(stderr, "  container : %s\n", file_name);
+
+    // bind pointers to static vectors
+     L2         = &m_L2[0];
+    rL2         = &m_rL2[0];
+     L2_64      = &m_L2_64[0];
+    rL2_64      = &m_rL2_64[0];
+    count_table = &m_count_table[0];
+
+    // map the file for random access, so that pages are only read in as queries touch them
+    const char* data = m_container_file.init( file_name, false );
+    if (data == NULL || m_container_file.size() < sizeof(Header))
+    {
+        log_error(stderr, "FMIndexData: unable to map \"%s\"\n", file_name);
+        return 0;
+    }
+
+    Header header;
+    memcpy( &header, data, sizeof(Header) );
+
+    if (memcmp( header.magic, FMI_CONTAINER_MAGIC, sizeof(FMI_CONTAINER_MAGIC) ) != 0)
+    {
+        log_error(stderr, "FMIndexData: \"%s\" is not an FM-index container\n", file_name);
+        return 0;
+    }
+    if (header.version != Header::VERSION)
+    {
+        log_error(stderr, "FMIndexData: \"%s\": unsupported container version %u\n", file_name, header.version);
+        return 0;
+    }
+    {
+        const uint64 header_checksum = header.header_checksum;
+        header.header_checksum = 0u;
+        if (fmi_container_checksum( &header, sizeof(Header) ) != header_checksum)
+        {
+            log_error(stderr, "FMIndexData: \"%s\": corrupted container header\n", file_name);
+            return 0;
+        }
+        header.header_checksum = header_checksum;
+    }
+    if (header.index_bits != 32 && header.index_bits != 64)
+    {
+        log_error(stderr, "FMIndexData: \"%s\": unsupported index width %u\n", file_name, header.index_bits);
+        return 0;
+    }
+
+    // check that all sections are aligned and lie within the file
+    for (uint32 s = 0; s < Header::N_SECTIONS; ++s)
+    {
+        const FMIndexContainerSection& section = header.sections[s];
+        if (section.offset % Header::ALIGNMENT != 0 ||
+            section.offset + section.size > m_container_file.size())
+        {
+            log_error(stderr, "FMIndexData: \"%s\": truncated container\n", file_name);
+            return 0;
+        }
+    }
+
+    if (verify)
+    {
+        log_info(stderr, "verifying checksums... started\n");
+        for (uint32 s = 0; s < Header::N_SECTIONS; ++s)
+        {
+            const FMIndexContainerSection& section = header.sections[s];
+            if (fmi_container_checksum( data + section.offset, section.size ) != section.checksum)
+            {
+                log_error(stderr, "FMIndexData: \"%s\": checksum mismatch in section %u\n", file_name, s);
+                return 0;
+            }
+        }
+        log_info(stderr, "verifying checksums... done\n");
+    }
+
+    m_index_bits = header.index_bits;
+    seq_length   = header.seq_length;
+    seq_words    = header.seq_words;
+    occ_words    = header.occ_words;
+    sa_words     = header.sa_words;
+    primary      = header.primary;
+    rprimary     = header.rprimary;
+
+    // the mapping is read-only: the tables may only be read through these pointers
+    m_genome_stream = container_section<uint32>( data, header, Header::GENOME_SECTION );
+    m_bwt_stream    = container_section<uint32>( data, header, Header::BWT_SECTION );
+    m_rbwt_stream   = container_section<uint32>( data, header, Header::RBWT_SECTION );
+    if (m_index_bits == 32)
+    {
+        m_occ       = container_section<uint32>( data, header, Header::OCC_SECTION );
+        m_rocc      = container_section<uint32>( data, header, Header::ROCC_SECTION );
+        ssa.m_ssa   = container_section<uint32>( data, header, Header::SSA_SECTION );
+        rssa.m_ssa  = container_section<uint32>( data, header, Header::RSSA_SECTION );
+    }
+    else
+    {
+        m_occ64      = container_section<uint64>( data, header, Header::OCC_SECTION );
+        m_rocc64     = container_section<uint64>( data, header, Header::ROCC_SECTION );
+        ssa64.m_ssa  = container_section<uint64>( data, header, Header::SSA_SECTION );
+        rssa64.m_ssa = container_section<uint64>( data, header, Header::RSSA_SECTION );
+    }
+    for (uint32 i = 0; i < 5; ++i)
+    {
+        L2_64[i]  = header.L2[i];
+        rL2_64[i] = header.rL2[i];
+        L2[i]     = m_index_bits == 32 ? uint32( header.L2[i] )  : 0u;
+        rL2[i]    = m_index_bits == 32 ? uint32( header.rL2[i] ) : 0u;
+    }
+
+    m_bnt_info       = header.bnt;
+    m_bnt_data.anns  = container_section<BNTAnn>( data, header, Header::BNT_ANNS_SECTION );
+    m_bnt_data.ambs  = container_section<BNTAmb>( data, header, Header::BNT_AMBS_SECTION );
+    m_bnt_data.names = container_section<char>( data, header, Header::BNT_NAMES_SECTION );
+    m_bnt_data.annos = container_section<char>( data, header, Header::BNT_ANNOS_SECTION );
+
+    m_flags = (m_genome_stream ? GENOME  : 0u) |
+              (m_bwt_stream    ? FORWARD : 0u) |
+              (m_rbwt_stream   ? REVERSE : 0u) |
+              (has_ssa()       ? SA      : 0u);
+
+    gen_bwt_count_table( count_table );
+
+    log_visible(stderr, "  genome length : %llu bps\n", seq_length);
+    log_visible(stderr, "FMIndexData (file) : loading... done\n");
+    return 1;
+}
+
 FMIndexDataDevice::FMIndexDataDevice(const FMIndexData& host_data, const uint32 flags) :
     m_allocated( 0u )
 {
+    if (host_data.index_bits() != 32)
+        throw runtime_error("FMIndexDataDevice: %u-bit indices are not supported (genome length: %llu)", host_data.index_bits(), host_data.genome_length());
+
     seq_length = host_data.seq_length;
     seq_words  = host_data.seq_words;
     occ_words  = host_data.occ_words;
@@ -1091,21 +1579,15 @@ FMIndexDataDevice::FMIndexDataDevice(const FMIndexData& host_data, const uint32
     #if defined(FUSED_BWT_OCC)
         thrust::host_vector<uint32> bwt_occ( seq_words + occ_words );
 
-        if (occ_words < seq_words)  throw runtime_error("FMIndexDataDevice: occurrence table has %u words, BWT has %u!", occ_words, seq_words);
-        if (occ_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: occurrence table has %u words, not a multiple of 4!", occ_words);
-        if (seq_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: BWT has %u words, not a multiple of 4!", seq_words);
+        if (occ_words < seq_words)  throw runtime_error("FMIndexDataDevice: occurrence table has %llu words, BWT has %llu!", occ_words, seq_words);
+        if (occ_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: occurrence table has %llu words, not a multiple of 4!", occ_words);
+        if (seq_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: BWT has %llu words, not a multiple of 4!", seq_words);
 
-        for (uint32 w = 0; w < seq_words; w += 4)
-        {
-            bwt_occ[ w*2+0 ] = host_data.m_bwt_stream[ w+0 ];
-            bwt_occ[ w*2+1 ] = host_data.m_bwt_stream[ w+1 ];
-            bwt_occ[ w*2+2 ] = host_data.m_bwt_stream[ w+2 ];
-            bwt_occ[ w*2+3 ] = host_data.m_bwt_stream[ w+3 ];
-            bwt_occ[ w*2+4 ] = host_data.m_occ[ w+0 ];
-            bwt_occ[ w*2+5 ] = host_data.m_occ[ w+1 ];
-            bwt_occ[ w*2+6 ] = host_data.m_occ[ w+2 ];
-            bwt_occ[ w*2+7 ] = host_data.m_occ[ w+3 ];
-        }
+        interleave_occurrence_table(
+            seq_words / 4,
+            (const uint4*)host_data.m_bwt_stream,
+            (const uint4*)host_data.m_occ,
+            (uint4*)&bwt_occ[0] );
         nvbio::cuda::thrust_copy_vector(m_bwt_occ, bwt_occ);
         m_allocated += sizeof(uint32)*(seq_words + occ_words);
     #else
@@ -1129,21 +1611,15 @@ FMIndexDataDevice::FMIndexDataDevice(const FMIndexData& host_data, const uint32
     #if defined(FUSED_BWT_OCC)
         thrust::host_vector<uint32> bwt_occ( seq_words + occ_words );
 
-        if (occ_words < seq_words)  throw runtime_error("FMIndexDataDevice: occurrence table has %u words, BWT has %u!", occ_words, seq_words);
-        if (occ_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: occurrence table has %u words, not a multiple of 4!", occ_words);
-        if (seq_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: BWT has %u words, not a multiple of 4!", seq_words);
+        if (occ_words < seq_words)  throw runtime_error("FMIndexDataDevice: occurrence table has %llu words, BWT has %llu!", occ_words, seq_words);
+        if (occ_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: occurrence table has %llu words, not a multiple of 4!", occ_words);
+        if (seq_words % 4 != 0)     throw runtime_error("FMIndexDataDevice: BWT has %llu words, not a multiple of 4!", seq_words);
 
-        for (uint32 w = 0; w < seq_words; w += 4)
-        {
-            bwt_occ[ w*2+0 ] = host_data.m_rbwt_stream[ w+0 ];
-            bwt_occ[ w*2+1 ] = host_data.m_rbwt_stream[ w+1 ];
-            bwt_occ[ w*2+2 ] = host_data.m_rbwt_stream[ w+2 ];
-            bwt_occ[ w*2+3 ] = host_data.m_rbwt_stream[ w+3 ];
-            bwt_occ[ w*2+4 ] = host_data.m_rocc[ w+0 ];
-            bwt_occ[ w*2+5 ] = host_data.m_rocc[ w+1 ];
-            bwt_occ[ w*2+6 ] = host_data.m_rocc[ w+2 ];
-            bwt_occ[ w*2+7 ] = host_data.m_rocc[ w+3 ];
-        }
+        interleave_occurrence_table(
+            seq_words / 4,
+            (const uint4*)host_data.m_rbwt_stream,
+            (const uint4*)host_data.m_rocc,
+            (uint4*)&bwt_occ[0] );
         nvbio::cuda::thrust_copy_vector(m_rbwt_occ, bwt_occ);
         m_allocated += sizeof(uint32)*(seq_words + occ_words);
     #else
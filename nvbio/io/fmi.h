@@ -50,6 +50,9 @@ namespace io {
 /// - FMIndexDataMMAP
 /// - FMIndexDataDevice
 ///
+/// FMIndexDataMMAP can also map single-file FM-index containers, written by save_fmi_container(),
+/// straight from disk (see fmi_container.h).
+///
 
 ///@addtogroup IO
 ///@{
@@ -109,16 +112,22 @@ struct BNTSeqVec
 /// by inheriting classes.
 /// The idea is that accessing this basic information is fast and requires no virtual function
 /// calls.
+///
+/// Texts which don't fit 32-bit coordinates are indexed with 64-bit occurrence tables, L2 and
+/// SSA (see index_bits()): in that case the 64-bit accessors (index64(), rindex64(), ...) must
+/// be used in place of the default 32-bit ones, whose tables are left empty.
 struct FMIndexData
 {
     static const uint32 GENOME  = 0x01;
     static const uint32 FORWARD = 0x02;
     static const uint32 REVERSE = 0x04;
     static const uint32 SA      = 0x10;
+    static const uint32 FUSED   = 0x20;     ///< build the interleaved BWT+occurrence table
 
     static const uint32 READ_BITS = 4;
-    static const uint32 OCC_INT = 64;
-    static const uint32 SA_INT  = 16;
+    static const uint32 OCC_INT   = 64;
+    static const uint32 OCC_INT64 = 128;    ///< occurrence sampling interval of 64-bit indices
+    static const uint32 SA_INT    = 16;
 
     typedef PackedStream<const uint32*,uint8,2,true>          stream_type;
     typedef PackedStream<      uint32*,uint8,2,true> nonconst_stream_type;
@@ -135,19 +144,51 @@ struct FMIndexData
     typedef fm_index<rank_dict_type, ssa_type>                                  fm_index_type;
     typedef fm_index<rank_dict_type, null_type>                         partial_fm_index_type;
 
+    // 64-bit index types, used when the text doesn't fit 32-bit coordinates: the BWT is stored
+    // in the same 32-bit words, while the occurrence counters, L2 and SSA are 64-bit wide
+    typedef PackedStream<const uint32*,uint8,2,true,uint64>     stream64_type;
+    typedef const uint64*                                       occ64_type;
+
+    typedef SSA_index_multiple<SA_INT,uint64>   SSA64_type;
+    typedef SSA64_type::context_type            SSA64_context;
+    typedef SSA64_context                       ssa64_type;
+
+    typedef rank_dictionary<2u,OCC_INT64,stream64_type,occ64_type,count_table_type>   rank_dict64_type;
+    typedef fm_index<rank_dict64_type, ssa64_type>                                    fm_index64_type;
+    typedef fm_index<rank_dict64_type, null_type>                             partial_fm_index64_type;
+
+    // the fused layout interleaves each uint4 of BWT text (64 symbols) with the uint4 of
+    // occurrence counters sampled at its start, so that a rank query touches a single cache line
+    typedef deinterleaved_iterator<2,0,const uint4*>                                            fused_bwt_type;
+    typedef deinterleaved_iterator<2,1,const uint4*>                                            fused_occ_type;
+    typedef rank_dictionary<2u,OCC_INT,PackedStream<fused_bwt_type,uint8,2u,true>,fused_occ_type,count_table_type> fused_rank_dict_type;
+    typedef fm_index<fused_rank_dict_type, ssa_type>                                            fused_fm_index_type;
+    typedef fm_index<fused_rank_dict_type, null_type>                                   fused_partial_fm_index_type;
+
              FMIndexData();                                                 ///< empty constructor
     virtual ~FMIndexData() {}                                               ///< virtual destructor
     
+    /// return the number of bits needed to index a text of the given length: 32-bit indices
+    /// are used whenever the text fits, as they take half the space and are the only ones
+    /// supported on the device
+    static uint32 required_index_bits(const uint64 length) { return length < uint64(uint32(-1)) ? 32u : 64u; }
+
     uint32        flags()         const { return m_flags; }                 ///< return loading flags
-    uint32        genome_length() const { return seq_length; }              ///< return genome length
+    uint32        index_bits()    const { return m_index_bits; }            ///< return the index width, 32 or 64 bits
+    uint64        genome_length() const { return seq_length; }              ///< return genome length
     bool          has_genome()    const { return m_genome_stream != NULL; } ///< return whether the genome is present
-    bool          has_ssa()       const { return ssa.m_ssa != NULL; }       ///< return whether the sampled suffix array is present
-    bool          has_rssa()      const { return rssa.m_ssa != NULL; }      ///< return whether the reverse sampled suffix array is present
+    bool          has_ssa()       const { return ssa.m_ssa != NULL || ssa64.m_ssa != NULL; }    ///< return whether the sampled suffix array is present
+    bool          has_rssa()      const { return rssa.m_ssa != NULL || rssa64.m_ssa != NULL; }  ///< return whether the reverse sampled suffix array is present
     const uint32* genome_stream() const { return m_genome_stream; }         ///< return the genome stream
     const uint32*  bwt_stream()   const { return m_bwt_stream; }            ///< return the BWT stream
     const uint32* rbwt_stream()   const { return m_rbwt_stream; }           ///< return the reverse BWT stream
     const uint32*  occ_stream()   const { return m_occ; }                   ///< return the occurrence table
     const uint32* rocc_stream()   const { return m_rocc; }                  ///< return the reverse occurrence table
+    const uint64*  occ64_stream() const { return m_occ64; }                 ///< return the 64-bit occurrence table
+    const uint64* rocc64_stream() const { return m_rocc64; }                ///< return the 64-bit reverse occurrence table
+    bool          has_fused()     const { return m_fused != NULL; }         ///< return whether the fused BWT+occurrence tables are present
+    const uint4*  fused_stream()  const { return m_fused; }                 ///< return the fused BWT+occurrence table
+    const uint4* rfused_stream()  const { return m_rfused; }                ///< return the fused reverse BWT+occurrence table
 
     // FM-index accessors
     //
@@ -171,24 +212,55 @@ struct FMIndexData
     partial_fm_index_type  partial_index() const { return partial_fm_index_type( genome_length(),  primary,  L2,  rank_dict(), null_type() ); }
     partial_fm_index_type rpartial_index() const { return partial_fm_index_type( genome_length(), rprimary, rL2, rrank_dict(), null_type() ); }
 
+    // fused FM-index accessors, only valid if has_fused() is true
+    //
+    fused_rank_dict_type  fused_rank_dict() const { return fused_rank_dict_type( fused_bwt_type( fused_stream()), fused_occ_type( fused_stream()), count_table_iterator() ); }
+    fused_rank_dict_type rfused_rank_dict() const { return fused_rank_dict_type( fused_bwt_type(rfused_stream()), fused_occ_type(rfused_stream()), count_table_iterator() ); }
+
+    fused_fm_index_type  fused_index() const { return fused_fm_index_type( genome_length(),  primary,  L2,  fused_rank_dict(),  ssa_iterator() ); }
+    fused_fm_index_type rfused_index() const { return fused_fm_index_type( genome_length(), rprimary, rL2, rfused_rank_dict(), rssa_iterator() ); }
+
+    fused_partial_fm_index_type  fused_partial_index() const { return fused_partial_fm_index_type( genome_length(),  primary,  L2,  fused_rank_dict(), null_type() ); }
+    fused_partial_fm_index_type rfused_partial_index() const { return fused_partial_fm_index_type( genome_length(), rprimary, rL2, rfused_rank_dict(), null_type() ); }
+
+    // 64-bit FM-index accessors, only valid if index_bits() is 64
+    //
+    rank_dict64_type  rank_dict64() const { return rank_dict64_type( stream64_type( bwt_stream()),  occ64_stream(), count_table_iterator() ); }
+    rank_dict64_type rrank_dict64() const { return rank_dict64_type( stream64_type(rbwt_stream()), rocc64_stream(), count_table_iterator() ); }
+
+    fm_index64_type  index64() const { return fm_index64_type( genome_length(),  primary,  L2_64,  rank_dict64(),  ssa64 ); }
+    fm_index64_type rindex64() const { return fm_index64_type( genome_length(), rprimary, rL2_64, rrank_dict64(), rssa64 ); }
+
+    partial_fm_index64_type  partial_index64() const { return partial_fm_index64_type( genome_length(),  primary,  L2_64,  rank_dict64(), null_type() ); }
+    partial_fm_index64_type rpartial_index64() const { return partial_fm_index64_type( genome_length(), rprimary, rL2_64, rrank_dict64(), null_type() ); }
+
 
     uint32             m_flags;
-    uint32             seq_length;
-    uint32             seq_words;
-    uint32             occ_words;
-    uint32             sa_words;
-    uint32              primary;
-    uint32             rprimary;
+    uint32             m_index_bits;
+    uint64             seq_length;
+    uint64             seq_words;
+    uint64             occ_words;
+    uint64             sa_words;
+    uint64              primary;
+    uint64             rprimary;
     uint32*            m_genome_stream;
     uint32*            m_bwt_stream;
     uint32*            m_rbwt_stream;
     uint32*            m_occ;
     uint32*            m_rocc;
+    uint4*             m_fused;
+    uint4*             m_rfused;
+    uint64*            m_occ64;
+    uint64*            m_rocc64;
     uint32*             L2;
     uint32*            rL2;
+    uint64*             L2_64;
+    uint64*            rL2_64;
     uint32*            count_table;
     SSA_context        ssa;
     SSA_context        rssa;
+    SSA64_context      ssa64;
+    SSA64_context      rssa64;
 
     BNTInfo            m_bnt_info;
     BNTSeqPOD          m_bnt_data;
@@ -199,6 +271,11 @@ void init_ssa(
     FMIndexData::SSA_type&   ssa,
     FMIndexData::SSA_type&   rssa);
 
+void init_ssa(
+    const FMIndexData&       driver_data,
+    FMIndexData::SSA64_type& ssa,
+    FMIndexData::SSA64_type& rssa);
+
 ///
 /// An in-RAM FM-index.
 ///
@@ -207,7 +284,9 @@ struct FMIndexDataRAM : public FMIndexData
     /// load a genome from file
     ///
     /// \param genome_prefix            prefix file name
-    /// \param flags                    loading flags specifying which elements to load
+    /// \param flags                    loading flags specifying which elements to load;
+    ///                                 FUSED additionally builds the cache-line aligned
+    ///                                 interleaved BWT+occurrence tables for the loaded directions
     int load(
         const char* genome_prefix,
         const uint32 flags = GENOME | FORWARD | REVERSE | SA);
@@ -217,27 +296,36 @@ struct FMIndexDataRAM : public FMIndexData
     std::vector<uint32> m_rbwt_stream_vec;
     std::vector<uint32> m_occ_vec;
     std::vector<uint32> m_rocc_vec;
+    std::vector<uint4>  m_fused_vec;
+    std::vector<uint4>  m_rfused_vec;
+    std::vector<uint64> m_occ64_vec;
+    std::vector<uint64> m_rocc64_vec;
 
     uint32              m_L2[5];
     uint32              m_rL2[5];
+    uint64              m_L2_64[5];
+    uint64              m_rL2_64[5];
     uint32              m_count_table[256];
 
     std::vector<uint32> m_ssa_vec;
     std::vector<uint32> m_rssa_vec;
+    std::vector<uint64> m_ssa64_vec;
+    std::vector<uint64> m_rssa64_vec;
 
     BNTSeqVec           m_bnt_vec;
 };
 
 struct FMIndexDataMMAPInfo
 {
-    uint32  sequence_length;
-    uint32  sequence_words;
-    uint32  occ_words;
-    uint32  sa_words;
-    uint32  primary;
-    uint32  rprimary;
-    uint32  L2[5];
-    uint32  rL2[5];
+    uint32  index_bits;         ///< 32 or 64, determining the width of the occurrence and SSA entries
+    uint64  sequence_length;
+    uint64  sequence_words;
+    uint64  occ_words;          ///< number of occurrence table entries
+    uint64  sa_words;           ///< number of SSA entries
+    uint64  primary;
+    uint64  rprimary;
+    uint64  L2[5];
+    uint64  rL2[5];
     BNTInfo bnt;
 };
 
@@ -283,6 +371,15 @@ struct FMIndexDataMMAP : public FMIndexData
     int load(
         const char*  genome_name);
 
+    /// map an FM-index container (see FMIndexContainerHeader) straight from disk, read-only;
+    /// its pages are only loaded as they get accessed
+    ///
+    /// \param file_name            container file name
+    /// \param verify               verify the section checksums, touching the entire index
+    int load_file(
+        const char*  file_name,
+        const bool   verify = false);
+
     MappedFile          m_genome_file;                  ///< internal memory-mapped genome object
     MappedFile          m_bwt_file;                     ///< internal memory-mapped forward BWT object
     MappedFile          m_rbwt_file;                    ///< internal memory-mapped reverse BWT object
@@ -292,9 +389,12 @@ struct FMIndexDataMMAP : public FMIndexData
     MappedFile          m_rsa_file;                     ///< internal memory-mapped reverse SSA table object
     MappedFile          m_info_file;                    ///< internal memory-mapped info object
     MappedFile          m_bnt_file;                     ///< internal memory-mapped BNT object
+    MappedInputFile     m_container_file;               ///< internal memory-mapped container file
 
     uint32              m_L2[5];                        ///< local storage for the forward L2 table
     uint32              m_rL2[5];                       ///< local storage for the reverse L2 table
+    uint64              m_L2_64[5];                     ///< local storage for the 64-bit forward L2 table
+    uint64              m_rL2_64[5];                    ///< local storage for the 64-bit reverse L2 table
     uint32              m_count_table[256];             ///< local storage for the BWT counting table
 };
 
@@ -341,7 +441,7 @@ struct FMIndexDataDevice : public FMIndexData
         rank_dict_type,
         null_type>                                              partial_fm_index_type;
 
-    /// load a host-memory FM-index in device memory
+    /// load a host-memory FM-index in device memory; only 32-bit indices are supported
     ///
     /// \param host_data                                host-memory FM-index to load
     /// \param flags                                    specify which parts of the FM-index to load
@@ -0,0 +1,205 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/fmi_container.h>
+#include <nvbio/basic/console.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace nvbio {
+namespace io {
+
+const char FMI_CONTAINER_MAGIC[8] = { 'N','V','B','I','O','F','M','I' };
+
+namespace { // anonymous
+
+// round a size up to the container's section alignment
+inline uint64 align_section(const uint64 size)
+{
+    const uint64 A = FMIndexContainerHeader::ALIGNMENT;
+    return ((size + A - 1u) / A) * A;
+}
+
+// write a block of data followed by the padding up to the next section boundary
+//
+bool write_section(FILE* file, const void* data, const uint64 size, uint64& offset)
+{
+    static const char padding[FMIndexContainerHeader::ALIGNMENT] = { 0 };
+
+    const uint64 padded_size = align_section( size );
+
+    if (size && fwrite( data, 1u, size, file ) != size)
+        return false;
+
+    if (padded_size > size && fwrite( padding, 1u, padded_size - size, file ) != padded_size - size)
+        return false;
+
+    offset += padded_size;
+    return true;
+}
+
+} // anonymous namespace
+
+// compute a 64-bit Fletcher checksum of a block of data, implicitly zero-padded to a multiple of 4 bytes
+//
+uint64 fmi_container_checksum(const void* data, const uint64 size)
+{
+    const uint64 M = 0xFFFFFFFFu;
+
+    // the number of words which can be summed before the partial sums need to be reduced
+    const uint64 BLOCK_WORDS = 16384u;
+
+    const uint8* bytes   = (const uint8*)data;
+    const uint64 n_words = size / 4u;
+
+    uint64 a = 0u;
+    uint64 b = 0u;
+
+    for (uint64 block_begin = 0; block_begin < n_words; block_begin += BLOCK_WORDS)
+    {
+        const uint64 block_end = nvbio::min( block_begin + BLOCK_WORDS, n_words );
+
+        for (uint64 i = block_begin; i < block_end; ++i)
+        {
+            uint32 word;
+            memcpy( &word, bytes + i*4u, sizeof(uint32) );
+
+            a += word;
+            b += a;
+        }
+        a %= M;
+        b %= M;
+    }
+
+    // add the trailing bytes, zero-padded to a whole word
+    if (size % 4u)
+    {
+        uint32 word = 0u;
+        memcpy( &word, bytes + n_words*4u, size % 4u );
+
+        a = (a + word) % M;
+        b = (b + a) % M;
+    }
+    return (b << 32) | a;
+}
+
+// save a loaded FM-index to a container file
+//
+bool save_fmi_container(const FMIndexData& fmi, const char* file_name)
+{
+    typedef FMIndexContainerHeader Header;
+
+    const uint64 index_size = fmi.index_bits() / 8u;
+
+    const void* ssa  = fmi.index_bits() == 32 ? (const void*)fmi.ssa.m_ssa  : (const void*)fmi.ssa64.m_ssa;
+    const void* rssa = fmi.index_bits() == 32 ? (const void*)fmi.rssa.m_ssa : (const void*)fmi.rssa64.m_ssa;
+    const void* occ  = fmi.index_bits() == 32 ? (const void*)fmi.m_occ      : (const void*)fmi.m_occ64;
+    const void* rocc = fmi.index_bits() == 32 ? (const void*)fmi.m_rocc     : (const void*)fmi.m_rocc64;
+
+    // gather the sections
+    const void* section_data[ Header::N_SECTIONS ];
+    uint64      section_size[ Header::N_SECTIONS ];
+
+    section_data[ Header::GENOME_SECTION ]    = fmi.m_genome_stream;
+    section_data[ Header::BWT_SECTION ]       = fmi.m_bwt_stream;
+    section_data[ Header::RBWT_SECTION ]      = fmi.m_rbwt_stream;
+    section_data[ Header::OCC_SECTION ]       = occ;
+    section_data[ Header::ROCC_SECTION ]      = rocc;
+    section_data[ Header::SSA_SECTION ]       = ssa;
+    section_data[ Header::RSSA_SECTION ]      = rssa;
+    section_data[ Header::BNT_ANNS_SECTION ]  = fmi.m_bnt_data.anns;
+    section_data[ Header::BNT_AMBS_SECTION ]  = fmi.m_bnt_data.ambs;
+    section_data[ Header::BNT_NAMES_SECTION ] = fmi.m_bnt_data.names;
+    section_data[ Header::BNT_ANNOS_SECTION ] = fmi.m_bnt_data.annos;
+
+    section_size[ Header::GENOME_SECTION ]    = sizeof(uint32) * fmi.seq_words;
+    section_size[ Header::BWT_SECTION ]       = sizeof(uint32) * fmi.seq_words;
+    section_size[ Header::RBWT_SECTION ]      = sizeof(uint32) * fmi.seq_words;
+    section_size[ Header::OCC_SECTION ]       = index_size * fmi.occ_words;
+    section_size[ Header::ROCC_SECTION ]      = index_size * fmi.occ_words;
+    section_size[ Header::SSA_SECTION ]       = index_size * fmi.sa_words;
+    section_size[ Header::RSSA_SECTION ]      = index_size * fmi.sa_words;
+    section_size[ Header::BNT_ANNS_SECTION ]  = sizeof(BNTAnn) * uint64( fmi.m_bnt_info.n_seqs );
+    section_size[ Header::BNT_AMBS_SECTION ]  = sizeof(BNTAmb) * uint64( fmi.m_bnt_info.n_holes );
+    section_size[ Header::BNT_NAMES_SECTION ] = fmi.m_bnt_info.names_len;
+    section_size[ Header::BNT_ANNOS_SECTION ] = fmi.m_bnt_info.annos_len;
+
+    Header header;
+    memset( &header, 0, sizeof(Header) );
+    memcpy( header.magic, FMI_CONTAINER_MAGIC, sizeof(FMI_CONTAINER_MAGIC) );
+    header.version    = Header::VERSION;
+    header.index_bits = fmi.index_bits();
+    header.seq_length = fmi.seq_length;
+    header.seq_words  = fmi.seq_words;
+    header.occ_words  = fmi.occ_words;
+    header.sa_words   = fmi.sa_words;
+    header.primary    = fmi.primary;
+    header.rprimary   = fmi.rprimary;
+    for (uint32 i = 0; i < 5; ++i)
+    {
+        header.L2[i]  = fmi.index_bits() == 32 ? (fmi.L2  ? fmi.L2[i]  : 0u) : fmi.L2_64[i];
+        header.rL2[i] = fmi.index_bits() == 32 ? (fmi.rL2 ? fmi.rL2[i] : 0u) : fmi.rL2_64[i];
+    }
+    header.bnt = fmi.m_bnt_info;
+
+    FILE* file = fopen( file_name, "wb" );
+    if (file == NULL)
+    {
+        log_error(stderr, "unable to open \"%s\" for writing\n", file_name);
+        return false;
+    }
+
+    log_info(stderr, "writing FM-index container \"%s\"... started\n", file_name);
+
+    // write a placeholder header, to be completed once all sections are in place
+    uint64 offset = 0;
+    bool ret = write_section( file, &header, sizeof(Header), offset );
+
+    for (uint32 s = 0; s < Header::N_SECTIONS && ret; ++s)
+    {
+        // skip the missing sections
+        if (section_data[s] == NULL)
+            section_size[s] = 0u;
+
+        header.sections[s].offset   = offset;
+        header.sections[s].size     = section_size[s];
+        header.sections[s].checksum = fmi_container_checksum( section_data[s], section_size[s] );
+
+        ret = write_section( file, section_data[s], section_size[s], offset );
+    }
+
+    header.header_checksum = fmi_container_checksum( &header, sizeof(Header) );
+
+    if (ret && (fseek( file, 0, SEEK_SET ) != 0 ||
+                fwrite( &header, sizeof(Header), 1u, file ) != 1u))
+        ret = false;
+
+    if (fclose( file ) != 0)
+        ret = false;
+
+    if (ret == false)
+        log_error(stderr, "writing \"%s\" failed\n", file_name);
+    else
+        log_info(stderr, "writing FM-index container \"%s\"... done (%.1f MB)\n", file_name, float(offset)/float(1024*1024));
+
+    return ret;
+}
+
+} // namespace io
+} // namespace nvbio
@@ -0,0 +1,124 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/io/fmi.h>
+
+namespace nvbio {
+namespace io {
+
+///@addtogroup IO
+///@{
+
+///@addtogroup FMIndexIO
+///@{
+
+///
+/// An FM-index container (.fmi) is a single-file snapshot of a fully loaded FM-index, storing
+/// all its tables exactly as they are laid out in memory - including the occurrence tables,
+/// which would otherwise have to be rebuilt at each load.
+/// Containers can be mapped straight from disk by FMIndexDataMMAP::load_file(), so that
+/// starting up costs only the time to page in the parts of the index actually accessed.
+///
+/// The file layout is the following:
+///
+/// - an FMIndexContainerHeader, holding the index dimensions, the L2 tables and the BNT info,
+///   together with the offset, size and checksum of each section
+/// - the sections, in the order of FMIndexContainerHeader::SectionId, each starting at a
+///   multiple of FMIndexContainerHeader::ALIGNMENT bytes: the genome, the forward and
+///   reverse BWTs, occurrence tables and SSAs, and the BNT annotations, ambiguities,
+///   names and annotation strings
+///
+/// Missing sections (e.g. the SSAs of an index saved without them) have zero size.
+/// The occurrence tables and the SSAs have 32-bit or 64-bit entries, depending on the
+/// index width.
+/// Section checksums are 64-bit Fletcher checksums of the zero-padded section data.
+///
+
+/// the descriptor of a section of an FM-index container
+///
+struct FMIndexContainerSection
+{
+    uint64  offset;         ///< the file offset of the section
+    uint64  size;           ///< the size of the section, in bytes
+    uint64  checksum;       ///< the checksum of the section
+};
+
+/// the header of an FM-index container
+///
+struct FMIndexContainerHeader
+{
+    static const uint32 VERSION   = 1u;
+    static const uint32 ALIGNMENT = 4096u;      ///< section alignment, a multiple of the page size
+
+    enum SectionId
+    {
+        GENOME_SECTION      = 0,
+        BWT_SECTION         = 1,
+        RBWT_SECTION        = 2,
+        OCC_SECTION         = 3,
+        ROCC_SECTION        = 4,
+        SSA_SECTION         = 5,
+        RSSA_SECTION        = 6,
+        BNT_ANNS_SECTION    = 7,
+        BNT_AMBS_SECTION    = 8,
+        BNT_NAMES_SECTION   = 9,
+        BNT_ANNOS_SECTION   = 10,
+        N_SECTIONS          = 11
+    };
+
+    char    magic[8];           ///< the magic string "NVBIOFMI"
+    uint32  version;            ///< the format version
+    uint32  index_bits;         ///< the index width, 32 or 64 bits
+    uint64  seq_length;         ///< the genome length
+    uint64  seq_words;          ///< the number of words of the genome and BWT streams
+    uint64  occ_words;          ///< the number of occurrence table entries
+    uint64  sa_words;           ///< the number of SSA entries
+    uint64  primary;            ///< the forward BWT primary
+    uint64  rprimary;           ///< the reverse BWT primary
+    uint64  L2[5];              ///< the forward L2 table
+    uint64  rL2[5];             ///< the reverse L2 table
+    BNTInfo bnt;                ///< the BNT sequence info
+    uint32  pad;                ///< extra padding field
+    uint64  header_checksum;    ///< the checksum of the header, computed with this field set to zero
+
+    FMIndexContainerSection sections[N_SECTIONS];   ///< the section descriptors
+};
+
+/// the magic string identifying FM-index containers, "NVBIOFMI"
+///
+extern const char FMI_CONTAINER_MAGIC[8];
+
+/// compute the checksum of a block of data, implicitly zero-padded to a multiple of 4 bytes
+///
+uint64 fmi_container_checksum(const void* data, const uint64 size);
+
+/// save a loaded FM-index to a container file, including whichever of its parts are present
+///
+/// \param fmi          the FM-index to save
+/// \param file_name    the output file name
+/// \return             true on success
+///
+bool save_fmi_container(const FMIndexData& fmi, const char* file_name);
+
+///@} // FMIndexIO
+///@} // IO
+
+} // namespace io
+} // namespace nvbio
@@ -18,29 +18,48 @@
 
 #include <nvbio/io/output/output_bam.h>
 #include <nvbio/io/output/output_sam.h>
+#include <nvbio/io/output/output_bam_index.h>
 #include <nvbio/io/fmi.h>
 #include <nvbio/basic/numbers.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
 namespace nvbio {
 namespace io {
 
-BamOutput::BamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt)
-    : OutputFile(file_name, alignment_type, bnt)
+BamOutput::BamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt,
+                     const int compression_level,
+                     const uint32 compression_threads,
+                     const bool sorted,
+                     const uint64 sort_memory,
+                     const QualityMode quality_mode)
+    : OutputFile(file_name, alignment_type, bnt),
+      sorter(NULL),
+      bam_name(file_name),
+      quality_mode(quality_mode)
 {
-    fp = fopen(file_name, "wt");
+    fp = open_output_stream(file_name, "wb");
     if (fp == NULL)
     {
         log_error(stderr, "BamOutput: could not open %s for writing\n", file_name);
         return;
     }
 
-    // set a 256kb output buffer on fp and make sure it's not line buffered
-    // this makes sure small fwrites do not land on disk straight away
-    // (256kb was chosen based on the default stripe size for Linux mdraid RAID-5 volumes)
-    setvbuf(fp, NULL, _IOFBF, 256 * 1024);
+    // start the compression pipeline, keeping track of block offsets for the index if we're sorting
+    bgzf.open(fp, compression_level, compression_threads, sorted);
+
+    // sorted runs are spilled next to the output file, or to the temporary directory
+    // when writing to the standard output
+    if (sorted)
+        sorter = new BamRecordSorter(sort_prefix().c_str(), sort_memory);
 
     // output the BAM header
     output_header();
@@ -48,11 +67,17 @@ BamOutput::BamOutput(const char *file_name, AlignmentType alignment_type, BNT bn
 
 BamOutput::~BamOutput()
 {
+    // the output thread may still be writing to our files
+    stop_output_thread();
+
     if (fp)
     {
+        bgzf.close();
         fclose(fp);
         fp = NULL;
     }
+
+    delete sorter;
 }
 
 void BamOutput::process(struct GPUOutputBatch& gpu_batch,
@@ -60,7 +85,7 @@ void BamOutput::process(struct GPUOutputBatch& gpu_batch,
                         const AlignmentScore score)
 {
     // read back the data into the CPU for later processing
-    readback(cpu_output, gpu_batch, mate, score);
+    readback(*cpu_batch, gpu_batch, mate, score);
 }
 
 uint32 BamOutput::generate_cigar(struct BAM_alignment& alnh,
@@ -293,19 +318,28 @@ uint32 BamOutput::process_one_alignment(DataBuffer& out, AlignmentData& alignmen
     }
 
     // fill out quality data
-    for(uint32 i = 0; i < alignment.read_len; i++)
+    if (quality_mode == QUALITY_DROP)
     {
-        char q;
-
-        if (alignment.best->m_rc)
+        // BAM marks missing qualities with a run of 0xFF
+        memset(alnd.qual, 0xff, alignment.read_len);
+    }
+    else
+    {
+        for(uint32 i = 0; i < alignment.read_len; i++)
         {
-            q = alignment.qual[i];
-        } else {
-            q = alignment.qual[alignment.read_len - i - 1];
-        }
+            char q;
 
-        alnd.qual[i] = q;
+            if (alignment.best->m_rc)
+            {
+                q = alignment.qual[i];
+            } else {
+                q = alignment.qual[alignment.read_len - i - 1];
+            }
+
+            alnd.qual[i] = quality_mode == QUALITY_BIN ? bin_quality(q) : q;
+        }
     }
+    iostats.output_qual_bytes += alignment.read_len;
 
     // compute mapping quality
     // mapq is always computed based on the anchor mate, so we may have to swap the mates around here
@@ -336,6 +370,7 @@ uint32 BamOutput::process_one_alignment(DataBuffer& out, AlignmentData& alignmen
         alnh.flag_nc = BAM_FLAGS_UNMAPPED;
         alnh.next_refID = -1;
         alnh.next_pos = -1;
+        alnh.bin_mq_nl |= bam_reg2bin(-1, 0) << 16;
         // mark the md string as empty
         alnd.md_string[0] = '\0';
 
@@ -380,6 +415,7 @@ uint32 BamOutput::process_one_alignment(DataBuffer& out, AlignmentData& alignmen
         alnh.pos = -1;
         alnh.next_refID = -1;
         alnh.next_pos = -1;
+        alnh.bin_mq_nl |= bam_reg2bin(-1, 0) << 16;
         alnd.md_string[0] = '\0';
 
         output_alignment(out, alnh, alnd);
@@ -392,8 +428,8 @@ uint32 BamOutput::process_one_alignment(DataBuffer& out, AlignmentData& alignmen
 
     // write out mapq
     alnh.bin_mq_nl |= (mapq << 8);
-    // BAM alignment bin is always 0
-    // xxxnsubtil: is the bin useful?
+    // and the bin of the alignment, used by indexed readers
+    alnh.bin_mq_nl |= bam_reg2bin(alnh.pos, alnh.pos + nvbio::max(ref_cigar_len, 1u)) << 16;
 
     // fill out the cigar string...
     uint32 computed_cigar_len = generate_cigar(alnh, alnd, alignment);
@@ -546,9 +582,9 @@ void BamOutput::output_alignment(DataBuffer& out, BAM_alignment& alnh, BAM_align
     }
 }
 
-void BamOutput::end_batch(void)
+void BamOutput::write_batch(CPUOutputBatch& cpu_batch)
 {
-    for(uint32 c = 0; c < cpu_output.count; c++)
+    for(uint32 c = 0; c < cpu_batch.count; c++)
     {
         // wrap the alignment into AlignmentData structures for both mates
         AlignmentData alignment;
@@ -558,7 +594,7 @@ void BamOutput::end_batch(void)
         switch(alignment_type)
         {
             case SINGLE_END:
-                alignment = cpu_output.get_mate(c, MATE_1, MATE_1);
+                alignment = cpu_batch.get_mate(c, MATE_1, MATE_1);
                 mate = AlignmentData::invalid();
 
                 mapq = process_one_alignment(data_buffer, alignment, mate);
@@ -568,8 +604,8 @@ void BamOutput::end_batch(void)
                 break;
 
             case PAIRED_END:
-                alignment = cpu_output.get_anchor(c);
-                mate = cpu_output.get_opposite_mate(c);
+                alignment = cpu_batch.get_anchor(c);
+                mate = cpu_batch.get_opposite_mate(c);
 
                 mapq = process_one_alignment(data_buffer, alignment, mate);
                 process_one_alignment(data_buffer, mate, alignment);
@@ -584,21 +620,78 @@ void BamOutput::end_batch(void)
     {
         write_block(data_buffer);
     }
-
-    OutputFile::end_batch();
 }
 
 void BamOutput::write_block(DataBuffer& block)
 {
-    DataBuffer compressed;
+    if (sorter)
+    {
+        // hold on to the alignments until we've seen all of them
+        sorter->add(block);
+        block.rewind();
+        return;
+    }
 
-    bgzf.start_block(compressed);
-    bgzf.compress(compressed, block);
-    bgzf.end_block(compressed);
+    // hand the block over to the compression pipeline, which writes blocks out in order
+    bgzf.write_block(block);
+}
+
+void BamOutput::write_sorted(void)
+{
+    BamIndexBuilder index(bnt.info.n_seqs);
+
+    sorter->finish();
+    log_verbose(stderr, "  merging %u sorted runs\n", sorter->spilled_runs());
+
+    const char *record;
+    uint32 record_size;
+    while (sorter->next(&record, &record_size))
+    {
+        // make sure records never straddle two blocks, so that their offsets are simple to track
+        if (data_buffer.get_pos() + record_size > DataBuffer::BUFFER_SIZE)
+            bgzf.write_block(data_buffer);
+
+        // offsets are recorded as block id and position in the block, and resolved once written
+        const uint64 begin = (bgzf.block_count() << 16) | data_buffer.get_pos();
+        data_buffer.append_data(record, record_size);
+        const uint64 end   = (bgzf.block_count() << 16) | data_buffer.get_pos();
+
+        index.add(record, begin, end);
+    }
 
-    fwrite(compressed.get_base_ptr(), compressed.pos, 1, fp);
+    if (data_buffer.get_pos())
+        bgzf.write_block(data_buffer);
+
+    delete sorter;
+    sorter = NULL;
+
+    // wait for all the blocks to land on disk and write out the index
+    bgzf.close();
 
-    block.rewind();
+    // there's nowhere to put the index of a stream
+    if (is_stdout(bam_name.c_str()))
+        log_verbose(stderr, "  skipping the BAM index of the standard output\n");
+    else
+        index.write((bam_name + ".bai").c_str(), bgzf);
+}
+
+std::string BamOutput::sort_prefix(void) const
+{
+    if (is_stdout(bam_name.c_str()) == false)
+        return bam_name + ".sort";
+
+    const char *tmp_dir = getenv("TMPDIR");
+    if (tmp_dir == NULL || tmp_dir[0] == '\0')
+        tmp_dir = "/tmp";
+
+    // make the prefix unique to this process
+    char prefix[64];
+#ifdef WIN32
+    sprintf(prefix, "/nvbio-sort.%d", int(_getpid()));
+#else
+    sprintf(prefix, "/nvbio-sort.%d", int(getpid()));
+#endif
+    return std::string(tmp_dir) + prefix;
 }
 
 void BamOutput::output_header(void)
@@ -617,7 +710,7 @@ void BamOutput::output_header(void)
 
     // fill out SAM header (text)
     data_buffer.append_string("@HD\t");
-    data_buffer.append_string("VN:1.3\n");
+    data_buffer.append_string(sorter ? "VN:1.3\tSO:coordinate\n" : "VN:1.3\n");
     data_buffer.append_string("@PG\t");
     // xxxnsubtil: this will have to be specified somewhere else later (maybe in Params?)
     data_buffer.append_string("ID:nvBowtie\t");
@@ -650,19 +743,29 @@ void BamOutput::output_header(void)
 
     // compress and write out the header block separately
     // (this yields a slightly smaller file)
-    write_block(data_buffer);
+    bgzf.write_block(data_buffer);
 }
 
 void BamOutput::close()
 {
     NVBIO_CUDA_ASSERT(fp);
 
+    // write out any pending batches
+    OutputFile::close();
+
+    // write out the alignments in coordinate order, along with their index
+    if (sorter)
+        write_sorted();
+
+    // wait for all the pending blocks to be compressed and written
+    bgzf.close();
+
     // write out the BAM EOF marker
-    static const unsigned char magic[28] =  { 0037, 0213, 0010, 0004, 0000, 0000, 0000, 0000, 0000,
-                                              0377, 0006, 0000, 0102, 0103, 0002, 0000, 0033, 0000,
-                                              0003, 0000, 0000, 0000, 0000, 0000, 0000, 0000, 0000, 0000 };
+    bgzf.write_eof_marker();
 
-    fwrite(magic, sizeof(magic), 1, fp);
+    iostats.output_raw_bytes        = bgzf.input_bytes();
+    iostats.output_bytes            = bgzf.output_bytes();
+    iostats.output_compression_time = bgzf.compression_time();
 
     fclose(fp);
     fp = NULL;
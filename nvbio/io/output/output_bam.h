@@ -25,6 +25,7 @@
 #include <nvbio/io/output/output_batch.h>
 #include <nvbio/io/output/output_databuffer.h>
 #include <nvbio/io/output/output_gzip.h>
+#include <nvbio/io/output/output_bam_sort.h>
 
 #include <nvbio/io/fmi.h>
 #include <nvbio/io/reads/reads.h>
@@ -32,6 +33,7 @@
 #include <nvbio/io/bam_format.h>
 
 #include <stdio.h>
+#include <string>
 
 namespace nvbio {
 namespace io {
@@ -56,20 +58,31 @@ private:
     } BamAlignmentFlags;
 
 public:
-    BamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt);
+    // if sorted is set, alignments are written out in coordinate order and indexed
+    // into file_name.bai; sorting uses at most sort_memory bytes, spilling the rest to disk.
+    // quality_mode selects whether base qualities are written verbatim, binned or omitted
+    BamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt,
+              const int compression_level = Z_DEFAULT_COMPRESSION,
+              const uint32 compression_threads = 0,
+              const bool sorted = false,
+              const uint64 sort_memory = 768u * 1024u * 1024u,
+              const QualityMode quality_mode = QUALITY_KEEP);
     ~BamOutput();
 
     void process(struct GPUOutputBatch& gpu_batch,
                  const AlignmentMate mate,
                  const AlignmentScore score);
-    void end_batch(void);
-
     void close(void);
 
+protected:
+    void write_batch(struct CPUOutputBatch& cpu_batch);
+
 private:
     void output_header(void);
     uint32 process_one_alignment(DataBuffer& out, AlignmentData& alignment, AlignmentData& mate);
     void write_block(DataBuffer& block);
+    void write_sorted(void);
+    std::string sort_prefix(void) const;
 
     uint32 generate_cigar(struct BAM_alignment& alnh,
                           struct BAM_alignment_data_block& alnd,
@@ -87,12 +100,16 @@ private:
 
     // our file pointer
     FILE *fp;
-    // CPU copy of the current alignment batch
-    CPUOutputBatch cpu_output;
     // text buffer that we're filling with data
     DataBuffer data_buffer;
-    // our BGZF compressor
-    BGZFCompressor bgzf;
+    // our BGZF compression pipeline
+    BGZFWriter bgzf;
+    // the alignments waiting to be written out in coordinate order, if we're sorting
+    BamRecordSorter *sorter;
+    // the name of the file, which the BAI index is named after
+    std::string bam_name;
+    // how base qualities are written out
+    QualityMode quality_mode;
 };
 
 } // namespace io
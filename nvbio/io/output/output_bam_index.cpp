@@ -0,0 +1,229 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/output/output_bam_index.h>
+#include <nvbio/io/bam_format.h>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/numbers.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace nvbio {
+namespace io {
+
+// the bin holding the per-reference metadata
+static const uint32 BAI_PSEUDO_BIN = 37450;
+// log2 of the size of the windows of the linear index
+static const uint32 BAI_LINEAR_SHIFT = 14;
+
+namespace {
+// append the raw bytes of a value to out (BAI is little-endian, and so is x86/amd64)
+template <typename T> void append(std::vector<char>& out, const T value)
+{
+    const char *p = (const char *)&value;
+    out.insert(out.end(), p, p + sizeof(T));
+}
+}
+
+BamIndexBuilder::BamIndexBuilder(const uint32 n_refs)
+    : refs(n_refs), n_no_coor(0), chunk_ref(-1), chunk_bin(0)
+{
+}
+
+void BamIndexBuilder::add(const char *record, const uint64 begin, const uint64 end)
+{
+    int32  refID, pos;
+    uint32 bin_mq_nl, flag_nc;
+    memcpy(&refID,     record + 4,  sizeof(int32));
+    memcpy(&pos,       record + 8,  sizeof(int32));
+    memcpy(&bin_mq_nl, record + 12, sizeof(uint32));
+    memcpy(&flag_nc,   record + 16, sizeof(uint32));
+
+    if (refID < 0)
+    {
+        // unplaced reads come last and are only counted
+        close_chunk();
+        chunk_ref = -1;
+        n_no_coor++;
+        return;
+    }
+
+    // compute the reference span of the alignment from its CIGAR
+    const uint32 n_cigar_op = flag_nc & 0xffff;
+    const char  *cigar      = record + 36 + (bin_mq_nl & 0xff);
+
+    int32 ref_len = 0;
+    for(uint32 i = 0; i < n_cigar_op; i++)
+    {
+        uint32 op;
+        memcpy(&op, cigar + i * sizeof(uint32), sizeof(uint32));
+
+        // M, D, N, = and X consume the reference
+        const uint32 type = op & 0xf;
+        if (type == 0 || type == 2 || type == 3 || type == 7 || type == 8)
+            ref_len += op >> 4;
+    }
+
+    const int32  pos_end = pos + (ref_len ? ref_len : 1);
+    const uint32 bin     = bam_reg2bin(pos, pos_end);
+
+    // extend the current chunk, or start a new one
+    if (refID != chunk_ref || bin != chunk_bin)
+    {
+        close_chunk();
+
+        chunk_ref   = refID;
+        chunk_bin   = bin;
+        chunk.begin = begin;
+    }
+    chunk.end = end;
+
+    Reference& ref = refs[refID];
+
+    // record the first record overlapping each window of the linear index
+    const uint32 first_window = uint32(pos) >> BAI_LINEAR_SHIFT;
+    const uint32 last_window  = uint32(pos_end - 1) >> BAI_LINEAR_SHIFT;
+    if (ref.intervals.size() <= last_window)
+        ref.intervals.resize(last_window + 1, uint64(-1));
+
+    for(uint32 w = first_window; w <= last_window; w++)
+    {
+        if (ref.intervals[w] == uint64(-1))
+            ref.intervals[w] = begin;
+    }
+
+    ref.begin = nvbio::min(ref.begin, begin);
+    ref.end   = nvbio::max(ref.end, end);
+
+    // flag 0x4 (unmapped) sits in the upper half of flag_nc
+    if (flag_nc & (4 << 16))
+        ref.n_unmapped++;
+    else
+        ref.n_mapped++;
+}
+
+void BamIndexBuilder::close_chunk(void)
+{
+    if (chunk_ref == -1)
+        return;
+
+    std::vector<Chunk>& chunks = refs[chunk_ref].bins[chunk_bin];
+
+    // merge with the previous chunk of the bin if they start and end in the same BGZF block
+    if (chunks.size() && (chunks.back().end >> 16) == (chunk.begin >> 16))
+        chunks.back().end = chunk.end;
+    else
+        chunks.push_back(chunk);
+
+    chunk_ref = -1;
+}
+
+bool BamIndexBuilder::write(const char *file_name, const BGZFWriter& bgzf)
+{
+    close_chunk();
+
+    FILE *fp = fopen(file_name, "wb");
+    if (fp == NULL)
+    {
+        log_error(stderr, "BamIndexBuilder: could not open %s for writing\n", file_name);
+        return false;
+    }
+
+    // translate block ids into file offsets
+    struct resolve
+    {
+        resolve(const BGZFWriter& bgzf) : bgzf(bgzf) {}
+
+        uint64 operator() (const uint64 v) const { return (bgzf.block_address(v >> 16) << 16) | (v & 0xffff); }
+
+        const BGZFWriter& bgzf;
+    } virtual_offset(bgzf);
+
+    std::vector<char> out;
+    out.insert(out.end(), "BAI\1", "BAI\1" + 4);
+
+    const int32 n_ref = int32(refs.size());
+    append(out, n_ref);
+
+    for(uint32 r = 0; r < refs.size(); r++)
+    {
+        const Reference& ref = refs[r];
+        const bool has_data = ref.n_mapped + ref.n_unmapped > 0;
+
+        const int32 n_bin = int32(ref.bins.size()) + (has_data ? 1 : 0);
+        append(out, n_bin);
+
+        for(std::map< uint32, std::vector<Chunk> >::const_iterator it = ref.bins.begin(); it != ref.bins.end(); ++it)
+        {
+            const uint32 bin     = it->first;
+            const int32  n_chunk = int32(it->second.size());
+            append(out, bin);
+            append(out, n_chunk);
+
+            for(uint32 c = 0; c < it->second.size(); c++)
+            {
+                const uint64 begin = virtual_offset(it->second[c].begin);
+                const uint64 end   = virtual_offset(it->second[c].end);
+                append(out, begin);
+                append(out, end);
+            }
+        }
+
+        if (has_data)
+        {
+            // the pseudo-bin holds the span of the reference in the file and its record counts
+            const uint32 bin     = BAI_PSEUDO_BIN;
+            const int32  n_chunk = 2;
+            const uint64 begin   = virtual_offset(ref.begin);
+            const uint64 end     = virtual_offset(ref.end);
+            append(out, bin);
+            append(out, n_chunk);
+            append(out, begin);
+            append(out, end);
+            append(out, ref.n_mapped);
+            append(out, ref.n_unmapped);
+        }
+
+        const int32 n_intv = int32(ref.intervals.size());
+        append(out, n_intv);
+
+        // windows not overlapped by any record inherit the offset of the previous one
+        uint64 ioffset = 0;
+        for(uint32 w = 0; w < ref.intervals.size(); w++)
+        {
+            if (ref.intervals[w] != uint64(-1))
+                ioffset = virtual_offset(ref.intervals[w]);
+
+            append(out, ioffset);
+        }
+    }
+
+    append(out, n_no_coor);
+
+    const bool ok = fwrite(&out[0], out.size(), 1, fp) == 1;
+    fclose(fp);
+
+    if (!ok)
+        log_error(stderr, "BamIndexBuilder: failed writing to %s\n", file_name);
+
+    return ok;
+}
+
+} // namespace io
+} // namespace nvbio
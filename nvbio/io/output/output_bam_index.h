@@ -0,0 +1,81 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/io/output/output_types.h>
+#include <nvbio/io/output/output_gzip.h>
+
+#include <vector>
+#include <map>
+
+namespace nvbio {
+namespace io {
+
+// Builds the BAI index of a coordinate-sorted BAM file while its records are being written out.
+//
+// Record offsets are passed in as block_id << 16 | offset_in_block, where block ids are those
+// assigned by the BGZFWriter compressing the file: since blocks are compressed asynchronously,
+// their file offsets are only resolved into proper BGZF virtual offsets when the index is written.
+struct BamIndexBuilder
+{
+    BamIndexBuilder(const uint32 n_refs);
+
+    // index a record (starting with its block_size field) spanning [begin, end) in the file;
+    // records must be added in coordinate order
+    void add(const char *record, const uint64 begin, const uint64 end);
+
+    // write out the index; all the blocks must have been written out by bgzf
+    bool write(const char *file_name, const BGZFWriter& bgzf);
+
+private:
+    struct Chunk
+    {
+        uint64 begin;
+        uint64 end;
+    };
+
+    struct Reference
+    {
+        Reference() : begin(uint64(-1)), end(0), n_mapped(0), n_unmapped(0) {}
+
+        // the chunks of each bin, and the offset of the first record overlapping each 16kbp window
+        std::map< uint32, std::vector<Chunk> > bins;
+        std::vector<uint64> intervals;
+
+        // the span of this reference's records in the file, and their number
+        uint64 begin;
+        uint64 end;
+        uint64 n_mapped;
+        uint64 n_unmapped;
+    };
+
+    // add the chunk being built to its bin
+    void close_chunk(void);
+
+    std::vector<Reference> refs;
+    uint64 n_no_coor;
+
+    // the chunk being built, covering consecutive records of the same bin
+    int32 chunk_ref;
+    uint32 chunk_bin;
+    Chunk chunk;
+};
+
+} // namespace io
+} // namespace nvbio
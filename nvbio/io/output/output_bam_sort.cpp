@@ -0,0 +1,244 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/output/output_bam_sort.h>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/exceptions.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+namespace nvbio {
+namespace io {
+
+// the size of the read buffer of each run during the merge; must hold at least one record
+static const uint32 RUN_BUFFER_SIZE = 1024 * 1024;
+
+BamRecordSorter::BamRecordSorter(const char *tmp_prefix, const uint64 memory_budget)
+    : tmp_prefix(tmp_prefix), memory_budget(memory_budget), next_record(0), last_run(-1)
+{
+    // allocate the record storage once and keep it across spills: a block can take it past the
+    // budget by at most the size of a BGZF block before we spill
+    data.reserve(memory_budget + DataBuffer::BUFFER_SIZE + DataBuffer::BUFFER_EXTRA);
+}
+
+BamRecordSorter::~BamRecordSorter()
+{
+    for(uint32 i = 0; i < runs.size(); i++)
+        delete runs[i];
+
+    // get rid of the temporary files
+    for(uint32 i = 0; i < run_names.size(); i++)
+        remove(run_names[i].c_str());
+}
+
+uint64 BamRecordSorter::record_key(const char *record)
+{
+    int32 refID, pos;
+    memcpy(&refID, record + 4, sizeof(int32));
+    memcpy(&pos,   record + 8, sizeof(int32));
+
+    // refID == -1 maps to the highest key, sending unplaced reads to the end
+    return (uint64(uint32(refID)) << 32) | uint64(uint32(pos));
+}
+
+void BamRecordSorter::add(DataBuffer& block)
+{
+    const char *base = (const char *)block.get_base_ptr();
+    const uint32 block_size = block.get_pos();
+
+    // split the block into records
+    uint32 offset = 0;
+    while (offset < block_size)
+    {
+        int32 record_size;
+        memcpy(&record_size, base + offset, sizeof(int32));
+        record_size += sizeof(int32);
+
+        Record r;
+        r.key    = record_key(base + offset);
+        r.offset = data.size();
+        records.push_back(r);
+
+        data.insert(data.end(), base + offset, base + offset + record_size);
+        offset += record_size;
+    }
+
+    if (data.size() + records.size() * sizeof(Record) >= memory_budget)
+        spill();
+}
+
+void BamRecordSorter::spill(void)
+{
+    if (records.empty())
+        return;
+
+    char name[32];
+    sprintf(name, ".%04u.tmp", uint32(run_names.size()));
+    run_names.push_back(tmp_prefix + name);
+
+    FILE *fp = fopen(run_names.back().c_str(), "wb");
+    if (fp == NULL)
+    {
+        throw nvbio::runtime_error("BamRecordSorter: could not open %s for writing", run_names.back().c_str());
+    }
+
+    log_verbose(stderr, "  spilling %llu sorted records to %s\n", (unsigned long long)records.size(), run_names.back().c_str());
+
+    // stable_sort keeps records with the same coordinate in their original order
+    std::stable_sort(records.begin(), records.end());
+
+    for(uint64 i = 0; i < records.size(); i++)
+    {
+        const char *record = &data[records[i].offset];
+
+        int32 record_size;
+        memcpy(&record_size, record, sizeof(int32));
+
+        if (fwrite(record, record_size + sizeof(int32), 1, fp) != 1)
+        {
+            throw nvbio::runtime_error("BamRecordSorter: failed writing to %s", run_names.back().c_str());
+        }
+    }
+
+    fclose(fp);
+
+    // keep the storage around for the next run
+    data.clear();
+    records.clear();
+}
+
+void BamRecordSorter::finish(void)
+{
+    if (run_names.empty())
+    {
+        // everything fit in memory: sort in place and skip the merge
+        std::stable_sort(records.begin(), records.end());
+        next_record = 0;
+        return;
+    }
+
+    // write out the last run and open all of them for merging; the merge reads the runs
+    // back through their own buffers, so the record storage can go
+    spill();
+
+    std::vector<char>().swap(data);
+    std::vector<Record>().swap(records);
+
+    for(uint32 i = 0; i < run_names.size(); i++)
+    {
+        runs.push_back(new Run(run_names[i].c_str()));
+
+        if (runs[i]->fetch())
+            heap.push_back(std::make_pair(record_key(&runs[i]->buffer[runs[i]->pos]), i));
+    }
+
+    // ties on the key are broken by the run index, which keeps the sort stable
+    std::make_heap(heap.begin(), heap.end(), std::greater< std::pair<uint64, uint32> >());
+}
+
+bool BamRecordSorter::next(const char **record, uint32 *size)
+{
+    if (runs.empty())
+    {
+        if (next_record == records.size())
+            return false;
+
+        const char *r = &data[records[next_record++].offset];
+
+        int32 record_size;
+        memcpy(&record_size, r, sizeof(int32));
+
+        *record = r;
+        *size   = record_size + sizeof(int32);
+        return true;
+    }
+
+    // move past the record we returned last, and put its run back in the heap
+    if (last_run != -1)
+    {
+        Run *run = runs[last_run];
+        run->pos += run->record_size;
+
+        if (run->fetch())
+        {
+            heap.push_back(std::make_pair(record_key(&run->buffer[run->pos]), uint32(last_run)));
+            std::push_heap(heap.begin(), heap.end(), std::greater< std::pair<uint64, uint32> >());
+        }
+
+        last_run = -1;
+    }
+
+    if (heap.empty())
+        return false;
+
+    std::pop_heap(heap.begin(), heap.end(), std::greater< std::pair<uint64, uint32> >());
+    last_run = int32(heap.back().second);
+    heap.pop_back();
+
+    const Run *run = runs[last_run];
+    *record = &run->buffer[run->pos];
+    *size   = run->record_size;
+    return true;
+}
+
+BamRecordSorter::Run::Run(const char *file_name)
+    : buffer(RUN_BUFFER_SIZE), pos(0), size(0), record_size(0)
+{
+    fp = fopen(file_name, "rb");
+    if (fp == NULL)
+    {
+        throw nvbio::runtime_error("BamRecordSorter: could not open %s for reading", file_name);
+    }
+}
+
+BamRecordSorter::Run::~Run()
+{
+    fclose(fp);
+}
+
+bool BamRecordSorter::Run::fetch(void)
+{
+    // refill the buffer if it doesn't contain the whole record
+    int32 block_size = 0;
+    if (size - pos >= sizeof(int32))
+        memcpy(&block_size, &buffer[pos], sizeof(int32));
+
+    if (size - pos < sizeof(int32) + block_size)
+    {
+        memmove(&buffer[0], &buffer[pos], size - pos);
+        size -= pos;
+        pos = 0;
+
+        size += uint32(fread(&buffer[size], 1, buffer.size() - size, fp));
+    }
+
+    if (size - pos < sizeof(int32))
+        return false;
+
+    memcpy(&block_size, &buffer[pos], sizeof(int32));
+    record_size = block_size + sizeof(int32);
+
+    NVBIO_CUDA_ASSERT(record_size <= size - pos);
+    return true;
+}
+
+} // namespace io
+} // namespace nvbio
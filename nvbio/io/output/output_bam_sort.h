@@ -0,0 +1,104 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/io/output/output_types.h>
+#include <nvbio/io/output/output_databuffer.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace nvbio {
+namespace io {
+
+// Sorts a stream of BAM alignment records by reference coordinate within a bounded amount of memory.
+//
+// Records are accumulated in memory until the memory budget is exhausted, at which point they are
+// sorted and spilled to a temporary file; once all records have been added, the sorted runs are
+// merged back together. Records with equal coordinates are returned in the order they were added,
+// and unplaced reads (refID == -1) come last.
+struct BamRecordSorter
+{
+    // temporary runs are named after tmp_prefix; memory_budget is in bytes
+    BamRecordSorter(const char *tmp_prefix, const uint64 memory_budget);
+    ~BamRecordSorter();
+
+    // add all the records contained in block, each starting with its block_size field
+    void add(DataBuffer& block);
+
+    // stop accepting records and get ready to return them in sorted order
+    void finish(void);
+
+    // get the next record in sorted order, including its block_size field; the record
+    // stays valid until the next call. Returns false when there are no more records.
+    bool next(const char **record, uint32 *size);
+
+    // the number of runs spilled to disk
+    uint32 spilled_runs(void) const { return uint32(run_names.size()); }
+
+private:
+    // an in-memory record, identified by its offset in data
+    struct Record
+    {
+        uint64 key;
+        uint64 offset;
+
+        bool operator< (const Record& r) const { return key < r.key; }
+    };
+
+    // a sorted run being read back from disk
+    struct Run
+    {
+        Run(const char *file_name);
+        ~Run();
+
+        // make sure the next record is entirely in the buffer; returns false at the end of the run
+        bool fetch(void);
+
+        FILE *fp;
+        std::vector<char> buffer;
+        uint32 pos;
+        uint32 size;
+        uint32 record_size;
+    };
+
+    // the sort key of a record: refID in the high word, pos in the low word
+    static uint64 record_key(const char *record);
+
+    // sort the in-memory records and write them out to a new run
+    void spill(void);
+
+    std::string tmp_prefix;
+    uint64 memory_budget;
+
+    // the records accumulated in memory
+    std::vector<char> data;
+    std::vector<Record> records;
+    uint64 next_record;
+
+    // the runs on disk, and a min-heap of (key, run) used to merge them
+    std::vector<std::string> run_names;
+    std::vector<Run*> runs;
+    std::vector< std::pair<uint64, uint32> > heap;
+    int32 last_run;
+};
+
+} // namespace io
+} // namespace nvbio
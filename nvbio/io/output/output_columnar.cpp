@@ -0,0 +1,270 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/output/output_columnar.h>
+#include <nvbio/io/fmi.h>
+#include <nvbio/basic/numbers.h>
+#include <crc/crc.h>
+
+namespace nvbio {
+namespace io {
+
+// SAM flags
+enum {
+    COLUMNAR_FLAGS_PROPER_PAIR   = 2,
+    COLUMNAR_FLAGS_UNMAPPED      = 4,
+    COLUMNAR_FLAGS_MATE_UNMAPPED = 8,
+    COLUMNAR_FLAGS_REVERSE       = 16,
+    COLUMNAR_FLAGS_READ_1        = 64,
+    COLUMNAR_FLAGS_READ_2        = 128
+};
+
+ColumnarOutput::ColumnarOutput(const char *file_name, AlignmentType alignment_type, BNT bnt)
+    : OutputFile(file_name, alignment_type, bnt)
+{
+    fp = open_output_stream(file_name, "wb");
+    if (fp == NULL)
+    {
+        log_error(stderr, "ColumnarOutput: could not open %s for writing\n", file_name);
+        return;
+    }
+
+    ColumnarFileHeader header;
+    memcpy(header.magic, "NVAC", 4);
+    header.version = COLUMNAR_VERSION;
+    header.paired  = alignment_type == PAIRED_END ? 1u : 0u;
+    header.pad     = 0;
+    fwrite(&header, sizeof(header), 1, fp);
+}
+
+ColumnarOutput::~ColumnarOutput()
+{
+    // the output thread may still be writing to our file
+    stop_output_thread();
+
+    if (fp)
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+}
+
+void ColumnarOutput::process(struct GPUOutputBatch& gpu_batch,
+                             const AlignmentMate mate,
+                             const AlignmentScore score)
+{
+    // read back the data into the CPU for later processing
+    readback(*cpu_batch, gpu_batch, mate, score);
+}
+
+void ColumnarOutput::write_batch(CPUOutputBatch& cpu_batch)
+{
+    for(uint32 c = 0; c < COLUMNAR_N_COLUMNS; c++)
+        columns[c].clear();
+
+    for(uint32 c = 0; c < cpu_batch.count; c++)
+    {
+        AlignmentData mate_1;
+        AlignmentData mate_2;
+
+        switch(alignment_type)
+        {
+            case SINGLE_END:
+                mate_1 = cpu_batch.get_mate(c, MATE_1, MATE_1);
+                mate_2 = AlignmentData::invalid();
+                break;
+
+            case PAIRED_END:
+                mate_1 = cpu_batch.get_mate(c, MATE_1, MATE_1);
+                mate_2 = cpu_batch.get_mate(c, MATE_2, MATE_2);
+                break;
+        }
+
+        const AlignmentData& anchor        = (mate_1.best->mate() ? mate_2 : mate_1);
+        const AlignmentData& opposite_mate = (mate_1.best->mate() ? mate_1 : mate_2);
+
+        // we always compute the mapq using the anchor, so this is only done once per pair
+        const uint32 mapq = mate_1.best->is_aligned() ? mapq_evaluator->compute_mapq(anchor, opposite_mate) : 0u;
+
+        process_one_mate(mate_1, mate_2, MATE_1, mapq);
+
+        if (alignment_type == PAIRED_END)
+        {
+            process_one_mate(mate_2, mate_1, MATE_2, mapq);
+
+            // track per-alignment statistics
+            iostats.track_alignment_statistics(anchor, opposite_mate, mapq);
+        }
+        else
+        {
+            // track per-alignment statistics
+            iostats.track_alignment_statistics(anchor, mapq);
+        }
+    }
+
+    const uint32 n_rows = uint32(columns[COLUMNAR_READ_ID].size());
+    if (n_rows == 0)
+        return;
+
+    // pack all the columns and write out the whole batch at once
+    ColumnarColumnHeader headers[COLUMNAR_N_COLUMNS];
+
+    uint64 size = 0;
+    for(uint32 c = 0; c < COLUMNAR_N_COLUMNS; c++)
+        size += sizeof(ColumnarColumnHeader) + columnar_setup(c, &columns[c][0], n_rows, &headers[c]);
+
+    ColumnarBatchHeader batch_header;
+    batch_header.n_rows    = n_rows;
+    batch_header.n_columns = COLUMNAR_N_COLUMNS;
+    batch_header.size      = size;
+
+    data.resize(sizeof(ColumnarBatchHeader) + size);
+    uint8 *out = &data[0];
+
+    memcpy(out, &batch_header, sizeof(ColumnarBatchHeader));
+    out += sizeof(ColumnarBatchHeader);
+
+    for(uint32 c = 0; c < COLUMNAR_N_COLUMNS; c++)
+    {
+        memcpy(out, &headers[c], sizeof(ColumnarColumnHeader));
+        out += sizeof(ColumnarColumnHeader);
+
+        columnar_pack(headers[c], &columns[c][0], n_rows, out);
+        out += uint64(n_rows) * headers[c].width;
+    }
+
+    fwrite(&data[0], data.size(), 1, fp);
+}
+
+void ColumnarOutput::close(void)
+{
+    // write out any pending batches
+    OutputFile::close();
+
+    if (fp)
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+}
+
+void ColumnarOutput::locate(const AlignmentData& alignment, uint32& pos, uint32& ref_id) const
+{
+    if (alignment.valid == false || alignment.best->is_aligned() == false)
+    {
+        pos    = 0u;
+        ref_id = uint32(-1);
+        return;
+    }
+
+    const io::BNTAnn* ann = std::upper_bound(
+        bnt.data.anns,
+        bnt.data.anns + bnt.info.n_seqs,
+        alignment.cigar_pos,
+        SeqFinder() ) - 1u;
+
+    pos    = alignment.cigar_pos - int32(ann->offset) + 1u;
+    ref_id = uint32(ann - bnt.data.anns);
+}
+
+// append a row for the given mate, with the same contents as DebugOutput
+void ColumnarOutput::process_one_mate(const AlignmentData& alignment,
+                                      const AlignmentData& mate,
+                                      const AlignmentMate slot,
+                                      const uint32 mapq)
+{
+    uint32 pos, ref_id;
+    uint32 mate_pos, mate_ref_id;
+    locate(alignment, pos, ref_id);
+    locate(mate, mate_pos, mate_ref_id);
+
+    columns[COLUMNAR_READ_ID].push_back(crcCalc(alignment.read_name, strlen(alignment.read_name)));
+    columns[COLUMNAR_READ_LEN].push_back(alignment.read_len);
+    columns[COLUMNAR_POS].push_back(pos);
+    columns[COLUMNAR_REF_ID].push_back(ref_id);
+    columns[COLUMNAR_MATE_POS].push_back(mate_pos);
+    columns[COLUMNAR_MATE_REF_ID].push_back(mate_ref_id);
+
+    if (pos == 0u)
+    {
+        // unmapped alignment: an unaligned mate doesn't know which one it is, so take the
+        // opposite of its aligned mate, falling back to the batch slot it was read from
+        const uint32 mate_index = (mate.valid && mate.best->is_aligned()) ? 1u - mate.best->mate() : uint32(slot);
+
+        // and use the same defaults readers use for missing data
+        columns[COLUMNAR_MATE].push_back(mate_index);
+        columns[COLUMNAR_FLAG].push_back(COLUMNAR_FLAGS_UNMAPPED | (mate_index ? COLUMNAR_FLAGS_READ_2 : COLUMNAR_FLAGS_READ_1));
+        columns[COLUMNAR_SCORE].push_back(uint32(-65536));
+        columns[COLUMNAR_MAPQ].push_back(0u);
+        columns[COLUMNAR_ED].push_back(255u);
+        columns[COLUMNAR_SUBS].push_back(0u);
+        columns[COLUMNAR_INS].push_back(0u);
+        columns[COLUMNAR_DELS].push_back(0u);
+        columns[COLUMNAR_MMS].push_back(0u);
+        columns[COLUMNAR_GAPO].push_back(0u);
+        columns[COLUMNAR_GAPE].push_back(0u);
+        columns[COLUMNAR_HAS_SECOND].push_back(0u);
+        columns[COLUMNAR_SEC_SCORE].push_back(uint32(-65536));
+        return;
+    }
+
+    uint32 flag = (alignment.best->mate() ? COLUMNAR_FLAGS_READ_2 : COLUMNAR_FLAGS_READ_1) |
+                  (alignment.best->is_rc() ? COLUMNAR_FLAGS_REVERSE : 0u);
+
+    if (alignment_type == PAIRED_END)
+    {
+        if (alignment.best->is_paired()) // FIXME: this should be other_mate.is_concordant()
+            flag |= COLUMNAR_FLAGS_PROPER_PAIR;
+
+        if (mate.best->is_aligned() == false)
+            flag |= COLUMNAR_FLAGS_MATE_UNMAPPED;
+    }
+
+    const io::BNTAnn& ann = bnt.data.anns[ref_id];
+    const uint32 ref_cigar_len = reference_cigar_length(alignment.cigar, alignment.cigar_len);
+    if (alignment.cigar_pos + ref_cigar_len > ann.offset + ann.len)
+    {
+        // flag UNMAPPED as this alignment bridges two adjacent reference sequences
+        flag |= COLUMNAR_FLAGS_UNMAPPED;
+    }
+
+    uint32 n_mm;
+    uint32 n_gapo;
+    uint32 n_gape;
+
+    analyze_md_string(alignment.mds_vec, n_mm, n_gapo, n_gape);
+
+    const bool has_second = alignment.second_best->is_aligned();
+
+    columns[COLUMNAR_MATE].push_back(alignment.best->mate());
+    columns[COLUMNAR_FLAG].push_back(flag);
+    columns[COLUMNAR_SCORE].push_back(uint32(alignment.best->score()));
+    columns[COLUMNAR_MAPQ].push_back(mapq);
+    columns[COLUMNAR_ED].push_back(alignment.best->ed());
+    columns[COLUMNAR_SUBS].push_back(count_symbols(Cigar::SUBSTITUTION, alignment.cigar, alignment.cigar_len));
+    columns[COLUMNAR_INS].push_back(count_symbols(Cigar::INSERTION, alignment.cigar, alignment.cigar_len));
+    columns[COLUMNAR_DELS].push_back(count_symbols(Cigar::DELETION, alignment.cigar, alignment.cigar_len));
+    columns[COLUMNAR_MMS].push_back(n_mm);
+    columns[COLUMNAR_GAPO].push_back(n_gapo);
+    columns[COLUMNAR_GAPE].push_back(n_gape);
+    columns[COLUMNAR_HAS_SECOND].push_back(has_second ? 1u : 0u);
+    columns[COLUMNAR_SEC_SCORE].push_back(uint32(has_second ? alignment.second_best->score() : Field_traits<int16>::min()));
+}
+
+} // namespace io
+} // namespace nvbio
@@ -0,0 +1,73 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/io/output/output_types.h>
+#include <nvbio/io/output/output_utils.h>
+#include <nvbio/io/output/output_file.h>
+#include <nvbio/io/output/output_batch.h>
+#include <nvbio/io/columnar_format.h>
+#include <nvbio/io/fmi.h>
+#include <nvbio/io/reads/reads.h>
+
+#include <stdio.h>
+#include <vector>
+
+namespace nvbio {
+namespace io {
+
+// Writes the compact columnar alignment format described in columnar_format.h.
+//
+// Each output batch is written out as one batch of the format, holding the same alignment
+// summaries as DebugOutput (and the opposite mate's position) in fixed-width, packed columns,
+// so that they can be read back with a handful of bulk reads.
+struct ColumnarOutput : public OutputFile
+{
+public:
+    ColumnarOutput(const char *file_name, AlignmentType alignment_type, BNT bnt);
+    ~ColumnarOutput();
+
+    void process(struct GPUOutputBatch& gpu_batch,
+                 const AlignmentMate mate,
+                 const AlignmentScore score);
+    void close(void);
+
+protected:
+    void write_batch(struct CPUOutputBatch& cpu_batch);
+
+private:
+    // append a row for the given mate, read from the given slot of the batch
+    void process_one_mate(const AlignmentData& alignment,
+                          const AlignmentData& mate,
+                          const AlignmentMate slot,
+                          const uint32 mapq);
+
+    // the position and reference index of an alignment, or (0, -1) if it's not aligned
+    void locate(const AlignmentData& alignment, uint32& pos, uint32& ref_id) const;
+
+    // our file pointer
+    FILE *fp;
+    // the columns of the batch being written
+    std::vector<uint32> columns[COLUMNAR_N_COLUMNS];
+    // the packed batch
+    std::vector<uint8> data;
+};
+
+} // namespace io
+} // namespace nvbio
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <algorithm>
 
 namespace nvbio {
 namespace io {
@@ -134,6 +135,12 @@ void DataBuffer::rewind(void)
     pos = 0;
 }
 
+void DataBuffer::swap(DataBuffer& other)
+{
+    std::swap(buffer, other.buffer);
+    std::swap(pos, other.pos);
+}
+
 void *DataBuffer::get_base_ptr(void)
 {
     return buffer;
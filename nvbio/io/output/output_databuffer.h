@@ -77,6 +77,14 @@ struct DataBuffer
 
     // rewind pos back to 0
     void rewind(void);
+
+    // exchange the contents of two buffers without copying any data
+    void swap(DataBuffer& other);
+
+private:
+    // buffers own their storage, so they cannot be copied
+    DataBuffer(const DataBuffer&);
+    DataBuffer& operator=(const DataBuffer&);
 };
 
 } // namespace io
@@ -58,6 +58,9 @@ DebugOutput::DebugOutput(const char *file_name, AlignmentType alignment_type, BN
 
 DebugOutput::~DebugOutput()
 {
+    // the output thread may still be writing to our files
+    stop_output_thread();
+
     if (fp)
     {
         gzclose(fp);
@@ -77,10 +80,10 @@ void DebugOutput::process(struct GPUOutputBatch& gpu_batch,
                           const AlignmentScore score)
 {
     // read back the data into the CPU for later processing
-    readback(cpu_batch, gpu_batch, mate, score);
+    readback(*cpu_batch, gpu_batch, mate, score);
 }
 
-void DebugOutput::end_batch(void)
+void DebugOutput::write_batch(CPUOutputBatch& cpu_batch)
 {
     for(uint32 c = 0; c < cpu_batch.count; c++)
     {
@@ -102,12 +105,13 @@ void DebugOutput::end_batch(void)
 
         process_one_alignment(mate_1, mate_2);
     }
-
-    OutputFile::end_batch();
 }
 
 void DebugOutput::close(void)
 {
+    // write out any pending batches
+    OutputFile::close();
+
     if (fp)
     {
         gzclose(fp);
@@ -87,10 +87,11 @@ public:
     void process(struct GPUOutputBatch& gpu_batch,
                  const AlignmentMate mate,
                  const AlignmentScore score);
-    void end_batch(void);
-
     void close(void);
 
+protected:
+    void write_batch(struct CPUOutputBatch& cpu_batch);
+
 private:
     void output_alignment(gzFile& fp, const struct DbgAlignment& al, const struct DbgInfo& info);
     void process_one_alignment(const AlignmentData& alignment, const AlignmentData& mate);
@@ -103,9 +104,6 @@ private:
     // our file pointers
     gzFile fp;
     gzFile fp_opposite_mate;
-
-    // CPU copy of the current alignment batch
-    CPUOutputBatch cpu_batch;
 };
 
 } // namespace io
@@ -20,6 +20,18 @@
 #include <nvbio/io/output/output_sam.h>
 #include <nvbio/io/output/output_bam.h>
 #include <nvbio/io/output/output_debug.h>
+#include <nvbio/io/output/output_columnar.h>
+#include <nvbio/basic/threads.h>
+#include <nvbio/basic/timer.h>
+
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace nvbio {
 namespace io {
@@ -31,12 +43,70 @@ OutputFile::OutputFile(const char *_file_name, AlignmentType _alignment_type, BN
       mapq_evaluator(NULL),
       mapq_filter(-1),
       read_data_1(NULL),
-      read_data_2(NULL)
+      read_data_2(NULL),
+      cpu_batch(new CPUOutputBatch),
+      output_thread(NULL),
+      read_stream_1(NULL),
+      read_stream_2(NULL),
+      paired_stream(NULL)
 {
 }
 
+// a thread writing batches out in the background, in the order they were queued
+struct OutputFile::OutputThread : public Thread<OutputFile::OutputThread>
+{
+    OutputThread(OutputFile *file, const uint32 queue_depth)
+        : file(file),
+          queue(queue_depth),
+          free_batches(queue_depth + 1)
+    {
+        // one batch for each queue slot, plus the one being written
+        for(uint32 i = 0; i < queue_depth + 1; i++)
+            free_batches.push(new CPUOutputBatch);
+    }
+
+    ~OutputThread()
+    {
+        CPUOutputBatch *batch;
+
+        free_batches.close();
+        while (free_batches.pop(&batch))
+            delete batch;
+    }
+
+    // queue a filled batch for output, and return an empty one to fill next
+    CPUOutputBatch *submit(CPUOutputBatch *batch)
+    {
+        queue.push(batch);
+
+        CPUOutputBatch *next;
+        free_batches.pop(&next);
+        return next;
+    }
+
+    void run(void)
+    {
+        CPUOutputBatch *batch;
+
+        while (queue.pop(&batch))
+        {
+            file->write_batch(*batch);
+            file->release_reads(*batch);
+
+            free_batches.push(batch);
+        }
+    }
+
+    OutputFile *file;
+    BlockingQueue<CPUOutputBatch*> queue;           // batches waiting to be written
+    BlockingQueue<CPUOutputBatch*> free_batches;    // batches available for filling
+};
+
 OutputFile::~OutputFile()
 {
+    stop_output_thread();
+
+    delete cpu_batch;
 }
 
 void OutputFile::configure_mapq_evaluator(const io::MapQEvaluator *mapq, int mapq_filter)
@@ -51,6 +121,11 @@ void OutputFile::start_batch(const io::ReadData *read_data_1,
     // stash the current host pointer for the read data
     OutputFile::read_data_1 = read_data_1;
     OutputFile::read_data_2 = read_data_2;
+
+    // and keep track of it in the batch, as it must stay alive until the batch is written
+    cpu_batch->count = 0;
+    cpu_batch->read_data[MATE_1] = read_data_1;
+    cpu_batch->read_data[MATE_2] = read_data_2;
 }
 
 void OutputFile::process(struct GPUOutputBatch& gpu_batch,
@@ -62,13 +137,96 @@ void OutputFile::process(struct GPUOutputBatch& gpu_batch,
 
 void OutputFile::end_batch(void)
 {
+    Timer timer;
+    timer.start();
+
+    if (output_thread)
+    {
+        // hand the batch over to the output thread, and grab an empty one;
+        // this only blocks if all the queue slots are taken
+        cpu_batch = output_thread->submit(cpu_batch);
+    }
+    else
+    {
+        write_batch(*cpu_batch);
+        release_reads(*cpu_batch);
+    }
+
+    timer.stop();
+    iostats.output_blocked_time += timer.seconds();
+
     // invalidate the read data pointers
     read_data_1 = NULL;
     read_data_2 = NULL;
 }
 
+void OutputFile::write_batch(struct CPUOutputBatch& cpu_batch)
+{
+    // do nothing
+}
+
 void OutputFile::close(void)
 {
+    // make sure all the pending batches have been written
+    stop_output_thread();
+}
+
+void OutputFile::set_read_streams(ReadDataStream *stream_1, ReadDataStream *stream_2)
+{
+    read_stream_1 = stream_1;
+    read_stream_2 = stream_2;
+}
+
+void OutputFile::set_read_streams(PairedReadDataStream *stream)
+{
+    paired_stream = stream;
+}
+
+void OutputFile::start_output_thread(const uint32 queue_depth)
+{
+    if (output_thread || queue_depth == 0)
+        return;
+
+    output_thread = new OutputThread(this, queue_depth);
+    output_thread->create();
+}
+
+void OutputFile::stop_output_thread(void)
+{
+    if (output_thread == NULL)
+        return;
+
+    Timer timer;
+    timer.start();
+
+    // the thread drains the queue before quitting
+    output_thread->queue.close();
+    output_thread->join();
+
+    delete output_thread;
+    output_thread = NULL;
+
+    timer.stop();
+    iostats.output_blocked_time += timer.seconds();
+}
+
+void OutputFile::release_reads(struct CPUOutputBatch& cpu_batch)
+{
+    // the batch only holds read-only references; the streams own the data
+    if (read_stream_1)
+        read_stream_1->release(const_cast<io::ReadData*>(cpu_batch.read_data[MATE_1]));
+
+    if (read_stream_2)
+        read_stream_2->release(const_cast<io::ReadData*>(cpu_batch.read_data[MATE_2]));
+
+    if (paired_stream)
+    {
+        paired_stream->release(const_cast<io::ReadData*>(cpu_batch.read_data[MATE_1]));
+        paired_stream->release(const_cast<io::ReadData*>(cpu_batch.read_data[MATE_2]));
+    }
+
+    cpu_batch.read_data[MATE_1] = NULL;
+    cpu_batch.read_data[MATE_2] = NULL;
 }
 
 IOStats& OutputFile::get_aggregate_statistics(void)
@@ -119,42 +277,145 @@ void OutputFile::readback(struct CPUOutputBatch& cpu_batch,
     iostats.alignments_DtoH_count += gpu_batch.count;
 }
 
-OutputFile *OutputFile::open(const char *file_name, AlignmentType aln_type, BNT bnt)
+namespace {
+
+// check whether a file name ends with a given extension
+bool has_extension(const char *file_name, const char *ext)
 {
-    // parse out file extension; look for .sam, .bam suffixes
-    uint32 len = uint32(strlen(file_name));
+    const uint32 len     = uint32(strlen(file_name));
+    const uint32 ext_len = uint32(strlen(ext));
+    return len >= ext_len && strcmp(&file_name[len - ext_len], ext) == 0;
+}
 
-    if (strcmp(file_name, "/dev/null") == 0)
+} // anonymous namespace
+
+OutputFile *OutputFile::open(const char *file_name, AlignmentType aln_type, BNT bnt,
+                             const OutputFileOptions& options)
+{
+    OutputFile *file = NULL;
+    bool sorted = false;
+
+    // parse out file extension; look for .sam, .bam suffixes, unless the format is given
+    OutputFormat format = options.format;
+    if (format == OUTPUT_FORMAT_AUTO)
     {
-        return new OutputFile(file_name, aln_type, bnt);
+        if (is_stdout(file_name) ||
+            has_extension(file_name, ".sam"))
+            format = OUTPUT_FORMAT_SAM;
+        else if (has_extension(file_name, ".sam.gz"))
+            format = OUTPUT_FORMAT_SAM_GZ;
+        else if (has_extension(file_name, ".bam"))
+            format = OUTPUT_FORMAT_BAM;
+        else if (has_extension(file_name, ".aln"))
+            format = OUTPUT_FORMAT_ALN;
     }
 
-    if (len >= strlen(".sam"))
+    if (strcmp(file_name, "/dev/null") == 0)
     {
-        if (strcmp(&file_name[len - strlen(".sam")], ".sam") == 0)
-        {
-            return new SamOutput(file_name, aln_type, bnt);
-        }
+        file = new OutputFile(file_name, aln_type, bnt);
     }
-
-    if (len >= strlen(".bam"))
+    else if (format == OUTPUT_FORMAT_SAM)
     {
-        if (strcmp(&file_name[len - strlen(".bam")], ".bam") == 0)
-        {
-            return new BamOutput(file_name, aln_type, bnt);
-        }
+        file = new SamOutput(file_name, aln_type, bnt,
+                             false,
+                             options.compression_level,
+                             options.compression_threads,
+                             options.quality_mode);
+    }
+    else if (format == OUTPUT_FORMAT_SAM_GZ)
+    {
+        // BGZF-compressed SAM
+        file = new SamOutput(file_name, aln_type, bnt,
+                             true,
+                             options.compression_level,
+                             options.compression_threads,
+                             options.quality_mode);
+    }
+    else if (format == OUTPUT_FORMAT_BAM)
+    {
+        file = new BamOutput(file_name, aln_type, bnt,
+                             options.compression_level,
+                             options.compression_threads,
+                             options.sort,
+                             options.sort_memory,
+                             options.quality_mode);
+        sorted = options.sort;
+    }
+    else if (format == OUTPUT_FORMAT_ALN)
+    {
+        file = new ColumnarOutput(file_name, aln_type, bnt);
+    }
+    else if (has_extension(file_name, ".dbg"))
+    {
+        file = new DebugOutput(file_name, aln_type, bnt);
+    }
+    else
+    {
+        log_warning(stderr, "could not determine file type for %s; guessing SAM\n", file_name);
+        file = new SamOutput(file_name, aln_type, bnt,
+                             false,
+                             options.compression_level,
+                             options.compression_threads,
+                             options.quality_mode);
     }
 
-    if (len >= strlen(".dbg"))
+    if (options.sort && sorted == false)
+        log_warning(stderr, "sorted output is only supported for BAM files; %s will not be sorted\n", file_name);
+
+    // write batches out in the background, if requested
+    file->start_output_thread(options.output_queue_depth);
+    return file;
+}
+
+bool is_stdout(const char *file_name)
+{
+    return strcmp(file_name, "-") == 0 || strcmp(file_name, "/dev/stdout") == 0;
+}
+
+FILE *open_output_stream(const char *file_name, const char *mode)
+{
+    FILE *fp;
+
+    if (is_stdout(file_name))
     {
-        if (strcmp(&file_name[len - strlen(".dbg")], ".dbg") == 0)
+        // write through a duplicate of the descriptor, so that closing the stream doesn't close stdout
+        fflush(stdout);
+#ifdef WIN32
+        const int fd = _dup(_fileno(stdout));
+        if (fd >= 0 && strchr(mode, 'b'))
+            _setmode(fd, _O_BINARY);
+#else
+        const int fd = dup(fileno(stdout));
+#endif
+        if (fd < 0)
+            return NULL;
+
+        fp = fdopen(fd, mode);
+        if (fp == NULL)
         {
-            return new DebugOutput(file_name, aln_type, bnt);
+#ifdef WIN32
+            _close(fd);
+#else
+            close(fd);
+#endif
+            return NULL;
         }
+
+        // pipes are written in large chunks, cutting down on system calls and context switches
+        // with the downstream reader
+        setvbuf(fp, NULL, _IOFBF, 4 * 1024 * 1024);
+        return fp;
     }
 
-    log_warning(stderr, "could not determine file type for %s; guessing SAM\n", file_name);
-    return new SamOutput(file_name, aln_type, bnt);
+    fp = fopen(file_name, mode);
+    if (fp == NULL)
+        return NULL;
+
+    // set a 256kb output buffer on fp and make sure it's not line buffered
+    // this makes sure small fwrites do not land on disk straight away
+    // (256kb was chosen based on the default stripe size for Linux mdraid RAID-5 volumes)
+    setvbuf(fp, NULL, _IOFBF, 256 * 1024);
+    return fp;
 }
 
 } // namespace io
@@ -35,6 +35,39 @@ namespace io {
    @{
 */
 
+/**
+   Options controlling how OutputFile objects write their data out.
+*/
+struct OutputFileOptions
+{
+    OutputFileOptions()
+        : compression_level(-1),
+          compression_threads(0),
+          output_queue_depth(0),
+          sort(false),
+          sort_memory(768u * 1024u * 1024u),
+          quality_mode(QUALITY_KEEP),
+          format(OUTPUT_FORMAT_AUTO) {}
+
+    /// zlib compression level for compressed formats: 0 (store only) to 9, or -1 for zlib's default
+    int compression_level;
+    /// number of threads compressing output blocks in the background;
+    /// 0 compresses them synchronously on the calling thread
+    uint32 compression_threads;
+    /// number of batches that can be queued for output while the caller moves on to the
+    /// next one; 0 writes each batch out synchronously in OutputFile::end_batch
+    uint32 output_queue_depth;
+    /// write alignments out in coordinate order along with their index (BAM output only)
+    bool sort;
+    /// the memory budget for sorting, in bytes; alignments beyond it are spilled to temporary files
+    uint64 sort_memory;
+    /// how base qualities are written out (SAM and BAM output only)
+    QualityMode quality_mode;
+    /// the file format, overriding the file name extension; this is the only way to
+    /// pick a format other than SAM when writing to the standard output
+    OutputFormat format;
+};
+
 /**
    The output file interface.
 
@@ -55,6 +88,13 @@ namespace io {
    batch, OutputFile::end_batch should be called. In most cases, data is only
    written to disk after OutputFile::end_batch is called.
 
+   Optionally, batches can be written out asynchronously: OutputFile::end_batch then
+   hands the batch over to a background thread and returns immediately, so that the
+   caller can align the next batch while the previous ones are being formatted and
+   written. In this mode the host read data referenced by a batch must stay alive
+   until the batch has been written, which is best achieved by letting the OutputFile
+   release it back to its stream (see OutputFile::set_read_streams).
+
    The factory method OutputFile::open is used to create OutputFile
    objects. It parses the file name extension to determine the file format for
    the output.
@@ -86,16 +126,42 @@ public:
                          const AlignmentMate alignment_mate,
                          const AlignmentScore alignment_score);
 
-    /// Mark a batch of alignment results as complete
-    virtual void end_batch(void);
+    /// Mark a batch of alignment results as complete, and write it out (or queue it for output)
+    void end_batch(void);
 
-    /// Flush and close the output file
+    /// Flush and close the output file; derived classes must call this before closing their own files
     virtual void close(void);
 
+    /// Let this object release the host read data of each batch back to the streams it was
+    /// read from, as soon as the batch has been written out
+    /// \param stream_1 The stream of the first mate
+    /// \param stream_2 The stream of the second mate, if any
+    void set_read_streams(ReadDataStream *stream_1, ReadDataStream *stream_2 = NULL);
+
+    /// Let this object release the host read data of each batch back to the paired stream
+    /// both mates were read from
+    /// \param stream The paired-end stream
+    void set_read_streams(PairedReadDataStream *stream);
+
     /// Returns aggregate I/O statistics for this object
     virtual IOStats& get_aggregate_statistics(void);
 
 protected:
+    /// Format and write out a complete batch of alignment results.
+    /// In asynchronous mode this is called from the output thread, one batch at a time.
+    /// \param [in] cpu_batch The batch to write
+    virtual void write_batch(struct CPUOutputBatch& cpu_batch);
+
+    /// Start writing batches out asynchronously
+    /// \param [in] queue_depth The maximum number of batches waiting to be written
+    void start_output_thread(const uint32 queue_depth);
+
+    /// Wait for all pending batches to be written, and stop the output thread
+    void stop_output_thread(void);
+
+    /// Release the host read data referenced by a batch, if we own it
+    void release_reads(struct CPUOutputBatch& cpu_batch);
+
     /// Read back batch data into the host
     /// \param [out] cpu_batch The CPUOutputBatch struct which will receive the data
     /// \param [in] gpu_batch The GPU memory handle to read from
@@ -126,16 +192,42 @@ protected:
     /// I/O statistics
     IOStats iostats;
 
+    /// The host batch being filled by the current alignment passes
+    struct CPUOutputBatch *cpu_batch;
+
+private:
+    struct OutputThread;
+
+    /// The background output thread, if any
+    OutputThread *output_thread;
+    /// The streams the host read data is released to, if any
+    ReadDataStream *read_stream_1;
+    ReadDataStream *read_stream_2;
+    PairedReadDataStream *paired_stream;
+
 public:
     /// Factory method to create OutputFile objects
     /// \param [in] file_name The name of the file to create (will be silently overwritten if it already exists).
-    ///             This method parses out the extension from the file name to determine what kind of file format to write.
+    ///             This method parses out the extension from the file name to determine what kind of file format to write,
+    ///             unless options.format says otherwise. "-" and "/dev/stdout" refer to the standard output.
     /// \param [in] aln_type The type of alignment (single or paired-end)
     /// \param [in] bnt A handle to the reference genome
+    /// \param [in] options Format-specific output options
     /// \return A pointer to an OutputFile object, or NULL if an error occurs.
-    static OutputFile *open(const char *file_name, AlignmentType aln_type, BNT bnt);
+    static OutputFile *open(const char *file_name, AlignmentType aln_type, BNT bnt,
+                            const OutputFileOptions& options = OutputFileOptions());
 };
 
+/// Return whether a file name refers to the standard output, i.e. "-" or "/dev/stdout"
+bool is_stdout(const char *file_name);
+
+/// Open a file for writing with a large buffer, or a duplicate of the standard output
+/// if the name refers to it (see is_stdout()), so that closing the file leaves stdout alone
+/// \param [in] file_name The name of the file to open
+/// \param [in] mode The fopen() mode
+/// \return The opened file, or NULL if an error occurs.
+FILE *open_output_stream(const char *file_name, const char *mode);
+
 /**
    @} // Output
    @} // IO
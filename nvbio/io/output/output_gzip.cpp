@@ -20,6 +20,7 @@
 #include <nvbio/io/fmi.h>
 #include <nvbio/basic/numbers.h>
 #include <nvbio/basic/types.h>
+#include <nvbio/basic/timer.h>
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -27,7 +28,8 @@
 namespace nvbio {
 namespace io {
 
-GzipCompressor::GzipCompressor()
+GzipCompressor::GzipCompressor(const int level)
+    : level(level)
 {
     // initialize the gzip header
     // note that we don't actually care about most of these fields
@@ -58,7 +60,7 @@ void GzipCompressor::start_block(DataBuffer& output)
     stream.avail_out = output.get_remaining_size();
 
     ret = deflateInit2(&stream,                 // stream object
-                       Z_DEFAULT_COMPRESSION,   // compression level (0-9, default = 6)
+                       level,                   // compression level (0-9, default = 6)
                        Z_DEFLATED,              // compression method (no other choice...)
                        15 + 16,                 // log2 of compression window size + 16 to switch zlib to gzip format
                        9,                       // memlevel (1..9, default 8: 1 uses less memory but is slower, 9 uses more memory and is faster)
@@ -116,8 +118,8 @@ void GzipCompressor::end_block(DataBuffer& output)
 }
 
 
-BGZFCompressor::BGZFCompressor()
-    : GzipCompressor()
+BGZFCompressor::BGZFCompressor(const int level)
+    : GzipCompressor(level)
 {
     // set up our gzip extra data field
     // these values are defined in the samtools spec (http://samtools.sourceforge.net/SAMv1.pdf)
@@ -144,5 +146,234 @@ void BGZFCompressor::end_block(DataBuffer& output)
     output.poke_uint16(16, (uint16)output.get_pos() - 1);
 }
 
+
+BGZFWriter::BGZFWriter()
+    : fp(NULL), level(Z_DEFAULT_COMPRESSION), bytes_in(0), bytes_written(0), compress_time(0.0f), track_addresses(false),
+      n_submitted(0), n_written(0), stopping(false)
+{
+}
+
+BGZFWriter::~BGZFWriter()
+{
+    close();
+}
+
+void BGZFWriter::open(FILE *fp, const int level, const uint32 n_threads, const bool track_addresses)
+{
+    this->fp = fp;
+    this->level = level;
+    this->track_addresses = track_addresses;
+
+    if (n_threads == 0)
+        return;
+
+    // allow a few blocks per thread to be in flight, so that the threads never starve
+    // while the writer is busy
+    jobs.resize(n_threads * 4);
+    for(uint32 i = 0; i < jobs.size(); i++)
+    {
+        jobs[i] = new Job;
+        free_jobs.push_back(jobs[i]);
+    }
+
+    writer_thread.writer = this;
+    writer_thread.create();
+
+    compression_threads.resize(n_threads);
+    for(uint32 i = 0; i < n_threads; i++)
+    {
+        compression_threads[i] = new CompressionThread(this, level);
+        compression_threads[i]->create();
+    }
+}
+
+void BGZFWriter::write_block(DataBuffer& block)
+{
+    bytes_in += block.get_pos();
+
+    if (compression_threads.empty())
+    {
+        BGZFCompressor bgzf(level);
+        DataBuffer compressed;
+
+        Timer timer;
+        timer.start();
+
+        bgzf.start_block(compressed);
+        bgzf.compress(compressed, block);
+        bgzf.end_block(compressed);
+
+        timer.stop();
+        compress_time += timer.seconds();
+
+        write_compressed(compressed);
+        n_submitted++;
+        n_written++;
+
+        block.rewind();
+        return;
+    }
+
+    Job *job;
+
+    // wait for a free job
+    {
+        ScopedLock guard(&lock);
+        while (free_jobs.empty())
+            job_done.wait(&lock);
+
+        job = free_jobs.back();
+        free_jobs.pop_back();
+    }
+
+    // take over the block's data, leaving it with the job's empty buffer
+    job->input.swap(block);
+    block.rewind();
+
+    {
+        ScopedLock guard(&lock);
+        job->id = n_submitted++;
+        compress_queue.push(job);
+        compress_ready.signal();
+    }
+}
+
+void BGZFWriter::flush(void)
+{
+    ScopedLock guard(&lock);
+    while (n_written < n_submitted)
+        job_done.wait(&lock);
+}
+
+void BGZFWriter::close(void)
+{
+    if (compression_threads.empty())
+        return;
+
+    {
+        ScopedLock guard(&lock);
+        stopping = true;
+        compress_ready.broadcast();
+        write_ready.broadcast();
+    }
+
+    // the threads drain all the queued blocks before quitting
+    for(uint32 i = 0; i < compression_threads.size(); i++)
+    {
+        compression_threads[i]->join();
+        delete compression_threads[i];
+    }
+    writer_thread.join();
+
+    for(uint32 i = 0; i < jobs.size(); i++)
+        delete jobs[i];
+
+    compression_threads.clear();
+    jobs.clear();
+    free_jobs.clear();
+}
+
+void BGZFWriter::write_eof_marker(void)
+{
+    flush();
+
+    // this is the empty BGZF block defined by the SAM/BAM spec
+    static const unsigned char magic[28] =  { 0037, 0213, 0010, 0004, 0000, 0000, 0000, 0000, 0000,
+                                              0377, 0006, 0000, 0102, 0103, 0002, 0000, 0033, 0000,
+                                              0003, 0000, 0000, 0000, 0000, 0000, 0000, 0000, 0000, 0000 };
+
+    fwrite(magic, sizeof(magic), 1, fp);
+    bytes_written += sizeof(magic);
+}
+
+uint64 BGZFWriter::block_address(const uint64 id) const
+{
+    NVBIO_CUDA_ASSERT(track_addresses && id <= block_addresses.size());
+    return id < block_addresses.size() ? block_addresses[id] : bytes_written;
+}
+
+void BGZFWriter::write_compressed(DataBuffer& compressed)
+{
+    if (track_addresses)
+        block_addresses.push_back(bytes_written);
+
+    fwrite(compressed.get_base_ptr(), compressed.pos, 1, fp);
+    bytes_written += compressed.pos;
+}
+
+void BGZFWriter::CompressionThread::run(void)
+{
+    for(;;)
+    {
+        Job *job;
+
+        {
+            ScopedLock guard(&writer->lock);
+            while (writer->compress_queue.empty() && writer->stopping == false)
+                writer->compress_ready.wait(&writer->lock);
+
+            if (writer->compress_queue.empty())
+                return;
+
+            job = writer->compress_queue.front();
+            writer->compress_queue.pop();
+        }
+
+        Timer timer;
+        timer.start();
+
+        job->output.rewind();
+        bgzf.start_block(job->output);
+        bgzf.compress(job->output, job->input);
+        bgzf.end_block(job->output);
+        job->input.rewind();
+
+        timer.stop();
+
+        {
+            ScopedLock guard(&writer->lock);
+            writer->compress_time += timer.seconds();
+            writer->write_queue[job->id] = job;
+
+            // only wake up the writer if this is the block it's waiting for
+            if (job->id == writer->n_written)
+                writer->write_ready.signal();
+        }
+    }
+}
+
+void BGZFWriter::WriterThread::run(void)
+{
+    for(;;)
+    {
+        Job *job;
+
+        {
+            ScopedLock guard(&writer->lock);
+            while (writer->write_queue.empty() ||
+                   writer->write_queue.begin()->first != writer->n_written)
+            {
+                if (writer->stopping && writer->n_written == writer->n_submitted)
+                    return;
+
+                writer->write_ready.wait(&writer->lock);
+            }
+
+            job = writer->write_queue.begin()->second;
+            writer->write_queue.erase(writer->write_queue.begin());
+        }
+
+        // write outside of the lock, so that the compression threads can keep going
+        writer->write_compressed(job->output);
+
+        {
+            ScopedLock guard(&writer->lock);
+            writer->free_jobs.push_back(job);
+            writer->n_written++;
+            writer->job_done.broadcast();
+        }
+    }
+}
+
 } // namespace io
 } // namespace nvbio
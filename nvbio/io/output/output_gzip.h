@@ -20,16 +20,21 @@
 
 #include <nvbio/io/output/output_types.h>
 #include <nvbio/io/output/output_databuffer.h>
+#include <nvbio/basic/threads.h>
 
 #include <zlib/zlib.h>
 #include <stdio.h>
+#include <vector>
+#include <queue>
+#include <map>
 
 namespace nvbio {
 namespace io {
 
 struct GzipCompressor
 {
-    GzipCompressor();
+    // level is the zlib compression level (0-9, or Z_DEFAULT_COMPRESSION)
+    GzipCompressor(const int level = Z_DEFAULT_COMPRESSION);
 
     void start_block(DataBuffer& output);
     void compress(DataBuffer& output, DataBuffer& input);
@@ -40,6 +45,8 @@ protected:
     z_stream stream;
     // gzip header for the stream
     gz_header_s gzh;
+    // the compression level
+    int level;
 };
 
 struct BGZFCompressor : public GzipCompressor
@@ -53,10 +60,113 @@ struct BGZFCompressor : public GzipCompressor
         uint16 BSIZE;   // BAM total block size - 1
     } extra_data;
 
-    BGZFCompressor();
+    BGZFCompressor(const int level = Z_DEFAULT_COMPRESSION);
 
     virtual void end_block(DataBuffer& output);
 };
 
+// Compresses a sequence of BGZF blocks and writes them out to a file in order.
+//
+// With n_threads > 0, blocks are handed over to a pool of threads which deflate them
+// concurrently, while a separate writer thread emits them in the order they were submitted;
+// the caller only blocks when all the in-flight blocks are still waiting to be written.
+// With n_threads == 0, each block is compressed and written synchronously by the caller.
+struct BGZFWriter
+{
+    BGZFWriter();
+    ~BGZFWriter();
+
+    // start writing to fp with the given compression level and number of compression threads;
+    // if track_addresses is set, the file offset of each block is recorded (see block_address)
+    void open(FILE *fp, const int level, const uint32 n_threads, const bool track_addresses = false);
+
+    // take over the contents of block and queue it for compression; block is left empty
+    void write_block(DataBuffer& block);
+
+    // wait until all the blocks submitted so far have been written out
+    void flush(void);
+
+    // write out all pending blocks and stop the threads
+    void close(void);
+
+    // append the empty block marking the end of a BGZF file; all blocks must have been written
+    void write_eof_marker(void);
+
+    // the number of blocks submitted so far, i.e. the id the next block will be assigned
+    uint64 block_count(void) const { return n_submitted; }
+
+    // the number of uncompressed and compressed bytes written out so far
+    uint64 input_bytes(void) const { return bytes_in; }
+    uint64 output_bytes(void) const { return bytes_written; }
+
+    // the time spent compressing blocks so far, summed over all threads
+    float compression_time(void) const { return compress_time; }
+
+    // the offset in the file of the given block, with block_count() mapping to the end of the
+    // data written so far; requires track_addresses and all blocks up to id to have been written
+    uint64 block_address(const uint64 id) const;
+
+private:
+    // a block in flight, with its uncompressed and compressed data
+    struct Job
+    {
+        DataBuffer input;
+        DataBuffer output;
+        uint64 id;
+    };
+
+    struct CompressionThread : public Thread<CompressionThread>
+    {
+        CompressionThread(BGZFWriter *writer, const int level) : writer(writer), bgzf(level) {}
+
+        void run(void);
+
+        BGZFWriter *writer;
+        BGZFCompressor bgzf;
+    };
+
+    struct WriterThread : public Thread<WriterThread>
+    {
+        void run(void);
+
+        BGZFWriter *writer;
+    };
+
+    // write out a compressed block, recording its address if needed
+    void write_compressed(DataBuffer& compressed);
+
+    FILE *fp;
+    int level;
+
+    // the number of bytes submitted and written so far, the time spent compressing them,
+    // and, optionally, the offset of each block
+    uint64 bytes_in;
+    uint64 bytes_written;
+    float compress_time;
+    bool track_addresses;
+    std::vector<uint64> block_addresses;
+
+    std::vector<CompressionThread*> compression_threads;
+    WriterThread writer_thread;
+
+    // all jobs, and those not currently in flight
+    std::vector<Job*> jobs;
+    std::vector<Job*> free_jobs;
+
+    // blocks waiting to be compressed, and compressed blocks waiting to be written, keyed by id
+    std::queue<Job*> compress_queue;
+    std::map<uint64, Job*> write_queue;
+
+    // the id of the next block to be submitted and of the next block to be written
+    uint64 n_submitted;
+    uint64 n_written;
+    bool stopping;
+
+    Mutex lock;
+    Condition compress_ready;
+    Condition write_ready;
+    Condition job_done;
+};
+
 } // namespace io
 } // namespace nvbio
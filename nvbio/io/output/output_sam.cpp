@@ -21,161 +21,179 @@
 #include <nvbio/basic/numbers.h>
 
 #include <stdio.h>
-#include <stdarg.h>
+#include <string.h>
 
 namespace nvbio {
 namespace io {
 
-SamOutput::SamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt)
-    : OutputFile(file_name, alignment_type, bnt)
+SamOutput::SamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt,
+                     const bool compressed,
+                     const int compression_level,
+                     const uint32 compression_threads,
+                     const QualityMode quality_mode)
+    : OutputFile(file_name, alignment_type, bnt),
+      compressed(compressed),
+      quality_mode(quality_mode)
 {
-    fp = fopen(file_name, "wt");
+    fp = open_output_stream(file_name, compressed ? "wb" : "wt");
     if (fp == NULL)
     {
         log_error(stderr, "SamOutput: could not open %s for writing\n", file_name);
         return;
     }
 
-    // set a 256kb output buffer on fp and make sure it's not line buffered
-    // this makes sure small fwrites do not land on disk straight away
-    // (256kb was chosen based on the default stripe size for Linux mdraid RAID-5 volumes)
-    setvbuf(fp, NULL, _IOFBF, 256 * 1024);
+    if (compressed)
+        bgzf.open(fp, compression_level, compression_threads);
+
+    // measure the reference names once, so that they can be copied straight into each record
+    ref_name_len.resize(bnt.info.n_seqs);
+    for(uint32 i = 0; i < bnt.info.n_seqs; i++)
+        ref_name_len[i] = uint32(strlen(bnt.data.names + bnt.data.anns[i].name_offset));
 
     // output the SAM header
-    // we do this early to force vbuf allocation on fp
     output_header();
 }
 
 SamOutput::~SamOutput()
 {
+    // the output thread may still be writing to our files
+    stop_output_thread();
+
     if (fp)
     {
+        bgzf.close();
         fclose(fp);
         fp = NULL;
     }
 }
 
-void SamOutput::write_formatted_string(const char *fmt, ...)
-{
-    va_list args;
+namespace {
 
-    fwrite("\t", 1, 1, fp);
-    va_start(args, fmt);
-    vfprintf(fp, fmt, args);
+// append a string of known length
+inline void append(char*& out, const char *str, const uint32 len)
+{
+    memcpy(out, str, len);
+    out += len;
 }
 
-void SamOutput::write_string(const char *str, bool tab)
+// append a NUL-terminated string
+inline void append(char*& out, const char *str)
 {
-    if (tab)
-        fwrite("\t", 1, 1, fp);
-
-    fwrite(str, 1, strlen(str), fp);
+    while (*str)
+        *out++ = *str++;
 }
 
-namespace {
-// utility function to convert an int to a base-10 string representation
-template <typename T> int itoa(char *buf, T in)
+// append a character
+inline void append(char*& out, const char c)
 {
-    int len = 0;
-    bool negative = false;
-
-    // track the sign
-    if (in < 0)
-    {
-        negative = true;
-        in = -int(in);
-    }
+    *out++ = c;
+}
 
-    // convert to base10
+// append the base-10 representation of an unsigned integer
+inline void append_uint(char*& out, uint32 in)
+{
+    // render the digits backwards into a scratch area, then copy them in order
+    char digits[16];
+    char *d = digits + sizeof(digits);
     do
     {
-        buf[len] = "0123456789"[in % 10];
-        in /= 10;
-        len++;
-    } while(in);
+        *--d = char('0' + in % 10u);
+        in /= 10u;
+    } while (in);
 
-    // add sign
-    if (negative)
-    {
-        buf[len] = '-';
-        len++;
-    }
+    append(out, d, uint32(digits + sizeof(digits) - d));
+}
 
-    // reverse
-    for(int c = 0; c < len / 2; c++)
+// append the base-10 representation of a signed integer
+inline void append_int(char*& out, const int32 in)
+{
+    if (in < 0)
     {
-        char tmp;
-        tmp = buf[c];
-        buf[c] = buf[len - c - 1];
-        buf[len - c - 1] = tmp;
+        *out++ = '-';
+        append_uint(out, uint32(-int64(in)));
     }
-
-    // terminate
-    buf[len] = 0;
-    return len;
+    else
+        append_uint(out, uint32(in));
 }
+
+// render an unsigned integer into a NUL-terminated string, returning its length
+inline uint32 uint_to_string(char *buf, const uint32 in)
+{
+    char *out = buf;
+    append_uint(out, in);
+    *out = '\0';
+    return uint32(out - buf);
 }
 
-template<typename T>
-void SamOutput::write_int(T i, bool tab)
+// append an integer SAM tag, preceded by a tab
+inline void append_tag(char*& out, const char *name, const int32 value)
 {
-    char str[32];
-    int len;
+    append(out, '\t');
+    append(out, name, 2);
+    append(out, ":i:", 3);
+    append_int(out, value);
+}
 
-    len = itoa(str, i);
+} // anonymous namespace
 
-    if (tab)
-    {
-        fwrite("\t", 1, 1, fp);
-    }
+char *SamOutput::reserve(const uint32 size)
+{
+    NVBIO_CUDA_ASSERT(size < DataBuffer::BUFFER_SIZE + DataBuffer::BUFFER_EXTRA);
 
-    fwrite(str, len, 1, fp);
-}
+    if (uint32(data_buffer.get_remaining_size()) <= size)
+        flush();
 
-template<typename T>
-void SamOutput::write_tag(const char *name, T value)
-{
-    write_string(name);
-    write_string(":i:", false);
-    write_int(value, false);
+    return (char *) data_buffer.get_cur_ptr();
 }
 
-template<>
-void SamOutput::write_tag(const char *name, const char *value)
+void SamOutput::commit(const char *end)
 {
-    write_string(name);
-    write_string(":Z:", false);
-    write_string(value, false);
+    data_buffer.skip_ahead(int(end - (const char *) data_buffer.get_cur_ptr()));
+
+    if (data_buffer.is_full())
+        flush();
 }
 
-void SamOutput::linebreak(void)
+void SamOutput::flush(void)
 {
-    fwrite("\n", 1, 1, fp);
+    if (data_buffer.get_pos() == 0)
+        return;
+
+    iostats.output_raw_bytes += data_buffer.get_pos();
+
+    if (compressed)
+    {
+        // hand the block over to the BGZF pipeline, which rewinds the buffer
+        bgzf.write_block(data_buffer);
+    }
+    else
+    {
+        fwrite(data_buffer.get_base_ptr(), data_buffer.get_pos(), 1, fp);
+        data_buffer.rewind();
+    }
 }
 
 void SamOutput::output_header(void)
 {
-    write_string("@HD", false);
-    write_string("VN:1.3");
-    linebreak();
-
-    write_string("@PG", false);
+    char *out = reserve(256);
+    append(out, "@HD\tVN:1.3\n");
     // xxxnsubtil: this will have to be specified somewhere else later (maybe in Params?)
-    write_string("ID:nvBowtie");
-    write_string("PN:nvBowtie");
     // VN was bumped to 0.5.1 to distinguish between the new and old output code
-    write_string("VN:0.5.1");
-    linebreak();
+    append(out, "@PG\tID:nvBowtie\tPN:nvBowtie\tVN:0.5.1\n");
+    commit(out);
 
     // output the sequence info
     for(uint32 i = 0; i < bnt.info.n_seqs; i++)
     {
         const io::BNTAnn& ann = bnt.data.anns[i];
-        // sequence header
-        write_string("@SQ", false);
-        write_formatted_string("SN:%s", bnt.data.names + ann.name_offset);
-        write_formatted_string("LN:%d", ann.len);
-        linebreak();
+
+        out = reserve(ref_name_len[i] + 64);
+        append(out, "@SQ\tSN:");
+        append(out, bnt.data.names + ann.name_offset, ref_name_len[i]);
+        append(out, "\tLN:");
+        append_int(out, ann.len);
+        append(out, '\n');
+        commit(out);
     }
 }
 
@@ -194,7 +212,7 @@ uint32 SamOutput::generate_cigar_string(struct SamAlignment& sam_align,
         int len;
 
         // output count
-        len = itoa(output, cigar_entry.m_len);
+        len = uint_to_string(output, cigar_entry.m_len);
         output += len;
         // output CIGAR op
         *output = cigar_op;
@@ -210,6 +228,7 @@ uint32 SamOutput::generate_cigar_string(struct SamAlignment& sam_align,
 
     // terminate the output string
     *output = '\0';
+    sam_align.cigar_len = uint32(output - sam_align.cigar);
     return read_len;
 }
 
@@ -241,7 +260,7 @@ uint32 SamOutput::generate_md_string(SamAlignment& sam_align, const AlignmentDat
                 while (i < mds_len && alignment.mds_vec[i] == MDS_MATCH)
                     l += alignment.mds_vec[i++];
 
-                buffer_len += itoa(buffer + buffer_len, l);
+                buffer_len += uint_to_string(buffer + buffer_len, l);
             }
 
             break;
@@ -287,60 +306,84 @@ uint32 SamOutput::generate_md_string(SamAlignment& sam_align, const AlignmentDat
     } while(i < mds_len);
 
     buffer[buffer_len] = '\0';
+    sam_align.md_len = buffer_len;
     return buffer_len;
 }
 
-// output a SAM alignment (but not tags)
-void SamOutput::output_alignment(const struct SamAlignment& sam_align)
+// an upper bound to the size of the record rendered for an alignment: all variable-length
+// fields plus the rest of the fields and tags, none of which can take more than 12 characters
+uint32 SamOutput::max_alignment_size(const struct SamAlignment& sam_align, const uint32 read_len)
+{
+    return uint32(strlen(sam_align.qname)) + 2 * read_len + sam_align.rname_len + sam_align.rnext_len +
+           sam_align.cigar_len + sam_align.md_len + 32 * 12;
+}
+
+// render a SAM alignment record
+char *SamOutput::format_alignment(char *out, const struct SamAlignment& sam_align, const uint32 read_len)
 {
-    write_string(sam_align.qname, false);
-    write_int((uint32)sam_align.flags);
+    append(out, sam_align.qname);
+    append(out, '\t');
+    append_uint(out, sam_align.flags);
 
-//    log_verbose(stderr, "%s: ed(NM)=%d score(AS)=%d second_score(XS)=%d mm(XM)=%d gapo(XO)=%d gape(XG)=%d\n",
-//                sam_align.qname,
-//                sam_align.ed, sam_align.score, sam_align.second_score, sam_align.mm, sam_align.gapo, sam_align.gape);
     if (sam_align.flags & SAM_FLAGS_UNMAPPED)
     {
         // output * or 0 for every other required field
-        write_string("*\t0\t0\t*\t*\t0\t0");
-        write_string(sam_align.seq);
-        write_string(sam_align.qual);
-
-        linebreak();
-
-        return;
+        append(out, "\t*\t0\t0\t*\t*\t0\t0\t", 15);
+        append(out, sam_align.seq, read_len);
+        append(out, '\t');
+        append(out, sam_align.qual, sam_align.qual_len);
+        append(out, '\n');
+        return out;
     }
 
-    write_string(sam_align.rname);
-    write_int(sam_align.pos);
-    write_int(sam_align.mapq);
-    write_string(sam_align.cigar);
+    append(out, '\t');
+    append(out, sam_align.rname, sam_align.rname_len);
+    append(out, '\t');
+    append_uint(out, sam_align.pos);
+    append(out, '\t');
+    append_uint(out, sam_align.mapq);
+    append(out, '\t');
+    append(out, sam_align.cigar, sam_align.cigar_len);
+    append(out, '\t');
 
     if (sam_align.rnext)
-        write_string(sam_align.rnext);
+        append(out, sam_align.rnext, sam_align.rnext_len);
     else
-        write_string("*");
-
-    write_int(sam_align.pnext);
-    write_int(sam_align.tlen);
-
-    write_string(sam_align.seq);
-    write_string(sam_align.qual);
-
-    write_tag("NM", sam_align.ed);
-    write_tag("AS", sam_align.score);
+        append(out, '*');
+
+    append(out, '\t');
+    append_uint(out, sam_align.pnext);
+    append(out, '\t');
+    append_int(out, sam_align.tlen);
+    append(out, '\t');
+    append(out, sam_align.seq, read_len);
+    append(out, '\t');
+    append(out, sam_align.qual, sam_align.qual_len);
+
+    append_tag(out, "NM", sam_align.ed);
+    append_tag(out, "AS", sam_align.score);
     if (sam_align.second_score_valid)
-        write_tag("XS", sam_align.second_score);
+        append_tag(out, "XS", sam_align.second_score);
+
+    append_tag(out, "XM", sam_align.mm);
+    append_tag(out, "XO", sam_align.gapo);
+    append_tag(out, "XG", sam_align.gape);
 
-    write_tag("XM", sam_align.mm);
-    write_tag("XO", sam_align.gapo);
-    write_tag("XG", sam_align.gape);
+    append(out, "\tMD:Z:", 6);
     if (sam_align.md_string[0])
-        write_tag("MD", sam_align.md_string);
+        append(out, sam_align.md_string, sam_align.md_len);
     else
-        write_tag("MD", "*");
+        append(out, '*');
 
-    linebreak();
+    append(out, '\n');
+    return out;
+}
+
+// render a SAM alignment into the output buffer
+void SamOutput::output_alignment(const struct SamAlignment& sam_align, const uint32 read_len)
+{
+    char *out = reserve(max_alignment_size(sam_align, read_len));
+    commit(format_alignment(out, sam_align, read_len));
 }
 
 uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
@@ -364,6 +407,12 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
     // fill out read name
     sam_align.qname = alignment.read_name;
 
+    // no variable-length fields have been generated yet
+    sam_align.rname_len = 0;
+    sam_align.rnext_len = 0;
+    sam_align.cigar_len = 0;
+    sam_align.md_len    = 0;
+
     // fill out sequence data
     for(uint32 i = 0; i < alignment.read_len; i++)
     {
@@ -382,20 +431,33 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
     sam_align.seq[alignment.read_len] = '\0';
 
     // fill out quality data
-    for(uint32 i = 0; i < alignment.read_len; i++)
+    if (quality_mode == QUALITY_DROP)
     {
-        char q;
-
-        if (alignment.best[MATE_1].m_rc)
+        sam_align.qual[0] = '*';
+        sam_align.qual_len = 1;
+    }
+    else
+    {
+        for(uint32 i = 0; i < alignment.read_len; i++)
         {
-            q = alignment.qual[i];
-        } else {
-            q = alignment.qual[alignment.read_len - i - 1];
-        }
+            char q;
+
+            if (alignment.best[MATE_1].m_rc)
+            {
+                q = alignment.qual[i];
+            } else {
+                q = alignment.qual[alignment.read_len - i - 1];
+            }
 
-        sam_align.qual[i] = q + 33;
+            if (quality_mode == QUALITY_BIN)
+                q = bin_quality(q);
+
+            sam_align.qual[i] = q + 33;
+        }
+        sam_align.qual_len = alignment.read_len;
     }
-    sam_align.qual[alignment.read_len] = '\0';
+    sam_align.qual[sam_align.qual_len] = '\0';
+    iostats.output_qual_bytes += sam_align.qual_len;
 
     // compute mapping quality
     // mapq is always computed based on the anchor mate, so we may have to swap the mates around here
@@ -426,7 +488,7 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
         sam_align.md_string[0] = '\0';
 
         // unaligned reads don't need anything else; output and return
-        output_alignment(sam_align);
+        output_alignment(sam_align, alignment.read_len);
         return 0;
     }
 
@@ -468,7 +530,8 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
         sam_align.mapq = 0;
     }
 
-    sam_align.rname = bnt.data.names + ann->name_offset;
+    sam_align.rname     = bnt.data.names + ann->name_offset;
+    sam_align.rname_len = ref_name_len[ ann - bnt.data.anns ];
     sam_align.pos = uint32( alignment.cigar_pos - ann->offset + 1 );
 
     // fill out the cigar string...
@@ -497,9 +560,11 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
 
             if (o_ann == ann)
             {
-                sam_align.rnext = "=";
+                sam_align.rnext     = "=";
+                sam_align.rnext_len = 1;
             } else {
-                sam_align.rnext = bnt.data.names + o_ann->name_offset;
+                sam_align.rnext     = bnt.data.names + o_ann->name_offset;
+                sam_align.rnext_len = ref_name_len[ o_ann - bnt.data.anns ];
             }
 
             sam_align.pnext = uint32( mate.cigar_pos - o_ann->offset + 1 );
@@ -519,6 +584,7 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
         } else {
             // other mate is unmapped
             sam_align.rnext = "=";
+            sam_align.rnext_len = 1;
             sam_align.pnext = (int)(alignment.cigar_pos - ann->offset + 1);
             // xxx: check whether this is really correct...
             sam_align.tlen = 0;
@@ -544,7 +610,7 @@ uint32 SamOutput::process_one_alignment(const AlignmentData& alignment,
     generate_md_string(sam_align, alignment);
 
     // write out the alignment
-    output_alignment(sam_align);
+    output_alignment(sam_align, alignment.read_len);
 
     return sam_align.mapq;
 }
@@ -554,11 +620,11 @@ void SamOutput::process(struct GPUOutputBatch& gpu_batch,
                         const AlignmentScore score)
 {
     // read back the data into the CPU for later processing
-    readback(cpu_batch, gpu_batch, mate, score);
+    readback(*cpu_batch, gpu_batch, mate, score);
 }
 
 // called when output data for a given batch has been received, triggers processing of the accumulated data
-void SamOutput::end_batch(void)
+void SamOutput::write_batch(CPUOutputBatch& cpu_batch)
 {
     for(uint32 c = 0; c < cpu_batch.count; c++)
     {
@@ -590,12 +656,26 @@ void SamOutput::end_batch(void)
                 break;
         }
     }
-
-    OutputFile::end_batch();
 }
 
 void SamOutput::close(void)
 {
+    // write out any pending batches
+    OutputFile::close();
+
+    // write out the buffered records
+    flush();
+
+    if (compressed)
+    {
+        // wait for all the pending blocks to be written and terminate the BGZF stream
+        bgzf.close();
+        bgzf.write_eof_marker();
+    }
+
+    iostats.output_bytes            = compressed ? bgzf.output_bytes() : iostats.output_raw_bytes;
+    iostats.output_compression_time = bgzf.compression_time();
+
     fclose(fp);
     fp = NULL;
 }
@@ -22,17 +22,19 @@
 #include <nvbio/io/output/output_utils.h>
 #include <nvbio/io/output/output_file.h>
 #include <nvbio/io/output/output_batch.h>
+#include <nvbio/io/output/output_databuffer.h>
+#include <nvbio/io/output/output_gzip.h>
 #include <nvbio/io/fmi.h>
 #include <nvbio/io/reads/reads.h>
 
 #include <stdio.h>
+#include <vector>
 
 namespace nvbio {
 namespace io {
 
 struct SamOutput : public OutputFile
 {
-private:
     // SAM alignment flags
     // these are meant to be bitwised OR'ed together
     typedef enum {
@@ -57,14 +59,18 @@ private:
         const char *        qname;              // query template name
         uint32              flags;              // bitwise alignment flags from SamAlignmentFlags
         const char *        rname;              // reference sequence name
+        uint32              rname_len;          // length of the reference sequence name
         uint32              pos;                // 1-based leftmost mapping position
         uint8               mapq;               // mapping quality
         char                cigar[4096];        // CIGAR string
+        uint32              cigar_len;          // length of the CIGAR string
         const char *        rnext;              // reference name of the mate/next read
+        uint32              rnext_len;          // length of the mate's reference name
         uint32              pnext;              // position of the mate/next read
         int32               tlen;               // observed template length
         char                seq[1024];          // segment sequence (xxxnsubtil: size this according to max read len)
         char                qual[1024];         // ASCII of phred-scaled base quality+33 (xxxnsubtil: same as above)
+        uint32              qual_len;           // length of the quality string ('*' if qualities are omitted)
 
         // our own additional data, output as tags (only if read is mapped)
         int32               ed;                 // NM:i
@@ -74,41 +80,48 @@ private:
         int32               gapo;               // XO:i
         int32               gape;               // XG:i
         char                md_string[4096];    // MD:Z (mostly optional?)
+        uint32              md_len;             // length of the MD string
 
         // extra data that's useful but not written out
         bool                second_score_valid; // do we have a second score?
     };
 
-public:
-    SamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt);
+    // if compressed is set, the output is written as BGZF blocks (i.e. .sam.gz) using the
+    // given compression level and number of compression threads; quality_mode selects
+    // whether base qualities are written verbatim, binned or omitted
+    SamOutput(const char *file_name, AlignmentType alignment_type, BNT bnt,
+              const bool compressed = false,
+              const int compression_level = Z_DEFAULT_COMPRESSION,
+              const uint32 compression_threads = 0,
+              const QualityMode quality_mode = QUALITY_KEEP);
     ~SamOutput();
 
     void process(struct GPUOutputBatch& gpu_batch,
                  const AlignmentMate mate,
                  const AlignmentScore score);
-    void end_batch(void);
-
     void close(void);
 
+    // an upper bound to the size of the record format_alignment() renders for an alignment
+    static uint32 max_alignment_size(const struct SamAlignment& aln, const uint32 read_len);
+    // render an alignment record, including its trailing newline, returning the end of the output
+    static char *format_alignment(char *out, const struct SamAlignment& aln, const uint32 read_len);
+
+protected:
+    void write_batch(struct CPUOutputBatch& cpu_batch);
+
 private:
-    // write a printf-style formatted string to the file (preceded by a \t)
-    void write_formatted_string(const char *fmt, ...);
-    // write a plain string
-    // tab controls whether to output a \t before the string
-    void write_string(const char *str, bool tab = true);
-    // write an integer
-    template <typename T> void write_int(T i, bool tab = true);
-    // add a line break
-    void linebreak();
-
-    // write a SAM tag
-    template <typename T>
-    void write_tag(const char *name, T value);
+    // make sure the buffer has room for a record of up to the given size, flushing it if needed,
+    // and return the current write pointer
+    char *reserve(const uint32 size);
+    // move the write pointer past the data rendered starting at reserve()
+    void commit(const char *end);
+    // write out the buffered data
+    void flush(void);
 
     // output the SAM file header
     void output_header(void);
     // output an alignment
-    void output_alignment(const struct SamAlignment& aln);
+    void output_alignment(const struct SamAlignment& aln, const uint32 read_len);
 
     // process a single alignment from the stream and output it
     uint32 process_one_alignment(const AlignmentData& alignment,
@@ -122,8 +135,16 @@ private:
 
     // our file pointer
     FILE *fp;
-    // CPU copy of the current alignment batch
-    CPUOutputBatch cpu_batch;
+    // buffer holding the rendered records that haven't been written yet
+    DataBuffer data_buffer;
+    // whether we're writing BGZF blocks, and the compression pipeline used to do so
+    bool compressed;
+    BGZFWriter bgzf;
+    // how base qualities are written out
+    QualityMode quality_mode;
+
+    // the lengths of the reference sequence names, computed once
+    std::vector<uint32> ref_name_len;
 };
 
 } // namespace io
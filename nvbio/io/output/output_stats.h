@@ -86,10 +86,28 @@ struct IOStats
     // time series for tracking each OutputFile::process() call
     TimeSeries output_process_timings;
 
+    // time the caller spent blocked in OutputFile::end_batch() and close(), i.e. the output time
+    // not hidden behind alignment
+    float output_blocked_time;
+
+    // number of bytes of formatted records, of which base qualities, and number of bytes
+    // written to disk after compression
+    uint64 output_raw_bytes;
+    uint64 output_qual_bytes;
+    uint64 output_bytes;
+
+    // time spent compressing the output, summed over all compression threads
+    float output_compression_time;
+
     IOStats()
         : alignments_DtoH_count(0),
           alignments_DtoH_time(0.0),
-          n_reads(0)
+          n_reads(0),
+          output_blocked_time(0.0),
+          output_raw_bytes(0),
+          output_qual_bytes(0),
+          output_bytes(0),
+          output_compression_time(0.0)
     {}
 
     // paired-end alignment
@@ -80,6 +80,22 @@ typedef enum {
     PAIRED_END
 } AlignmentType;
 
+/// Helper enum to select how base qualities are written out
+typedef enum {
+    QUALITY_KEEP,   ///< write qualities verbatim
+    QUALITY_BIN,    ///< apply Illumina's 8-level quality binning
+    QUALITY_DROP,   ///< omit qualities altogether ('*' in SAM, 0xFF in BAM)
+} QualityMode;
+
+/// Helper enum to select the output file format, overriding the file name extension
+typedef enum {
+    OUTPUT_FORMAT_AUTO,     ///< pick the format from the file name extension (SAM for the standard output)
+    OUTPUT_FORMAT_SAM,      ///< plain SAM
+    OUTPUT_FORMAT_SAM_GZ,   ///< BGZF-compressed SAM
+    OUTPUT_FORMAT_BAM,      ///< BAM
+    OUTPUT_FORMAT_ALN,      ///< columnar alignments
+} OutputFormat;
+
 /// Helper enum to identify a mate in an alignment.
 /// Note that these are used as indices within BestAlignments.
 typedef enum {
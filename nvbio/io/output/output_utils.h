@@ -42,6 +42,20 @@ struct SeqFinder
     }
 };
 
+// map a Phred quality score to the representative of its bin in Illumina's 8-level
+// binning scheme; qualities below 2 (i.e. no-calls) are left alone
+inline uint8 bin_quality(const uint8 q)
+{
+    return q <  2 ? q  :
+           q < 10 ? 6  :
+           q < 20 ? 15 :
+           q < 25 ? 22 :
+           q < 30 ? 27 :
+           q < 35 ? 33 :
+           q < 40 ? 37 :
+                    40;
+}
+
 // compute the CIGAR alignment position given the alignment base and the sink offset
 inline uint32 compute_cigar_pos(const uint32 sink, const uint32 alignment)
 {
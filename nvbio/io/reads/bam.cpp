@@ -41,10 +41,13 @@ ReadDataFile_BAM::ReadDataFile_BAM(const char *read_file_name,
                                    const uint32 max_reads,
                                    const uint32 truncate_read_len,
                                    const ReadEncoding flags)
-  : ReadDataFile(max_reads, truncate_read_len, flags)
+  : ReadDataFile(max_reads, truncate_read_len, flags),
+    m_buffer(BUFFER_SIZE),
+    m_buffer_size(0),
+    m_buffer_pos(0),
+    m_n_ref(0)
 {
-    fp = gzopen(read_file_name, "rb");
-    if (fp == NULL)
+    if (!fp.open(read_file_name))
     {
         // this will cause init() to fail below
         log_error(stderr, "unable to open BAM file %s\n", read_file_name);
@@ -56,15 +59,15 @@ ReadDataFile_BAM::ReadDataFile_BAM(const char *read_file_name,
 
 bool ReadDataFile_BAM::readData(void *output, unsigned int len)
 {
-    unsigned int ret;
+    int ret;
 
-    ret = gzread(fp, output, len);
+    ret = fp.read(output, len);
     if (ret > 0)
     {
         return true;
     } else {
         // check for EOF separately; zlib will not always return Z_STREAM_END at EOF below
-        if (gzeof(fp))
+        if (fp.eof())
         {
             m_file_state = FILE_EOF;
         } else {
@@ -72,7 +75,7 @@ bool ReadDataFile_BAM::readData(void *output, unsigned int len)
             int err;
             const char *msg;
 
-            msg = gzerror(fp, &err);
+            msg = fp.error(&err);
             // we're making the assumption that we never see Z_STREAM_END here
             assert(err != Z_STREAM_END);
 
@@ -92,13 +95,13 @@ bool ReadDataFile_BAM::readData(void *output, unsigned int len)
     }
 
 // skip bytes in fp
-// note that gzseek won't actually detect EOF, so we don't check return values here
+// note that skipping won't report EOF errors, so we don't check return values here
 #define GZFWD(bytes) \
-    gzseek(fp, (bytes), SEEK_CUR)
+    fp.skip(bytes)
 
 // skip a structure field in fp
 #define GZSKIP(field) \
-    gzseek(fp, sizeof(field), SEEK_CUR)
+    fp.skip(sizeof(field))
 
 bool ReadDataFile_BAM::init(void)
 {
@@ -108,7 +111,7 @@ bool ReadDataFile_BAM::init(void)
     BAM_header header;
     int c;
 
-    if (fp == NULL)
+    if (!fp.is_open())
     {
         // file failed to open
         return false;
@@ -139,215 +142,382 @@ bool ReadDataFile_BAM::init(void)
         GZREAD(ref.l_name);
         GZFWD(ref.l_name + sizeof(ref.l_ref));
     }
+    m_n_ref = header.n_ref;
 
     return true;
 }
 
+// restrict the stream to the records starting in a shard of the compressed blocks of the file
+bool ReadDataFile_BAM::select_shard(const uint32 shard, const uint32 n_shards)
+{
+    if (fp.is_bgzf() == false || m_loaded)
+        return false;
+
+    return fp.select_shard( shard, n_shards, BAMRecordFinder( m_n_ref ) );
+}
+
 namespace {
 
-// decode a BAM bp into ascii
-inline unsigned char decode_BAM_bp(uint8 bp)
+// the outcome of checking whether a BAM record starts at a given position
+enum BAMRecordCheck
 {
-    static const char table[] = "=ACMGRSVTWYHKDBN";
+    BAM_RECORD_VALID,
+    BAM_RECORD_INVALID,
+    BAM_RECORD_INCOMPLETE,      // more data is needed to tell
+};
 
-    assert(bp < 16);
-    return table[bp];
+inline int32 read_bam_int32(const char* p)
+{
+    int32 r;
+    memcpy( &r, p, sizeof(int32) );
+    return r;
 }
 
+// check whether the fields of a candidate BAM record are consistent, returning the start of the
+// following record in *next; the bounds are deliberately strict: rejecting an unusually large valid
+// record only means the boundary is placed at one of the following ones
+BAMRecordCheck check_bam_record(const char* p, const char* end, const int32 n_ref, const char** next)
+{
+    // the largest record and the largest auxiliary data block accepted as a valid boundary
+    const int32 MAX_BLOCK_SIZE = 16*1024*1024;
+    const int32 MAX_AUX_SIZE   = 1024*1024;
+
+    if (end - p < int64( sizeof(BAM_alignment) ))
+        return BAM_RECORD_INCOMPLETE;
+
+    BAM_alignment align;
+    memcpy( &align, p, sizeof(BAM_alignment) );
+
+    const int32 l_read_name = int32( align.bin_mq_nl & 0xff );
+    const int32 n_cigar     = int32( align.flag_nc & 0xffff );
+    const int32 fixed_size  = int32( sizeof(BAM_alignment) - sizeof(int32) );
+
+    if (align.block_size < fixed_size || align.block_size > MAX_BLOCK_SIZE ||
+        align.refID      < -1 || align.refID      >= n_ref ||
+        align.next_refID < -1 || align.next_refID >= n_ref ||
+        align.pos        < -1 || align.next_pos   < -1     ||
+        align.l_seq      <  0 || align.l_seq > MAX_BLOCK_SIZE ||
+        l_read_name      <  1)
+        return BAM_RECORD_INVALID;
+
+    const int64 data_size = int64( l_read_name ) + 4 * n_cigar + (align.l_seq + 1) / 2 + align.l_seq;
+    const int64 aux_size  = int64( align.block_size ) - fixed_size - data_size;
+    if (aux_size < 0 || aux_size > MAX_AUX_SIZE)
+        return BAM_RECORD_INVALID;
+
+    // the read name must be a NUL-terminated printable string
+    const char* name = p + sizeof(BAM_alignment);
+    if (end - name < l_read_name)
+        return BAM_RECORD_INCOMPLETE;
+
+    if (name[ l_read_name-1 ] != '\0')
+        return BAM_RECORD_INVALID;
+
+    for (int32 i = 0; i < l_read_name-1; ++i)
+    {
+        if (name[i] < 0x21 || name[i] > 0x7E)
+            return BAM_RECORD_INVALID;
+    }
+
+    *next = p + sizeof(int32) + align.block_size;
+    return BAM_RECORD_VALID;
 }
 
-// grab the next chunk of reads from the file, up to max_reads
-int ReadDataFile_BAM::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps)
+} // anonymous namespace
+
+// locate the first BAM record starting past a given position
+const char* BAMRecordFinder::find(const char* begin, const char* end, const bool eof) const
 {
-    if (max_bps < ReadDataFile::LONG_READ)
-        return 0;
+    // the number of consecutive records to check before accepting a candidate position
+    const uint32 CHAIN_LENGTH = 4;
+
+    for (const char* p = begin + 1; p < end; ++p)
+    {
+        const char* record = p;
+        uint32      n_valid = 0;
+
+        BAMRecordCheck check = BAM_RECORD_VALID;
+        while (n_valid < CHAIN_LENGTH && record != end)
+        {
+            const char* next = NULL;
+            check = record > end ? BAM_RECORD_INCOMPLETE : check_bam_record( record, end, m_n_ref, &next );
+            if (check != BAM_RECORD_VALID)
+                break;
+
+            record = next;
+            ++n_valid;
+        }
+
+        // a chain ending exactly at the end of the file is valid, however short,
+        // while anywhere else it needs to be checked against the following data
+        if (check == BAM_RECORD_VALID)
+            return (n_valid == CHAIN_LENGTH || eof) ? p : end;
+
+        // at the end of the file, a truncated record can't be valid
+        if (check == BAM_RECORD_INCOMPLETE && eof == false)
+            return end;
+    }
+    return end;
+}
 
-    // error code for gzread
-    static const int error = -1;
+namespace {
 
-    // small utility structure to keep track of data buffers and free them as appropriate
-    // (note the slightly evil initializer that sets all pointers to NULL)
-    struct data
+// a table translating a byte holding two 4-bit BAM bases ('=ACMGRSVTWYHKDBN', high nibble first)
+// into the corresponding pair of nvbio symbols, i.e. A,C,G,T = 0,1,2,3, and anything else = 4
+struct BAMSymbolTable
+{
+    BAMSymbolTable()
     {
-        char *read_name;
-        uint8 *encoded_read;
-        uint8 *decoded_read;
-        uint8 *quality;
+        static const uint8 bp_to_symbol[16] = { 4, 0, 1, 4, 2, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4 };
 
-        ~data()
+        for (uint32 c = 0; c < 256; ++c)
         {
-            if (read_name)
-                free(read_name);
+            pairs[c][0] = bp_to_symbol[ c >> 4 ];
+            pairs[c][1] = bp_to_symbol[ c & 15 ];
+        }
+    }
+
+    uint8 pairs[256][2];
+};
 
-            if (encoded_read)
-                free(encoded_read);
+const BAMSymbolTable bam_symbol_table;
 
-            if (decoded_read)
-                free(decoded_read);
+// convert n 4-bit BAM bases to nvbio symbols, two at a time
+inline void decode_BAM_bps(const uint32 n, const uint8* seq, uint8* symbols)
+{
+    const uint32 n_pairs = n / 2;
+    for (uint32 i = 0; i < n_pairs; ++i)
+        memcpy( symbols + 2*i, bam_symbol_table.pairs[ seq[i] ], 2 );
+
+    if (n & 1)
+        symbols[n-1] = bam_symbol_table.pairs[ seq[n_pairs] ][0];
+}
+
+} // anonymous namespace
+
+// make sure at least the given number of bytes past m_buffer_pos are available in m_buffer,
+// refilling it with as much data as possible
+bool ReadDataFile_BAM::fill_buffer(const uint32 needed)
+{
+    if (m_buffer_size - m_buffer_pos >= needed)
+        return true;
 
-            if (quality)
-                free(quality);
+    if (m_file_state != FILE_OK)
+        return false;
+
+    // move the unconsumed data to the beginning of the buffer
+    const uint32 remaining = m_buffer_size - m_buffer_pos;
+    if (remaining)
+        memmove( &m_buffer[0], &m_buffer[0] + m_buffer_pos, remaining );
+
+    m_buffer_size = remaining;
+    m_buffer_pos  = 0;
+
+    // make room for records larger than the buffer
+    if (m_buffer.size() < needed)
+        m_buffer.resize( needed );
+
+    while (m_buffer_size < needed)
+    {
+        const int n_read = fp.read( &m_buffer[0] + m_buffer_size, uint32( m_buffer.size() ) - m_buffer_size );
+        if (n_read <= 0)
+        {
+            // check for EOF separately; zlib will not always return Z_STREAM_END at EOF below
+            if (fp.eof())
+            {
+                if (m_buffer_size)
+                {
+                    log_error(stderr, "error processing BAM file (truncated alignment record)\n");
+                    m_file_state = FILE_STREAM_ERROR;
+                }
+                else
+                    m_file_state = FILE_EOF;
+            } else {
+                // ask zlib what happened and inform the user
+                int err;
+                const char *msg;
+
+                msg = fp.error(&err);
+                log_error(stderr, "error processing BAM file: zlib error %d (%s)\n", err, msg);
+                m_file_state = FILE_STREAM_ERROR;
+            }
+            return false;
         }
-    } data = { };
+        m_buffer_size += uint32( n_read );
+    }
+    return true;
+}
 
-    // utility structure to keep track of alignment header data
+// locate the fields of an alignment record needed to load its read
+bool ReadDataFile_BAM::parse_record(const char* record, const char* record_end, BAMRead* read) const
+{
     BAM_alignment align;
+    memcpy( &align, record, sizeof(BAM_alignment) );
 
-    z_off_t read_block_start;
-    int read_name_len;
-    int read_flags;
-    int cigar_len;
-    int encoded_read_len;
+    const uint32 read_name_len = align.bin_mq_nl & 0xff;
+    const uint32 cigar_len     = (align.flag_nc & 0xffff) * sizeof(uint32);
 
-    int c;
+    read->flags    = align.flag_nc >> 16;
+    read->name     = record + sizeof(BAM_alignment);
+    read->name_len = read_name_len ? read_name_len - 1u : 0u;
+    read->seq      = reinterpret_cast<const uint8*>( read->name + read_name_len + cigar_len );
+    read->qual     = read->seq + (align.l_seq + 1) / 2;
+    read->len      = nvbio::min( uint32( nvbio::max( align.l_seq, 0 ) ), m_truncate_read_len );
 
-    // are we done?
-    if (gzeof(fp))
+    return align.l_seq >= 0 && read_name_len &&
+           reinterpret_cast<const char*>( read->qual ) + align.l_seq <= record_end;
+}
+
+// add all strands of a read to a batch
+void ReadDataFile_BAM::push_read(ReadDataRAM* output, const BAMRead& read, const uint32 n_ops, const ReadDataRAM::StrandOp* ops)
+{
+    // translate the 4-bit bases straight into nvbio's symbols
+    if (m_symbols.size() < read.len)
+        m_symbols.resize( read.len );
+
+    decode_BAM_bps( read.len, read.seq, &m_symbols[0] );
+
+    // reads aligned to the reverse strand are stored reverse-complemented
+    ReadDataRAM::StrandOp read_ops[4];
+    for (uint32 i = 0; i < n_ops; ++i)
     {
-        m_file_state = FILE_EOF;
-        return 0;
+        read_ops[i] = (read.flags & SAMFlag_ReverseComplemented) ?
+            ReadDataRAM::StrandOp( ops[i] ^ ReadDataRAM::REVERSE_COMPLEMENT_OP ) : ops[i];
     }
 
-    // parse and skip all non-primary reads
-    do {
-        // read in the block_size
-        GZREAD(align.block_size);
+    output->push_back_symbols(
+        read.len,
+        load_names()     ? read.name : NULL,
+        &m_symbols[0],
+        load_qualities() ? read.qual : NULL,
+        Phred,
+        m_truncate_read_len,
+        n_ops,
+        read_ops,
+        read.name_len );
+}
 
-        // record the starting file position for this read block
-        read_block_start = gztell(fp);
+// grab the next chunk of reads from the file, up to max_reads
+int ReadDataFile_BAM::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps)
+{
+    // the size of the fixed portion of an alignment record, excluding its block_size field
+    const int32 FIXED_SIZE = int32( sizeof(BAM_alignment) - sizeof(int32) );
+
+    ReadDataRAM::StrandOp ops[4];
+    const uint32 n_ops = strand_ops( ops );
 
-        // skip uninsteresting fields
-        GZFWD(sizeof(align.refID) +
-              sizeof(align.pos));
+    // paired reads are output two mates at a time
+    const bool   paired = (m_load_flags & LOAD_PAIRS) != 0;
+    const uint32 n_mult = paired ? 2u * n_ops : n_ops;
 
-        GZREAD(align.bin_mq_nl);
-        GZREAD(align.flag_nc);
+    uint32 n_reads = 0;
+    uint32 n_bps   = 0;
 
-        // compute read flags
-        read_flags = align.flag_nc >> 16;
-        if (read_flags & SAMFlag_SecondaryAlignment)
+    while (n_reads + n_mult                         <= max_reads &&
+           n_bps   + n_mult*ReadDataFile::LONG_READ <= max_bps)
+    {
+        // fetch the whole record, and decode it in place
+        if (fill_buffer( sizeof(int32) ) == false)
         {
-            // we're not interested in this read; skip the remainder of the read block and loop
-            uint32 skip = align.block_size - (gztell(fp) - read_block_start);
-            assert(skip);
-            GZFWD(skip);
+            // a mate still waiting for its pair means the file was cut short
+            if (m_file_state == FILE_EOF && m_mate.empty() == false)
+            {
+                BAMRead mate;
+                parse_record( &m_mate[0], &m_mate[0] + m_mate.size(), &mate );
+
+                log_error(stderr, "error processing BAM file (read %.*s is missing its mate)\n", int(mate.name_len), mate.name);
+                m_file_state = FILE_PARSE_ERROR;
+                m_mate.clear();
+            }
+            break;
+        }
 
-            continue;
+        const int32 block_size = read_bam_int32( &m_buffer[0] + m_buffer_pos );
+        if (block_size < FIXED_SIZE)
+        {
+            log_error(stderr, "error processing BAM file (invalid alignment record size)\n");
+            m_file_state = FILE_PARSE_ERROR;
+            break;
         }
-    } while (read_flags & SAMFlag_SecondaryAlignment);
 
-    // this is a primary read, so read the read
-    GZREAD(align.l_seq);
-    GZFWD(sizeof(align.next_refID) +
-          sizeof(align.next_pos) +
-          sizeof(align.tlen));
+        if (fill_buffer( sizeof(int32) + block_size ) == false)
+            break;
 
-    // read in the name (and add a null-terminator just in case)
-    read_name_len = align.bin_mq_nl & 0xff;
-    data.read_name = (char *) malloc(read_name_len + 1);
-    data.read_name[read_name_len] = 0;
+        const char* record     = &m_buffer[0] + m_buffer_pos;
+        const char* record_end = record + sizeof(int32) + block_size;
+        m_buffer_pos += sizeof(int32) + block_size;
 
-    if (gzread(fp, data.read_name, read_name_len) != read_name_len)
-    {
-        log_error(stderr, "error processing BAM file (could not fetch read name)\n");
-        m_file_state = FILE_STREAM_ERROR;
-        return 0;
-    }
+        BAMRead read;
+        if (parse_record( record, record_end, &read ) == false)
+        {
+            log_error(stderr, "error processing BAM file (inconsistent alignment record)\n");
+            m_file_state = FILE_PARSE_ERROR;
+            break;
+        }
 
-    // skip the cigar
-    cigar_len = (align.flag_nc & 0xffff) * sizeof(uint32);
-    GZFWD(cigar_len);
+        // skip all non-primary reads
+        if (read.flags & SAMFlag_SecondaryAlignment)
+            continue;
 
-    // grab the read data
-    encoded_read_len = (align.l_seq + 1) / 2;
-    data.encoded_read = (uint8 *) malloc((align.l_seq + 1) / 2);
+        if (paired == false)
+        {
+            // skip records without a sequence (l_seq == 0), e.g. supplementary alignments
+            // whose sequence was omitted: empty reads trip an assertion in ReadDataRAM and
+            // can't be aligned anyway, and the TXT and SAM readers skip them as well
+            if (read.len == 0)
+                continue;
 
-    if (gzread(fp, data.encoded_read, encoded_read_len) != encoded_read_len)
-    {
-        log_error(stderr, "error processing BAM file (could not fetch sequence data)\n");
-        m_file_state = FILE_STREAM_ERROR;
-        return 0;
-    }
+            // add all strands of the read into the batch
+            push_read( output, read, n_ops, ops );
 
-    // read in the quality data
-    data.quality = (uint8 *) malloc(align.l_seq);
-    if (gzread(fp, data.quality, align.l_seq) != align.l_seq)
-    {
-        log_error(stderr, "error processing BAM file (could not fetch quality data)\n");
-        m_file_state = FILE_STREAM_ERROR;
-        return 0;
-    }
+            n_reads += n_ops;
+            n_bps   += n_ops * read.len;
+            continue;
+        }
 
-    // skip the rest of the read block
-    uint32 skip = align.block_size - (gztell(fp) - read_block_start);
-    GZFWD(skip);
+        // only keep the primary records of paired reads
+        if ((read.flags & SAMFlag_MultipleSegments) == 0 ||
+            (read.flags & SAMFlag_SupplementaryAlignment))
+            continue;
 
-    // decode the read data into a null-terminated string
-    data.decoded_read = (uint8 *) malloc(align.l_seq + 1);
-    data.decoded_read[align.l_seq] = 0;
+        // hold on to the first mate we see until the other one shows up
+        if (m_mate.empty())
+        {
+            m_mate.assign( record, record_end );
+            continue;
+        }
 
-    PackedStream<uint8*, uint8, 4, true> stream(data.encoded_read);
-    for(c = 0; c < align.l_seq; c++)
-    {
-        data.decoded_read[c] = decode_BAM_bp(stream[c]);
-    }
+        BAMRead mate;
+        parse_record( &m_mate[0], &m_mate[0] + m_mate.size(), &mate );
 
-    if (m_flags & FORWARD)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::REVERSE_COMPLEMENT_OP : ReadDataRAM::NO_OP;
-
-        // add the read into the batch
-        output->push_back(align.l_seq,
-                          data.read_name,
-                          data.decoded_read,
-                          data.quality,
-                          Phred,
-                          m_truncate_read_len,
-                          op );
-    }
-    if (m_flags & REVERSE)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::COMPLEMENT_OP : ReadDataRAM::REVERSE_OP;
-
-        output->push_back(align.l_seq,
-                          data.read_name,
-                          data.decoded_read,
-                          data.quality,
-                          Phred,
-                          m_truncate_read_len,
-                          op );
-    }
-    if (m_flags & FORWARD_COMPLEMENT)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::REVERSE_OP : ReadDataRAM::COMPLEMENT_OP;
-
-        output->push_back(align.l_seq,
-                          data.read_name,
-                          data.decoded_read,
-                          data.quality,
-                          Phred,
-                          m_truncate_read_len,
-                          op );
-    }
-    if (m_flags & REVERSE_COMPLEMENT)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::NO_OP : ReadDataRAM::REVERSE_COMPLEMENT_OP;
-
-        output->push_back(align.l_seq,
-                          data.read_name,
-                          data.decoded_read,
-                          data.quality,
-                          Phred,
-                          m_truncate_read_len,
-                          op );
-    }
+        if (mate.name_len != read.name_len || memcmp( mate.name, read.name, read.name_len ) != 0)
+        {
+            log_error(stderr, "error processing BAM file (the mates of %.*s are not adjacent; the file must be grouped by read name)\n", int(mate.name_len), mate.name);
+            m_file_state = FILE_PARSE_ERROR;
+            break;
+        }
+
+        const bool mate_first = (mate.flags & SAMFlag_FirstSegment) != 0;
+        if (mate_first == ((read.flags & SAMFlag_FirstSegment) != 0))
+        {
+            log_error(stderr, "error processing BAM file (read %.*s doesn't have exactly one first mate)\n", int(mate.name_len), mate.name);
+            m_file_state = FILE_PARSE_ERROR;
+            break;
+        }
+
+        // skip pairs where either mate lacks a sequence
+        if (read.len && mate.len)
+        {
+            // add all strands of the first mate, followed by the second's
+            push_read( output, mate_first ? mate : read, n_ops, ops );
+            push_read( output, mate_first ? read : mate, n_ops, ops );
 
-    // we always return 1 read at a time
-    return 1;
+            n_reads += n_mult;
+            n_bps   += n_ops * (read.len + mate.len);
+        }
+        m_mate.clear();
+    }
+    return n_reads;
 }
 
 ///@} // ReadsIODetail
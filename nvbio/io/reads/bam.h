@@ -23,6 +23,7 @@
 #include <nvbio/io/bam_format.h>
 #include <nvbio/io/reads/reads.h>
 #include <nvbio/io/reads/reads_priv.h>
+#include <nvbio/io/reads/bgzf.h>
 #include <nvbio/basic/console.h>
 
 namespace nvbio {
@@ -37,7 +38,8 @@ namespace io {
 ///@addtogroup ReadsIODetail
 ///@{
 
-/// ReadDataFile from a BAM file
+/// ReadDataFile from a BAM file: only primary records are loaded, and records without a
+/// sequence are skipped, along with their mate when loading paired reads
 ///
 struct ReadDataFile_BAM : public ReadDataFile
 {
@@ -56,13 +58,79 @@ struct ReadDataFile_BAM : public ReadDataFile
     ///
     bool init(void);
 
+    /// restrict the stream to the records starting in a shard of the compressed blocks of the file,
+    /// which must be in BGZF format as usual; the header is only parsed by init()
+    ///
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards);
+
 private:
+    /// the fields of an alignment record needed to load its read
+    ///
+    struct BAMRead
+    {
+        const char*  name;
+        uint32       name_len;
+        const uint8* seq;
+        const uint8* qual;
+        uint32       len;       // the read length, after truncation
+        uint32       flags;
+    };
+
+    /// locate the fields of an alignment record needed to load its read
+    ///
+    /// \return                 false if the record is inconsistent
+    ///
+    bool parse_record(const char* record, const char* record_end, BAMRead* read) const;
+
+    /// add all strands of a read to a batch
+    ///
+    void push_read(ReadDataRAM* output, const BAMRead& read, const uint32 n_ops, const ReadDataRAM::StrandOp* ops);
+
     /// small utility function to read data from the gzip stream
     ///
     bool readData(void *output, unsigned int len);
 
-    // our file pointer
-    gzFile fp;
+    /// make sure at least the given number of bytes past m_buffer_pos are available in m_buffer,
+    /// refilling it with as much data as possible
+    ///
+    bool fill_buffer(const uint32 needed);
+
+    // the amount of uncompressed data fetched at once
+    static const uint32 BUFFER_SIZE = 4*1024*1024;
+
+    // our file stream
+    BGZFReader fp;
+
+    // a buffer of uncompressed data, where whole alignment records are decoded in place
+    std::vector<char>  m_buffer;
+    uint32             m_buffer_size;
+    uint32             m_buffer_pos;
+
+    // scratch storage for the symbols of the current read
+    std::vector<uint8> m_symbols;
+
+    // a copy of the record of a mate waiting for its pair, when loading paired reads
+    std::vector<char>  m_mate;
+
+    // the number of reference sequences listed in the header
+    int32 m_n_ref;
+};
+
+/// locate the first BAM record starting past a given position, validating the fields of a few
+/// consecutive candidate records against each other
+///
+struct BAMRecordFinder : public RecordFinder
+{
+    /// constructor
+    ///
+    /// \param n_ref            the number of reference sequences listed in the header
+    ///
+    BAMRecordFinder(const int32 n_ref) : m_n_ref( n_ref ) {}
+
+    virtual const char* find(const char* begin, const char* end, const bool eof) const;
+
+private:
+    int32 m_n_ref;
 };
 
 ///@} // ReadsIODetail
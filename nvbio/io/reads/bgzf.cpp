@@ -0,0 +1,679 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/reads/bgzf.h>
+#include <nvbio/io/reads/reads_priv.h>
+#include <nvbio/basic/numbers.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace nvbio {
+namespace io {
+
+///@addtogroup IO
+///@{
+
+///@addtogroup ReadsIO
+///@{
+
+///@addtogroup ReadsIODetail
+///@{
+
+namespace {
+
+// size of the fixed portion of a BGZF block header, up to and including the XLEN field
+const uint32 BGZF_HEADER_SIZE = 12;
+// size of the gzip footer (CRC32 + ISIZE)
+const uint32 BGZF_FOOTER_SIZE = 8;
+
+// read a little-endian 16-bit integer
+inline uint32 read_le16(const uint8* p) { return uint32(p[0]) | (uint32(p[1]) << 8); }
+// read a little-endian 32-bit integer
+inline uint32 read_le32(const uint8* p) { return read_le16(p) | (read_le16(p + 2) << 16); }
+
+// check whether a header marks a BGZF block, and if so return the total block size
+// (see the samtools spec, http://samtools.sourceforge.net/SAMv1.pdf)
+uint32 bgzf_block_size(const uint8* header, const uint8* extra, const uint32 xlen)
+{
+    // check the gzip magic, the deflate method and the FEXTRA flag
+    if (header[0] != 31 || header[1] != 139 || header[2] != 8 || (header[3] & 4) == 0)
+        return 0;
+
+    // look for the BC subfield
+    for (uint32 i = 0; i + 4 <= xlen; )
+    {
+        const uint32 slen = read_le16( extra + i + 2 );
+        if (extra[i] == 66 && extra[i+1] == 67 && slen == 2 && i + 6 <= xlen)
+            return read_le16( extra + i + 4 ) + 1u;
+
+        i += 4 + slen;
+    }
+    return 0;
+}
+
+} // anonymous namespace
+
+BGZFReader::BGZFReader() :
+    m_gz_file( NULL ),
+    m_file( NULL ),
+    m_file_eof( false ),
+    m_file_size( 0 ),
+    m_comp_pos( 0 ),
+    m_limit( uint64(-1) ),
+    m_n_blocks( 0 ),
+    m_block( 0 ),
+    m_block_pos( 0 ),
+    m_pos( 0 ),
+    m_error( Z_OK )
+{}
+
+BGZFReader::~BGZFReader()
+{
+    close();
+}
+
+// open a file, detecting whether it's BGZF-compressed
+//
+bool BGZFReader::open(const char* file_name, const uint32 buffer_size)
+{
+    close();
+
+    // the standard input can't be peeked at, and goes straight to zlib
+    if (is_stdin( file_name ))
+    {
+        m_gz_file = gzopen_input( file_name, "rb" );
+        if (m_gz_file == NULL)
+            return false;
+
+        gzbuffer( m_gz_file, buffer_size );
+        return true;
+    }
+
+    m_file = fopen( file_name, "rb" );
+    if (m_file == NULL)
+        return false;
+
+    // peek at the first block header, unless the file can't be rewound (e.g. a pipe),
+    // in which case it is handed to zlib untouched
+    uint8 header[BGZF_HEADER_SIZE + 6];
+    const bool bgzf =
+        fseek( m_file, 0, SEEK_CUR ) == 0 &&
+        fread( header, 1u, sizeof(header), m_file ) == sizeof(header) &&
+        bgzf_block_size( header, header + BGZF_HEADER_SIZE, read_le16( header + 10 ) ) != 0;
+
+    if (bgzf)
+    {
+        fseek( m_file, 0, SEEK_END );
+        m_file_size = uint64( ftell( m_file ) );
+        fseek( m_file, 0, SEEK_SET );
+
+        m_comp_buffer.resize( NUM_BLOCKS * MAX_BLOCK_SIZE );
+        m_comp_sizes.resize( NUM_BLOCKS );
+        m_comp_offsets.resize( NUM_BLOCKS );
+        m_block_sizes.resize( NUM_BLOCKS );
+        m_buffer.resize( NUM_BLOCKS * MAX_BLOCK_SIZE );
+        return true;
+    }
+
+    // fall back to zlib's own stream, which handles plain gzip and uncompressed files
+    fclose( m_file );
+    m_file = NULL;
+
+    m_gz_file = gzopen( file_name, "rb" );
+    if (m_gz_file == NULL)
+        return false;
+
+    gzbuffer( m_gz_file, buffer_size );
+    return true;
+}
+
+// close the file
+//
+void BGZFReader::close()
+{
+    if (m_gz_file)
+        gzclose( m_gz_file );
+
+    if (m_file)
+        fclose( m_file );
+
+    m_gz_file   = NULL;
+    m_file      = NULL;
+    m_file_eof  = false;
+    m_file_size = 0;
+    m_comp_pos  = 0;
+    m_limit     = uint64(-1);
+    m_n_blocks  = 0;
+    m_block     = 0;
+    m_block_pos = 0;
+    m_pos       = 0;
+    m_error     = Z_OK;
+}
+
+// read the next compressed block from the file
+//
+uint32 BGZFReader::read_block(uint8* block)
+{
+    const uint32 n_read = uint32( fread( block, 1u, BGZF_HEADER_SIZE, m_file ) );
+    if (n_read < BGZF_HEADER_SIZE)
+    {
+        m_file_eof = true;
+
+        // a truncated header is an error, a clean end of file is not
+        if (n_read)
+            m_error = Z_DATA_ERROR;
+        return 0;
+    }
+
+    // read the extra subfields
+    const uint32 xlen = read_le16( block + 10 );
+    if (BGZF_HEADER_SIZE + xlen > MAX_BLOCK_SIZE ||
+        fread( block + BGZF_HEADER_SIZE, 1u, xlen, m_file ) != xlen)
+    {
+        m_error = Z_DATA_ERROR;
+        return 0;
+    }
+
+    const uint32 block_size = bgzf_block_size( block, block + BGZF_HEADER_SIZE, xlen );
+    if (block_size < BGZF_HEADER_SIZE + xlen + BGZF_FOOTER_SIZE || block_size > MAX_BLOCK_SIZE)
+    {
+        // not a BGZF block
+        m_error = Z_DATA_ERROR;
+        return 0;
+    }
+
+    // read the rest of the block
+    const uint32 remaining = block_size - BGZF_HEADER_SIZE - xlen;
+    if (fread( block + BGZF_HEADER_SIZE + xlen, 1u, remaining, m_file ) != remaining)
+    {
+        m_error = Z_DATA_ERROR;
+        return 0;
+    }
+    return block_size;
+}
+
+// inflate a single block
+//
+int32 BGZFReader::inflate_block(const uint8* block, const uint32 block_size, uint8* output)
+{
+    const uint32 xlen   = read_le16( block + 10 );
+    const uint8* data   = block + BGZF_HEADER_SIZE + xlen;
+    const uint8* footer = block + block_size - BGZF_FOOTER_SIZE;
+
+    const uint32 crc   = read_le32( footer );
+    const uint32 isize = read_le32( footer + 4 );
+    if (isize > MAX_BLOCK_SIZE)
+        return -1;
+
+    // initialize a raw inflate stream
+    z_stream stream;
+    stream.zalloc   = Z_NULL;
+    stream.zfree    = Z_NULL;
+    stream.opaque   = Z_NULL;
+    stream.next_in  = (Bytef*)data;
+    stream.avail_in = uint32( footer - data );
+
+    if (inflateInit2( &stream, -15 ) != Z_OK)
+        return -1;
+
+    stream.next_out  = (Bytef*)output;
+    stream.avail_out = MAX_BLOCK_SIZE;
+
+    const int ret = inflate( &stream, Z_FINISH );
+    inflateEnd( &stream );
+
+    if (ret != Z_STREAM_END || stream.total_out != isize)
+        return -1;
+
+    // check the CRC
+    if (crc32( crc32( 0L, Z_NULL, 0 ), output, isize ) != crc)
+        return -1;
+
+    return int32( isize );
+}
+
+// read and inflate the next batch of blocks
+//
+bool BGZFReader::fill_blocks()
+{
+    m_n_blocks  = 0;
+    m_block     = 0;
+    m_block_pos = 0;
+
+    if (m_file_eof || m_error != Z_OK)
+        return false;
+
+    // read a batch of compressed blocks, stopping at the first one past the stream limit
+    while (m_n_blocks < NUM_BLOCKS && (m_comp_pos << 16) < m_limit)
+    {
+        const uint32 block_size = read_block( &m_comp_buffer[0] + m_n_blocks * MAX_BLOCK_SIZE );
+        if (block_size == 0)
+            break;
+
+        m_comp_offsets[ m_n_blocks ] = m_comp_pos;
+        m_comp_sizes[ m_n_blocks++ ] = block_size;
+        m_comp_pos += block_size;
+    }
+
+    if (m_error != Z_OK)
+        return false;
+
+    // and inflate them in parallel
+    const int n_blocks = int( m_n_blocks );
+
+    #pragma omp parallel for
+    for (int i = 0; i < n_blocks; ++i)
+    {
+        m_block_sizes[i] = inflate_block(
+            &m_comp_buffer[0] + i * MAX_BLOCK_SIZE,
+            m_comp_sizes[i],
+            &m_buffer[0]      + i * MAX_BLOCK_SIZE );
+    }
+
+    for (int i = 0; i < n_blocks; ++i)
+    {
+        if (m_block_sizes[i] < 0)
+        {
+            m_error = Z_DATA_ERROR;
+            return false;
+        }
+    }
+    return m_n_blocks > 0;
+}
+
+// return the number of uncompressed bytes available in the current block before the stream limit,
+// moving to the next non-empty block and fetching more of them if needed
+//
+uint32 BGZFReader::available()
+{
+    while (1)
+    {
+        if (m_block >= m_n_blocks)
+        {
+            if (fill_blocks() == false)
+                return 0;
+        }
+
+        const uint64 block_offset = m_comp_offsets[ m_block ];
+        if (((block_offset << 16) | m_block_pos) >= m_limit)
+            return 0;
+
+        uint32 n_avail = uint32( m_block_sizes[ m_block ] ) - m_block_pos;
+
+        // the limit might fall inside this block
+        if ((m_limit >> 16) == block_offset)
+            n_avail = nvbio::min( n_avail, uint32( m_limit & 0xFFFFu ) - m_block_pos );
+
+        if (n_avail)
+            return n_avail;
+
+        // skip empty blocks, e.g. the end-of-file marker
+        m_block++;
+        m_block_pos = 0;
+    }
+}
+
+// read up to len uncompressed bytes
+//
+int BGZFReader::read(void* output, const uint32 len)
+{
+    if (m_gz_file)
+    {
+        const int n = gzread( m_gz_file, output, len );
+        if (n > 0)
+            m_pos += uint64( n );
+        return n;
+    }
+
+    uint8* dst = (uint8*)output;
+    uint32 n   = 0;
+
+    while (n < len)
+    {
+        // fetch more blocks if needed
+        const uint32 n_avail = available();
+        if (n_avail == 0)
+            break;
+
+        const uint32 block_size = uint32( m_block_sizes[ m_block ] );
+        const uint32 n_copy     = nvbio::min( len - n, n_avail );
+
+        memcpy( dst + n, &m_buffer[0] + m_block * MAX_BLOCK_SIZE + m_block_pos, n_copy );
+
+        n           += n_copy;
+        m_block_pos += n_copy;
+
+        // advance to the next block
+        if (m_block_pos == block_size)
+        {
+            m_block++;
+            m_block_pos = 0;
+        }
+    }
+
+    m_pos += n;
+
+    if (n == 0 && m_error != Z_OK)
+        return -1;
+
+    return int( n );
+}
+
+// skip a given number of uncompressed bytes
+//
+uint64 BGZFReader::skip(const uint64 len)
+{
+    if (m_gz_file)
+    {
+        // read and discard the data rather than calling gzseek, which would try to
+        // seek the underlying file when it's not compressed, failing on pipes
+        if (m_buffer.size() < MAX_BLOCK_SIZE)
+            m_buffer.resize( MAX_BLOCK_SIZE );
+
+        uint64 n = 0;
+        while (n < len)
+        {
+            const int n_read = read( &m_buffer[0], uint32( nvbio::min( len - n, uint64( MAX_BLOCK_SIZE ) ) ) );
+            if (n_read <= 0)
+                break;
+
+            n += uint64( n_read );
+        }
+        return n;
+    }
+
+    uint64 n = 0;
+    while (n < len)
+    {
+        // fetch more blocks if needed
+        const uint32 n_avail = available();
+        if (n_avail == 0)
+            break;
+
+        const uint32 block_size = uint32( m_block_sizes[ m_block ] );
+        const uint32 n_skip     = uint32( nvbio::min( len - n, uint64( n_avail ) ) );
+
+        n           += n_skip;
+        m_block_pos += n_skip;
+
+        // advance to the next block
+        if (m_block_pos == block_size)
+        {
+            m_block++;
+            m_block_pos = 0;
+        }
+    }
+
+    m_pos += n;
+    return n;
+}
+
+// return the position in the uncompressed stream
+//
+uint64 BGZFReader::tell() const
+{
+    return m_pos;
+}
+
+// return true if a read went past the end of the file
+//
+bool BGZFReader::eof() const
+{
+    if (m_gz_file)
+        return gzeof( m_gz_file ) ? true : false;
+
+    return m_error == Z_OK && ((m_file_eof && m_block >= m_n_blocks) || virtual_tell() >= m_limit);
+}
+
+// return a description of the last error, mirroring gzerror()
+//
+const char* BGZFReader::error(int* errnum)
+{
+    if (m_gz_file)
+        return gzerror( m_gz_file, errnum );
+
+    *errnum = m_error;
+    return m_error == Z_OK ? "" : "corrupted BGZF block";
+}
+
+// return the virtual offset of the current position
+//
+uint64 BGZFReader::virtual_tell() const
+{
+    if (m_block < m_n_blocks)
+        return (m_comp_offsets[ m_block ] << 16) | m_block_pos;
+
+    return m_comp_pos << 16;
+}
+
+// move to a given virtual offset
+//
+bool BGZFReader::virtual_seek(const uint64 voffset)
+{
+    if (m_file == NULL)
+        return false;
+
+    m_n_blocks  = 0;
+    m_block     = 0;
+    m_block_pos = 0;
+    m_file_eof  = false;
+    m_error     = Z_OK;
+    m_comp_pos  = voffset >> 16;
+
+    if (fseek( m_file, long( m_comp_pos ), SEEK_SET ) != 0)
+        return false;
+
+    // position the stream inside the first block
+    const uint32 block_pos = uint32( voffset & 0xFFFFu );
+    if (block_pos)
+    {
+        if (fill_blocks() == false || uint32( m_block_sizes[0] ) < block_pos)
+            return false;
+
+        m_block_pos = block_pos;
+    }
+    return true;
+}
+
+// locate the first block starting at or past a file offset
+//
+uint64 BGZFReader::find_block(const uint64 offset)
+{
+    // any offset is followed by a block header within MAX_BLOCK_SIZE bytes, and the header
+    // of the following block can be found within MAX_BLOCK_SIZE more
+    std::vector<uint8> window( 2u * MAX_BLOCK_SIZE + BGZF_HEADER_SIZE + 6u );
+
+    if (fseek( m_file, long( offset ), SEEK_SET ) != 0)
+        return m_file_size;
+
+    const uint32 n_read = uint32( fread( &window[0], 1u, window.size(), m_file ) );
+
+    for (uint32 i = 0; i + BGZF_HEADER_SIZE <= n_read; ++i)
+    {
+        const uint32 xlen = read_le16( &window[i] + 10 );
+        if (i + BGZF_HEADER_SIZE + xlen > n_read)
+            continue;
+
+        const uint32 block_size = bgzf_block_size( &window[i], &window[i] + BGZF_HEADER_SIZE, xlen );
+        if (block_size == 0)
+            continue;
+
+        // check the next block header, to avoid being fooled by compressed data looking like one
+        const uint32 next = i + block_size;
+        if (offset + next == m_file_size)
+            return offset + i;
+
+        if (next + BGZF_HEADER_SIZE <= n_read)
+        {
+            const uint32 next_xlen = read_le16( &window[next] + 10 );
+            if (next + BGZF_HEADER_SIZE + next_xlen <= n_read &&
+                bgzf_block_size( &window[next], &window[next] + BGZF_HEADER_SIZE, next_xlen ))
+                return offset + i;
+        }
+    }
+    return m_file_size;
+}
+
+// return the virtual offset of the first record boundary found past the start of the first block
+// at or past a given file offset
+//
+uint64 BGZFReader::find_record(const uint64 offset, const RecordFinder& finder)
+{
+    uint64 comp_pos = find_block( offset );
+    if (comp_pos >= m_file_size || fseek( m_file, long( comp_pos ), SEEK_SET ) != 0)
+        return m_file_size << 16;
+
+    std::vector<uint8>  block( MAX_BLOCK_SIZE );
+    std::vector<char>   data;
+    std::vector<uint64> block_offsets;
+    std::vector<uint32> block_starts;
+
+    m_file_eof = false;
+
+    // inflate as many blocks as needed to locate the boundary
+    while (1)
+    {
+        const uint32 block_size = read_block( &block[0] );
+        if (block_size == 0 && m_error != Z_OK)
+            return uint64(-1);
+
+        const bool eof = block_size == 0;
+        if (eof == false)
+        {
+            const uint32 start = uint32( data.size() );
+            data.resize( start + MAX_BLOCK_SIZE );
+
+            const int32 size = inflate_block( &block[0], block_size, (uint8*)&data[0] + start );
+            if (size < 0)
+            {
+                m_error = Z_DATA_ERROR;
+                return uint64(-1);
+            }
+            data.resize( start + size );
+
+            block_offsets.push_back( comp_pos );
+            block_starts.push_back( start );
+            comp_pos += block_size;
+        }
+
+        if (data.empty() == false)
+        {
+            const char* begin    = &data[0];
+            const char* end      = begin + data.size();
+            const char* boundary = finder.find( begin, end, eof );
+            if (boundary < end)
+            {
+                // map the boundary back to its block, skipping any empty ones
+                const uint32 pos = uint32( boundary - begin );
+                const uint32 k   = uint32( std::upper_bound( block_starts.begin(), block_starts.end(), pos ) - block_starts.begin() ) - 1u;
+                return (block_offsets[k] << 16) | (pos - block_starts[k]);
+            }
+        }
+        if (eof)
+            return m_file_size << 16;
+    }
+}
+
+// restrict the stream to the records starting in the given shard of the file
+//
+bool BGZFReader::select_shard(const uint32 shard, const uint32 n_shards, const RecordFinder& finder)
+{
+    if (m_file == NULL || shard >= n_shards)
+        return false;
+
+    // records before the current position are never part of any shard
+    const uint64 start    = virtual_tell();
+    const bool   file_eof = m_file_eof;
+
+    const uint64 begin = shard ?
+        find_record( m_file_size * shard / n_shards, finder ) : start;
+
+    const uint64 end = shard + 1u < n_shards ?
+        find_record( m_file_size * (shard + 1u) / n_shards, finder ) : uint64(-1);
+
+    if (begin == uint64(-1) || (shard + 1u < n_shards && end == uint64(-1)))
+        return false;
+
+    if (nvbio::max( begin, start ) != start)
+    {
+        if (virtual_seek( begin ) == false)
+            return false;
+    }
+    else
+    {
+        // restore the file position, moved while looking for the boundaries
+        m_file_eof = file_eof;
+        m_error    = Z_OK;
+        if (fseek( m_file, long( m_comp_pos ), SEEK_SET ) != 0)
+            return false;
+    }
+
+    m_limit = nvbio::max( end, start );
+    return true;
+}
+
+// return whether a file name refers to the standard input
+//
+bool is_stdin(const char* file_name)
+{
+    return strcmp( file_name, "-" ) == 0 || strcmp( file_name, "/dev/stdin" ) == 0;
+}
+
+// open a zlib stream on a file, or on a duplicate of the standard input's descriptor
+//
+gzFile gzopen_input(const char* file_name, const char* mode)
+{
+    if (is_stdin( file_name ) == false)
+        return gzopen( file_name, mode );
+
+#ifdef WIN32
+    const int fd = _dup( _fileno( stdin ) );
+    if (fd >= 0)
+        _setmode( fd, _O_BINARY );
+#else
+    const int fd = dup( fileno( stdin ) );
+#endif
+    if (fd < 0)
+        return NULL;
+
+    gzFile file = gzdopen( fd, mode );
+    if (file == NULL)
+    {
+#ifdef WIN32
+        _close( fd );
+#else
+        ::close( fd );
+#endif
+    }
+
+    return file;
+}
+
+///@} // ReadsIODetail
+///@} // ReadsIO
+///@} // IO
+
+} // namespace io
+} // namespace nvbio
@@ -0,0 +1,211 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/basic/types.h>
+#include <zlib/zlib.h>
+#include <stdio.h>
+#include <vector>
+
+namespace nvbio {
+namespace io {
+
+///@addtogroup IO
+///@{
+
+///@addtogroup ReadsIO
+///@{
+
+///@addtogroup ReadsIODetail
+///@{
+
+struct RecordFinder;
+
+///
+/// A compressed input stream supporting multi-threaded BGZF decompression.
+///
+/// BGZF files (BAM files, or files compressed with bgzip) are made of a sequence of independent
+/// gzip members, each holding at most 64KB of uncompressed data.
+/// When such a file is detected, batches of up to NUM_BLOCKS compressed blocks are read from disk
+/// by the calling thread and inflated in parallel with OpenMP, and the uncompressed blocks are then
+/// returned in file order.
+/// Any other file (plain gzip or uncompressed) is read through zlib's gzread, exactly as before.
+/// The standard input (see is_stdin()) is always read through gzread, as it can't be rewound
+/// after peeking at its first block; positions are then tracked without ever calling gzseek()
+/// or gztell(), so that pipes can be streamed as well.
+///
+/// The read() interface mirrors gzread(), so that this class can replace a gzFile in any of
+/// the fillBuffer() implementations.
+///
+/// BGZF files can also be split in shards at block boundaries, so that several processes can
+/// each read a disjoint portion of the same file without inflating the rest of it.
+/// Positions within a BGZF file are expressed as virtual offsets, i.e. the file offset of
+/// a block shifted left by 16 bits, or-ed with an offset within its uncompressed data.
+///
+struct BGZFReader
+{
+    static const uint32 MAX_BLOCK_SIZE = 64*1024;   ///< maximum compressed and uncompressed size of a BGZF block
+    static const uint32 NUM_BLOCKS     = 128;       ///< number of blocks inflated in parallel
+
+    /// constructor
+    ///
+    BGZFReader();
+
+    /// destructor
+    ///
+    ~BGZFReader();
+
+    /// open a file, detecting whether it's BGZF-compressed
+    ///
+    /// \param file_name        the name of the file to open
+    /// \param buffer_size      the size of zlib's internal buffer for non-BGZF files
+    ///
+    /// \return                 true on success, false if the file couldn't be opened
+    ///
+    bool open(const char* file_name, const uint32 buffer_size = 64*1024u);
+
+    /// close the file
+    ///
+    void close();
+
+    /// return whether a file is open
+    ///
+    bool is_open() const { return m_file != NULL || m_gz_file != NULL; }
+
+    /// return whether the file is in BGZF format
+    ///
+    bool is_bgzf() const { return m_file != NULL; }
+
+    /// read up to len uncompressed bytes
+    ///
+    /// \return                 the number of bytes read, 0 at the end of file, or -1 on errors
+    ///
+    int read(void* output, const uint32 len);
+
+    /// skip a given number of uncompressed bytes
+    ///
+    /// \return                 the number of bytes skipped
+    ///
+    uint64 skip(const uint64 len);
+
+    /// return the position in the uncompressed stream
+    ///
+    uint64 tell() const;
+
+    /// return true if a read went past the end of the file
+    ///
+    bool eof() const;
+
+    /// return a description of the last error, mirroring gzerror()
+    ///
+    const char* error(int* errnum);
+
+    /// return the virtual offset of the current position (BGZF files only)
+    ///
+    uint64 virtual_tell() const;
+
+    /// move to a given virtual offset (BGZF files only)
+    ///
+    /// \return                 false on errors
+    ///
+    bool virtual_seek(const uint64 voffset);
+
+    /// restrict the stream to the records starting in the given shard of the file, assigning each
+    /// record to the shard containing the compressed block where the finder locates it (BGZF files only);
+    /// records before the current position, e.g. a file header, are never part of any shard
+    ///
+    /// \param shard            the index of the shard to select
+    /// \param n_shards         the number of shards the file is split into
+    /// \param finder           the object used to locate record boundaries in the uncompressed data
+    ///
+    /// \return                 false if the file is not in BGZF format or on errors
+    ///
+    bool select_shard(const uint32 shard, const uint32 n_shards, const RecordFinder& finder);
+
+private:
+    /// return the number of uncompressed bytes available in the current block before
+    /// the stream limit, moving to the next non-empty block and fetching more of them if needed
+    ///
+    uint32 available();
+
+    /// locate the first block starting at or past a file offset, checking that it's followed
+    /// by another block (or by the end of the file)
+    ///
+    /// \return                 the block offset, or the file size if there is none
+    ///
+    uint64 find_block(const uint64 offset);
+
+    /// return the virtual offset of the first record boundary found past the start of
+    /// the first block at or past a given file offset, or of the end of file if there is none
+    ///
+    uint64 find_record(const uint64 offset, const RecordFinder& finder);
+
+    /// read and inflate the next batch of blocks
+    ///
+    /// \return                 false at the end of the file or on errors
+    ///
+    bool fill_blocks();
+
+    /// read the next compressed block from the file
+    ///
+    /// \return                 the block size, or 0 at the end of file or on errors
+    ///
+    uint32 read_block(uint8* block);
+
+    /// inflate a single block
+    ///
+    /// \return                 the uncompressed size, or -1 on errors
+    ///
+    static int32 inflate_block(const uint8* block, const uint32 block_size, uint8* output);
+
+    gzFile              m_gz_file;          // the zlib file, for non-BGZF inputs
+    FILE*               m_file;             // the raw file, for BGZF inputs
+    bool                m_file_eof;         // set when the raw file reached its end
+    uint64              m_file_size;        // the raw file size
+    uint64              m_comp_pos;         // the file offset of the next block to read
+    uint64              m_limit;            // the virtual offset where the stream ends
+
+    std::vector<uint8>  m_comp_buffer;      // compressed blocks of the current batch
+    std::vector<uint32> m_comp_sizes;       // compressed block sizes
+    std::vector<uint64> m_comp_offsets;     // compressed block file offsets
+    std::vector<int32>  m_block_sizes;      // uncompressed block sizes
+    std::vector<uint8>  m_buffer;           // uncompressed blocks of the current batch
+    uint32              m_n_blocks;         // number of blocks in the current batch
+    uint32              m_block;            // current block
+    uint32              m_block_pos;        // read position in the current block
+    uint64              m_pos;              // uncompressed bytes consumed so far
+
+    int                 m_error;            // last error code
+};
+
+/// return whether a file name refers to the standard input, i.e. "-" or "/dev/stdin"
+///
+bool is_stdin(const char* file_name);
+
+/// open a zlib stream on a file, or on a duplicate of the standard input's descriptor
+/// if the name refers to it (see is_stdin()), so that closing the stream leaves stdin alone
+///
+gzFile gzopen_input(const char* file_name, const char* mode);
+
+///@} // ReadsIODetail
+///@} // ReadsIO
+///@} // IO
+
+} // namespace io
+} // namespace nvbio
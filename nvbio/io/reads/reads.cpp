@@ -22,127 +22,297 @@
 #include <nvbio/io/reads/reads_txt.h>
 #include <nvbio/io/reads/sam.h>
 #include <nvbio/io/reads/bam.h>
+#include <nvbio/io/reads/reads_archive.h>
+#include <nvbio/io/reads/bgzf.h>
 #include <nvbio/basic/console.h>
 #include <nvbio/basic/vector_view.h>
 #include <nvbio/basic/timer.h>
+#include <nvbio/basic/byte_scan.h>
 #include <cuda_runtime.h>
 
 #include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NVBIO_READS_ENCODE_SSE2
+#endif
 
 namespace nvbio {
 namespace io {
 
-// factory method to open a read file, tries to detect file type based on file name
-ReadDataStream *open_read_file(const char*           read_file_name,
-                               const QualityEncoding qualities,
-                               const uint32          max_reads,
-                               const uint32          truncate_read_len,
-                               const ReadEncoding    flags)
+// open a FASTQ file, parsing it in place from a memory mapping if possible
+//
+static ReadDataStream *open_fastq_file(const char*           read_file_name,
+                                       const bool            mappable,
+                                       const QualityEncoding qualities,
+                                       const uint32          max_reads,
+                                       const uint32          truncate_read_len,
+                                       const ReadEncoding    flags,
+                                       const uint32          n_threads)
 {
-    // parse out file extension; look for .fastq.gz, .fastq suffixes
-    uint32 len = uint32( strlen(read_file_name) );
-    bool is_gzipped = false;
-
-    // do we have a .gz suffix?
-    if (len >= strlen(".gz"))
+    if (mappable)
     {
-        if (strcmp(&read_file_name[len - strlen(".gz")], ".gz") == 0)
-        {
-            is_gzipped = true;
-            len = uint32(len - strlen(".gz"));
-        }
+        ReadDataFile_FASTQ_mmap* file = new ReadDataFile_FASTQ_mmap(read_file_name,
+                                                                    qualities,
+                                                                    max_reads,
+                                                                    truncate_read_len,
+                                                                    flags,
+                                                                    n_threads);
+        if (file->is_ok())
+            return file;
+
+        // fall back to the buffered loader, e.g. for pipes or compressed files without a .gz suffix
+        delete file;
     }
+    return new ReadDataFile_FASTQ_gz(read_file_name,
+                                     qualities,
+                                     max_reads,
+                                     truncate_read_len,
+                                     flags,
+                                     n_threads);
+}
 
-    // check for fastq suffix
-    if (len >= strlen(".fastq"))
+// open a TXT file, parsing it in place from a memory mapping if possible
+//
+static ReadDataStream *open_txt_file(const char*           read_file_name,
+                                     const bool            mappable,
+                                     const QualityEncoding qualities,
+                                     const uint32          max_reads,
+                                     const uint32          truncate_read_len,
+                                     const ReadEncoding    flags)
+{
+    if (mappable)
     {
-        if (strncmp(&read_file_name[len - strlen(".fastq")], ".fastq", strlen(".fastq")) == 0)
-        {
-            return new ReadDataFile_FASTQ_gz(read_file_name,
-                                             qualities,
-                                             max_reads,
-                                             truncate_read_len,
-                                             flags);
-        }
+        ReadDataFile_TXT_mmap* file = new ReadDataFile_TXT_mmap(read_file_name,
+                                                                qualities,
+                                                                max_reads,
+                                                                truncate_read_len,
+                                                                flags);
+        if (file->is_ok())
+            return file;
+
+        // fall back to the buffered loader, e.g. for pipes or compressed files without a .gz suffix
+        delete file;
     }
+    return new ReadDataFile_TXT_gz(read_file_name,
+                                   qualities,
+                                   max_reads,
+                                   truncate_read_len,
+                                   flags);
+}
 
-    // check for fastq suffix
-    if (len >= strlen(".fq"))
+// open a read file of a given format
+//
+static ReadDataStream *open_read_file_as(const char*           read_file_name,
+                                         const ReadFileFormat  format,
+                                         const bool            mappable,
+                                         const QualityEncoding qualities,
+                                         const uint32          max_reads,
+                                         const uint32          truncate_read_len,
+                                         const ReadEncoding    flags,
+                                         const uint32          n_threads)
+{
+    switch (format)
+    {
+    case READ_FORMAT_TXT:
+        return open_txt_file(read_file_name,
+                             mappable,
+                             qualities,
+                             max_reads,
+                             truncate_read_len,
+                             flags);
+
+    case READ_FORMAT_SAM:
     {
-        if (strncmp(&read_file_name[len - strlen(".fq")], ".fq", strlen(".fq")) == 0)
+        ReadDataFile_SAM *ret;
+
+        ret = new ReadDataFile_SAM(read_file_name,
+                                   max_reads,
+                                   truncate_read_len,
+                                   flags);
+
+        if (ret->init() == false)
         {
-            return new ReadDataFile_FASTQ_gz(read_file_name,
-                                             qualities,
-                                             max_reads,
-                                             truncate_read_len,
-                                             flags);
+            delete ret;
+            return NULL;
         }
+
+        return ret;
     }
 
-    // check for txt suffix
-    if (len >= strlen(".txt"))
+    case READ_FORMAT_BAM:
     {
-        if (strncmp(&read_file_name[len - strlen(".txt")], ".txt", strlen(".txt")) == 0)
+        ReadDataFile_BAM *ret;
+
+        ret = new ReadDataFile_BAM(read_file_name,
+                                   max_reads,
+                                   truncate_read_len,
+                                   flags);
+
+        if (ret->init() == false)
         {
-            return new ReadDataFile_TXT_gz(read_file_name,
-                                           qualities,
-                                           max_reads,
-                                           truncate_read_len,
-                                           flags);
+            delete ret;
+            return NULL;
         }
+
+        return ret;
     }
 
-    // check for sam suffix
-    if (len >= strlen(".sam"))
+    default:
+        return open_fastq_file(read_file_name,
+                               mappable,
+                               qualities,
+                               max_reads,
+                               truncate_read_len,
+                               flags,
+                               n_threads);
+    }
+}
+
+// check whether a file name, stripped of its last len characters, ends with a given suffix
+//
+static bool has_suffix(const char* file_name, const uint32 len, const char* suffix)
+{
+    const uint32 suffix_len = uint32( strlen(suffix) );
+    return len >= suffix_len && strncmp(&file_name[len - suffix_len], suffix, suffix_len) == 0;
+}
+
+// open a read file, detecting its type based on the file name unless a format is given
+//
+static ReadDataStream *open_read_file_by_type(const char*           read_file_name,
+                                              const ReadFileFormat  format,
+                                              const QualityEncoding qualities,
+                                              const uint32          max_reads,
+                                              const uint32          truncate_read_len,
+                                              const ReadEncoding    flags,
+                                              const uint32          n_threads)
+{
+    // the standard input is streamed, and its format can't be told from its name
+    if (is_stdin(read_file_name))
     {
-        if (strncmp(&read_file_name[len - strlen(".sam")], ".sam", strlen(".sam")) == 0)
-        {
-            ReadDataFile_SAM *ret;
+        return open_read_file_as(read_file_name,
+                                 format == READ_FORMAT_AUTO ? READ_FORMAT_FASTQ : format,
+                                 false,
+                                 qualities,
+                                 max_reads,
+                                 truncate_read_len,
+                                 flags,
+                                 n_threads);
+    }
 
-            ret = new ReadDataFile_SAM(read_file_name,
-                                       max_reads,
-                                       truncate_read_len,
-                                       flags);
+    // parse out file extension; look for .fastq.gz, .fastq suffixes
+    uint32 len = uint32( strlen(read_file_name) );
+    bool is_gzipped = false;
 
-            if (ret->init() == false)
-            {
-                delete ret;
-                return NULL;
-            }
+    // do we have a .gz suffix?
+    if (has_suffix(read_file_name, len, ".gz"))
+    {
+        is_gzipped = true;
+        len = uint32(len - strlen(".gz"));
+    }
 
-            return ret;
-        }
+    // an explicit format overrides the suffix
+    if (format != READ_FORMAT_AUTO)
+    {
+        return open_read_file_as(read_file_name,
+                                 format,
+                                 is_gzipped == false,
+                                 qualities,
+                                 max_reads,
+                                 truncate_read_len,
+                                 flags,
+                                 n_threads);
     }
 
+    ReadFileFormat detected = READ_FORMAT_AUTO;
+
+    // check for fastq suffixes
+    if (has_suffix(read_file_name, len, ".fastq") ||
+        has_suffix(read_file_name, len, ".fq"))
+        detected = READ_FORMAT_FASTQ;
+
+    // check for txt suffix
+    else if (has_suffix(read_file_name, len, ".txt"))
+        detected = READ_FORMAT_TXT;
+
+    // check for sam suffix
+    else if (has_suffix(read_file_name, len, ".sam"))
+        detected = READ_FORMAT_SAM;
+
     // check for bam suffix
-    if (len >= strlen(".bam"))
+    else if (has_suffix(read_file_name, len, ".bam"))
+        detected = READ_FORMAT_BAM;
+
+    // check for a read archive
+    else if (is_gzipped == false && has_suffix(read_file_name, len, ".nvr"))
     {
-        if (strncmp(&read_file_name[len - strlen(".bam")], ".bam", strlen(".bam")) == 0)
-        {
-            ReadDataFile_BAM *ret;
+        ReadDataFile_Archive* ret = new ReadDataFile_Archive(
+            read_file_name,
+            max_reads,
+            truncate_read_len,
+            flags);
 
-            ret = new ReadDataFile_BAM(read_file_name,
-                                       max_reads,
-                                       truncate_read_len,
-                                       flags);
+        if (ret->is_ok() == false)
+        {
+            delete ret;
+            return NULL;
+        }
 
-            if (ret->init() == false)
-            {
-                delete ret;
-                return NULL;
-            }
+        return ret;
+    }
 
-            return ret;
-        }
+    if (detected == READ_FORMAT_AUTO)
+    {
+        // we don't actually know what this is; guess fastq
+        log_warning(stderr, "could not determine file type for %s; guessing %sfastq\n", read_file_name, is_gzipped ? "compressed " : "");
+        detected = READ_FORMAT_FASTQ;
     }
 
-    // we don't actually know what this is; guess fastq
-    log_warning(stderr, "could not determine file type for %s; guessing %sfastq\n", read_file_name, is_gzipped ? "compressed " : "");
-    return new ReadDataFile_FASTQ_gz(read_file_name,
-                                     qualities,
-                                     max_reads,
-                                     truncate_read_len,
-                                     flags);
+    return open_read_file_as(read_file_name,
+                             detected,
+                             is_gzipped == false,
+                             qualities,
+                             max_reads,
+                             truncate_read_len,
+                             flags,
+                             n_threads);
+}
+
+// factory method to open a read file, tries to detect file type based on file name
+ReadDataStream *open_read_file(const char*           read_file_name,
+                               const QualityEncoding qualities,
+                               const uint32          max_reads,
+                               const uint32          truncate_read_len,
+                               const ReadEncoding    flags,
+                               const uint32          n_threads,
+                               const uint32          load_flags,
+                               const uint32          shard,
+                               const uint32          n_shards,
+                               const ReadFileFormat  format)
+{
+    ReadDataStream* ret = open_read_file_by_type(
+        read_file_name,
+        format,
+        qualities,
+        max_reads,
+        truncate_read_len,
+        flags,
+        n_threads );
+
+    if (ret == NULL)
+        return NULL;
+
+    // the load flags are only consulted while parsing, i.e. past the initialization of the stream
+    ret->m_load_flags = load_flags;
+
+    if (n_shards > 1u && ret->is_ok() && ret->select_shard( shard, n_shards ) == false)
+    {
+        log_error(stderr, "unable to select shard %u of %u of \"%s\": only uncompressed or BGZF-compressed files can be split\n", shard, n_shards, read_file_name);
+        delete ret;
+        return NULL;
+    }
+    return ret;
 }
 
 namespace { // anonymous
@@ -261,10 +431,247 @@ inline unsigned char complement_bp(unsigned char bp)
     }
 }
 
+#if defined(NVBIO_READS_ENCODE_SSE2)
+
+// reverse the order of the 16 bytes of a vector
+inline __m128i reverse_bytes(__m128i x)
+{
+    x = _mm_shuffle_epi32( x, _MM_SHUFFLE(0,1,2,3) );
+    x = _mm_shufflelo_epi16( x, _MM_SHUFFLE(2,3,0,1) );
+    x = _mm_shufflehi_epi16( x, _MM_SHUFFLE(2,3,0,1) );
+    return _mm_or_si128( _mm_slli_epi16( x, 8 ), _mm_srli_epi16( x, 8 ) );
+}
+
+#endif
+
+// convert a run of ASCII base pairs to 4-bit symbols, as nst_nt4_encode() does
+//
+void encode_bps(const uint32 n, const uint8* bps, uint8* symbols)
+{
+    uint32 i = 0;
+
+#if defined(NVBIO_READS_ENCODE_SSE2)
+    const __m128i case_mask = _mm_set1_epi8( char(0xDF) );
+    const __m128i A         = _mm_set1_epi8( 'A' );
+    const __m128i C         = _mm_set1_epi8( 'C' );
+    const __m128i G         = _mm_set1_epi8( 'G' );
+    const __m128i T         = _mm_set1_epi8( 'T' );
+    const __m128i dash      = _mm_set1_epi8( '-' );
+    const __m128i one       = _mm_set1_epi8( 1 );
+    const __m128i two       = _mm_set1_epi8( 2 );
+    const __m128i three     = _mm_set1_epi8( 3 );
+    const __m128i four      = _mm_set1_epi8( 4 );
+
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>( bps + i ) );
+
+        // fold lower-case letters onto upper-case ones
+        const __m128i u = _mm_and_si128( c, case_mask );
+
+        const __m128i is_a = _mm_cmpeq_epi8( u, A );
+        const __m128i is_c = _mm_cmpeq_epi8( u, C );
+        const __m128i is_g = _mm_cmpeq_epi8( u, G );
+        const __m128i is_t = _mm_cmpeq_epi8( u, T );
+        const __m128i is_acgt = _mm_or_si128( _mm_or_si128( is_a, is_c ), _mm_or_si128( is_g, is_t ) );
+
+        // A,C,G,T map to 0,1,2,3, '-' maps to 5, and anything else to 4
+        __m128i sym = _mm_or_si128(
+            _mm_and_si128( is_c, one ),
+            _mm_or_si128( _mm_and_si128( is_g, two ), _mm_and_si128( is_t, three ) ) );
+
+        sym = _mm_or_si128( sym, _mm_andnot_si128( is_acgt, four ) );
+        sym = _mm_or_si128( sym, _mm_and_si128( _mm_cmpeq_epi8( c, dash ), one ) );
+
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( symbols + i ), sym );
+    }
+#endif
+
+    // scalar tail
+    for (; i < n; ++i)
+        symbols[i] = nst_nt4_encode( bps[i] );
+}
+
+// convert a run of qualities to Phred, according to a compile-time quality-encoding
+//
+template <QualityEncoding encoding>
+void convert_qualities(const uint32 n, const uint8* qual, char* phred)
+{
+    uint32 i = 0;
+
+#if defined(NVBIO_READS_ENCODE_SSE2)
+    if (encoding == Phred33 || encoding == Phred64 || encoding == Phred)
+    {
+        const __m128i offset = _mm_set1_epi8( encoding == Phred33 ? 33 : encoding == Phred64 ? 64 : 0 );
+
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i q = _mm_loadu_si128( reinterpret_cast<const __m128i*>( qual + i ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( phred + i ), _mm_sub_epi8( q, offset ) );
+        }
+    }
+#endif
+
+    // scalar tail
+    for (; i < n; ++i)
+        phred[i] = convert_to_phred_quality<encoding>( qual[i] );
+}
+
+// convert a run of qualities to Phred, according to a run-time quality-encoding
+//
+void convert_qualities(const QualityEncoding quality_encoding, const uint32 n, const uint8* qual, char* phred)
+{
+    switch (quality_encoding)
+    {
+    case Phred:
+        convert_qualities<Phred>( n, qual, phred );
+        break;
+    case Phred33:
+        convert_qualities<Phred33>( n, qual, phred );
+        break;
+    case Phred64:
+        convert_qualities<Phred64>( n, qual, phred );
+        break;
+    case Solexa:
+        convert_qualities<Solexa>( n, qual, phred );
+        break;
+    }
+}
+
+// copy a run of bytes, optionally reversing their order
+//
+void copy_bytes(const bool reverse, const uint32 n, const char* in, char* out)
+{
+    if (reverse == false)
+    {
+        memcpy( out, in, n );
+        return;
+    }
+
+    uint32 i = 0;
+
+#if defined(NVBIO_READS_ENCODE_SSE2)
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + n - i - 16 ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), reverse_bytes( x ) );
+    }
+#endif
+
+    // scalar tail
+    for (; i < n; ++i)
+        out[i] = in[n - i - 1];
+}
+
+// fetch the i-th symbol of a strand, applying the given compile-time operators
+//
+template <uint32 FLAGS>
+inline uint32 strand_symbol(const uint32 n, const uint8* symbols, const uint32 i)
+{
+    const uint8 bp = symbols[ (FLAGS & ReadDataRAM::REVERSE_OP) ? n - i - 1u : i ];
+
+    // complement A,C,G,T, mapping all other symbols to N
+    if (FLAGS & ReadDataRAM::COMPLEMENT_OP)
+        return bp < 4u ? 3u - bp : 4u;
+
+    return bp;
+}
+
+// pack a run of 4-bit symbols into a stream of LSB-first 32-bit words starting at a given
+// symbol offset, applying the given compile-time strand operators on the fly
+//
+template <uint32 FLAGS>
+void pack_symbols(const uint32 n, const uint8* symbols, uint32* words, const uint32 offset)
+{
+    static const uint32 SYMBOL_SIZE      = ReadData::READ_BITS;
+    static const uint32 SYMBOLS_PER_WORD = 32u / ReadData::READ_BITS;
+
+    uint32 i = 0;
+
+    // fill the partially occupied word at the beginning of the range
+    if (offset % SYMBOLS_PER_WORD)
+    {
+        uint32 word = words[ offset / SYMBOLS_PER_WORD ];
+
+        for (; i < n && (offset + i) % SYMBOLS_PER_WORD; ++i)
+        {
+            const uint32 bit_idx = ((offset + i) % SYMBOLS_PER_WORD) * SYMBOL_SIZE;
+
+            word &= ~(0xFu << bit_idx);
+            word |= strand_symbol<FLAGS>( n, symbols, i ) << bit_idx;
+        }
+        words[ offset / SYMBOLS_PER_WORD ] = word;
+    }
+
+#if defined(NVBIO_READS_ENCODE_SSE2)
+    const __m128i byte_mask = _mm_set1_epi16( 0xFF );
+    const __m128i three     = _mm_set1_epi8( 3 );
+    const __m128i four      = _mm_set1_epi8( 4 );
+
+    // encode two words at a time
+    for (; i + 2u*SYMBOLS_PER_WORD <= n; i += 2u*SYMBOLS_PER_WORD)
+    {
+        __m128i x = (FLAGS & ReadDataRAM::REVERSE_OP) ?
+            reverse_bytes( _mm_loadu_si128( reinterpret_cast<const __m128i*>( symbols + n - i - 16u ) ) ) :
+                           _mm_loadu_si128( reinterpret_cast<const __m128i*>( symbols + i ) );
+
+        // complement A,C,G,T, mapping all other symbols to N
+        if (FLAGS & ReadDataRAM::COMPLEMENT_OP)
+        {
+            const __m128i is_acgt = _mm_cmplt_epi8( x, four );
+            x = _mm_or_si128(
+                _mm_and_si128( is_acgt, _mm_xor_si128( x, three ) ),
+                _mm_andnot_si128( is_acgt, four ) );
+        }
+
+        // merge the nibbles of each pair of bytes, and pack the pairs
+        const __m128i pairs = _mm_and_si128( _mm_or_si128( x, _mm_srli_epi16( x, 4 ) ), byte_mask );
+
+        _mm_storel_epi64(
+            reinterpret_cast<__m128i*>( words + (offset + i) / SYMBOLS_PER_WORD ),
+            _mm_packus_epi16( pairs, pairs ) );
+    }
+#endif
+
+    // encode the remaining symbols a word at a time
+    for (; i < n; i += SYMBOLS_PER_WORD)
+    {
+        const uint32 n_symbols = nvbio::min( SYMBOLS_PER_WORD, n - i );
+
+        uint32 word = 0u;
+        for (uint32 j = 0; j < n_symbols; ++j)
+            word |= strand_symbol<FLAGS>( n, symbols, i + j ) << (j * SYMBOL_SIZE);
+
+        words[ (offset + i) / SYMBOLS_PER_WORD ] = word;
+    }
+}
+
+// pack a run of 4-bit symbols into a stream of LSB-first 32-bit words starting at a given
+// symbol offset, applying the given run-time strand operators on the fly
+//
+void pack_symbols(const ReadDataRAM::StrandOp conversion_flags, const uint32 n, const uint8* symbols, uint32* words, const uint32 offset)
+{
+    switch (conversion_flags)
+    {
+    case ReadDataRAM::NO_OP:
+        pack_symbols<ReadDataRAM::NO_OP>( n, symbols, words, offset );
+        break;
+    case ReadDataRAM::REVERSE_OP:
+        pack_symbols<ReadDataRAM::REVERSE_OP>( n, symbols, words, offset );
+        break;
+    case ReadDataRAM::COMPLEMENT_OP:
+        pack_symbols<ReadDataRAM::COMPLEMENT_OP>( n, symbols, words, offset );
+        break;
+    case ReadDataRAM::REVERSE_COMPLEMENT_OP:
+        pack_symbols<ReadDataRAM::REVERSE_COMPLEMENT_OP>( n, symbols, words, offset );
+        break;
+    }
+}
+
 } // anonymous namespace
 
 ReadDataRAM::ReadDataRAM()
-  : ReadData()
+  : ReadData(), m_has_quals( false )
 {
     // old mechanism employed before introducing reserve()
     //m_read_vec.reserve( 8*1024*1024 );
@@ -279,15 +686,14 @@ ReadDataRAM::ReadDataRAM()
     m_name_index_vec[0] = 0u;
 }
 
-#if defined(PRESIZED_VECTORS)
-  #define PRESIZE_VECTORS(vec, x) vec.resize(x)
-  #define ADJUST_VECTORS(vec, x)  vec.resize(x)
-  #define RESIZE_VECTORS(vec, x)  if (vec.size() < x) vec.resize(x)
-#else
-  #define PRESIZE_VECTORS(vec, x)
-  #define ADJUST_VECTORS(vec, x)
-  #define RESIZE_VECTORS(vec, x)  vec.resize(x)
-#endif
+// grow a vector to hold at least n elements, never shrinking it
+//
+template <typename T>
+static inline void grow_vector(std::vector<T>& vec, const size_t n)
+{
+    if (vec.size() < n)
+        vec.resize( n );
+}
 
 // reserve enough storage for a given number of reads and bps
 //
@@ -301,12 +707,22 @@ void ReadDataRAM::reserve(const uint32 n_reads, const uint32 n_bps)
     m_read_vec.reserve( n_bps / bps_per_word );
     m_qual_vec.reserve( n_bps );
     m_read_index_vec.reserve( n_reads+1 );
-    m_name_index_vec.reserve( AVG_NAME_LENGTH * n_reads );
+    m_name_vec.reserve( AVG_NAME_LENGTH * n_reads );
     m_name_index_vec.reserve( n_reads+1 );
+}
 
-    // pre-size the vectors
-    PRESIZE_VECTORS( m_read_vec, n_bps / bps_per_word );
-    PRESIZE_VECTORS( m_qual_vec, n_bps );
+// make sure the read, quality and name buffers can hold a given number of bps and name characters
+//
+void ReadDataRAM::presize(const uint32 n_bps, const uint32 name_len, const bool quals)
+{
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
+
+    grow_vector( m_read_vec, (n_bps + bps_per_word - 1) / bps_per_word );
+    if (quals)
+        grow_vector( m_qual_vec, n_bps );
+    grow_vector( m_name_vec, name_len );
+
+    m_has_quals |= quals;
 }
 
 // signals that the batch is complete
@@ -316,141 +732,276 @@ void ReadDataRAM::end_batch(void)
 
     m_avg_read_len = (uint32) ceilf(float(m_read_stream_len) / float(m_n_reads));
 
-    // adjust the vector sizes
-    ADJUST_VECTORS( m_read_vec, m_read_stream_words );
-    ADJUST_VECTORS( m_qual_vec, m_read_stream_len );
+    // the buffers might be larger than the batch if they have been recycled: zero the unused
+    // symbols of the last word, which might still hold the ones of a previous batch
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
+    if (m_read_stream_len % bps_per_word)
+        m_read_vec[ m_read_stream_words-1 ] &= (1u << ((m_read_stream_len % bps_per_word) * ReadData::READ_BITS)) - 1u;
 
-    // set the stream pointers
+    // set the stream pointers; the qualities might have been skipped, in which case
+    // the quality stream is left NULL
     m_read_stream = nvbio::plain_view( m_read_vec );
-    m_qual_stream = nvbio::plain_view( m_qual_vec );
+    m_qual_stream = m_has_quals ? nvbio::plain_view( m_qual_vec ) : NULL;
     m_read_index  = nvbio::plain_view( m_read_index_vec );
 
     m_name_stream = nvbio::plain_view( m_name_vec );
     m_name_index  = nvbio::plain_view( m_name_index_vec );
 }
 
-// a small read class supporting REVERSE | COMPLEMENT operations
+// fetch the 4-bit symbols of a packed stream of n_symbols overlapping the 8-symbol window starting
+// at a given (possibly negative) position, returning them packed in a word along with the mask of
+// the valid ones
 //
-template <ReadDataRAM::StrandOp FLAGS>
-struct read_string
+static inline uint32 fetch_packed_symbols(const uint32* words, const uint32 n_symbols, const int64 pos, uint32* mask)
 {
-    // constructor
-    read_string(const uint32 len, const uint8* read, const uint8* qual) : m_len(len), m_read(read), m_qual(qual) {}
-
-    // string length
-    uint32 length() const { return m_len; }
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
 
-    // indexing operator
-    uint8 operator[] (const uint32 i) const
+    uint32 value;
+    if (pos < 0)
+        value = words[0] << (uint32(-pos) * ReadData::READ_BITS);
+    else
     {
-        const uint32 index = (FLAGS & ReadDataRAM::REVERSE_OP) ? m_len - i - 1u : i;
+        const uint32 w = uint32( pos / bps_per_word );
+        const uint32 r = uint32( pos % bps_per_word ) * ReadData::READ_BITS;
 
-        // fetch the bp
-        const uint8 bp = nst_nt4_encode( m_read[index] );
+        value = words[w] >> r;
+        if (r && (w+1) * bps_per_word < n_symbols)
+            value |= words[w+1] << (32u - r);
+    }
 
-        if (FLAGS & ReadDataRAM::COMPLEMENT_OP)
-            return bp < 4u ? 3u - bp : 4u;
+    // mask out the symbols falling outside of [0, n_symbols)
+    const uint32 lo = pos < 0 ? uint32(-pos) : 0u;
+    const uint32 hi = uint32( nvbio::min( int64(n_symbols) - pos, int64(bps_per_word) ) );
 
-        return bp;
-    }
+    *mask = (hi == bps_per_word ? 0xFFFFFFFFu : (1u << (hi * ReadData::READ_BITS)) - 1u) &
+           ~((1u << (lo * ReadData::READ_BITS)) - 1u);
 
-    // quality operator
-    uint8 quality(const uint32 i) const
+    return value & *mask;
+}
+
+// copy a packed 4-bit symbol stream into another at a given symbol offset, limiting the writes
+// to the destination words in [word_begin, word_end): the symbols of the destination
+// words which are not covered by the copied range are preserved
+//
+static void splice_packed_symbols(
+    uint32*         dst,
+    const uint32    dst_offset,
+    const uint32*   src,
+    const uint32    n_symbols,
+    const uint32    word_begin,
+    const uint32    word_end)
+{
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
+
+    for (uint32 w = word_begin; w < word_end; ++w)
     {
-        const uint32 index = (FLAGS & REVERSE) ? m_len - i - 1u : i;
+        uint32 mask;
+        const uint32 value = fetch_packed_symbols( src, n_symbols, int64(w) * bps_per_word - int64(dst_offset), &mask );
 
-        return m_qual[index];
+        dst[w] = (dst[w] & ~mask) | value;
     }
+}
 
-    const uint32 m_len;
-    const uint8* m_read;
-    const uint8* m_qual;
-};
-
-// encode a read according to a compile-time quality-encoding
+// append a sequence of batches to the end of this one, in order
 //
-template <QualityEncoding quality_encoding, typename read_type>
-void encode(
-    const read_type                         read,
-    ReadData::read_stream_type::iterator    stream,
-    char*                                   qual_stream)
+void ReadDataRAM::append(const uint32 n_batches, const ReadDataRAM* batches)
 {
-  #if 1
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
+
+    // compute the offsets of each batch in the concatenated streams
+    std::vector<uint32> read_offsets( n_batches+1 );
+    std::vector<uint32> bp_offsets( n_batches+1 );
+    std::vector<uint32> name_offsets( n_batches+1 );
+
+    read_offsets[0] = m_n_reads;
+    bp_offsets[0]   = m_read_stream_len;
+    name_offsets[0] = m_name_stream_len;
+    for (uint32 i = 0; i < n_batches; ++i)
+    {
+        read_offsets[i+1] = read_offsets[i] + batches[i].m_n_reads;
+        bp_offsets[i+1]   = bp_offsets[i]   + batches[i].m_read_stream_len;
+        name_offsets[i+1] = name_offsets[i] + batches[i].m_name_stream_len;
+    }
+
+    const uint32 n_reads    = read_offsets[ n_batches ];
+    const uint32 stream_len = bp_offsets[ n_batches ];
+    const uint32 names_len  = name_offsets[ n_batches ];
+    const uint32 words      = (stream_len + bps_per_word - 1) / bps_per_word;
+
+    // the qualities might have been skipped while loading
+    bool has_quals = m_n_reads && m_has_quals;
+    for (uint32 i = 0; i < n_batches; ++i)
+        has_quals |= batches[i].m_n_reads && batches[i].m_has_quals;
+
+    presize( stream_len, names_len, has_quals );
+    m_read_index_vec.resize( n_reads+1 );
+    m_name_index_vec.resize( n_reads+1 );
+
+    #pragma omp parallel for
+    for (int i = 0; i < int(n_batches); ++i)
+    {
+        const ReadDataRAM& batch = batches[i];
+        if (batch.m_n_reads == 0)
+            continue;
+
+        // rebase the read and name indices
+        for (uint32 r = 1; r <= batch.m_n_reads; ++r)
+        {
+            m_read_index_vec[ read_offsets[i] + r ] = bp_offsets[i]   + batch.m_read_index_vec[r];
+            m_name_index_vec[ read_offsets[i] + r ] = name_offsets[i] + batch.m_name_index_vec[r];
+        }
 
-    // use the custom PackedStream assign() method
-    assign( read.length(), read, stream  );
+        if (has_quals)
+            memcpy( &m_qual_vec[0] + bp_offsets[i], &batch.m_qual_vec[0], batch.m_read_stream_len );
+        memcpy( &m_name_vec[0] + name_offsets[i], &batch.m_name_vec[0], batch.m_name_stream_len );
 
-    // naive serial implementation
-    for (uint32 i = 0; i < read.length(); i++)
-        qual_stream[i] = convert_to_phred_quality<quality_encoding>(read.quality(i));
+        // copy the read words entirely covered by this batch: the ones at either end might
+        // be shared with the neighbouring batches, and are merged sequentially below
+        const uint32 full_begin = (bp_offsets[i]   + bps_per_word - 1) / bps_per_word;
+        const uint32 full_end   =  bp_offsets[i+1]                     / bps_per_word;
 
-  #else
-    // naive serial implementation
-    for (uint32 i = 0; i < read.length(); i++)
+        if (full_begin < full_end)
+        {
+            splice_packed_symbols(
+                &m_read_vec[0], bp_offsets[i],
+                &batch.m_read_vec[0], batch.m_read_stream_len,
+                full_begin, full_end );
+        }
+    }
+
+    for (uint32 i = 0; i < n_batches; ++i)
     {
-        stream[i] = read[i];
-        qual_stream[i] = convert_to_phred_quality<quality_encoding>(read.quality(i));
+        const ReadDataRAM& batch = batches[i];
+        if (batch.m_n_reads == 0)
+            continue;
+
+        const uint32 word_begin = bp_offsets[i] / bps_per_word;
+        const uint32 word_end   = (bp_offsets[i+1] + bps_per_word - 1) / bps_per_word;
+        const uint32 full_begin = (bp_offsets[i]   + bps_per_word - 1) / bps_per_word;
+        const uint32 full_end   =  bp_offsets[i+1]                     / bps_per_word;
+
+        if (full_begin < full_end)
+        {
+            splice_packed_symbols( &m_read_vec[0], bp_offsets[i], &batch.m_read_vec[0], batch.m_read_stream_len, word_begin, full_begin );
+            splice_packed_symbols( &m_read_vec[0], bp_offsets[i], &batch.m_read_vec[0], batch.m_read_stream_len, full_end,   word_end );
+        }
+        else
+            splice_packed_symbols( &m_read_vec[0], bp_offsets[i], &batch.m_read_vec[0], batch.m_read_stream_len, word_begin, word_end );
+
+        m_min_read_len = nvbio::min( m_min_read_len, batch.m_min_read_len );
+        m_max_read_len = nvbio::max( m_max_read_len, batch.m_max_read_len );
     }
-  #endif
+
+    m_n_reads           = n_reads;
+    m_read_stream_len   = stream_len;
+    m_read_stream_words = words;
+    m_name_stream_len   = names_len;
 }
 
-// encode a read according to some compile-time flags and run-time quality-encoding
+// copy n symbols of a packed 4-bit symbol stream starting at a given source offset into
+// another stream at a given destination offset, preserving the destination symbols around them
 //
-template <typename read_type>
-void encode(
-    const QualityEncoding                   quality_encoding,
-    const read_type                         read,
-    ReadData::read_stream_type::iterator    stream,
-    char*                                   qual_stream)
+static void copy_packed_symbols(
+    uint32*         dst,
+    const uint32    dst_offset,
+    const uint32*   src,
+    const uint32    src_offset,
+    const uint32    n_symbols)
 {
-    switch (quality_encoding)
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
+
+    const uint32 dst_end = dst_offset + n_symbols;
+
+    for (uint32 w = dst_offset / bps_per_word; w * bps_per_word < dst_end; ++w)
     {
-    case Phred:
-        encode<Phred>( read, stream, qual_stream );
-        break;
-    case Phred33:
-        encode<Phred33>( read, stream, qual_stream );
-        break;
-    case Phred64:
-        encode<Phred64>( read, stream, qual_stream );
-        break;
-    case Solexa:
-        encode<Solexa>( read, stream, qual_stream );
-        break;
+        // the range of symbols of this word to overwrite
+        const uint32 lo = nvbio::max( dst_offset, w * bps_per_word );
+        const uint32 hi = nvbio::min( dst_end,    (w+1) * bps_per_word );
+        const uint32 n  = hi - lo;
+
+        // fetch them from the source
+        const uint32 pos = src_offset + (lo - dst_offset);
+        const uint32 sw  = pos / bps_per_word;
+        const uint32 r   = (pos % bps_per_word) * ReadData::READ_BITS;
+
+        uint32 value = src[sw] >> r;
+        if (r && (pos % bps_per_word) + n > bps_per_word)
+            value |= src[sw+1] << (32u - r);
+
+        const uint32 shift = (lo - w * bps_per_word) * ReadData::READ_BITS;
+        const uint32 mask  = (n == bps_per_word ? 0xFFFFFFFFu : (1u << (n * ReadData::READ_BITS)) - 1u) << shift;
+
+        dst[w] = (dst[w] & ~mask) | ((value << shift) & mask);
     }
 }
 
-// encode a read according to some given run-time flags and quality-encoding
+// append a range of reads of another batch to the end of this one
 //
-void encode(
-    const ReadDataRAM::StrandOp             conversion_flags,
-    const QualityEncoding                   quality_encoding,
-    const uint32                            read_len,
-    const uint8*                            read,
-    const uint8*                            quality,
-    ReadData::read_stream_type::iterator    stream,
-    char*                                   qual_stream)
+void ReadDataRAM::append_reads(const ReadDataRAM& batch, const uint32 begin, const uint32 end)
 {
+    static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
 
-    const read_string<ReadDataRAM::REVERSE_OP>              r_read( read_len, read, quality );
-    const read_string<ReadDataRAM::REVERSE_COMPLEMENT_OP>   rc_read( read_len, read, quality );
-    const read_string<ReadDataRAM::COMPLEMENT_OP>           fc_read( read_len, read, quality );
-    const read_string<ReadDataRAM::NO_OP>                   f_read( read_len, read, quality );
+    if (begin >= end)
+        return;
 
-    if (conversion_flags & ReadDataRAM::REVERSE_OP)
-    {
-        if (conversion_flags & ReadDataRAM::COMPLEMENT_OP)
-            encode( quality_encoding, rc_read, stream, qual_stream );
-        else
-            encode( quality_encoding, r_read,  stream, qual_stream );
-    }
-    else
+    const uint32 bp_begin   = batch.m_read_index_vec[ begin ];
+    const uint32 bp_end     = batch.m_read_index_vec[ end ];
+    const uint32 name_begin = batch.m_name_index_vec[ begin ];
+    const uint32 name_end   = batch.m_name_index_vec[ end ];
+
+    const uint32 stream_len = m_read_stream_len + (bp_end - bp_begin);
+    const uint32 names_len  = m_name_stream_len + (name_end - name_begin);
+    const uint32 words      = (stream_len + bps_per_word - 1) / bps_per_word;
+
+    presize( stream_len, names_len, batch.m_has_quals );
+    if (batch.m_has_quals)
+        memcpy( &m_qual_vec[0] + m_read_stream_len, &batch.m_qual_vec[0] + bp_begin, bp_end - bp_begin );
+
+    copy_packed_symbols( &m_read_vec[0], m_read_stream_len, &batch.m_read_vec[0], bp_begin, bp_end - bp_begin );
+
+    memcpy( &m_name_vec[0] + m_name_stream_len, &batch.m_name_vec[0] + name_begin, name_end - name_begin );
+
+    // rebase the read and name indices
+    for (uint32 r = begin; r < end; ++r)
     {
-        if (conversion_flags & ReadDataRAM::COMPLEMENT_OP)
-            encode( quality_encoding, fc_read, stream, qual_stream );
-        else
-            encode( quality_encoding, f_read,  stream, qual_stream );
+        const uint32 read_len = batch.m_read_index_vec[r+1] - batch.m_read_index_vec[r];
+
+        m_read_index_vec.push_back( m_read_stream_len + batch.m_read_index_vec[r+1] - bp_begin );
+        m_name_index_vec.push_back( m_name_stream_len + batch.m_name_index_vec[r+1] - name_begin );
+
+        m_min_read_len = nvbio::min( m_min_read_len, read_len );
+        m_max_read_len = nvbio::max( m_max_read_len, read_len );
     }
+
+    m_n_reads          += end - begin;
+    m_read_stream_len   = stream_len;
+    m_read_stream_words = words;
+    m_name_stream_len   = names_len;
+}
+
+// remove all reads from this batch, retaining the allocated storage
+//
+void ReadDataRAM::clear(void)
+{
+    m_n_reads           = 0;
+    m_name_stream_len   = 0;
+    m_read_stream_len   = 0;
+    m_read_stream_words = 0;
+    m_min_read_len      = uint32(-1);
+    m_max_read_len      = 0;
+    m_avg_read_len      = 0;
+    m_has_quals         = false;
+
+    // keep the read, quality and name buffers initialized, as they are overwritten
+    // by the following reads
+    m_read_index_vec.resize( 1u );
+    m_name_index_vec.resize( 1u );
+
+    m_name_stream = NULL;
+    m_name_index  = NULL;
+    m_read_stream = NULL;
+    m_read_index  = NULL;
+    m_qual_stream = NULL;
 }
 
 // add a read to this batch
@@ -460,55 +1011,132 @@ void ReadDataRAM::push_back(uint32 read_len,
                             const uint8* quality,
                             const QualityEncoding quality_encoding,
                             const uint32 truncate_read_len,
-                            const StrandOp conversion_flags)
+                            const StrandOp conversion_flags,
+                            const uint32 name_len)
+{
+    push_back(
+        read_len,
+        name,
+        read,
+        quality,
+        quality_encoding,
+        truncate_read_len,
+        1u,
+        &conversion_flags,
+        name_len );
+}
+
+// add a read to this batch once for each of the given strands
+void ReadDataRAM::push_back(uint32 read_len,
+                            const char *name,
+                            const uint8* read,
+                            const uint8* quality,
+                            const QualityEncoding quality_encoding,
+                            const uint32 truncate_read_len,
+                            const uint32 n_strands,
+                            const StrandOp* conversion_flags,
+                            const uint32 name_len)
 {
     // truncate read
     // xxx: should we do this silently?
     read_len = nvbio::min(read_len, truncate_read_len);
 
+    // convert the base pairs once for all strands
+    if (m_bp_scratch.size() < read_len)
+        m_bp_scratch.resize( read_len );
+
+    encode_bps( read_len, read, &m_bp_scratch[0] );
+
+    push_back_symbols(
+        read_len,
+        name,
+        &m_bp_scratch[0],
+        quality,
+        quality_encoding,
+        read_len,
+        n_strands,
+        conversion_flags,
+        name_len );
+}
+
+// add a read with pre-encoded base pairs to this batch once for each of the given strands
+void ReadDataRAM::push_back_symbols(uint32 read_len,
+                                    const char *name,
+                                    const uint8* symbols,
+                                    const uint8* quality,
+                                    const QualityEncoding quality_encoding,
+                                    const uint32 truncate_read_len,
+                                    const uint32 n_strands,
+                                    const StrandOp* conversion_flags,
+                                    const uint32 name_len)
+{
+    // truncate read
+    read_len = nvbio::min(read_len, truncate_read_len);
+
     assert(read_len);
 
-    // resize the reads & quality buffers
+    // convert the qualities once for all strands
+    if (m_qual_scratch.size() < read_len)
+        m_qual_scratch.resize( read_len );
+
+    if (quality)
+        convert_qualities( quality_encoding, read_len, quality, &m_qual_scratch[0] );
+
+    // a missing name is stored as an empty one
+    const uint32 name_length = name == NULL ? 0u :
+                               name_len == uint32(-1) ? uint32(strlen(name)) : name_len;
+
+    for (uint32 s = 0; s < n_strands; ++s)
     {
-        static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
-        const uint32 stream_len = m_read_stream_len + read_len;
-        const uint32 words      = (stream_len + bps_per_word - 1) / bps_per_word;
+        // resize the reads & quality buffers
+        {
+            static const uint32 bps_per_word = 32u / ReadData::READ_BITS;
+            const uint32 stream_len = m_read_stream_len + read_len;
+            const uint32 words      = (stream_len + bps_per_word - 1) / bps_per_word;
 
-        RESIZE_VECTORS( m_read_vec, words );
-        RESIZE_VECTORS( m_qual_vec, stream_len );
+            presize( stream_len, m_name_stream_len, quality != NULL );
 
-        m_read_stream_words = words;
-    }
+            m_read_stream_words = words;
+        }
 
-    // encode the read data
-    ReadData::read_stream_type stream(&m_read_vec[0]);
-    encode(
-        conversion_flags,
-        quality_encoding,
-        read_len,
-        read,
-        quality,
-        stream.begin() + m_read_stream_len,
-        &m_qual_vec[0] + m_read_stream_len );
+        // encode the read data
+        pack_symbols(
+            conversion_flags[s],
+            read_len,
+            symbols,
+            &m_read_vec[0],
+            m_read_stream_len );
+
+        // NOTE: the qualities are laid out in reverse order for the complemented strands only,
+        // as they always have been
+        if (quality)
+        {
+            copy_bytes(
+                (conversion_flags[s] & COMPLEMENT_OP) != 0,
+                read_len,
+                &m_qual_scratch[0],
+                &m_qual_vec[0] + m_read_stream_len );
+        }
 
-    // update read and bp counts
-    m_n_reads++;
-    m_read_stream_len += read_len;
-    m_read_index_vec.push_back(m_read_stream_len);
+        // update read and bp counts
+        m_n_reads++;
+        m_read_stream_len += read_len;
+        m_read_index_vec.push_back(m_read_stream_len);
 
-    m_min_read_len = nvbio::min(m_min_read_len, read_len);
-    m_max_read_len = nvbio::max(m_max_read_len, read_len);
+        m_min_read_len = nvbio::min(m_min_read_len, read_len);
+        m_max_read_len = nvbio::max(m_max_read_len, read_len);
 
-    // store the read name
-    const uint32 name_len = uint32(strlen(name));
-    const uint32 name_offset = m_name_stream_len;
+        // store the read name
+        const uint32 name_offset = m_name_stream_len;
 
-    m_name_vec.resize(name_offset + name_len + 1);
-    //strcpy(&m_name_vec[name_offset], name);
-    memcpy(&m_name_vec[name_offset],name,name_len + 1);
+        grow_vector( m_name_vec, name_offset + name_length + 1 );
+        if (name_length)
+            memcpy(&m_name_vec[name_offset],name,name_length);
+        m_name_vec[name_offset + name_length] = '\0';
 
-    m_name_stream_len += name_len + 1;
-    m_name_index_vec.push_back(m_name_stream_len);
+        m_name_stream_len += name_length + 1;
+        m_name_index_vec.push_back(m_name_stream_len);
+    }
 }
 
 // utility function to alloc and copy a vector in device memory
@@ -573,6 +1201,54 @@ ReadDataDevice::~ReadDataDevice()
         cudaFree( m_qual_stream );
 }
 
+// destructor
+//
+ReadDataStream::~ReadDataStream()
+{
+    for (size_t i = 0; i < m_pool.size(); ++i)
+        delete m_pool[i];
+}
+
+// hand a batch back to the stream for recycling
+//
+void ReadDataStream::release(ReadData* batch)
+{
+    if (batch == NULL)
+        return;
+
+    // only host batches can be recycled
+    ReadDataRAM* reads = dynamic_cast<ReadDataRAM*>( batch );
+    if (reads == NULL)
+    {
+        delete batch;
+        return;
+    }
+
+    ScopedLock lock( &m_pool_lock );
+    m_pool.push_back( reads );
+}
+
+// grab an empty batch from the pool, or allocate a new one
+//
+ReadDataRAM* ReadDataStream::acquire_batch()
+{
+    ReadDataRAM* reads = NULL;
+    {
+        ScopedLock lock( &m_pool_lock );
+        if (m_pool.empty() == false)
+        {
+            reads = m_pool.back();
+            m_pool.pop_back();
+        }
+    }
+    if (reads == NULL)
+        return new ReadDataRAM();
+
+    // empty the batch, retaining its storage
+    reads->clear();
+    return reads;
+}
+
 // grab the next batch of reads into a host memory buffer
 ReadData *ReadDataFile::next(const uint32 batch_size, const uint32 batch_bps)
 {
@@ -584,7 +1260,7 @@ ReadData *ReadDataFile::next(const uint32 batch_size, const uint32 batch_bps)
     // a default average read length used to reserve enough space
     const uint32 AVG_READ_LENGTH = 100;
 
-    ReadDataRAM *reads = new ReadDataRAM();
+    ReadDataRAM *reads = acquire_batch();
     reads->reserve(
         batch_size,
         batch_bps == uint32(-1) ? batch_size * AVG_READ_LENGTH : batch_bps ); // try to use a default read length
@@ -606,10 +1282,12 @@ ReadData *ReadDataFile::next(const uint32 batch_size, const uint32 batch_bps)
 
     if (reads->size() == 0)
     {
-        delete reads;
+        release( reads );
         return NULL;
     }
 
+    assign_read_ids( reads );
+
     m_loaded += reads->size();
 
     reads->end_batch();
@@ -617,5 +1295,77 @@ ReadData *ReadDataFile::next(const uint32 batch_size, const uint32 batch_bps)
     return reads;
 }
 
+// if requested, replace the names of a freshly parsed batch with the ordinal ids of its reads
+void ReadDataFile::assign_read_ids(ReadDataRAM* reads) const
+{
+    if ((m_load_flags & LOAD_READ_IDS) == 0)
+        return;
+
+    ReadDataRAM::StrandOp ops[4];
+    const uint32 read_mult = nvbio::max( strand_ops( ops ), 1u ) *
+                             ((m_load_flags & LOAD_PAIRS) ? 2u : 1u);
+
+    // each read is output once for each strand (and mate), and all its copies share the same id
+    const uint32 first_id = m_loaded / read_mult;
+    const uint32 last_id  = (m_loaded + reads->size() - 1u) / read_mult;
+
+    // all ids are at most as long as the last one
+    uint32 max_digits = 1;
+    for (uint32 id = last_id; id >= 10u; id /= 10u)
+        ++max_digits;
+
+    grow_vector( reads->m_name_vec, reads->size() * (max_digits + 1u) );
+
+    char*  names = &reads->m_name_vec[0];
+    uint32 offset = 0;
+    for (uint32 i = 0; i < reads->size(); ++i)
+    {
+        const uint32 id = first_id + i / read_mult;
+
+        // print the id backwards, and then flip it
+        char*  name  = names + offset;
+        uint32 n     = 0;
+        uint32 value = id;
+        do
+        {
+            name[ n++ ] = char( '0' + value % 10u );
+            value /= 10u;
+        }
+        while (value);
+
+        std::reverse( name, name + n );
+        name[ n ] = '\0';
+
+        offset += n + 1u;
+        reads->m_name_index_vec[ i+1 ] = offset;
+    }
+    reads->m_name_stream_len = offset;
+}
+
+// compute the byte range covered by the records of a given shard of an uncompressed file
+void shard_range(
+    const char*         data,
+    const uint64        size,
+    const uint32        shard,
+    const uint32        n_shards,
+    const RecordFinder& finder,
+    uint64*             begin,
+    uint64*             end)
+{
+    // each shard ends where the following one begins, so that every record is assigned to exactly one of them
+    *begin = shard == 0u ? 0u :
+        uint64( finder.find( data + size * shard / n_shards, data + size, true ) - data );
+
+    *end = shard + 1u >= n_shards ? size :
+        uint64( finder.find( data + size * (shard + 1u) / n_shards, data + size, true ) - data );
+}
+
+// locate the beginning of the first line starting past a given position
+const char* LineFinder::find(const char* begin, const char* end, const bool eof) const
+{
+    const char* line = find_byte( begin, end, '\n' );
+    return line == end ? end : line + 1;
+}
+
 } // namespace io
 } // namespace nvbio
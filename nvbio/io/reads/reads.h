@@ -21,6 +21,7 @@
 #include <nvbio/basic/strided_iterator.h>
 #include <nvbio/basic/packedstream.h>
 #include <nvbio/basic/vector_wrapper.h>
+#include <nvbio/basic/threads.h>
 #include <nvbio/strings/string_set.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -83,6 +84,29 @@ enum ReadEncoding
     REVERSE_COMPLEMENT = 0x0008,
 };
 
+// a set of flags describing which per-read fields to load besides the base pairs
+enum ReadLoadFlags
+{
+    LOAD_NAMES      = 0x0001,   // load the read names
+    LOAD_QUALITIES  = 0x0002,   // load the base qualities; if missing, qual_stream() will be NULL
+    LOAD_READ_IDS   = 0x0004,   // replace the read names with their compact ordinal ids
+    LOAD_PAIRS      = 0x0008,   // the input holds the two mates of each read one after the other:
+                                // BAM records are paired up through their READ1/READ2 flags,
+                                // and both mates share the same read id
+    LOAD_ALL        = LOAD_NAMES | LOAD_QUALITIES,
+};
+
+// the format of a read file, used to override the detection based on its name
+// (e.g. for the standard input)
+enum ReadFileFormat
+{
+    READ_FORMAT_AUTO    = 0,    // detect the format from the file name suffix
+    READ_FORMAT_FASTQ   = 1,    // FASTQ, optionally gzip-compressed
+    READ_FORMAT_TXT     = 2,    // one read per line, optionally gzip-compressed
+    READ_FORMAT_SAM     = 3,    // SAM, optionally gzip-compressed
+    READ_FORMAT_BAM     = 4,    // BAM
+};
+
 // how mates of a paired-end read are encoded
 // F = forward, R = reverse
 enum PairedEndPolicy
@@ -392,6 +416,29 @@ struct ReadDataRAM : public ReadData
     /// \param quality_encoding             quality encoding scheme
     /// \param truncate_read_len            truncate the read if longer than this
     /// \param conversion_flags             conversion operators applied to the strand
+    /// \param name_len                     read name length, or uint32(-1) if the name is NUL-terminated
+    ///
+    void push_back(uint32                   read_len,
+                   const char*              name,
+                   const uint8*             base_pairs,
+                   const uint8*             quality,
+                   const QualityEncoding    quality_encoding,
+                   const uint32             truncate_read_len,
+                   const StrandOp           conversion_flags,
+                   const uint32             name_len = uint32(-1));
+
+    /// add a read to the end of this batch once for each of the given strands,
+    /// converting its base pairs and qualities only once
+    ///
+    /// \param read_len                     input read length
+    /// \param name                         read name, or NULL to store an empty name
+    /// \param base_pairs                   list of base pairs
+    /// \param quality                      list of base qualities, or NULL to skip them altogether
+    /// \param quality_encoding             quality encoding scheme
+    /// \param truncate_read_len            truncate the read if longer than this
+    /// \param n_strands                    number of strands to add
+    /// \param conversion_flags             conversion operators applied to each strand
+    /// \param name_len                     read name length, or uint32(-1) if the name is NUL-terminated
     ///
     void push_back(uint32                   read_len,
                    const char*              name,
@@ -399,17 +446,79 @@ struct ReadDataRAM : public ReadData
                    const uint8*             quality,
                    const QualityEncoding    quality_encoding,
                    const uint32             truncate_read_len,
-                   const StrandOp           conversion_flags);
+                   const uint32             n_strands,
+                   const StrandOp*          conversion_flags,
+                   const uint32             name_len = uint32(-1));
+
+    /// add a read whose base pairs are already encoded as 4-bit symbols (A,C,G,T,N = 0,1,2,3,4)
+    /// to the end of this batch once for each of the given strands
+    ///
+    /// \param read_len                     input read length
+    /// \param name                         read name, or NULL to store an empty name
+    /// \param symbols                      list of encoded base pairs
+    /// \param quality                      list of base qualities, or NULL to skip them altogether
+    /// \param quality_encoding             quality encoding scheme
+    /// \param truncate_read_len            truncate the read if longer than this
+    /// \param n_strands                    number of strands to add
+    /// \param conversion_flags             conversion operators applied to each strand
+    /// \param name_len                     read name length, or uint32(-1) if the name is NUL-terminated
+    ///
+    void push_back_symbols(uint32                   read_len,
+                           const char*              name,
+                           const uint8*             symbols,
+                           const uint8*             quality,
+                           const QualityEncoding    quality_encoding,
+                           const uint32             truncate_read_len,
+                           const uint32             n_strands,
+                           const StrandOp*          conversion_flags,
+                           const uint32             name_len = uint32(-1));
+
+    /// append a sequence of batches to the end of this one, in order;
+    /// the appended batches need not have been completed with end_batch()
+    ///
+    /// \param n_batches                    number of batches to append
+    /// \param batches                      the batches to append
+    ///
+    void append(const uint32 n_batches, const ReadDataRAM* batches);
+
+    /// append a range of reads of another batch to the end of this one, in order;
+    /// the source batch need not have been completed with end_batch()
+    ///
+    /// \param batch                        the batch to copy the reads from
+    /// \param begin                        the first read to copy
+    /// \param end                          the end of the range of reads to copy
+    ///
+    void append_reads(const ReadDataRAM& batch, const uint32 begin, const uint32 end);
+
+    /// remove all reads from this batch, retaining the allocated storage
+    ///
+    void clear(void);
 
     /// signals that the batch is complete
     ///
     void end_batch(void);
 
+    /// make sure the read, quality and name buffers can hold a given number of bps and
+    /// name characters; the buffers never shrink, so that a recycled batch reuses its
+    /// already initialized storage instead of value-initializing it again
+    ///
+    /// \param n_bps                        number of bps
+    /// \param name_len                     total length of the read names
+    /// \param quals                        whether the qualities are stored as well
+    ///
+    void presize(const uint32 n_bps, const uint32 name_len, const bool quals);
+
     std::vector<uint32> m_read_vec;
     std::vector<uint32> m_read_index_vec;
     std::vector<char>   m_qual_vec;
     std::vector<char>   m_name_vec;
     std::vector<uint32> m_name_index_vec;
+    bool                m_has_quals;        ///< whether the qualities of this batch have been stored
+
+private:
+    // scratch buffers holding the converted base pairs and qualities of the last read
+    std::vector<uint8>  m_bp_scratch;
+    std::vector<char>   m_qual_scratch;
 };
 
 ///
@@ -446,13 +555,14 @@ typedef ReadDataDevice  ReadDataCUDA;
 struct ReadDataStream
 {
     ReadDataStream(uint32 truncate_read_len = uint32(-1))
-      : m_truncate_read_len(truncate_read_len)
+      : m_truncate_read_len(truncate_read_len),
+        m_load_flags(LOAD_ALL)
     {
     };
 
     /// virtual destructor
     ///
-    virtual ~ReadDataStream() {}
+    virtual ~ReadDataStream();
 
     /// next batch
     ///
@@ -462,8 +572,45 @@ struct ReadDataStream
     ///
     virtual bool is_ok() = 0;
 
+    /// has the stream stopped because of an error, e.g. a truncated or malformed input,
+    /// rather than at the end of its input?
+    ///
+    virtual bool has_error() = 0;
+
+    /// restrict the stream to one of several contiguous shards of its input, each record belonging
+    /// to exactly one shard, so that separate processes can load disjoint portions of the same file
+    /// without splitting it upfront; this must be called before the first call to next()
+    ///
+    /// \param shard            the index of the shard to select
+    /// \param n_shards         the number of shards the input is split into
+    ///
+    /// \return                 false if the input can't be split in shards
+    ///
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards) { return n_shards <= 1u; }
+
+    /// hand a batch returned by next() back to the stream once it is no longer needed,
+    /// instead of deleting it: its storage will be recycled by the following calls to next(),
+    /// so that a steady-state stream doesn't need to allocate any new memory.
+    /// This method can be called from any thread, but all batches must be either released
+    /// or deleted before the stream itself is destroyed.
+    ///
+    void release(ReadData* batch);
+
+protected:
+    /// grab an empty batch from the pool of released ones, or allocate a new one
+    ///
+    ReadDataRAM* acquire_batch();
+
+public:
     // maximum length of a read; longer reads are truncated to this size
     uint32             m_truncate_read_len;
+
+    // the set of ReadLoadFlags specifying which fields to load
+    uint32             m_load_flags;
+
+private:
+    Mutex                       m_pool_lock;
+    std::vector<ReadDataRAM*>   m_pool;
 };
 
 
@@ -478,12 +625,103 @@ struct ReadDataStream
 ///                             For example, passing FORWARD | REVERSE_COMPLEMENT
 ///                             will result in a stream containing BOTH the forward
 ///                             and reverse-complemented strands.
+/// \param n_threads            number of host threads used to parse the input;
+///                             currently only FASTQ files are parsed in parallel,
+///                             producing the very same batches as the sequential parser
+/// \param load_flags           a set of ReadLoadFlags specifying which fields to load
+///                             besides the base pairs: skipped fields are not copied at all,
+///                             resulting in empty names and a NULL qual_stream()
+/// \param shard                the index of the shard of the file to load, see ReadDataStream::select_shard();
+///                             uncompressed and BGZF-compressed FASTQ, TXT and BAM files as well as
+///                             read archives are split at byte (or compressed block) boundaries,
+///                             and max_reads applies to each shard separately
+/// \param n_shards             the number of shards the file is split into
+/// \param format               the file format; by default it's detected from the file name,
+///                             and the standard input, "-" or "/dev/stdin", is parsed as FASTQ.
+///                             Compression is always detected from the data itself.
+///                             The standard input is streamed sequentially and can't be split in shards
 ///
 ReadDataStream *open_read_file(const char *          read_file_name,
                                const QualityEncoding qualities,
                                const uint32          max_reads = uint32(-1),
                                const uint32          max_read_len = uint32(-1),
-                               const ReadEncoding    flags = REVERSE);
+                               const ReadEncoding    flags = REVERSE,
+                               const uint32          n_threads = 1u,
+                               const uint32          load_flags = LOAD_ALL,
+                               const uint32          shard = 0u,
+                               const uint32          n_shards = 1u,
+                               const ReadFileFormat  format = READ_FORMAT_AUTO);
+
+///
+/// A stream of mate-synchronized pairs of ReadData batches, i.e. holding the first and second
+/// mates of the same reads in the same order.
+///
+struct PairedReadDataStream
+{
+    /// virtual destructor
+    ///
+    virtual ~PairedReadDataStream();
+
+    /// load the next pair of batches
+    ///
+    /// \param batch_size           the maximum number of reads (counting each strand separately) in each batch
+    /// \param mates1               the output batch of first mates
+    /// \param mates2               the output batch of second mates
+    ///
+    /// \return                     false at the end of the input or on errors
+    ///
+    virtual bool next(const uint32 batch_size, ReadData** mates1, ReadData** mates2) = 0;
+
+    /// is the stream ok?
+    ///
+    virtual bool is_ok() = 0;
+
+    /// has the stream stopped because of an error, e.g. a truncated or malformed input,
+    /// rather than at the end of its input?
+    ///
+    virtual bool has_error() = 0;
+
+    /// hand a batch of either mate back to the stream for recycling, see ReadDataStream::release()
+    ///
+    virtual void release(ReadData* batch);
+
+protected:
+    /// grab an empty batch from the pool of released ones, or allocate a new one
+    ///
+    ReadDataRAM* acquire_batch();
+
+private:
+    Mutex                       m_pool_lock;
+    std::vector<ReadDataRAM*>   m_pool;
+};
+
+/// factory method to open a paired-end read input, either from two files holding the first and
+/// second mates respectively, or from a single file holding both mates of each read one after
+/// the other (see LOAD_PAIRS): in the latter case both mates are parsed in a single pass,
+/// sharing the same decompression pipeline.
+///
+/// \param read_file_name1      the file to open
+/// \param read_file_name2      the file holding the second mates, or NULL if the mates are interleaved
+///                             in the first one: FASTQ and TXT files are expected to alternate first
+///                             and second mates, while BAM records are paired up through their
+///                             READ1/READ2 flags and must be grouped by name (SAM is not supported)
+/// \param qualities            the encoding of the qualities
+/// \param max_reads            maximum number of paired reads to input
+/// \param max_read_len         maximum read length - reads will be truncated
+/// \param flags                a set of flags indicating which strands to encode, see open_read_file()
+/// \param n_threads            number of host threads used to parse the input, see open_read_file()
+/// \param load_flags           a set of ReadLoadFlags specifying which fields to load
+/// \param format               the file format, see open_read_file()
+///
+PairedReadDataStream *open_paired_read_file(const char *          read_file_name1,
+                                            const char *          read_file_name2,
+                                            const QualityEncoding qualities,
+                                            const uint32          max_reads = uint32(-1),
+                                            const uint32          max_read_len = uint32(-1),
+                                            const ReadEncoding    flags = REVERSE,
+                                            const uint32          n_threads = 1u,
+                                            const uint32          load_flags = LOAD_ALL,
+                                            const ReadFileFormat  format = READ_FORMAT_AUTO);
 
 ///@} // ReadsIO
 ///@} // IO
@@ -0,0 +1,459 @@
+/*
+ * nvbio
+ * Copyright (C) 2011-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/reads/reads_archive.h>
+#include <nvbio/basic/console.h>
+#include <nvbio/basic/popcount.h>
+
+#include <string.h>
+
+namespace nvbio {
+namespace io {
+
+namespace { // anonymous
+
+const char ARCHIVE_MAGIC[8] = { 'N','V','B','I','O','R','D','S' };
+
+// round a size up to the archive's section alignment
+inline uint64 align8(const uint64 size) { return (size + 7u) & ~uint64(7u); }
+
+// the sizes of the sections of a batch
+struct BatchSections
+{
+    BatchSections(const ReadArchiveBatchInfo& info) :
+        read_index( align8( sizeof(uint32) * (uint64(info.n_reads) + 1u) ) ),
+        name_index( align8( sizeof(uint32) * (uint64(info.n_reads) + 1u) ) ),
+        read_stream( align8( sizeof(uint32) * uint64(info.read_stream_words) ) ),
+        qual_stream( (info.flags & ReadArchiveBatchInfo::HAS_QUALITIES) ? align8( info.read_stream_len ) : 0u ),
+        name_stream( align8( info.name_stream_len ) ) {}
+
+    uint64 size() const { return read_index + name_index + read_stream + qual_stream + name_stream; }
+
+    uint64 read_index;
+    uint64 name_index;
+    uint64 read_stream;
+    uint64 qual_stream;
+    uint64 name_stream;
+};
+
+} // anonymous namespace
+
+// open a new archive
+//
+bool ReadDataArchiveWriter::open(const char* file_name)
+{
+    close();
+
+    m_file = fopen( file_name, "wb" );
+    if (m_file == NULL)
+        return false;
+
+    memset( &m_header, 0, sizeof(ReadArchiveHeader) );
+    memcpy( m_header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC) );
+    m_header.version = ReadArchiveHeader::VERSION;
+    m_header.flags   = FORWARD;
+
+    m_index.clear();
+
+    // write a placeholder header, to be completed by close()
+    m_offset = 0;
+    return write_block( &m_header, sizeof(ReadArchiveHeader) );
+}
+
+// write a block of data followed by its alignment padding
+//
+bool ReadDataArchiveWriter::write_block(const void* data, const uint64 size)
+{
+    static const char padding[8] = { 0 };
+
+    const uint64 padded_size = align8( size );
+
+    if (size && fwrite( data, 1u, size, m_file ) != size)
+        return false;
+
+    if (padded_size > size && fwrite( padding, 1u, padded_size - size, m_file ) != padded_size - size)
+        return false;
+
+    m_offset += padded_size;
+    return true;
+}
+
+// append a host batch to the archive
+//
+bool ReadDataArchiveWriter::write(const ReadData& batch)
+{
+    if (m_file == NULL)
+        return false;
+
+    ReadArchiveBatchInfo info;
+    memset( &info, 0, sizeof(ReadArchiveBatchInfo) );
+    info.offset             = m_offset;
+    info.n_reads            = batch.size();
+    info.read_stream_len    = batch.bps();
+    info.read_stream_words  = batch.words();
+    info.name_stream_len    = batch.name_stream_len();
+    info.min_read_len       = batch.min_read_len();
+    info.max_read_len       = batch.max_read_len();
+    info.flags              = batch.qual_stream() ? ReadArchiveBatchInfo::HAS_QUALITIES : 0u;
+
+    const uint64 n_indices = uint64( batch.size() ) + 1u;
+
+    if (write_block( batch.read_index(),  sizeof(uint32) * n_indices )                == false ||
+        write_block( batch.name_index(),  sizeof(uint32) * n_indices )                == false ||
+        write_block( batch.read_stream(), sizeof(uint32) * uint64( batch.words() ) )  == false)
+        return false;
+
+    // the qualities are optional
+    if (batch.qual_stream() &&
+        write_block( batch.qual_stream(), batch.bps() ) == false)
+        return false;
+
+    if (write_block( batch.name_stream(), batch.name_stream_len() ) == false)
+        return false;
+
+    m_index.push_back( info );
+
+    m_header.n_reads      += batch.size();
+    m_header.max_read_len  = nvbio::max( m_header.max_read_len, batch.max_read_len() );
+    return true;
+}
+
+// write the batch index and close the archive
+//
+bool ReadDataArchiveWriter::close()
+{
+    if (m_file == NULL)
+        return false;
+
+    m_header.n_batches    = uint32( m_index.size() );
+    m_header.index_offset = m_offset;
+
+    bool ret = true;
+
+    // write the index
+    if (m_index.size() &&
+        write_block( &m_index[0], sizeof(ReadArchiveBatchInfo) * m_index.size() ) == false)
+        ret = false;
+
+    // and complete the header
+    if (ret && (fseek( m_file, 0, SEEK_SET ) != 0 ||
+                fwrite( &m_header, sizeof(ReadArchiveHeader), 1u, m_file ) != 1u))
+        ret = false;
+
+    if (fclose( m_file ) != 0)
+        ret = false;
+
+    m_file = NULL;
+    return ret;
+}
+
+// constructor
+//
+ReadDataFile_Archive::ReadDataFile_Archive(
+    const char*        file_name,
+    const uint32       max_reads,
+    const uint32       max_read_len,
+    const ReadEncoding flags)
+    : ReadDataFile( max_reads, max_read_len, flags ),
+      m_data( NULL ),
+      m_index( NULL ),
+      m_batch( 0u ),
+      m_batch_offset( 0u ),
+      m_batch_end( uint32(-1) )
+{
+    m_file_state = FILE_OPEN_FAILED;
+
+    m_data = m_file.init( file_name );
+    if (m_data == NULL || m_file.size() < sizeof(ReadArchiveHeader))
+        return;
+
+    memcpy( &m_header, m_data, sizeof(ReadArchiveHeader) );
+
+    if (memcmp( m_header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC) ) != 0)
+    {
+        log_error(stderr, "  \"%s\" is not a read archive\n", file_name);
+        return;
+    }
+    if (m_header.version != ReadArchiveHeader::VERSION)
+    {
+        log_error(stderr, "  \"%s\": unsupported read archive version %u\n", file_name, m_header.version);
+        return;
+    }
+    if (m_header.index_offset + uint64( m_header.n_batches ) * sizeof(ReadArchiveBatchInfo) > m_file.size())
+    {
+        log_error(stderr, "  \"%s\": truncated read archive\n", file_name);
+        return;
+    }
+
+    m_index = reinterpret_cast<const ReadArchiveBatchInfo*>( m_data + m_header.index_offset );
+
+    // check that all batches lie within the file
+    for (uint32 k = 0; k < m_header.n_batches; ++k)
+    {
+        if (m_index[k].offset + BatchSections( m_index[k] ).size() > m_header.index_offset)
+        {
+            log_error(stderr, "  \"%s\": corrupt read archive index\n", file_name);
+            return;
+        }
+    }
+
+    // only the forward strands are stored, the requested ones are derived while streaming
+    if (m_header.flags != FORWARD)
+    {
+        log_error(stderr, "  \"%s\": unsupported read archive strands (%u)\n", file_name, m_header.flags);
+        return;
+    }
+
+    if (max_read_len < m_header.max_read_len)
+        log_warning(stderr, "  \"%s\": reads stored in a read archive can't be truncated\n", file_name);
+
+    m_file_state = FILE_OK;
+}
+
+// return a view of the k-th stored batch
+//
+void ReadDataFile_Archive::view(const uint32 k, ReadData* view) const
+{
+    const ReadArchiveBatchInfo& info = m_index[k];
+    const BatchSections         sections( info );
+
+    // NOTE: the mapping is read-only, the non-const pointers of ReadData notwithstanding
+    char* base = const_cast<char*>( m_data + info.offset );
+
+    view->m_read_index  = reinterpret_cast<uint32*>( base );                          base += sections.read_index;
+    view->m_name_index  = reinterpret_cast<uint32*>( base );                          base += sections.name_index;
+    view->m_read_stream = reinterpret_cast<uint32*>( base );                          base += sections.read_stream;
+    view->m_qual_stream = sections.qual_stream ? base : NULL;                         base += sections.qual_stream;
+    view->m_name_stream = base;
+
+    view->m_n_reads           = info.n_reads;
+    view->m_read_stream_len   = info.read_stream_len;
+    view->m_read_stream_words = info.read_stream_words;
+    view->m_name_stream_len   = info.name_stream_len;
+    view->m_min_read_len      = info.min_read_len;
+    view->m_max_read_len      = info.max_read_len;
+    view->m_avg_read_len      = info.n_reads ? (info.read_stream_len + info.n_reads - 1u) / info.n_reads : 0u;
+}
+
+// return a zero-copy view of the k-th stored batch
+//
+ReadData* ReadDataFile_Archive::batch(const uint32 k) const
+{
+    if (m_index == NULL || k >= m_header.n_batches)
+        return NULL;
+
+    ReadData* ret = new ReadData();
+    view( k, ret );
+    return ret;
+}
+
+// position the stream at the beginning of the k-th stored batch
+//
+void ReadDataFile_Archive::seek(const uint32 k)
+{
+    m_batch        = nvbio::min( k, m_header.n_batches );
+    m_batch_offset = 0u;
+}
+
+// restrict the stream to a contiguous range of the stored batches
+//
+bool ReadDataFile_Archive::select_shard(const uint32 shard, const uint32 n_shards)
+{
+    if (shard >= n_shards || m_loaded)
+        return false;
+
+    seek( uint32( uint64( m_header.n_batches ) * shard / n_shards ) );
+    m_batch_end = uint32( uint64( m_header.n_batches ) * (shard + 1u) / n_shards );
+    return true;
+}
+
+// grab the next batch of reads
+//
+ReadData* ReadDataFile_Archive::next(const uint32 batch_size, const uint32 batch_bps)
+{
+    const uint32 reads_to_load = std::min(m_max_reads - m_loaded, batch_size);
+
+    if (!is_ok() || reads_to_load == 0)
+        return NULL;
+
+    // skip empty batches
+    const uint32 batch_end = nvbio::min( m_header.n_batches, m_batch_end );
+    while (m_batch < batch_end && m_batch_offset >= m_index[ m_batch ].n_reads)
+    {
+        m_batch++;
+        m_batch_offset = 0u;
+    }
+    if (m_batch >= batch_end)
+        return NULL;
+
+    ReadData stored;
+    view( m_batch, &stored );
+
+    m_file.read_ahead( m_index[ m_batch ].offset );
+
+    // each stored read is output once for each of the requested strands
+    ReadDataRAM::StrandOp ops[4];
+    const uint32 n_ops   = nvbio::max( strand_ops( ops ), 1u );
+    const bool   forward = (m_flags == FORWARD);
+
+    // serve the whole stored batch if it fits the request
+    if (forward &&
+        m_batch_offset == 0u &&
+        stored.size() <= reads_to_load &&
+        stored.bps()  <= batch_bps)
+    {
+        ReadData* ret = new ReadData( stored );
+
+        // NOTE: the names are part of the mapping, and cost nothing unless they are accessed;
+        // the qualities are hidden nonetheless, so that skipping them behaves like for all other formats
+        if (load_qualities() == false)
+            ret->m_qual_stream = NULL;
+
+        m_loaded += ret->size();
+        m_batch++;
+        return ret;
+    }
+
+    // otherwise, find the largest slice that does
+    const uint32 begin = m_batch_offset;
+    const uint32 bp0   = stored.m_read_index[ begin ];
+
+    uint32 end = begin + 1u;
+    while (end < stored.size() &&
+           (end + 1u - begin) * n_ops <= reads_to_load &&
+           (stored.m_read_index[ end + 1u ] - bp0) * n_ops <= batch_bps)
+        end++;
+
+    ReadDataRAM* reads = acquire_batch();
+
+    if (forward)
+    {
+        const uint32 bp1 = stored.m_read_index[ end ];
+        const uint32 n_reads = end - begin;
+        const uint32 n_bps   = bp1 - bp0;
+
+        static const uint32 SYMBOLS_PER_WORD = 32u / ReadData::READ_BITS;
+
+        const bool has_qualities = load_qualities() && stored.m_qual_stream != NULL;
+
+        // size the buffers for the slice
+        const uint32 name0 = stored.m_name_index[ begin ];
+        const uint32 name1 = stored.m_name_index[ end ];
+
+        reads->presize( n_bps, name1 - name0, has_qualities );
+
+        reads->m_n_reads           = n_reads;
+        reads->m_read_stream_len   = n_bps;
+        reads->m_read_stream_words = (n_bps + SYMBOLS_PER_WORD - 1u) / SYMBOLS_PER_WORD;
+
+        // shift the packed symbols of the slice down to the beginning of the stream
+        {
+            const uint32  first_word = bp0 / SYMBOLS_PER_WORD;
+            const uint32  shift      = (bp0 % SYMBOLS_PER_WORD) * ReadData::READ_BITS;
+            const uint32* words      = stored.m_read_stream;
+
+            for (uint32 w = 0; w < reads->m_read_stream_words; ++w)
+            {
+                const uint32 src = first_word + w;
+
+                uint32 word = words[src] >> shift;
+                if (shift && src + 1u < stored.words())
+                    word |= words[src + 1u] << (32u - shift);
+
+                reads->m_read_vec[w] = word;
+            }
+        }
+
+        // copy the qualities, if needed
+        if (n_bps && has_qualities)
+            memcpy( &reads->m_qual_vec[0], stored.m_qual_stream + bp0, n_bps );
+
+        // copy the names
+        reads->m_name_stream_len = name1 - name0;
+        if (name1 > name0)
+            memcpy( &reads->m_name_vec[0], stored.m_name_stream + name0, name1 - name0 );
+
+        // rebase the indices, and collect the read lengths
+        reads->m_read_index_vec.resize( n_reads + 1u );
+        reads->m_name_index_vec.resize( n_reads + 1u );
+        for (uint32 i = 0; i <= n_reads; ++i)
+        {
+            reads->m_read_index_vec[i] = stored.m_read_index[ begin + i ] - bp0;
+            reads->m_name_index_vec[i] = stored.m_name_index[ begin + i ] - name0;
+        }
+        for (uint32 i = 0; i < n_reads; ++i)
+        {
+            const uint32 read_len = reads->m_read_index_vec[i+1] - reads->m_read_index_vec[i];
+            reads->m_min_read_len = nvbio::min( reads->m_min_read_len, read_len );
+            reads->m_max_read_len = nvbio::max( reads->m_max_read_len, read_len );
+        }
+    }
+    else
+        transcode( stored, begin, end, reads );
+
+    reads->end_batch();
+
+    m_loaded       += reads->size();
+    m_batch_offset  = end;
+    return reads;
+}
+
+// derive the requested strands of the stored reads [begin, end) into a host batch
+//
+void ReadDataFile_Archive::transcode(const ReadData& stored, const uint32 begin, const uint32 end, ReadDataRAM* reads)
+{
+    ReadDataRAM::StrandOp ops[4];
+    const uint32 n_ops = strand_ops( ops );
+
+    const char* qual_stream = load_qualities() ? stored.m_qual_stream : NULL;
+
+    const uint32 bp0 = stored.m_read_index[ begin ];
+    const uint32 bp1 = stored.m_read_index[ end ];
+    reads->reserve( (end - begin) * n_ops, (bp1 - bp0) * n_ops );
+
+    for (uint32 i = begin; i < end; ++i)
+    {
+        const ReadData::read_string read = stored.get_read(i);
+        const uint32 read_len = read.length();
+
+        // unpack the stored symbols
+        if (m_symbols.size() < read_len)
+            m_symbols.resize( read_len );
+
+        for (uint32 j = 0; j < read_len; ++j)
+            m_symbols[j] = read[j];
+
+        // the stored qualities are already in the Phred scale, and the names are null-terminated
+        const uint32 name_offset = stored.m_name_index[i];
+        const uint32 name_len    = stored.m_name_index[i+1] - name_offset - 1u;
+
+        reads->push_back_symbols(
+            read_len,
+            stored.m_name_stream + name_offset,
+            &m_symbols[0],
+            qual_stream ? reinterpret_cast<const uint8*>( qual_stream + stored.m_read_index[i] ) : NULL,
+            Phred,
+            read_len,
+            n_ops,
+            ops,
+            name_len );
+    }
+}
+
+} // namespace io
+} // namespace nvbio
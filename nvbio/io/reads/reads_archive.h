@@ -0,0 +1,204 @@
+/*
+ * nvbio
+ * Copyright (C) 2011-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/io/reads/reads.h>
+#include <nvbio/io/reads/reads_priv.h>
+#include <nvbio/basic/mmap.h>
+#include <stdio.h>
+
+namespace nvbio {
+namespace io {
+
+///@addtogroup IO
+///@{
+
+///@addtogroup ReadsIO
+///@{
+
+///
+/// A read archive (.nvr) is a native binary container storing a sequence of read batches
+/// exactly as they are laid out in memory by ReadDataRAM::end_batch(): the packed 4-bit read
+/// stream, the read index, the qualities, the names and the name index.
+/// Archives can be memory mapped and streamed without any parsing, and provide random
+/// access to their batches through an index stored at the end of the file.
+/// Only the forward strand of each read is stored: the other strands are derived while
+/// loading, so that the same archive can be opened with any ReadEncoding.
+///
+/// The file layout is the following, with all sections aligned to 8 bytes:
+///
+/// - a ReadArchiveHeader
+/// - the batches, each made of: read index, name index, read stream, qualities (if present), names
+/// - the batch index, an array of ReadArchiveBatchInfo
+///
+
+/// the header of a read archive
+///
+struct ReadArchiveHeader
+{
+    static const uint32 VERSION = 2u;
+
+    char    magic[8];       ///< the magic string "NVBIORDS"
+    uint32  version;        ///< the format version
+    uint32  flags;          ///< the ReadEncoding flags of the stored reads, always FORWARD
+    uint32  n_batches;      ///< the number of batches
+    uint32  max_read_len;   ///< the maximum read length
+    uint64  n_reads;        ///< the total number of reads
+    uint64  index_offset;   ///< the file offset of the batch index
+};
+
+/// the index entry describing a batch in a read archive
+///
+struct ReadArchiveBatchInfo
+{
+    static const uint32 HAS_QUALITIES = 0x0001;    ///< the batch stores the base qualities
+
+    uint64  offset;             ///< the file offset of the batch
+    uint32  n_reads;            ///< the number of reads
+    uint32  read_stream_len;    ///< the number of base pairs
+    uint32  read_stream_words;  ///< the number of words of the packed read stream
+    uint32  name_stream_len;    ///< the length of the name stream
+    uint32  min_read_len;       ///< the minimum read length
+    uint32  max_read_len;       ///< the maximum read length
+    uint32  flags;              ///< the batch flags, e.g. HAS_QUALITIES
+};
+
+///
+/// A class to write a sequence of host read batches to a read archive.
+/// The batches must have been loaded with the FORWARD strand only, while the qualities
+/// are optional, and only stored for the batches carrying them.
+///
+/// \code
+/// ReadDataArchiveWriter writer;
+/// if (writer.open( "reads.nvr" ))
+/// {
+///     while (ReadData* batch = read_data_file->next( batch_size ))
+///     {
+///         writer.write( *batch );
+///         read_data_file->release( batch );
+///     }
+///     writer.close();
+/// }
+/// \endcode
+///
+struct ReadDataArchiveWriter
+{
+    /// constructor
+    ///
+    ReadDataArchiveWriter() : m_file( NULL ) {}
+
+    /// destructor: closes the archive if still open
+    ///
+    ~ReadDataArchiveWriter() { close(); }
+
+    /// open a new archive
+    ///
+    /// \param file_name    the output file name
+    ///
+    bool open(const char* file_name);
+
+    /// append a host batch to the archive
+    ///
+    bool write(const ReadData& batch);
+
+    /// write the batch index and close the archive
+    ///
+    bool close();
+
+    /// return the number of batches written so far
+    ///
+    uint32 n_batches() const { return uint32( m_index.size() ); }
+
+private:
+    bool write_block(const void* data, const uint64 size);
+
+    FILE*                               m_file;
+    uint64                              m_offset;
+    ReadArchiveHeader                   m_header;
+    std::vector<ReadArchiveBatchInfo>   m_index;
+};
+
+///
+/// A ReadDataStream serving the batches stored in a read archive straight out of a
+/// read-only memory mapping.
+/// When only the FORWARD strand is requested, stored batches fitting the requested batch size
+/// are returned as zero-copy views of the mapping, while larger ones are served in slices copied
+/// to host batches; any other strands are derived from the stored ones into host batches.
+/// As the archive stores fully encoded reads, the read lengths are those the archive was
+/// written with, irrespective of the options requested at opening time.
+///
+struct ReadDataFile_Archive : public ReadDataFile
+{
+    /// constructor
+    ///
+    ReadDataFile_Archive(const char*        file_name,
+                         const uint32       max_reads,
+                         const uint32       max_read_len,
+                         const ReadEncoding flags);
+
+    /// grab the next batch of reads
+    ///
+    virtual ReadData* next(const uint32 batch_size, const uint32 batch_bps = uint32(-1));
+
+    /// return the number of stored batches
+    ///
+    uint32 n_batches() const { return m_header.n_batches; }
+
+    /// return the total number of stored reads
+    ///
+    uint64 n_reads() const { return m_header.n_reads; }
+
+    /// return a zero-copy view of the k-th stored batch, holding its FORWARD strands, to be
+    /// released or deleted after use
+    ///
+    ReadData* batch(const uint32 k) const;
+
+    /// position the stream at the beginning of the k-th stored batch
+    ///
+    void seek(const uint32 k);
+
+    /// restrict the stream to a contiguous range of the stored batches
+    ///
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards);
+
+protected:
+    virtual int nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps) { return 0; }
+
+private:
+    // return a view of the k-th stored batch
+    void view(const uint32 k, ReadData* view) const;
+
+    // derive the requested strands of the stored reads [begin, end) into a host batch
+    void transcode(const ReadData& stored, const uint32 begin, const uint32 end, ReadDataRAM* reads);
+
+    MappedInputFile                 m_file;
+    const char*                     m_data;
+    ReadArchiveHeader               m_header;
+    const ReadArchiveBatchInfo*     m_index;
+    uint32                          m_batch;
+    uint32                          m_batch_offset;
+    uint32                          m_batch_end;
+    std::vector<uint8>              m_symbols;
+};
+
+///@} // ReadsIO
+///@} // IO
+
+} // namespace io
+} // namespace nvbio
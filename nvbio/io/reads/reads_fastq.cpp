@@ -19,6 +19,7 @@
 #include <nvbio/io/reads/reads_fastq.h>
 #include <nvbio/basic/types.h>
 #include <nvbio/basic/timer.h>
+#include <nvbio/basic/byte_scan.h>
 
 #include <string.h>
 #include <ctype.h>
@@ -35,6 +36,130 @@ namespace io {
 ///@addtogroup ReadsIODetail
 ///@{
 
+// try to locate a complete record whose name starts at the given position of a buffer
+// (right past its '@' marker).
+// Only well-formed 4-line records entirely contained in the buffer are accepted, i.e.
+// records whose single sequence line is made of printable characters other than '+'
+// and has the same length as the quality line: for all of these the byte-at-a-time parser
+// would produce exactly the same output, and anything else is left to it.
+//
+static const char* scan_fastq_record_body(const char* name_begin, const char* buffer_end, FASTQRecord* record)
+{
+    // locate the end of the name line
+    const char* name_end = find_byte( name_begin, buffer_end, '\n' );
+    if (name_end == buffer_end)
+        return NULL;
+
+    // a NUL byte would stop the byte-at-a-time parser early
+    if (find_byte( name_begin, name_end, '\0' ) != name_end)
+        return NULL;
+
+    // locate the end of the sequence line
+    const char* bp_begin = name_end + 1;
+    const char* bp_end   = find_byte( bp_begin, buffer_end, '\n' );
+    if (bp_end == buffer_end || bp_end == bp_begin)
+        return NULL;
+
+    // make sure the sequence is a single line of printable characters, none of which is a '+'
+    if (find_byte_not_in_range( bp_begin, bp_end, 0x21, 0x7E ) != bp_end ||
+        find_byte( bp_begin, bp_end, '+' ) != bp_end)
+        return NULL;
+
+    // the separator line must follow immediately
+    const char* plus_begin = bp_end + 1;
+    if (plus_begin == buffer_end || *plus_begin != '+')
+        return NULL;
+
+    const char* plus_end = find_byte( plus_begin, buffer_end, '\n' );
+    if (plus_end == buffer_end)
+        return NULL;
+
+    // locate the end of the quality line
+    const char* q_begin = plus_end + 1;
+    const char* q_end   = find_byte( q_begin, buffer_end, '\n' );
+    if (q_end == buffer_end || q_end - q_begin != bp_end - bp_begin)
+        return NULL;
+
+    if (find_byte( q_begin, q_end, '\0' ) != q_end)
+        return NULL;
+
+    record->name     = name_begin;
+    record->name_len = uint32( name_end - name_begin );
+    record->read_bp  = reinterpret_cast<const uint8*>( bp_begin );
+    record->read_q   = reinterpret_cast<const uint8*>( q_begin );
+    record->len      = uint32( q_end - q_begin );
+    record->lines    = 4u;
+    return q_end + 1;
+}
+
+// try to locate a complete 4-line record starting at the given position of a buffer,
+// possibly preceded by empty lines; returns a pointer past its last line, or NULL if
+// the record is either incomplete or doesn't follow the simple 4-line layout
+//
+const char* scan_fastq_record(const char* begin, const char* end, FASTQRecord* record)
+{
+    // consume spaces & newlines, just like the byte-at-a-time parser
+    uint32 empty_lines = 0;
+    while (begin != end && (*begin == '\n' || *begin == ' '))
+    {
+        if (*begin == '\n')
+            empty_lines++;
+
+        ++begin;
+    }
+
+    if (begin == end || *begin != '@')
+        return NULL;
+
+    const char* record_end = scan_fastq_record_body( begin + 1, end, record );
+    if (record_end)
+        record->lines += empty_lines;
+
+    return record_end;
+}
+
+// try to parse a complete record starting at m_buffer_pos (right past its '@' marker)
+// directly from the input data.
+//
+bool ReadDataFile_FASTQ_parser::scan_record(const char** name, uint32* name_len, const uint8** read_bp, const uint8** read_q, uint32* len)
+{
+    FASTQRecord record;
+    const char* record_end = scan_fastq_record_body( m_data + m_buffer_pos, m_data + m_buffer_size, &record );
+    if (record_end == NULL)
+        return false;
+
+    *name     = record.name;
+    *name_len = record.name_len;
+    *read_bp = record.read_bp;
+    *read_q  = record.read_q;
+    *len     = record.len;
+
+    // consume the record
+    m_buffer_pos = uint64( record_end - m_data );
+    m_line += record.lines;
+    return true;
+}
+
+// add a parsed record to a batch, once for each of the requested strands
+//
+void ReadDataFile_FASTQ_parser::push_back_record(ReadDataRAM* output, const char* name, const uint32 name_len, const uint8* read_bp, const uint8* read_q, const uint32 len) const
+{
+    // encode all strands in a single pass over the record
+    ReadDataRAM::StrandOp ops[4];
+    const uint32 n_ops = strand_ops( ops );
+
+    // skip the fields we were not asked to load
+    output->push_back( len,
+                      load_names()     ? name   : NULL,
+                      read_bp,
+                      load_qualities() ? read_q : NULL,
+                      m_quality_encoding,
+                      m_truncate_read_len,
+                      n_ops,
+                      ops,
+                      name_len );
+}
+
 int ReadDataFile_FASTQ_parser::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps)
 {
     uint32 n_reads = 0;
@@ -73,161 +198,416 @@ int ReadDataFile_FASTQ_parser::nextChunk(ReadDataRAM *output, uint32 max_reads,
             return uint32(-1);
         }
 
-        // read all the line
-        uint32 len = 0;
-        for (uint8 c = get(); c != '\n' && c != 0; c = get())
+        const char*  name;
+        uint32       name_len;
+        const uint8* read_bp;
+        const uint8* read_q;
+        uint32       len;
+
+        // try the fast path first, parsing the whole record in place
+        if (m_block_scan == false || scan_record( &name, &name_len, &read_bp, &read_q, &len ) == false)
         {
-            m_name[ len++ ] = c;
+            // read all the line, storing it only if needed
+            const bool keep_name = load_names();
 
-            // expand on demand
-            if (m_name.size() <= len)
-                m_name.resize( len * 2u );
-        }
+            len = 0;
+            for (uint8 c = get(); c != '\n' && c != 0; c = get())
+            {
+                if (keep_name == false)
+                    continue;
 
-        m_name[ len++ ] = '\0';
+                m_name[ len++ ] = c;
 
-        // check for errors
-        if (m_file_state != FILE_OK)
-        {
-            log_error(stderr, "incomplete read!\n");
+                // expand on demand
+                if (m_name.size() <= len)
+                    m_name.resize( len * 2u );
+            }
 
-            m_error_char = 0;
-            return uint32(-1);
-        }
+            m_name[ len++ ] = '\0';
+            name_len = len - 1u;
 
-        m_line++;
+            // check for errors
+            if (m_file_state != FILE_OK)
+            {
+                log_error(stderr, "incomplete read!\n");
 
-        // start reading the bp read
-        len = 0;
-        for (uint8 c = get(); c != '+' && c != 0; c = get())
-        {
-            // if (isgraph(c))
-            if (c >= 0x21 && c <= 0x7E)
-                m_read_bp[ len++ ] = c;
-            else if (c == '\n')
-                m_line++;
+                m_error_char = 0;
+                return uint32(-1);
+            }
 
-            // expand on demand
-            if (m_read_bp.size() <= len)
+            m_line++;
+
+            // start reading the bp read
+            len = 0;
+            for (uint8 c = get(); c != '+' && c != 0; c = get())
             {
-                m_read_bp.resize( len * 2u );
-                m_read_q.resize(  len * 2u );
+                // if (isgraph(c))
+                if (c >= 0x21 && c <= 0x7E)
+                    m_read_bp[ len++ ] = c;
+                else if (c == '\n')
+                    m_line++;
+
+                // expand on demand
+                if (m_read_bp.size() <= len)
+                {
+                    m_read_bp.resize( len * 2u );
+                    m_read_q.resize(  len * 2u );
+                }
             }
-        }
 
-        // check for errors
-        if (m_file_state != FILE_OK)
-        {
-            log_error(stderr, "incomplete read!\n");
+            // check for errors
+            if (m_file_state != FILE_OK)
+            {
+                log_error(stderr, "incomplete read!\n");
 
-            m_error_char = 0;
-            return uint32(-1);
+                m_error_char = 0;
+                return uint32(-1);
+            }
+
+            // read all the line
+            for(uint8 c = get(); c != '\n' && c != 0; c = get()) {}
+
+            // check for errors
+            if (m_file_state != FILE_OK)
+            {
+                log_error(stderr, "incomplete read!\n");
+
+                m_error_char = 0;
+                return uint32(-1);
+            }
+
+            m_line++;
+
+            // start reading the quality read, storing it only if needed
+            const bool keep_quals = load_qualities();
+
+            len = 0;
+            for (uint8 c = get(); c != '\n' && c != 0; c = get(), ++len)
+            {
+                if (keep_quals)
+                    m_read_q[ len ] = c;
+            }
+
+            // check for errors
+            if (m_file_state != FILE_OK)
+            {
+                log_error(stderr, "incomplete read!\n");
+
+                m_error_char = 0;
+                return uint32(-1);
+            }
+
+            m_line++;
+
+            name    = &m_name[0];
+            read_bp = &m_read_bp[0];
+            read_q  = &m_read_q[0];
         }
 
-        // read all the line
-        for(uint8 c = get(); c != '\n' && c != 0; c = get()) {}
+        push_back_record( output, name, name_len, read_bp, read_q, len );
 
-        // check for errors
-        if (m_file_state != FILE_OK)
+        n_bps   += read_mult * len;
+        n_reads += read_mult;
+    }
+    return n_reads;
+}
+
+// find the first record starting on a line beginning past the given position, i.e. the first line
+// starting with a '@' whose next-but-one line starts with a '+'; quality lines may well begin with
+// a '@', but they are followed by a name and a sequence line
+//
+static const char* find_fastq_record_start(const char* begin, const char* end)
+{
+    const char* p = begin;
+    while (1)
+    {
+        const char* line = find_byte( p, end, '\n' );
+        if (line == end)
+            return end;
+
+        ++line;
+
+        if (line != end && *line == '@')
         {
-            log_error(stderr, "incomplete read!\n");
+            const char* bp_line = find_byte( line, end, '\n' );
+            if (bp_line == end)
+                return end;
 
-            m_error_char = 0;
-            return uint32(-1);
+            const char* plus_line = find_byte( bp_line + 1, end, '\n' );
+            if (plus_line == end)
+                return end;
+
+            if (plus_line + 1 != end && plus_line[1] == '+')
+                return line;
         }
+        p = line;
+    }
+}
 
-        m_line++;
+// locate the first FASTQ record starting on a line beginning past a given position
+//
+const char* FASTQRecordFinder::find(const char* begin, const char* end, const bool eof) const
+{
+    return find_fastq_record_start( begin, end );
+}
 
-        // start reading the quality read
-        len = 0;
-        for (uint8 c = get(); c != '\n' && c != 0; c = get())
-            m_read_q[ len++ ] = c;
+// parse as many records as possible out of the input data with multiple threads
+//
+uint32 ReadDataFile_FASTQ_parser::parse_parallel(ReadDataRAM* output, const uint32 max_reads, const uint32 max_bps)
+{
+    // avoid splitting the input in chunks smaller than this
+    const uint32 MIN_CHUNK_SIZE = 64*1024;
 
-        // check for errors
-        if (m_file_state != FILE_OK)
+    const uint32 read_mult = strand_count();
+
+    const char* region_begin = m_data + m_buffer_pos;
+    const char* buffer_end   = m_data + m_buffer_size;
+
+    // restrict the parsing region to the amount of input likely needed to fill the batch,
+    // so that small batches don't pay for scanning the whole buffer
+    const uint64 needed_bytes = uint64( float(max_reads / read_mult) * m_avg_record_len * 1.125f ) + 4096u;
+    const uint64 max_bytes    = uint64( m_n_threads ) * PARALLEL_BUFFER_SIZE;
+    const uint32 region_len   = uint32( nvbio::min( nvbio::min( uint64( buffer_end - region_begin ), needed_bytes ), max_bytes ) );
+    const char*  region_end   = region_begin + region_len;
+
+    // bail out early if the block scanner can't handle the very first record
+    FASTQRecord first_record;
+    if (scan_fastq_record( region_begin, buffer_end, &first_record ) == NULL)
+        return 0u;
+
+    const uint32 n_chunks = nvbio::max( nvbio::min( m_n_threads, region_len / MIN_CHUNK_SIZE ), 1u );
+
+    if (m_chunk_records.size() < n_chunks)
+    {
+        m_chunk_records.resize( n_chunks );
+        m_chunk_reads.resize( n_chunks );
+    }
+
+    // split the region at record boundaries
+    std::vector<const char*> chunk_begin( n_chunks+1 );
+    std::vector<const char*> chunk_stop( n_chunks );
+
+    chunk_begin[0]        = region_begin;
+    chunk_begin[n_chunks] = region_end;
+    for (uint32 i = 1; i < n_chunks; ++i)
+    {
+        const char* split = region_begin + uint64(region_len) * i / n_chunks;
+        if (split < chunk_begin[i-1])
+            split = chunk_begin[i-1];
+
+        chunk_begin[i] = find_fastq_record_start( split, region_end );
+    }
+
+    // locate all records in each chunk: the records starting before the end of a chunk are
+    // allowed to extend past it, which will be detected as an inconsistent split below
+    #pragma omp parallel for num_threads(m_n_threads)
+    for (int i = 0; i < int(n_chunks); ++i)
+    {
+        std::vector<FASTQRecord>& records = m_chunk_records[i];
+        records.clear();
+
+        const char* p = chunk_begin[i];
+        while (p < chunk_begin[i+1])
         {
-            log_error(stderr, "incomplete read!\n");
+            FASTQRecord record;
+            const char* record_end = scan_fastq_record( p, buffer_end, &record );
+            if (record_end == NULL)
+                break;
 
-            m_error_char = 0;
-            return uint32(-1);
+            records.push_back( record );
+            p = record_end;
         }
+        chunk_stop[i] = p;
+    }
+
+    // select the records to keep, in order, applying the same limits as nextChunk()
+    uint32 n_reads = 0;
+    uint64 n_bps   = 0;
+    uint32 n_lines = 0;
+    uint32 n_records = 0;
+    uint32 n_used_chunks = 0;
+    const char* resume = region_begin;
+
+    for (uint32 i = 0; i < n_chunks; ++i)
+    {
+        const std::vector<FASTQRecord>& records = m_chunk_records[i];
 
-        m_line++;
+        bool full = false;
 
-        if (m_flags & FORWARD)
+        uint32 r = 0;
+        for (; r < records.size(); ++r)
         {
-            output->push_back( len,
-                              &m_name[0],
-                              &m_read_bp[0],
-                              &m_read_q[0],
-                              m_quality_encoding,
-                              m_truncate_read_len,
-                              ReadDataRAM::NO_OP );
+            if (n_reads + read_mult                                 > max_reads ||
+                n_bps   + read_mult*uint64(ReadDataFile::LONG_READ) > max_bps)
+            {
+                full = true;
+                break;
+            }
+
+            n_bps   += read_mult * records[r].len;
+            n_reads += read_mult;
+            n_lines += records[r].lines;
         }
-        if (m_flags & REVERSE)
+
+        // keep only the selected records
+        m_chunk_records[i].resize( r );
+
+        n_records += r;
+        n_used_chunks = i+1;
+
+        if (full)
         {
-            output->push_back( len,
-                              &m_name[0],
-                              &m_read_bp[0],
-                              &m_read_q[0],
-                              m_quality_encoding,
-                              m_truncate_read_len,
-                              ReadDataRAM::REVERSE_OP );
+            if (r)
+                resume = reinterpret_cast<const char*>( records[r-1].read_q ) + records[r-1].len + 1u;
+            break;
         }
-        if (m_flags & FORWARD_COMPLEMENT)
+
+        resume = chunk_stop[i];
+
+        // stop at the first chunk whose records didn't end exactly where the next chunk begins:
+        // either its scan failed, or the split didn't fall on an actual record boundary
+        if (chunk_stop[i] != chunk_begin[i+1])
+            break;
+    }
+
+    if (n_records == 0)
+        return 0u;
+
+    // encode the selected records of each chunk in a separate batch
+    #pragma omp parallel for num_threads(m_n_threads)
+    for (int i = 0; i < int(n_used_chunks); ++i)
+    {
+        const std::vector<FASTQRecord>& records = m_chunk_records[i];
+        ReadDataRAM& reads = m_chunk_reads[i];
+        reads.clear();
+
+        for (uint32 r = 0; r < records.size(); ++r)
+            push_back_record( &reads, records[r].name, records[r].name_len, records[r].read_bp, records[r].read_q, records[r].len );
+    }
+
+    // and concatenate them
+    output->append( n_used_chunks, &m_chunk_reads[0] );
+
+    // consume the parsed input
+    m_avg_record_len = float( resume - region_begin ) / float( n_records );
+    m_buffer_pos     = uint64( resume - m_data );
+    m_line          += n_lines;
+    return n_reads;
+}
+
+// move the unconsumed part of m_buffer to its front and top it up with new data from the file
+//
+void ReadDataFile_FASTQ_parser::refill_buffer()
+{
+    const uint32 tail = uint32( m_buffer_size - m_buffer_pos );
+    if (tail)
+        memmove( &m_buffer[0], &m_buffer[0] + m_buffer_pos, tail );
+
+    m_buffer_pos  = 0;
+    m_buffer_size = tail;
+
+    const FileState state = fillBuffer( tail );
+    if (state == FILE_EOF)
+        m_input_eof = true;
+    else if (state != FILE_OK)
+        m_file_state = state;
+}
+
+// grab the next batch of reads into a host memory buffer
+//
+ReadData* ReadDataFile_FASTQ_parser::next(const uint32 batch_size, const uint32 batch_bps)
+{
+    if (m_n_threads <= 1u || m_block_scan == false)
+        return ReadDataFile::next( batch_size, batch_bps );
+
+    const uint32 reads_to_load = std::min(m_max_reads - m_loaded, batch_size);
+
+    if (!is_ok() || reads_to_load == 0)
+        return NULL;
+
+    // a default average read length used to reserve enough space
+    const uint32 AVG_READ_LENGTH = 100;
+
+    ReadDataRAM *reads = acquire_batch();
+    reads->reserve(
+        batch_size,
+        batch_bps == uint32(-1) ? batch_size * AVG_READ_LENGTH : batch_bps ); // try to use a default read length
+
+    while (reads->size() < reads_to_load &&
+           reads->bps()  < batch_bps)
+    {
+        // keep the buffer topped up, so as to always have large regions to split among threads
+        if (m_input_eof == false && m_buffer_size - m_buffer_pos < m_buffer.size() / 2)
         {
-            output->push_back( len,
-                              &m_name[0],
-                              &m_read_bp[0],
-                              &m_read_q[0],
-                              m_quality_encoding,
-                              m_truncate_read_len,
-                              ReadDataRAM::COMPLEMENT_OP );
+            refill_buffer();
+            if (!is_ok())
+                break;
         }
-        if (m_flags & REVERSE_COMPLEMENT)
+
+        if (parse_parallel( reads, reads_to_load - reads->size(), batch_bps - reads->bps() ) == 0)
         {
-            output->push_back( len,
-                              &m_name[0],
-                              &m_read_bp[0],
-                              &m_read_q[0],
-                              m_quality_encoding,
-                              m_truncate_read_len,
-                              ReadDataRAM::REVERSE_COMPLEMENT_OP );
+            // the block scanner can't handle the next record (e.g. because it spans several lines,
+            // or because it's the last one in the file and it's truncated): hand it over to the
+            // sequential parser, which is also responsible for detecting EOF and errors
+            const uint32 chunk_reads = nvbio::min( reads_to_load - reads->size(), strand_count() );
+            const uint32 chunk_bps   = batch_bps - reads->bps();
+
+            const int n = nextChunk( reads, chunk_reads, chunk_bps );
+            if (n <= 0)
+                break;
         }
+    }
 
-        n_bps   += read_mult * len;
-        n_reads += read_mult;
+    if (reads->size() == 0)
+    {
+        release( reads );
+        return NULL;
     }
-    return n_reads;
+
+    assign_read_ids( reads );
+
+    m_loaded += reads->size();
+
+    reads->end_batch();
+
+    return reads;
 }
 
 ReadDataFile_FASTQ_gz::ReadDataFile_FASTQ_gz(const char *read_file_name,
                                              const QualityEncoding qualities,
                                              const uint32 max_reads,
                                              const uint32 max_read_len,
-                                             const ReadEncoding flags)
-    : ReadDataFile_FASTQ_parser(read_file_name, qualities, max_reads, max_read_len, flags)
+                                             const ReadEncoding flags,
+                                             const uint32 n_threads)
+    : ReadDataFile_FASTQ_parser(read_file_name, qualities, max_reads, max_read_len, flags, n_threads)
 {
-    m_file = gzopen(read_file_name, "r");
-    if (!m_file) {
+    if (!m_file.open(read_file_name, uint32( m_buffer.size() ))) {
         m_file_state = FILE_OPEN_FAILED;
     } else {
         m_file_state = FILE_OK;
     }
+}
+
+// restrict the stream to the records starting in the compressed blocks covered by a given shard
+bool ReadDataFile_FASTQ_gz::select_shard(const uint32 shard, const uint32 n_shards)
+{
+    if (m_file.is_bgzf() == false || m_loaded)
+        return false;
 
-    gzbuffer(m_file, m_buffer_size);
+    return m_file.select_shard( shard, n_shards, FASTQRecordFinder() );
 }
 
 static float time = 0.0f;
 
-ReadDataFile_FASTQ_parser::FileState ReadDataFile_FASTQ_gz::fillBuffer(void)
+ReadDataFile_FASTQ_parser::FileState ReadDataFile_FASTQ_gz::fillBuffer(const uint32 offset)
 {
-    m_buffer_size = gzread(m_file, &m_buffer[0], (uint32)m_buffer.size());
+    const int n_read = m_file.read(&m_buffer[0] + offset, (uint32)m_buffer.size() - offset);
+    m_buffer_size = offset + (n_read > 0 ? uint64(n_read) : 0u);
 
-    if (m_buffer_size <= 0)
+    if (n_read <= 0)
     {
         // check for EOF separately; zlib will not always return Z_STREAM_END at EOF below
-        if (gzeof(m_file))
+        if (m_file.eof())
         {
             return FILE_EOF;
         } else {
@@ -235,7 +615,7 @@ ReadDataFile_FASTQ_parser::FileState ReadDataFile_FASTQ_gz::fillBuffer(void)
             int err;
             const char *msg;
 
-            msg = gzerror(m_file, &err);
+            msg = m_file.error(&err);
             // we're making the assumption that we never see Z_STREAM_END here
             assert(err != Z_STREAM_END);
 
@@ -246,6 +626,56 @@ ReadDataFile_FASTQ_parser::FileState ReadDataFile_FASTQ_gz::fillBuffer(void)
     return FILE_OK;
 }
 
+ReadDataFile_FASTQ_mmap::ReadDataFile_FASTQ_mmap(const char *read_file_name,
+                                                 const QualityEncoding qualities,
+                                                 const uint32 max_reads,
+                                                 const uint32 max_read_len,
+                                                 const ReadEncoding flags,
+                                                 const uint32 n_threads)
+    : ReadDataFile_FASTQ_parser(read_file_name, qualities, max_reads, max_read_len, flags, n_threads, 0u)
+{
+    m_data = m_file.init( read_file_name );
+
+    // refuse compressed data, which must be handled by the zlib-based loader
+    if (m_data == NULL ||
+       (m_file.size() >= 2u && uint8(m_data[0]) == 0x1Fu && uint8(m_data[1]) == 0x8Bu))
+    {
+        m_file_state = FILE_OPEN_FAILED;
+    } else {
+        m_buffer_size = m_file.size();
+        m_buffer_pos  = 0u;
+        m_input_eof   = true;
+        m_file_state  = FILE_OK;
+    }
+}
+
+// grab the next batch of reads, prefetching the input that follows it
+ReadData* ReadDataFile_FASTQ_mmap::next(const uint32 batch_size, const uint32 batch_bps)
+{
+    ReadData* batch = ReadDataFile_FASTQ_parser::next( batch_size, batch_bps );
+
+    m_file.read_ahead( m_buffer_pos );
+    return batch;
+}
+
+// the whole file is mapped upfront: there's never any more data to read
+ReadDataFile_FASTQ_parser::FileState ReadDataFile_FASTQ_mmap::fillBuffer(const uint32 offset)
+{
+    m_buffer_size = offset;
+    return FILE_EOF;
+}
+
+// restrict the stream to the byte range of the input covered by a given shard
+bool ReadDataFile_FASTQ_mmap::select_shard(const uint32 shard, const uint32 n_shards)
+{
+    if (shard >= n_shards || m_loaded)
+        return false;
+
+    // the parser simply sees the end of the input at the end of the shard
+    shard_range( m_data, m_file.size(), shard, n_shards, FASTQRecordFinder(), &m_buffer_pos, &m_buffer_size );
+    return true;
+}
+
 ///@} // ReadsIODetail
 ///@} // ReadsIO
 ///@} // IO
@@ -20,7 +20,9 @@
 
 #include <nvbio/io/reads/reads.h>
 #include <nvbio/io/reads/reads_priv.h>
+#include <nvbio/io/reads/bgzf.h>
 #include <nvbio/basic/console.h>
+#include <nvbio/basic/mmap.h>
 
 #include <zlib/zlib.h>
 
@@ -36,6 +38,28 @@ namespace io {
 ///@addtogroup ReadsIODetail
 ///@{
 
+// a FASTQ record located in place in a memory buffer
+struct FASTQRecord
+{
+    const char*     name;           // the name, not NUL-terminated
+    uint32          name_len;       // the name length
+    const uint8*    read_bp;        // the base pairs
+    const uint8*    read_q;         // the qualities
+    uint32          len;            // the read length
+    uint32          lines;          // the number of lines spanned by the record, including leading empty ones
+};
+
+// try to locate a complete 4-line record starting at the given position of a buffer,
+// possibly preceded by empty lines; returns a pointer past its last line, or NULL if
+// the record is either incomplete or doesn't follow the simple 4-line layout
+const char* scan_fastq_record(const char* begin, const char* end, FASTQRecord* record);
+
+// locate the first FASTQ record starting on a line beginning past a given position
+struct FASTQRecordFinder : public RecordFinder
+{
+    virtual const char* find(const char* begin, const char* end, const bool eof) const;
+};
+
 // ReadDataFile from a FASTQ file
 // contains the code to parse FASTQ files and dump the results into a ReadDataRAM object
 // file access is done via derived classes
@@ -47,14 +71,20 @@ protected:
                               const uint32 max_reads,
                               const uint32 max_read_len,
                               const ReadEncoding flags,
+                              const uint32 n_threads = 1u,
                               const uint32 buffer_size = 64536u)
       : ReadDataFile(max_reads, max_read_len, flags),
         m_file_name(read_file_name),
         m_quality_encoding(quality_encoding),
-        m_buffer(buffer_size),
-        m_buffer_size(buffer_size),
-        m_buffer_pos(buffer_size),
+        m_buffer(buffer_size == 0u ? 0u : n_threads > 1u ? n_threads * PARALLEL_BUFFER_SIZE : buffer_size),
+        m_data(buffer_size == 0u ? NULL : &m_buffer[0]),
+        m_buffer_size(0u),
+        m_buffer_pos(0u),
+        m_input_eof(false),
         m_line(0),
+        m_block_scan(true),
+        m_n_threads(n_threads),
+        m_avg_record_len(256.0f),
         m_name( 1024*1024 ),
         m_read_bp( 1024*1024 ),
         m_read_q( 1024*1024 )
@@ -65,14 +95,56 @@ protected:
     virtual int nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps);
 
     // fill m_buffer with data from the file, return the new file state
+    // the first offset bytes of the buffer are preserved, and new data is appended after them;
     // this should only report EOF when no more bytes could be read
     // derived classes should override this method to return actual file data
-    virtual FileState fillBuffer(void) = 0;
+    virtual FileState fillBuffer(const uint32 offset = 0u) = 0;
+
+public:
+    // per-thread amount of input buffered by the parallel parser
+    static const uint32 PARALLEL_BUFFER_SIZE = 4*1024*1024;
+
+    // grab the next batch of reads into a host memory buffer:
+    // when running with multiple threads, large regions of the input buffer are split at record
+    // boundaries and parsed concurrently, and the resulting fragments are concatenated in file order,
+    // producing exactly the same batch the sequential parser would
+    virtual ReadData *next(const uint32 batch_size, const uint32 batch_bps);
+
+    // enable or disable the block-scanning parser: when enabled, complete 4-line records
+    // found in m_buffer are located with vectorized scans and parsed in place, while records
+    // straddling a buffer boundary (or deviating from the 4-line layout) go through the
+    // original byte-at-a-time parser, which remains responsible for all error reporting
+    void set_block_scan(const bool enable) { m_block_scan = enable; }
 
 private:
     // get next character from file
     uint8 get();
 
+    // try to parse a complete record starting at m_buffer_pos (right past its '@' marker)
+    // directly from the input data; on success, advance m_buffer_pos and m_line past the record
+    // and return pointers to its fields, otherwise leave the parser state untouched
+    bool scan_record(const char** name, uint32* name_len, const uint8** read_bp, const uint8** read_q, uint32* len);
+
+    // number of strands added to a batch for each record
+    uint32 strand_count() const
+    {
+        return ((m_flags & FORWARD)            ? 1u : 0u) +
+               ((m_flags & REVERSE)            ? 1u : 0u) +
+               ((m_flags & FORWARD_COMPLEMENT) ? 1u : 0u) +
+               ((m_flags & REVERSE_COMPLEMENT) ? 1u : 0u);
+    }
+
+    // add a parsed record to a batch, once for each of the requested strands
+    void push_back_record(ReadDataRAM* output, const char* name, const uint32 name_len, const uint8* read_bp, const uint8* read_q, const uint32 len) const;
+
+    // move the unconsumed part of m_buffer to its front and top it up with new data from the file
+    void refill_buffer();
+
+    // parse as many records as possible out of m_buffer with multiple threads, appending them to the
+    // given batch until either the read or bp limits are reached; returns the number of reads added,
+    // which is zero when the record at m_buffer_pos can't be handled by the block scanner
+    uint32 parse_parallel(ReadDataRAM* output, const uint32 max_reads, const uint32 max_bps);
+
 protected:
     // file name we're reading from
     const char *            m_file_name;
@@ -81,8 +153,14 @@ protected:
 
     // buffers input from the fastq file
     std::vector<char>       m_buffer;
-    uint32                  m_buffer_size;
-    uint32                  m_buffer_pos;
+
+    // the input data being parsed: either m_buffer, or a memory mapping of the whole file
+    const char*             m_data;
+    uint64                  m_buffer_size;
+    uint64                  m_buffer_pos;
+
+    // whether the file has been read entirely into the buffer (used by the parallel parser only)
+    bool                    m_input_eof;
 
     // counter for which line we're at
     uint32                  m_line;
@@ -90,6 +168,19 @@ protected:
     // error reporting from the parser: stores the character that generated an error
     uint8                   m_error_char;
 
+    // whether to use the block-scanning parser
+    bool                    m_block_scan;
+
+    // number of parsing threads
+    uint32                  m_n_threads;
+
+    // running estimate of the average record length, used to size the parallel parsing regions
+    float                   m_avg_record_len;
+
+    // per-thread storage for the parallel parser
+    std::vector< std::vector<FASTQRecord> > m_chunk_records;
+    std::vector<ReadDataRAM>                m_chunk_reads;
+
     // temp buffers for data coming in from the FASTQ file: read name, base pairs and qualities
     std::vector<char>  m_name;
     std::vector<uint8> m_read_bp;
@@ -97,19 +188,46 @@ protected:
 };
 
 // loader for gzipped files
-// this also works for plain uncompressed files, as zlib does that transparently
+// this also works for plain uncompressed files, as zlib does that transparently,
+// while BGZF files are inflated in parallel by BGZFReader
 struct ReadDataFile_FASTQ_gz : public ReadDataFile_FASTQ_parser
 {
     ReadDataFile_FASTQ_gz(const char *read_file_name,
                           const QualityEncoding qualities,
                           const uint32 max_reads,
                           const uint32 max_read_len,
-                          const ReadEncoding flags);
+                          const ReadEncoding flags,
+                          const uint32 n_threads = 1u);
+
+    virtual FileState fillBuffer(const uint32 offset = 0u);
+
+    // restrict the stream to a shard of the input, which must be BGZF-compressed
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards);
+
+private:
+    BGZFReader m_file;
+};
+
+// loader for uncompressed files, parsed in place from a read-only memory mapping
+struct ReadDataFile_FASTQ_mmap : public ReadDataFile_FASTQ_parser
+{
+    ReadDataFile_FASTQ_mmap(const char *read_file_name,
+                            const QualityEncoding qualities,
+                            const uint32 max_reads,
+                            const uint32 max_read_len,
+                            const ReadEncoding flags,
+                            const uint32 n_threads = 1u);
+
+    // grab the next batch of reads, prefetching the input that follows it
+    virtual ReadData *next(const uint32 batch_size, const uint32 batch_bps);
+
+    virtual FileState fillBuffer(const uint32 offset = 0u);
 
-    virtual FileState fillBuffer(void);
+    // restrict the stream to a byte range of the input
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards);
 
 private:
-    gzFile m_file;
+    MappedInputFile m_file;
 };
 
 ///@} // ReadsIODetail
@@ -129,7 +247,7 @@ inline uint8 ReadDataFile_FASTQ_parser::get(void)
             return 0;
     }
 
-    return m_buffer[m_buffer_pos++];
+    return m_data[m_buffer_pos++];
 }
 
 } // namespace io
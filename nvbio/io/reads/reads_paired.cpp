@@ -0,0 +1,232 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <nvbio/io/reads/reads_paired.h>
+#include <nvbio/basic/console.h>
+#include <string.h>
+
+namespace nvbio {
+namespace io {
+
+// destructor
+//
+PairedReadDataStream::~PairedReadDataStream()
+{
+    for (size_t i = 0; i < m_pool.size(); ++i)
+        delete m_pool[i];
+}
+
+// hand a batch back to the stream for recycling
+//
+void PairedReadDataStream::release(ReadData* batch)
+{
+    if (batch == NULL)
+        return;
+
+    // only host batches can be recycled
+    ReadDataRAM* reads = dynamic_cast<ReadDataRAM*>( batch );
+    if (reads == NULL)
+    {
+        delete batch;
+        return;
+    }
+
+    ScopedLock lock( &m_pool_lock );
+    m_pool.push_back( reads );
+}
+
+// grab an empty batch from the pool, or allocate a new one
+//
+ReadDataRAM* PairedReadDataStream::acquire_batch()
+{
+    ReadDataRAM* reads = NULL;
+    {
+        ScopedLock lock( &m_pool_lock );
+        if (m_pool.empty() == false)
+        {
+            reads = m_pool.back();
+            m_pool.pop_back();
+        }
+    }
+    if (reads == NULL)
+        return new ReadDataRAM();
+
+    // empty the batch, retaining its storage
+    reads->clear();
+    return reads;
+}
+
+PairedReadDataFiles::~PairedReadDataFiles()
+{
+    delete m_stream1;
+    delete m_stream2;
+}
+
+// load the next pair of batches, one from each file
+//
+bool PairedReadDataFiles::next(const uint32 batch_size, ReadData** mates1, ReadData** mates2)
+{
+    *mates1 = m_stream1->next( batch_size );
+    *mates2 = m_stream2->next( batch_size );
+
+    if (*mates1 && *mates2 && (*mates1)->size() == (*mates2)->size())
+        return true;
+
+    // the files are expected to end together
+    if (*mates1 || *mates2)
+    {
+        log_error(stderr, "the paired read files hold different numbers of reads\n");
+        m_mismatch = true;
+    }
+
+    m_stream1->release( *mates1 );
+    m_stream2->release( *mates2 );
+    *mates1 = NULL;
+    *mates2 = NULL;
+    return false;
+}
+
+// hand a batch back to the streams for recycling
+//
+void PairedReadDataFiles::release(ReadData* batch)
+{
+    if (batch == NULL)
+        return;
+
+    // the batches of both streams are interchangeable: alternate between the two pools,
+    // so that each stream gets back as many batches as it hands out
+    ReadDataStream* stream;
+    {
+        ScopedLock lock( &m_release_lock );
+        stream = (m_released++ & 1u) ? m_stream2 : m_stream1;
+    }
+    stream->release( batch );
+}
+
+InterleavedReadDataStream::~InterleavedReadDataStream()
+{
+    delete m_stream;
+}
+
+// load the next batch of pairs, and split it in the batches of first and second mates
+//
+bool InterleavedReadDataStream::next(const uint32 batch_size, ReadData** mates1, ReadData** mates2)
+{
+    *mates1 = NULL;
+    *mates2 = NULL;
+
+    // load both mates of as many reads as fit in a batch, in one go
+    const uint32 pair_size = 2u * m_n_strands;
+
+    ReadData* batch = m_stream->next( nvbio::max( batch_size / m_n_strands, 1u ) * pair_size );
+    if (batch == NULL)
+        return false;
+
+    ReadDataRAM* pairs = dynamic_cast<ReadDataRAM*>( batch );
+    if (pairs == NULL || pairs->size() % pair_size)
+    {
+        log_error(stderr, "the interleaved read file ends with an unpaired mate\n");
+        m_unpaired = true;
+        m_stream->release( batch );
+        return false;
+    }
+
+    ReadDataRAM* mates[2] = { acquire_batch(), acquire_batch() };
+
+    // split the mates in parallel
+    #pragma omp parallel for
+    for (int m = 0; m < 2; ++m)
+    {
+        mates[m]->reserve( pairs->size() / 2u, pairs->bps() / 2u );
+
+        for (uint32 i = m * m_n_strands; i < pairs->size(); i += pair_size)
+            mates[m]->append_reads( *pairs, i, i + m_n_strands );
+
+        mates[m]->end_batch();
+    }
+
+    m_stream->release( batch );
+
+    *mates1 = mates[0];
+    *mates2 = mates[1];
+    return true;
+}
+
+// factory method to open a paired-end read input
+//
+PairedReadDataStream *open_paired_read_file(const char*           read_file_name1,
+                                            const char*           read_file_name2,
+                                            const QualityEncoding qualities,
+                                            const uint32          max_reads,
+                                            const uint32          max_read_len,
+                                            const ReadEncoding    flags,
+                                            const uint32          n_threads,
+                                            const uint32          load_flags,
+                                            const ReadFileFormat  format)
+{
+    if (read_file_name2)
+    {
+        ReadDataStream* stream1 = open_read_file( read_file_name1, qualities, max_reads, max_read_len, flags, n_threads, load_flags, 0u, 1u, format );
+        if (stream1 == NULL)
+            return NULL;
+
+        ReadDataStream* stream2 = open_read_file( read_file_name2, qualities, max_reads, max_read_len, flags, n_threads, load_flags, 0u, 1u, format );
+        if (stream2 == NULL)
+        {
+            delete stream1;
+            return NULL;
+        }
+        return new PairedReadDataFiles( stream1, stream2 );
+    }
+
+    // the mates of SAM records are not paired up
+    const uint32 len = uint32( strlen( read_file_name1 ) );
+    if (format == READ_FORMAT_SAM ||
+        (format == READ_FORMAT_AUTO &&
+         ((len >= 4 && strcmp( read_file_name1 + len - 4, ".sam" ) == 0) ||
+          (len >= 7 && strcmp( read_file_name1 + len - 7, ".sam.gz" ) == 0))))
+    {
+        log_error(stderr, "interleaved paired reads can't be loaded from SAM files, please convert \"%s\" to BAM\n", read_file_name1);
+        return NULL;
+    }
+
+    // count the strands each mate is output with
+    uint32 n_strands = 0;
+    for (uint32 f = FORWARD; f <= REVERSE_COMPLEMENT; f <<= 1)
+        n_strands += (flags & f) ? 1u : 0u;
+
+    ReadDataStream* stream = open_read_file(
+        read_file_name1,
+        qualities,
+        max_reads == uint32(-1) ? uint32(-1) : 2u * max_reads,
+        max_read_len,
+        flags,
+        n_threads,
+        load_flags | LOAD_PAIRS,
+        0u,
+        1u,
+        format );
+
+    if (stream == NULL)
+        return NULL;
+
+    return new InterleavedReadDataStream( stream, nvbio::max( n_strands, 1u ) );
+}
+
+} // namespace io
+} // namespace nvbio
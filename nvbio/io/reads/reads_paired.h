@@ -0,0 +1,113 @@
+/*
+ * nvbio
+ * Copyright (C) 2012-2014, NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <nvbio/io/reads/reads.h>
+
+namespace nvbio {
+namespace io {
+
+///@addtogroup IO
+///@{
+
+///@addtogroup ReadsIO
+///@{
+
+///@addtogroup ReadsIODetail
+///@{
+
+/// a PairedReadDataStream reading the first and second mates from two separate streams,
+/// checking that they stay in sync
+///
+struct PairedReadDataFiles : public PairedReadDataStream
+{
+    /// constructor, taking ownership of the streams
+    ///
+    PairedReadDataFiles(ReadDataStream* stream1, ReadDataStream* stream2)
+      : m_stream1( stream1 ), m_stream2( stream2 ), m_released( 0 ), m_mismatch( false ) {}
+
+    /// destructor
+    ///
+    ~PairedReadDataFiles();
+
+    /// load the next pair of batches
+    ///
+    virtual bool next(const uint32 batch_size, ReadData** mates1, ReadData** mates2);
+
+    /// is the stream ok?
+    ///
+    virtual bool is_ok() { return m_mismatch == false && m_stream1->is_ok() && m_stream2->is_ok(); }
+
+    /// has either stream failed, or have the two gone out of sync?
+    ///
+    virtual bool has_error() { return m_mismatch || m_stream1->has_error() || m_stream2->has_error(); }
+
+    /// hand a batch back to the streams for recycling
+    ///
+    virtual void release(ReadData* batch);
+
+private:
+    ReadDataStream* m_stream1;
+    ReadDataStream* m_stream2;
+    Mutex           m_release_lock;
+    uint32          m_released;
+    bool            m_mismatch;
+};
+
+/// a PairedReadDataStream splitting the batches of a single stream holding the two mates
+/// of each read one after the other (see LOAD_PAIRS)
+///
+struct InterleavedReadDataStream : public PairedReadDataStream
+{
+    /// constructor, taking ownership of the stream
+    ///
+    /// \param stream           the interleaved stream
+    /// \param n_strands        the number of strands each mate is output with
+    ///
+    InterleavedReadDataStream(ReadDataStream* stream, const uint32 n_strands)
+      : m_stream( stream ), m_n_strands( n_strands ), m_unpaired( false ) {}
+
+    /// destructor
+    ///
+    ~InterleavedReadDataStream();
+
+    /// load the next pair of batches
+    ///
+    virtual bool next(const uint32 batch_size, ReadData** mates1, ReadData** mates2);
+
+    /// is the stream ok?
+    ///
+    virtual bool is_ok() { return m_unpaired == false && m_stream->is_ok(); }
+
+    /// has the stream failed, or did it end with an unpaired mate?
+    ///
+    virtual bool has_error() { return m_unpaired || m_stream->has_error(); }
+
+private:
+    ReadDataStream* m_stream;
+    uint32          m_n_strands;
+    bool            m_unpaired;
+};
+
+///@} // ReadsIODetail
+///@} // ReadsIO
+///@} // IO
+
+} // namespace io
+} // namespace nvbio
@@ -32,6 +32,49 @@ namespace io {
 ///@addtogroup ReadsIODetail
 ///@{
 
+/// interface to locate record boundaries in a file's uncompressed data, used to split it in shards:
+/// each record belongs to the shard containing the position where the search for its boundary starts
+///
+struct RecordFinder
+{
+    /// virtual destructor
+    ///
+    virtual ~RecordFinder() {}
+
+    /// return the start of the first record beginning past the first byte of [begin, end),
+    /// or end if it can't be located without looking at more data
+    ///
+    /// \param begin            the data to search
+    /// \param end              the end of the data
+    /// \param eof              whether the data extends up to the end of the file
+    ///
+    virtual const char* find(const char* begin, const char* end, const bool eof) const = 0;
+};
+
+/// compute the byte range [*begin, *end) covered by the records of a given shard of an uncompressed file
+///
+/// \param data                the file data
+/// \param size                the file size
+/// \param shard               the index of the shard
+/// \param n_shards            the number of shards the file is split into
+/// \param finder              the object used to locate record boundaries
+///
+void shard_range(
+    const char*         data,
+    const uint64        size,
+    const uint32        shard,
+    const uint32        n_shards,
+    const RecordFinder& finder,
+    uint64*             begin,
+    uint64*             end);
+
+/// locate line-based records, i.e. the beginning of the first line starting past a given position
+///
+struct LineFinder : public RecordFinder
+{
+    virtual const char* find(const char* begin, const char* end, const bool eof) const;
+};
+
 /// abstract file-backed ReadDataStream
 ///
 struct ReadDataFile : public ReadDataStream
@@ -82,9 +125,44 @@ public:
         return m_file_state == FILE_OK;
     };
 
+    /// returns true if the stream failed opening, or stopped on a read or parse error
+    ///
+    virtual bool has_error(void)
+    {
+        return m_file_state == FILE_OPEN_FAILED  ||
+               m_file_state == FILE_STREAM_ERROR ||
+               m_file_state == FILE_PARSE_ERROR;
+    };
+
 protected:
     virtual int nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps) = 0;
 
+    /// fill the list of strand operators corresponding to the requested encoding flags,
+    /// returning their number
+    ///
+    uint32 strand_ops(ReadDataRAM::StrandOp* ops) const
+    {
+        uint32 n_ops = 0;
+        if (m_flags & FORWARD)              ops[ n_ops++ ] = ReadDataRAM::NO_OP;
+        if (m_flags & REVERSE)              ops[ n_ops++ ] = ReadDataRAM::REVERSE_OP;
+        if (m_flags & FORWARD_COMPLEMENT)   ops[ n_ops++ ] = ReadDataRAM::COMPLEMENT_OP;
+        if (m_flags & REVERSE_COMPLEMENT)   ops[ n_ops++ ] = ReadDataRAM::REVERSE_COMPLEMENT_OP;
+        return n_ops;
+    }
+
+    /// return true if the parsers need to load the read names
+    ///
+    bool load_names() const { return (m_load_flags & (LOAD_NAMES | LOAD_READ_IDS)) == LOAD_NAMES; }
+
+    /// return true if the parsers need to load the base qualities
+    ///
+    bool load_qualities() const { return (m_load_flags & LOAD_QUALITIES) != 0; }
+
+    /// if requested by the load flags, replace the names of a freshly parsed batch
+    /// with the ordinal ids of its reads; must be called before updating m_loaded
+    ///
+    void assign_read_ids(ReadDataRAM* reads) const;
+
     uint32                  m_max_reads;
     ReadEncoding            m_flags;
     uint32                  m_loaded;
@@ -18,6 +18,7 @@
 
 #include <nvbio/io/reads/reads_txt.h>
 #include <nvbio/basic/types.h>
+#include <nvbio/basic/byte_scan.h>
 
 #include <string.h>
 #include <ctype.h>
@@ -50,72 +51,67 @@ int ReadDataFile_TXT::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 ma
     while (n_reads + read_mult                       <= max_reads &&
            n_bps + read_mult*ReadDataFile::LONG_READ <= max_bps)
     {
-        // reset the read
-        m_read_bp.erase( m_read_bp.begin(), m_read_bp.end() );
+        const uint8* read_bp;
+        uint32       read_len;
 
-        // read an entire line
-        for (uint8 c = get(); c != '\n' && c != 0; c = get())
+        // try to use the entire line in place first: this is possible whenever it's
+        // completely contained in the input data and it's made of printable characters only
+        const char* line_begin = m_data + m_buffer_pos;
+        const char* data_end   = m_data + m_buffer_size;
+        const char* line_end   = m_buffer_pos < m_buffer_size ? find_byte( line_begin, data_end, '\n' ) : data_end;
+
+        if (line_end != data_end &&
+            find_byte_not_in_range( line_begin, line_end, 0x21, 0x7E ) == line_end)
         {
-            // if (isgraph(c))
-            if (c >= 0x21 && c <= 0x7E)
-                m_read_bp.push_back( c );
+            read_bp  = reinterpret_cast<const uint8*>( line_begin );
+            read_len = uint32( line_end - line_begin );
+
+            m_buffer_pos = uint64( line_end + 1 - m_data );
+        }
+        else
+        {
+            // reset the read
+            m_read_bp.erase( m_read_bp.begin(), m_read_bp.end() );
+
+            // read an entire line
+            for (uint8 c = get(); c != '\n' && c != 0; c = get())
+            {
+                // if (isgraph(c))
+                if (c >= 0x21 && c <= 0x7E)
+                    m_read_bp.push_back( c );
+            }
+
+            read_bp  = m_read_bp.size() ? &m_read_bp[0] : NULL;
+            read_len = uint32( m_read_bp.size() );
         }
 
         ++m_line;
 
-        if (m_read_q.size() < m_read_bp.size())
+        if (m_read_q.size() < read_len)
         {
             // extend the quality score vector if needed
             const size_t old_size = m_read_q.size();
-            m_read_q.resize( m_read_bp.size() );
-            for (size_t i = old_size; i < m_read_bp.size(); ++i)
+            m_read_q.resize( read_len );
+            for (size_t i = old_size; i < read_len; ++i)
                 m_read_q[i] = char(255);
         }
 
-        if (m_read_bp.size())
+        if (read_len)
         {
-            if (m_flags & FORWARD)
-            {
-                output->push_back(uint32( m_read_bp.size() ),
-                                  name,
-                                  &m_read_bp[0],
-                                  &m_read_q[0],
-                                  m_quality_encoding,
-                                  m_truncate_read_len,
-                                  ReadDataRAM::NO_OP );
-            }
-            if (m_flags & REVERSE)
-            {
-                output->push_back(uint32( m_read_bp.size() ),
-                                  name,
-                                  &m_read_bp[0],
-                                  &m_read_q[0],
-                                  m_quality_encoding,
-                                  m_truncate_read_len,
-                                  ReadDataRAM::REVERSE_OP );
-            }
-            if (m_flags & FORWARD_COMPLEMENT)
-            {
-                output->push_back(uint32( m_read_bp.size() ),
-                                  name,
-                                  &m_read_bp[0],
-                                  &m_read_q[0],
-                                  m_quality_encoding,
-                                  m_truncate_read_len,
-                                  ReadDataRAM::COMPLEMENT_OP );
-            }
-            if (m_flags & REVERSE_COMPLEMENT)
-            {
-                output->push_back(uint32( m_read_bp.size() ),
-                                  name,
-                                  &m_read_bp[0],
-                                  &m_read_q[0],
-                                  m_quality_encoding,
-                                  m_truncate_read_len,
-                                  ReadDataRAM::REVERSE_COMPLEMENT_OP );
-            }
-
-            n_bps   += read_mult * (uint32)m_read_bp.size();
+            // encode all strands in a single pass over the read
+            ReadDataRAM::StrandOp ops[4];
+            const uint32 n_ops = strand_ops( ops );
+
+            output->push_back(read_len,
+                              name,
+                              read_bp,
+                              load_qualities() ? &m_read_q[0] : NULL,
+                              m_quality_encoding,
+                              m_truncate_read_len,
+                              n_ops,
+                              ops );
+
+            n_bps   += read_mult * read_len;
             n_reads += read_mult;
         }
 
@@ -134,23 +130,30 @@ ReadDataFile_TXT_gz::ReadDataFile_TXT_gz(const char *read_file_name,
                                              const uint32 buffer_size)
     : ReadDataFile_TXT(read_file_name, qualities, max_reads, max_read_len, flags, buffer_size)
 {
-    m_file = gzopen(read_file_name, "r");
-    if (!m_file) {
+    if (!m_file.open(read_file_name, uint32( m_buffer.size() ))) {
         m_file_state = FILE_OPEN_FAILED;
     } else {
         m_file_state = FILE_OK;
     }
+}
 
-    gzbuffer(m_file, m_buffer_size);
+// restrict the stream to the lines starting in the compressed blocks covered by a given shard
+bool ReadDataFile_TXT_gz::select_shard(const uint32 shard, const uint32 n_shards)
+{
+    if (m_file.is_bgzf() == false || m_loaded)
+        return false;
+
+    return m_file.select_shard( shard, n_shards, LineFinder() );
 }
 
 ReadDataFile_TXT::FileState ReadDataFile_TXT_gz::fillBuffer(void)
 {
-    m_buffer_size = gzread(m_file, &m_buffer[0], (uint32)m_buffer.size());
-    if (m_buffer_size <= 0)
+    const int n_read = m_file.read(&m_buffer[0], (uint32)m_buffer.size());
+    m_buffer_size = n_read > 0 ? uint64(n_read) : 0u;
+    if (n_read <= 0)
     {
         // check for EOF separately; zlib will not always return Z_STREAM_END at EOF below
-        if (gzeof(m_file))
+        if (m_file.eof())
         {
             return FILE_EOF;
         } else {
@@ -158,7 +161,7 @@ ReadDataFile_TXT::FileState ReadDataFile_TXT_gz::fillBuffer(void)
             int err;
             const char *msg;
 
-            msg = gzerror(m_file, &err);
+            msg = m_file.error(&err);
             // we're making the assumption that we never see Z_STREAM_END here
             assert(err != Z_STREAM_END);
 
@@ -170,6 +173,54 @@ ReadDataFile_TXT::FileState ReadDataFile_TXT_gz::fillBuffer(void)
     return FILE_OK;
 }
 
+ReadDataFile_TXT_mmap::ReadDataFile_TXT_mmap(const char *read_file_name,
+                                             const QualityEncoding qualities,
+                                             const uint32 max_reads,
+                                             const uint32 max_read_len,
+                                             const ReadEncoding flags)
+    : ReadDataFile_TXT(read_file_name, qualities, max_reads, max_read_len, flags, 0u)
+{
+    m_data = m_file.init( read_file_name );
+
+    // refuse compressed data, which must be handled by the zlib-based loader
+    if (m_data == NULL ||
+       (m_file.size() >= 2u && uint8(m_data[0]) == 0x1Fu && uint8(m_data[1]) == 0x8Bu))
+    {
+        m_file_state = FILE_OPEN_FAILED;
+    } else {
+        m_buffer_size = m_file.size();
+        m_buffer_pos  = 0u;
+        m_file_state  = FILE_OK;
+    }
+}
+
+// grab the next batch of reads, prefetching the input that follows it
+ReadData* ReadDataFile_TXT_mmap::next(const uint32 batch_size, const uint32 batch_bps)
+{
+    ReadData* batch = ReadDataFile_TXT::next( batch_size, batch_bps );
+
+    m_file.read_ahead( m_buffer_pos );
+    return batch;
+}
+
+// the whole file is mapped upfront: there's never any more data to read
+ReadDataFile_TXT::FileState ReadDataFile_TXT_mmap::fillBuffer(void)
+{
+    m_buffer_size = 0u;
+    return FILE_EOF;
+}
+
+// restrict the stream to the byte range of the input covered by a given shard
+bool ReadDataFile_TXT_mmap::select_shard(const uint32 shard, const uint32 n_shards)
+{
+    if (shard >= n_shards || m_loaded)
+        return false;
+
+    // the parser simply sees the end of the input at the end of the shard
+    shard_range( m_data, m_file.size(), shard, n_shards, LineFinder(), &m_buffer_pos, &m_buffer_size );
+    return true;
+}
+
 ///@} // ReadsIODetail
 ///@} // ReadsIO
 ///@} // IO
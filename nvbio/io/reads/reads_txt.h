@@ -20,7 +20,9 @@
 
 #include <nvbio/io/reads/reads.h>
 #include <nvbio/io/reads/reads_priv.h>
+#include <nvbio/io/reads/bgzf.h>
 #include <nvbio/basic/console.h>
+#include <nvbio/basic/mmap.h>
 
 #include <zlib/zlib.h>
 
@@ -52,6 +54,7 @@ protected:
         m_file_name(read_file_name),
         m_quality_encoding(quality_encoding),
         m_buffer(buffer_size),
+        m_data(buffer_size ? &m_buffer[0] : NULL),
         m_buffer_size(buffer_size),
         m_buffer_pos(buffer_size),
         m_line(0)
@@ -78,8 +81,11 @@ protected:
 
     // buffers input from the fastq file
     std::vector<char>       m_buffer;
-    uint32                  m_buffer_size;
-    uint32                  m_buffer_pos;
+
+    // the input data being parsed: either m_buffer, or a memory mapping of the whole file
+    const char*             m_data;
+    uint64                  m_buffer_size;
+    uint64                  m_buffer_pos;
 
     // counter for which line we're at
     uint32                  m_line;
@@ -94,7 +100,8 @@ protected:
 };
 
 // loader for gzipped files
-// this also works for plain uncompressed files, as zlib does that transparently
+// this also works for plain uncompressed files, as zlib does that transparently,
+// while BGZF files are inflated in parallel by BGZFReader
 struct ReadDataFile_TXT_gz : public ReadDataFile_TXT
 {
     ReadDataFile_TXT_gz(const char *read_file_name,
@@ -106,8 +113,32 @@ struct ReadDataFile_TXT_gz : public ReadDataFile_TXT
 
     virtual FileState fillBuffer(void);
 
+    // restrict the stream to a shard of the input, which must be BGZF-compressed
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards);
+
+private:
+    BGZFReader m_file;
+};
+
+// loader for uncompressed files, parsed in place from a read-only memory mapping
+struct ReadDataFile_TXT_mmap : public ReadDataFile_TXT
+{
+    ReadDataFile_TXT_mmap(const char *read_file_name,
+                          const QualityEncoding qualities,
+                          const uint32 max_reads,
+                          const uint32 max_read_len,
+                          const ReadEncoding flags);
+
+    // grab the next batch of reads, prefetching the input that follows it
+    virtual ReadData *next(const uint32 batch_size, const uint32 batch_bps);
+
+    virtual FileState fillBuffer(void);
+
+    // restrict the stream to a byte range of the input
+    virtual bool select_shard(const uint32 shard, const uint32 n_shards);
+
 private:
-    gzFile m_file;
+    MappedInputFile m_file;
 };
 
 ///@} // ReadsIODetail
@@ -127,7 +158,7 @@ inline uint8 ReadDataFile_TXT::get(void)
             return 0;
     }
 
-    return m_buffer[m_buffer_pos++];
+    return m_data[m_buffer_pos++];
 }
 
 } // namespace io
@@ -22,6 +22,7 @@
 
 #include <nvbio/basic/console.h>
 #include <nvbio/io/reads/sam.h>
+#include <nvbio/io/reads/bgzf.h>
 
 namespace nvbio {
 namespace io {
@@ -30,21 +31,28 @@ ReadDataFile_SAM::ReadDataFile_SAM(const char *read_file_name,
                                    const uint32 max_reads,
                                    const uint32 truncate_read_len,
                                    const ReadEncoding flags)
-  : ReadDataFile(max_reads, truncate_read_len, flags)
+  : ReadDataFile(max_reads, truncate_read_len, flags),
+    buffer(BUFFER_INIT_SIZE)
 {
-    fp = gzopen(read_file_name, "rt");
+    // the file is only ever read sequentially, so it can be streamed from the standard input
+    fp = gzopen_input(read_file_name, "rb");
     if (fp == Z_NULL)
     {
         // this will cause init() to fail below
         log_error(stderr, "unable to open SAM file %s\n", read_file_name);
         m_file_state = FILE_OPEN_FAILED;
     } else {
+        // read in large chunks, cutting down on system calls when reading from a pipe
+        gzbuffer(fp, 1024 * 1024);
         m_file_state = FILE_OK;
     }
 
+    buffer_size = 0;
+    buffer_pos = 0;
+
     linebuf = NULL;
-    linebuf_size = 0;
     line_length = 0;
+    line_pending = false;
 
     numLines = 0;
 
@@ -52,87 +60,97 @@ ReadDataFile_SAM::ReadDataFile_SAM(const char *read_file_name,
     sortOrder = SortOrder_unknown;
 }
 
-bool ReadDataFile_SAM::readLine(void)
+// refill the buffer with the next block of uncompressed data, keeping the bytes not yet consumed;
+// returns false if no more data could be read
+bool ReadDataFile_SAM::fillBuffer(void)
 {
-    char *ret;
-    int start_file_pos;
+    // move the unconsumed data to the beginning of the buffer
+    const uint32 remaining = buffer_size - buffer_pos;
+    if (remaining && buffer_pos)
+        memmove(&buffer[0], &buffer[0] + buffer_pos, remaining);
 
-    // current position in linebuf that we're writing into
-    // used when resizing the buffer
-    int cur_buf_pos = 0;
+    buffer_size = remaining;
+    buffer_pos = 0;
 
-    if (!linebuf)
+    // grow the buffer if a single line doesn't fit, always keeping a spare byte for the terminator
+    if (buffer_size + 1 >= buffer.size())
+        buffer.resize(buffer.size() * 2);
+
+    const int n_read = gzread(fp, &buffer[0] + buffer_size, uint32(buffer.size()) - buffer_size - 1);
+    if (n_read < 0)
     {
-        // allocate initial buffer
-        linebuf_size = LINE_BUFFER_INIT_SIZE;
-        linebuf = (char *) malloc(linebuf_size);
+        int err;
+        const char *msg = gzerror(fp, &err);
 
-        if (linebuf == NULL)
-        {
-            log_error(stderr, "out of memory reading SAM file\n");
-            m_file_state = FILE_STREAM_ERROR;
-            return false;
-        }
+        log_error(stderr, "error processing SAM file: zlib error %d (%s)\n", err, msg);
+        m_file_state = FILE_STREAM_ERROR;
+        return false;
     }
 
-    // stash the (uncompressed) stream position we started reading from
-    start_file_pos = gztell(fp);
+    buffer_size += uint32(n_read);
+    return n_read > 0;
+}
 
-    for(;;)
+bool ReadDataFile_SAM::readLine(void)
+{
+    // hand out the line that was put back again, without touching the stream
+    if (line_pending)
     {
-        // mark the next-to-last byte with a \0
-        // this serves to detect when a buffer is too small for a full line
-        linebuf[linebuf_size - 2] = '\0';
+        line_pending = false;
+        numLines++;
+        return true;
+    }
 
-        // try to read a full line
-        ret = gzgets(fp, &linebuf[cur_buf_pos], linebuf_size - cur_buf_pos);
-        if (ret == Z_NULL)
-        {
-            // EOF
-            m_file_state = FILE_EOF;
-            return false;
-        }
+    if (m_file_state != FILE_OK)
+        return false;
 
-        if (linebuf[linebuf_size - 2] == '\0')
-        {
+    // number of bytes of the current line already scanned for a newline
+    uint32 scanned = 0;
+
+    const char *newline;
+    for(;;)
+    {
+        newline = (const char *) memchr(&buffer[0] + buffer_pos + scanned, '\n', buffer_size - buffer_pos - scanned);
+        if (newline)
             break;
-        } else {
-            // buffer is too small, double it
-            char *tmp;
 
-            cur_buf_pos = linebuf_size - 1;
+        scanned = buffer_size - buffer_pos;
 
-            linebuf_size *= 2;
-            tmp = (char *) realloc(linebuf, linebuf_size);
-            if (tmp == NULL)
+        if (fillBuffer() == false)
+        {
+            if (m_file_state != FILE_OK)
+                return false;
+
+            if (buffer_pos == buffer_size)
             {
-                log_error(stderr, "out of memory reading SAM file\n");
-                m_file_state = FILE_STREAM_ERROR;
+                // EOF
+                m_file_state = FILE_EOF;
                 return false;
             }
 
-            linebuf = tmp;
+            // the last line is not terminated by a newline
+            break;
         }
     }
 
-    // store the byte size of the line we read
-    line_length = gztell(fp) - start_file_pos;
+    linebuf = &buffer[0] + buffer_pos;
+    line_length = newline ? int(newline - linebuf) : int(buffer_size - buffer_pos);
 
-    // chop off the newline character if any
-    if (linebuf[line_length - 1] == '\n')
-    {
-        assert(linebuf[line_length] == '\0');
-        linebuf[line_length - 1] = '\0';
-    }
+    // terminate the line in place, replacing the newline
+    linebuf[line_length] = '\0';
+
+    buffer_pos = nvbio::min(buffer_pos + uint32(line_length) + 1u, buffer_size);
 
     numLines++;
     return true;
 }
 
+// put back the current line, so that the next call to readLine() returns it again
 void ReadDataFile_SAM::rewindLine(void)
 {
-    assert(line_length);
-    gzseek(fp, -line_length, SEEK_CUR);
+    assert(linebuf);
+    line_pending = true;
+    numLines--;
 }
 
 // initializes a SAM file
@@ -263,9 +281,6 @@ bool ReadDataFile_SAM::parseHeaderLine(char *start)
 // fetch the next chunk of reads (up to max_reads) from the file and push it into output
 int ReadDataFile_SAM::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 max_bps)
 {
-    if (max_bps < ReadDataFile::LONG_READ)
-        return 0;
-
     char *name;
     char *flag;
     char *rname;
@@ -280,18 +295,25 @@ int ReadDataFile_SAM::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 ma
 
     uint32 read_flags;
 
-    // find the next primary alignment from the file
-    do {
+    ReadDataRAM::StrandOp ops[4];
+    const uint32 n_ops = strand_ops(ops);
+
+    uint32 n_reads = 0;
+    uint32 n_bps   = 0;
+
+    while (n_reads + n_ops                         <= max_reads &&
+           n_bps   + n_ops*ReadDataFile::LONG_READ <= max_bps)
+    {
         // get next line from file
         if (readLine() == false)
-        {
-            return 0;
-        }
+            break;
 
-// ugly macro to tokenize the string based on strchr
+        const char *line_end = linebuf + line_length;
+
+// ugly macro to tokenize the line based on memchr
 #define NEXT(prev, next)                        \
     {                                           \
-        next = strchr(prev, '\t');              \
+        next = (char *) memchr(prev, '\t', line_end - prev);            \
         if (!next) {                                                    \
             log_error(stderr, "Error parsing SAM file (line %d): incomplete alignment section\n", numLines); \
             m_file_state = FILE_PARSE_ERROR;                            \
@@ -320,67 +342,53 @@ int ReadDataFile_SAM::nextChunk(ReadDataRAM *output, uint32 max_reads, uint32 ma
 
         // figure out what the flag value is
         read_flags = strtol(flag, NULL, 0);
-    } while(read_flags & SAMFlag_SecondaryAlignment);
 
-    if (m_flags & FORWARD)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::REVERSE_COMPLEMENT_OP : ReadDataRAM::NO_OP;
+        // skip all non-primary alignments
+        if (read_flags & SAMFlag_SecondaryAlignment)
+            continue;
 
-        // add the read
-        output->push_back(uint32(strlen(seq)),
-                          name,
-                          (uint8*)seq,
-                          (uint8*)qual,
-                          Phred33,
-                          m_truncate_read_len,
-                          op );
-    }
-    if (m_flags & REVERSE)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::COMPLEMENT_OP : ReadDataRAM::REVERSE_OP;
+        // skip records without a sequence
+        const uint32 read_len = uint32(qual - seq - 1);
+        if (read_len == 0 || (read_len == 1 && seq[0] == '*'))
+            continue;
 
-        // add the read
-        output->push_back(uint32(strlen(seq)),
-                          name,
-                          (uint8*)seq,
-                          (uint8*)qual,
-                          Phred33,
-                          m_truncate_read_len,
-                          op );
-    }
-    if (m_flags & FORWARD_COMPLEMENT)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::REVERSE_OP : ReadDataRAM::COMPLEMENT_OP;
+        // records without qualities (i.e. with a '*' in their place) get the highest score;
+        // a lone '*' must be told apart from the quality of a single base read
+        const char *qual_end = (const char *) memchr(qual, '\t', line_end - qual);
+        if (qual_end == NULL)
+            qual_end = line_end;
 
-        // add the read
-        output->push_back(uint32(strlen(seq)),
-                          name,
-                          (uint8*)seq,
-                          (uint8*)qual,
-                          Phred33,
-                          m_truncate_read_len,
-                          op );
-    }
-    if (m_flags & REVERSE_COMPLEMENT)
-    {
-        const ReadDataRAM::StrandOp op = (read_flags & SAMFlag_ReverseComplemented) ?
-            ReadDataRAM::NO_OP : ReadDataRAM::REVERSE_COMPLEMENT_OP;
+        if ((qual[0] == '*' && qual_end == qual + 1) || qual_end - qual < int(read_len))
+        {
+            if (missing_qual.size() < read_len)
+                missing_qual.resize(read_len, char(255));
 
-        // add the read
-        output->push_back(uint32(strlen(seq)),
-                          name,
+            qual = &missing_qual[0];
+        }
+
+        // reads aligned to the reverse strand are stored reverse-complemented
+        ReadDataRAM::StrandOp read_ops[4];
+        for (uint32 i = 0; i < n_ops; ++i)
+        {
+            read_ops[i] = (read_flags & SAMFlag_ReverseComplemented) ?
+                ReadDataRAM::StrandOp(ops[i] ^ ReadDataRAM::REVERSE_COMPLEMENT_OP) : ops[i];
+        }
+
+        // add all strands of the read
+        output->push_back(read_len,
+                          load_names()     ? name : NULL,
                           (uint8*)seq,
-                          (uint8*)qual,
+                          load_qualities() ? (uint8*)qual : NULL,
                           Phred33,
                           m_truncate_read_len,
-                          op );
-    }
+                          n_ops,
+                          read_ops,
+                          uint32(flag - name - 1));
 
-    // we always input 1 read at a time here
-    return 1;
+        n_reads += n_ops;
+        n_bps   += n_ops * nvbio::min(read_len, m_truncate_read_len);
+    }
+    return n_reads;
 }
 
 } // namespace io
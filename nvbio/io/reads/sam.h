@@ -56,13 +56,16 @@ enum AlignmentFlags
     SAMFlag_FailedQC = 0x200,
     // PCR or optical duplicate
     SAMFlag_Duplicate = 0x400,
+    // supplementary alignment
+    SAMFlag_SupplementaryAlignment = 0x800,
 };
 
 
 // ReadDataFile from a SAM file
 struct ReadDataFile_SAM : public ReadDataFile
 {
-    enum { LINE_BUFFER_INIT_SIZE = 1024 };
+    // the amount of uncompressed data fetched at once; the buffer grows if a single line doesn't fit
+    enum { BUFFER_INIT_SIZE = 4*1024*1024 };
 
     enum SortOrder
     {
@@ -84,16 +87,25 @@ struct ReadDataFile_SAM : public ReadDataFile
 private:
     bool readLine(void);
     void rewindLine(void);
+    bool fillBuffer(void);
     bool parseHeaderLine(char *start);
 
     gzFile fp;
 
-    // a buffer for a full line; this will grow as needed
+    // a block of uncompressed data, and the cursor to the first byte not yet consumed
+    std::vector<char> buffer;
+    uint32 buffer_size;
+    uint32 buffer_pos;
+
+    // the current line, NUL-terminated in place within the buffer
     char *linebuf;
-    // current size of the buffer
-    int linebuf_size;
-    // length of the current line in the buffer
+    // length of the current line, excluding the newline
     int line_length;
+    // set when the current line was put back and must be returned again by readLine()
+    bool line_pending;
+
+    // the qualities used for records that don't provide any
+    std::vector<char> missing_qual;
 
     // how many lines we parsed so far
     int numLines;